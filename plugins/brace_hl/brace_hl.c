@@ -24,6 +24,7 @@ int yed_plugin_boot(yed_plugin *self) {
 
     yed_plugin_add_event_handler(self, cursor_moved);
     yed_plugin_add_event_handler(self, line);
+    yed_set_line_draw_deps(line, LINE_DRAW_DEP_LINE);
 
     return 0;
 }
@@ -31,6 +32,7 @@ int yed_plugin_boot(yed_plugin *self) {
 void brace_hl_cursor_moved_handler(yed_event *event) {
     yed_frame *frame;
     int        save_beg_row, save_end_row;
+    int        save_beg_col, save_end_col;
 
     frame = event->frame;
 
@@ -42,8 +44,15 @@ void brace_hl_cursor_moved_handler(yed_event *event) {
 
     save_beg_row = beg_row;
     save_end_row = end_row;
+    save_beg_col = beg_col;
+    save_end_col = end_col;
 
     brace_hl_find_braces(event->frame);
+
+    if (beg_row != save_beg_row || beg_col != save_beg_col
+    ||  end_row != save_end_row || end_col != save_end_col) {
+        yed_invalidate_line_draw_caches();
+    }
 }
 
 void brace_hl_line_handler(yed_event *event) {
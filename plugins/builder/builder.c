@@ -24,9 +24,12 @@ static int                err_line;
 static int                err_col;
 static int                err_has_loc;
 static char               builder_notif_cmd[1024];
-static int                builder_notif_cmd_status;
 
-static yed_nb_subproc_t   nb_subproc;
+typedef struct {
+    char cmd[1200];
+    int  status;
+} builder_notif_job_t;
+
 
 #define LOCKED(_m)                                 \
 for (int _foozle = (pthread_mutex_lock(&(_m)), 1); \
@@ -217,6 +220,9 @@ static void notif_start(void) {
 
     notif_start_ms  = measure_time_now_ms();
     notif_up        = 1;
+
+    /* Make sure that there's a pump to take the notification down. */
+    yed_plugin_add_timer(Self, notif_stay_ms, 0, NULL, NULL);
 }
 
 static void notif_stop(void) {
@@ -246,36 +252,48 @@ static const char * builder_get_status_string(void) {
     return "a build has not been started";
 }
 
-static void * builder_bg_cmd_thread_fn(void *arg) {
-    char *notif_cmd;
-    char  message_buff[512];
-    char  expand_buff[1024];
-    char  cmd_buff[1200];
-    char *output;
-    int   output_len;
-    int   status;
+static void builder_notif_cmd_work(yed_job *job, void *arg) {
+    builder_notif_job_t *nj;
+    char                *output;
+    int                  output_len;
 
+    nj     = arg;
+    output = yed_run_subproc(nj->cmd, &output_len, &nj->status);
 
-    notif_cmd = arg;
-    snprintf(message_buff, sizeof(message_buff), "'%s (builder-build-command: %s)'",
-             builder_get_status_string(), build_cmd);
+    if (output) { free(output); }
+}
 
-    perc_subst(notif_cmd, message_buff, expand_buff, sizeof(expand_buff));
+static void builder_notif_cmd_done(yed_job *job, void *arg) {
+    builder_notif_job_t *nj;
 
-    sprintf(cmd_buff, "(%s) 2>&1", expand_buff);
+    nj = arg;
 
-    output = yed_run_subproc(cmd_buff, &output_len, &status);
+    if (!yed_job_is_cancelled(job) && nj->status != 0) {
+        yed_cerr("builder-notify-command '%s' failed with error code %d", builder_notif_cmd, nj->status);
+    }
 
-    if (output) { free(output); }
+    free(nj);
+}
 
-    builder_notif_cmd_status = status;
+static void builder_start_notif_cmd(char *notif_cmd) {
+    builder_notif_job_t *nj;
+    char                 message_buff[512];
+    char                 expand_buff[1024];
 
-    return NULL;
+    nj = calloc(1, sizeof(*nj));
+
+    snprintf(message_buff, sizeof(message_buff), "'%s (builder-build-command: %s)'",
+             builder_get_status_string(), build_cmd);
+
+    perc_subst(notif_cmd, message_buff, expand_buff, sizeof(expand_buff));
+
+    snprintf(nj->cmd, sizeof(nj->cmd), "(%s) 2>&1", expand_buff);
+
+    yed_plugin_submit_job(Self, builder_notif_cmd_work, builder_notif_cmd_done, nj);
 }
 
 static void builder_report(void) {
-    char      *notif_cmd;
-    pthread_t  p;
+    char *notif_cmd;
 
     if (notif_up) {
         notif_stop();
@@ -283,7 +301,7 @@ static void builder_report(void) {
 
     if ((notif_cmd = yed_get_var("builder-notify-command"))) {
         strncpy(builder_notif_cmd, notif_cmd, sizeof(builder_notif_cmd) - 1);
-        pthread_create(&p, NULL, builder_bg_cmd_thread_fn, notif_cmd);
+        builder_start_notif_cmd(notif_cmd);
     } else {
         notif_start();
     }
@@ -347,28 +365,10 @@ static void builder_draw_error_message(int do_draw) {
     }
 }
 
-void builder_update_running(void) {
+static void builder_follow_output(void) {
     yed_frame **fit;
     int         last_row;
 
-LOG_FN_ENTER();
-
-    get_or_make_buffer()->flags &= ~BUFF_RD_ONLY;
-    build_is_running = yed_read_subproc_into_buffer_nb(&nb_subproc);
-    get_or_make_buffer()->flags |= BUFF_RD_ONLY;
-
-    if (!build_is_running) {
-        builder_run_before = 1;
-        if (nb_subproc.err && nb_subproc.err != ECHILD) {
-            yed_cerr("something went wrong -- errno = %d\n", nb_subproc.err);
-            build_failed = 1;
-        } else {
-            build_failed = nb_subproc.exit_status != 0 || nb_subproc.err == ECHILD;
-            builder_report();
-        }
-        err_fixed = 0;
-    }
-
     array_traverse(ys->frames, fit) {
         if (*fit == ys->active_frame) { continue; }
         if ((*fit)->buffer == get_or_make_buffer()) {
@@ -376,6 +376,28 @@ LOG_FN_ENTER();
             yed_set_cursor_far_within_frame(*fit, last_row, 1);
         }
     }
+}
+
+static void builder_on_data(yed_subproc *sp, const char *data, int len, void *arg) {
+    builder_follow_output();
+}
+
+static void builder_on_exit(yed_subproc *sp, int exit_status, void *arg) {
+LOG_FN_ENTER();
+
+    build_is_running   = 0;
+    builder_run_before = 1;
+
+    if (sp->err && sp->err != ECHILD) {
+        yed_cerr("something went wrong -- errno = %d\n", sp->err);
+        build_failed = 1;
+    } else {
+        build_failed = exit_status != 0 || sp->err == ECHILD;
+        builder_report();
+    }
+    err_fixed = 0;
+
+    builder_follow_output();
 
 LOG_EXIT();
 }
@@ -387,18 +409,11 @@ void builder_pump_handler(yed_event *event) {
 
     yed_set_var("builder-status", (char*)builder_get_status_string());
 
-    if (build_is_running) {
-        builder_update_running();
-    }
-
     if (notif_up) {
         now_ms = measure_time_now_ms();
         if (now_ms - notif_start_ms >= notif_stay_ms) {
             notif_stop();
         }
-    } else if (builder_notif_cmd_status != 0) {
-        yed_cerr("builder-notify-command '%s' failed with error code %d", builder_notif_cmd, builder_notif_cmd_status);
-        builder_notif_cmd_status = 0;
     }
 
     LOG_EXIT();
@@ -728,9 +743,10 @@ static void builder_echo_status(int n_args, char **args) {
 }
 
 static void builder_start(int n_args, char **args) {
-    char *cmd;
-    yed_buffer *buff;
-    char cmd_buff[1024];
+    char             *cmd;
+    yed_buffer       *buff;
+    char              cmd_buff[1024];
+    yed_subproc_opts  opts;
 
     if (n_args > 1) {
         yed_cerr("expected 0 or 1 arguments, but got %d", n_args);
@@ -764,21 +780,15 @@ static void builder_start(int n_args, char **args) {
     snprintf(cmd_buff, sizeof(cmd_buff),
              "(%s) 2>&1", cmd);
 
-    get_or_make_buffer()->flags &= ~BUFF_RD_ONLY;
-    if (yed_start_read_subproc_into_buffer_nb(cmd_buff, buff, &nb_subproc)) {
-        get_or_make_buffer()->flags |= BUFF_RD_ONLY;
-        yed_cerr("there was an error when calling yed_start_read_subproc_into_buffer_nb()");
+    memset(&opts, 0, sizeof(opts));
+    opts.out_buffer = buff;
+    opts.on_data    = builder_on_data;
+    opts.on_exit    = builder_on_exit;
+
+    if (yed_plugin_start_subproc(Self, cmd_buff, &opts) == NULL) {
+        yed_cerr("couldn't start the build command -- errno = %d", errno);
         return;
     }
-    get_or_make_buffer()->flags |= BUFF_RD_ONLY;
-
-    build_is_running  = 1;
-    /*
-    ** Wait 15 milliseconds so that the subprocess has time to start and
-    ** do _something_.
-    ** This makes it so that we can start to produce output before the next
-    ** pump (which could be ~300 ms if there aren't any keypresses).
-    */
-    usleep(15000);
-    builder_update_running();
+
+    build_is_running = 1;
 }
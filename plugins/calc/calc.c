@@ -902,6 +902,15 @@ static void buffer_pre_mod_handler(yed_event *event) {
             event->cancel = 1;
         }
     }
+
+    if (event->buff_mod_event == BUFF_MOD_BATCH) {
+        if (event->row != 1
+        ||  event->col <= PROMPT_LEN
+        ||  event->buff_change->n_old_rows != 1
+        ||  event->buff_change->n_new_rows != 1) {
+            event->cancel = 1;
+        }
+    }
 }
 
 static void buffer_post_mod_handler(yed_event *event) {
@@ -16,16 +16,12 @@ typedef struct {
     int                col;
 } ctags_fn_hint;
 
-static int                     gen_thread_started;
-static int                     gen_thread_finished;
-static int                     gen_thread_exit_status;
-static int                     parse_thread_started;
-static int                     parse_thread_finished;
+static yed_plugin             *Self;
+static yed_job                *gen_job;
+static int                     gen_exit_status;
+static yed_job                *parse_job;
+static int                     parse_pending;
 static int                     has_parsed;
-static pthread_t               gen_pthread;
-static pthread_mutex_t         gen_mtx = PTHREAD_MUTEX_INITIALIZER;
-static pthread_t               parse_pthread;
-static pthread_mutex_t         parse_mtx = PTHREAD_MUTEX_INITIALIZER;
 static int                     using_tmp;
 static char                    tmp_tags_file[4096];
 static array_t                 tmp_tags_buffers;
@@ -61,7 +57,6 @@ void unload(yed_plugin *self);
 void ctags_find_key_pressed_handler(yed_event *event);
 void ctags_find_line_handler(yed_event *event);
 void ctags_hl_line_handler(yed_event *event);
-void ctags_pump_handler(yed_event *event);
 void ctags_buffer_post_load_handler(yed_event *event);
 void ctags_buffer_post_write_handler(yed_event *event);
 void ctags_buffer_pre_quit_handler(yed_event *event);
@@ -82,7 +77,6 @@ int yed_plugin_boot(yed_plugin *self) {
     yed_event_handler key_pressed;
     yed_event_handler find_line;
     yed_event_handler hl_line;
-    yed_event_handler pump;
     yed_event_handler load;
     yed_event_handler write;
     yed_event_handler quit;
@@ -92,6 +86,8 @@ int yed_plugin_boot(yed_plugin *self) {
 
     YED_PLUG_VERSION_CHECK();
 
+    Self = self;
+
     yed_plugin_set_unload_fn(self, unload);
 
     yed_syntax_start(&syn);
@@ -107,8 +103,6 @@ int yed_plugin_boot(yed_plugin *self) {
     find_line.fn       = ctags_find_line_handler;
     hl_line.kind       = EVENT_LINE_PRE_DRAW;
     hl_line.fn         = ctags_hl_line_handler;
-    pump.kind          = EVENT_PRE_PUMP;
-    pump.fn            = ctags_pump_handler;
     load.kind          = EVENT_BUFFER_POST_LOAD;
     load.fn            = ctags_buffer_post_load_handler;
     write.kind         = EVENT_BUFFER_POST_WRITE;
@@ -124,7 +118,6 @@ int yed_plugin_boot(yed_plugin *self) {
     yed_plugin_add_event_handler(self, key_pressed);
     yed_plugin_add_event_handler(self, find_line);
     yed_plugin_add_event_handler(self, hl_line);
-    yed_plugin_add_event_handler(self, pump);
     yed_plugin_add_event_handler(self, load);
     yed_plugin_add_event_handler(self, write);
     yed_plugin_add_event_handler(self, quit);
@@ -209,22 +202,34 @@ static const char *tags_file_name(void) {
     return tags_file;
 }
 
-void *ctags_gen_thread(void *arg) {
-    char *cmd;
-
-    pthread_mutex_lock(&gen_mtx);
+static void ctags_gen_work(yed_job *job, void *arg) {
+    gen_exit_status = system(arg);
+}
 
-    cmd = arg;
+static void ctags_gen_done(yed_job *job, void *arg) {
+    free(arg);
+    gen_job = NULL;
 
-    gen_thread_exit_status = system(cmd);
+    if (yed_job_is_cancelled(job)) { return; }
 
-    free(cmd);
-    gen_pthread         = 0;
-    gen_thread_finished = 1;
+LOG_CMD_ENTER("ctags");
+    if (gen_exit_status) {
+        yed_cerr("ctags failed with exit status %d", gen_exit_status);
+    } else {
+        yed_cprint("ctags-gen has completed");
+    }
+LOG_EXIT();
 
-    pthread_mutex_unlock(&gen_mtx);
+    /* Someone asked for a parse while we were generating. */
+    if (parse_pending) {
+        parse_pending = 0;
+        ctags_parse();
+    }
+}
 
-    return NULL;
+static void ctags_start_gen(const char *cmd) {
+    gen_exit_status = 0;
+    gen_job         = yed_plugin_submit_job(Self, ctags_gen_work, ctags_gen_done, strdup(cmd));
 }
 
 static void show_fn_hint(ctags_fn_hint *hint) {
@@ -399,9 +404,7 @@ trunc:;
 LOG_CMD_ENTER("ctags");
     yed_cprint("running ctags in background...");
 LOG_EXIT();
-    gen_thread_finished = 0;
-    gen_thread_started  = 1;
-    pthread_create(&gen_pthread, NULL, ctags_gen_thread, strdup(cmd_buff));
+    ctags_start_gen(cmd_buff);
 }
 
 static void setup_tmp_tags(void) {
@@ -459,7 +462,7 @@ int parse_tag_line(char *line, char **tag, char **file, char **kind) {
     return 1;
 }
 
-void * ctags_parse_thread(void *arg) {
+static void ctags_parse_work(yed_job *job, void *arg) {
     FILE                      *f;
     char                       line[4096];
     char                      *tag;
@@ -470,11 +473,6 @@ void * ctags_parse_thread(void *arg) {
     tree_it(ctags_str_t, int)  it;
     char                      *key;
 
-    pthread_mutex_lock(&parse_mtx);
-
-    /* Wait on the gen thread if it's running so that we parse up-to-date tags. */
-    while (gen_thread_started && !gen_thread_finished) { usleep(1000); }
-
     pthread_mutex_lock(&tags_mtx);
 
     tags = tree_make(ctags_str_t, int);
@@ -483,6 +481,8 @@ void * ctags_parse_thread(void *arg) {
     if (f == NULL) { goto out; }
 
     while (fgets(line, sizeof(line), f)) {
+        if (yed_job_is_cancelled(job)) { break; }
+
         if (parse_tag_line(line, &tag, &file, &kind)) {
             switch (*kind) {
                 case 'd':
@@ -537,13 +537,6 @@ void * ctags_parse_thread(void *arg) {
 
 out:;
     pthread_mutex_unlock(&tags_mtx);
-
-    parse_pthread         = 0;
-    parse_thread_finished = 1;
-
-    pthread_mutex_unlock(&parse_mtx);
-
-    return NULL;
 }
 
 void ctags_hl_cleanup(void) {
@@ -570,12 +563,14 @@ out:;
     pthread_mutex_unlock(&tags_mtx);
 }
 
-void ctags_finish_parse(void) {
+static void ctags_parse_done(yed_job *job, void *arg) {
     yed_syntax syn_swap;
 
-LOG_CMD_ENTER("ctags");
-    parse_thread_started = parse_thread_finished = 0;
+    parse_job = NULL;
+
+    if (yed_job_is_cancelled(job)) { return; }
 
+LOG_CMD_ENTER("ctags");
     pthread_mutex_lock(&tags_mtx);
     memcpy(&syn_swap, &syn, sizeof(syn));
     memcpy(&syn, &syn_tmp, sizeof(syn_tmp));
@@ -589,18 +584,17 @@ LOG_EXIT();
 }
 
 void ctags_parse(void) {
-    if (parse_thread_started) { return; }
+    if (parse_job != NULL) { return; }
 
-    parse_thread_finished = 0;
-    parse_thread_started  = 1;
-    ctags_parse_cleanup();
-    pthread_create(&parse_pthread, NULL, ctags_parse_thread, (void*)(u64)yed_var_is_truthy("ctags-enable-extra-highlighting"));
-
-    /* See if the thread can finish in 15ms... if so, we can avoid the pump delay. */
-    usleep(15000);
-
-    if (parse_thread_finished) { ctags_finish_parse(); }
+    /* Wait for the tags that are being generated. */
+    if (gen_job != NULL) {
+        parse_pending = 1;
+        return;
+    }
 
+    ctags_parse_cleanup();
+    parse_job = yed_plugin_submit_job(Self, ctags_parse_work, ctags_parse_done,
+                                      (void*)(u64)yed_var_is_truthy("ctags-enable-extra-highlighting"));
 }
 
 static void delete_tmp_tags_file(void) {
@@ -612,9 +606,6 @@ void unload(yed_plugin *self) {
 
     cancelled = 0;
 
-    pthread_mutex_lock(&gen_mtx);
-    pthread_mutex_lock(&parse_mtx);
-
     ctags_parse_cleanup();
     ctags_hl_cleanup();
 
@@ -866,31 +857,6 @@ void ctags_hl_line_handler(yed_event *event) {
     yed_syntax_line_event(&syn, event);
 }
 
-void ctags_pump_handler(yed_event *event) {
-    int did_gen_thread;
-
-LOG_CMD_ENTER("ctags");
-
-    did_gen_thread = 0;
-
-    if (gen_thread_started && gen_thread_finished) {
-        if (gen_thread_exit_status) {
-            yed_cerr("ctags failed with exit status %d", gen_thread_exit_status);
-        } else {
-            yed_cprint("ctags-gen has completed");
-        }
-        gen_thread_started = gen_thread_finished = gen_thread_exit_status = 0;
-        did_gen_thread = 1;
-    }
-
-    if (!gen_thread_started && parse_thread_started && parse_thread_finished) {
-        if (did_gen_thread) { yed_cprint("\n"); }
-        ctags_finish_parse();
-    }
-
-LOG_EXIT();
-}
-
 void ctags_buffer_post_load_handler(yed_event *event) {
     const char  *base;
     char       **it;
@@ -1066,7 +1032,7 @@ void ctags_gen(int n_args, char **args) {
         return;
     }
 
-    if (gen_thread_started) {
+    if (gen_job != NULL) {
         yed_cerr("ctags is currently running");
         return;
     }
@@ -1085,9 +1051,7 @@ void ctags_gen(int n_args, char **args) {
     snprintf(cmd_buff, sizeof(cmd_buff), "ctags %s %s > /dev/null", ctags_flags, additional_paths);
 
     yed_cprint("running 'ctags %s' in background...", ctags_flags);
-    gen_thread_finished = 0;
-    gen_thread_started  = 1;
-    pthread_create(&gen_pthread, NULL, ctags_gen_thread, strdup(cmd_buff));
+    ctags_start_gen(cmd_buff);
 
     using_tmp = 0;
 }
@@ -7,10 +7,12 @@ void cursor_word_hl_cursor_moved_handler(yed_event *event);
 void cursor_word_hl_delete_back_handler(yed_event *event);
 void cursor_word_hl_pump_handler(yed_event *event);
 void cursor_word_hl_hl_word(yed_event *event);
+static int get_idle_threshold_ms(void);
 
 #define DEFAULT_THRESHOLD  (1000)
 static unsigned long long  cursor_idle_start_ms;
 static int                 cursor_is_idle;
+static int                 idle_timer;
 static char               *the_word;
 static int                 the_word_len;
 
@@ -29,6 +31,7 @@ int yed_plugin_boot(yed_plugin *self) {
     pump.fn            = cursor_word_hl_pump_handler;
 
     yed_plugin_add_event_handler(self, line);
+    yed_set_line_draw_deps(line, LINE_DRAW_DEP_LINE);
     yed_plugin_add_event_handler(self, cursor_moved);
     yed_plugin_add_event_handler(self, delete_back);
     yed_plugin_add_event_handler(self, pump);
@@ -76,6 +79,14 @@ void cursor_word_hl_cursor_moved_handler(yed_event *event) {
     cursor_is_idle       = 0;
     cursor_idle_start_ms = measure_time_now_ms();
 
+    /* Make sure there's a pump once the cursor has been idle long enough. */
+    if (idle_timer) { yed_remove_timer(idle_timer); }
+    idle_timer = yed_add_timer(get_idle_threshold_ms() + 1, 0, NULL, NULL);
+
+    if (cursor_was_idle) {
+        yed_invalidate_line_draw_caches();
+    }
+
     word = yed_word_under_cursor();
 
     if (!word) {
@@ -118,6 +129,7 @@ void cursor_word_hl_delete_back_handler(yed_event *event) {
             free(the_word);
             the_word     = NULL;
             the_word_len = 0;
+            yed_invalidate_line_draw_caches();
         }
         return;
     }
@@ -132,22 +144,23 @@ void cursor_word_hl_delete_back_handler(yed_event *event) {
 
     the_word     = word;
     the_word_len = strlen(the_word);
+
+    yed_invalidate_line_draw_caches();
 }
 
 void cursor_word_hl_pump_handler(yed_event *event) {
     unsigned long long cursor_idle_now_ms;
-    int                cursor_idle_threshold_ms;
     int                cursor_was_moving;
 
     cursor_was_moving  = !cursor_is_idle;
     cursor_idle_now_ms = measure_time_now_ms();
 
-    if (!yed_get_var_as_int("cursor-word-hl-idle-threshold-ms", &cursor_idle_threshold_ms)) {
-        cursor_idle_threshold_ms = DEFAULT_THRESHOLD;
-    }
-
-    if (cursor_idle_now_ms - cursor_idle_start_ms >= cursor_idle_threshold_ms) {
+    if (cursor_idle_now_ms - cursor_idle_start_ms >= get_idle_threshold_ms()) {
         cursor_is_idle = 1;
+
+        if (cursor_was_moving) {
+            yed_invalidate_line_draw_caches();
+        }
     }
 }
 
@@ -230,3 +243,13 @@ void cursor_word_hl_hl_word(yed_event *event) {
         }
     }
 }
+
+static int get_idle_threshold_ms(void) {
+    int threshold_ms;
+
+    if (!yed_get_var_as_int("cursor-word-hl-idle-threshold-ms", &threshold_ms)) {
+        threshold_ms = DEFAULT_THRESHOLD;
+    }
+
+    return threshold_ms;
+}
@@ -1,4 +1,12 @@
 #include <yed/plugin.h>
+#include <yed/tree.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#define FF_HAVE_INOTIFY
+#endif
+
+typedef char *ff_str_t;
+use_tree_c(ff_str_t, int, strcmp);
 
 void find_file(int n_args, char **args);
 void find_file_start(void);
@@ -7,6 +15,8 @@ void find_file_run(void);
 void find_file_select(void);
 
 void find_file_key_pressed_handler(yed_event *event);
+void find_file_pre_pump_handler(yed_event *event);
+void find_file_unload(yed_plugin *self);
 
 yed_buffer *get_or_make_buff(void) {
     yed_buffer *buff;
@@ -21,37 +31,197 @@ yed_buffer *get_or_make_buff(void) {
     return buff;
 }
 
-static char *prg;
+/*
+ * The file index.
+ *
+ * Unless 'find-file-prg' is set, find-file matches against an index of every
+ * file below the current directory instead of running a command. The index
+ * is built the first time it's needed by a crawl that runs on all of the
+ * worker threads, and is kept up to date with inotify afterwards (where
+ * there's no inotify, it is crawled again each time find-file starts).
+ *
+ * Matching is fuzzy: the characters of the query have to show up in the
+ * path in order. Matches are ranked by how tight they are and whether they
+ * land at the start of words or in the file name, and the best
+ * FF_MAX_RESULTS go in *find-file-list. The index is split up between the
+ * worker threads to score it. When the query just gets longer, only the
+ * paths that matched the last one are looked at again.
+ */
+
+#define FF_MAX_RESULTS       (500)
+#define FF_MIN_CHUNK         (16384)
+#define FF_REFRESH_MS        (50)
+#define FF_WAIT_MS           (20)
+#define FF_WATCH_MASK        (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+#define FF_SCORE_MATCH       (16)
+#define FF_BONUS_SEGMENT     (10) /* Start of a path component. */
+#define FF_BONUS_BOUNDARY    (8)  /* After _, -, . or a space. */
+#define FF_BONUS_CAMEL       (7)
+#define FF_BONUS_CONSECUTIVE (6)
+#define FF_BONUS_BASENAME    (4)
+#define FF_PENALTY_GAP       (1)
+
+typedef struct {
+    unsigned  off;      /* Into the arena. The path is relative to the root. */
+    int       len;
+    int       base;     /* Where the file name starts. */
+    int       dir;
+    int       dead;
+    uint64_t  mask;     /* Which characters the path has. See ff_char_bit(). */
+} ff_entry;
+
+typedef struct {
+    char    *path;      /* "" for the root. */
+    int      wd;
+    int      dead;
+    array_t  files;     /* int, into the entries */
+} ff_dir;
+
+typedef struct {
+    char    *root;
+    array_t  arena;
+    array_t  entries;
+    int      n_dead;
+    array_t  dirs;
+    tree(ff_str_t, int) dir_map;
+    array_t  wd_dirs;   /* int, indexed by watch descriptor */
+    array_t  deferred;  /* ff_event, for watches we don't know about yet */
+    int      inotify_fd;
+    int      watching;
+    int      stale;
+    int      generation;
+} ff_index;
+
+typedef struct {
+    int   wd;
+    int   mask;
+    char *name;
+} ff_event;
+
+/* What a crawl job found in one directory. */
+typedef struct {
+    char    *path;
+    int      wd;
+    array_t  names;     /* char* */
+} ff_found_dir;
+
+typedef struct {
+    ff_index         *index;
+    char             *root;
+    int               root_fd;
+    int               inotify_fd;
+    int               cancelled;
+    int               watch_failed;
+
+    pthread_mutex_t   mtx;
+    pthread_cond_t    cond;
+    array_t           dirs;     /* char* */
+    int               n_busy;
+
+    pthread_mutex_t   found_mtx;
+    array_t           found;    /* ff_found_dir */
+
+    /* Main thread only. */
+    array_t           jobs;
+    int               n_jobs;
+} ff_crawl;
+
+typedef struct {
+    int idx;
+    int score;
+} ff_match;
+
+/* The paths that matched a query, so that a longer one only has to look at those. */
+typedef struct {
+    char    *query;
+    array_t  cands;     /* int, in index order */
+} ff_level;
+
+typedef struct {
+    ff_index   *index;
+    const char *query;
+    int         query_len;
+    int         fold;
+    uint64_t    query_mask;
+    const int  *cands;      /* NULL to look at every entry. */
+    int         start;
+    int         n;
+    array_t     matched;    /* int */
+    ff_match    best[FF_MAX_RESULTS];
+    int         n_best;
+} ff_chunk;
+
+static yed_plugin  *Self;
+static yed_subproc *subproc;
+static int          select_when_done;
+static char        *prg;
+static ff_index    *file_index;
+static array_t      crawls;
+static char        *last_query;
+static array_t      levels;
+static int          levels_generation;
+static int          dirty;
+static int          refresh_timer;
+static unsigned long long last_run_ms;
+
+static void find_file_select_if_one(void) {
+    yed_line *line;
+
+    if (yed_buff_n_lines(get_or_make_buff()) == 1) {
+        line = yed_buff_get_line(get_or_make_buff(), 1);
+        if (line->visual_width) {
+            find_file_select();
+        }
+    }
+}
+
+/* Wait for the results if they aren't all in yet. */
+static void find_file_select_if_one_when_done(void) {
+    if (subproc != NULL || array_len(crawls) > 0) {
+        select_when_done = 1;
+    } else {
+        find_file_select_if_one();
+    }
+}
 
 int yed_plugin_boot(yed_plugin *self) {
     yed_event_handler h;
 
     YED_PLUG_VERSION_CHECK();
 
+    Self   = self;
+    crawls = array_make(ff_crawl*);
+    levels = array_make(ff_level);
+
+    yed_plugin_set_unload_fn(self, find_file_unload);
+
     h.kind = EVENT_KEY_PRESSED;
     h.fn   = find_file_key_pressed_handler;
 
     yed_plugin_add_event_handler(self, h);
+
+    h.kind = EVENT_PRE_PUMP;
+    h.fn   = find_file_pre_pump_handler;
+
+    yed_plugin_add_event_handler(self, h);
+
     yed_plugin_set_command(self, "find-file", find_file);
     yed_plugin_set_completion(self, "find-file-compl-arg-0", yed_get_completion("file"));
 
-    if (!yed_get_var("find-file-prg")) {
-        yed_set_var("find-file-prg",
-                    "find . -path ./.git -prune -o -type f -name '*%*' -print");
-    }
-
     return 0;
 }
 
+static int ff_index_start(void);
+
 void find_file(int n_args, char **args) {
-    int       i;
-    int       key;
-    yed_line *line;
+    int i;
+    int key;
 
     if (!ys->interactive_command) {
         prg = yed_get_var("find-file-prg");
-        if (!prg) {
-            yed_cerr("'find-file-prg' not set");
+        if (!prg && !ff_index_start()) {
+            yed_cerr("couldn't open the current directory");
             return;
         }
         find_file_start();
@@ -64,12 +234,7 @@ void find_file(int n_args, char **args) {
             find_file_run();
             ys->interactive_command = NULL;
             yed_clear_cmd_buff();
-            if (yed_buff_n_lines(get_or_make_buff()) == 1) {
-                line = yed_buff_get_line(get_or_make_buff(), 1);
-                if (line->visual_width) {
-                    find_file_select();
-                }
-            }
+            find_file_select_if_one_when_done();
         }
     } else {
         sscanf(args[0], "%d", &key);
@@ -92,8 +257,6 @@ void find_file_start(void) {
 }
 
 void find_file_take_key(int key) {
-    yed_line *line;
-
     switch (key) {
         case ESC:
         case CTRL_C:
@@ -105,12 +268,7 @@ void find_file_take_key(int key) {
         case ENTER:
             ys->interactive_command = NULL;
             yed_clear_cmd_buff();
-            if (yed_buff_n_lines(get_or_make_buff()) == 1) {
-                line = yed_buff_get_line(get_or_make_buff(), 1);
-                if (line->visual_width) {
-                    find_file_select();
-                }
-            }
+            find_file_select_if_one_when_done();
             break;
         default:
             yed_cmd_line_readline_take_key(NULL, key);
@@ -120,16 +278,1292 @@ void find_file_take_key(int key) {
     }
 }
 
+static void find_file_clear(void) {
+    get_or_make_buff()->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(get_or_make_buff());
+    get_or_make_buff()->flags |= BUFF_RD_ONLY;
+}
+
+static void find_file_on_exit(yed_subproc *sp, int exit_status, void *arg) {
+    /* It was killed to make way for a newer pattern. */
+    if (sp != subproc) { return; }
+
+    subproc = NULL;
+
+    if (exit_status != 0) {
+        find_file_clear();
+    }
+
+    if (select_when_done) {
+        select_when_done = 0;
+        find_file_select_if_one();
+    }
+}
+
+
+/*
+ * Scoring.
+ */
+
+static inline char ff_fold(char c) {
+    /* No branch, since this is in the innermost loop. */
+    return c + (((unsigned char)(c - 'A') < 26) << 5);
+}
+
+static inline uint64_t ff_char_bit(char c) {
+    c = ff_fold(c);
+
+    if (c >= 'a' && c <= 'z') { return 1ULL << (c - 'a');      }
+    if (c >= '0' && c <= '9') { return 1ULL << (26 + c - '0'); }
+
+    return 1ULL << (36 + ((unsigned char)c % 28));
+}
+
+static uint64_t ff_mask(const char *s, int len) {
+    uint64_t mask;
+    int      i;
+
+    mask = 0;
+    for (i = 0; i < len; i += 1) {
+        mask |= ff_char_bit(s[i]);
+    }
+
+    return mask;
+}
+
+static inline int ff_is_boundary(char c) {
+    return c == '_' || c == '-' || c == '.' || c == ' ';
+}
+
+/*
+ * Find the first place where the whole query matches going forward, then
+ * walk back from its end to find the tightest window that still has all of
+ * it, and score that.
+ * If the window can't possibly score above floor, the path still matches,
+ * but it isn't scored and *score_out is just set to floor.
+ */
+static int ff_score(const char *path, int len, int base, const char *q, int q_len, int fold, int floor, int *score_out) {
+    int  i;
+    int  qi;
+    int  start;
+    int  end;
+    int  score;
+    int  s;
+    int  prev;
+    int  n_base;
+    char want;
+    char c;
+    char p;
+
+    /* The fold check is hoisted out of the scanning loops. */
+    qi   = 0;
+    want = q[0];
+    if (fold) {
+        for (i = 0; i < len; i += 1) {
+            if (ff_fold(path[i]) == want) {
+                if (++qi == q_len) { break; }
+                want = q[qi];
+            }
+        }
+    } else {
+        for (i = 0; i < len; i += 1) {
+            if (path[i] == want) {
+                if (++qi == q_len) { break; }
+                want = q[qi];
+            }
+        }
+    }
+
+    if (qi < q_len) { return 0; }
+
+    end  = i + 1;
+    qi   = q_len - 1;
+    want = q[qi];
+    if (fold) {
+        for (i = end - 1; i >= 0; i -= 1) {
+            if (ff_fold(path[i]) == want) {
+                if (--qi < 0) { break; }
+                want = q[qi];
+            }
+        }
+    } else {
+        for (i = end - 1; i >= 0; i -= 1) {
+            if (path[i] == want) {
+                if (--qi < 0) { break; }
+                want = q[qi];
+            }
+        }
+    }
+
+    start = i;
+
+    n_base = MAX(0, MIN(q_len, end - base));
+    score  = q_len * (FF_SCORE_MATCH + FF_BONUS_SEGMENT)
+           + (q_len - 1) * FF_BONUS_CONSECUTIVE
+           + n_base * FF_BONUS_BASENAME
+           - FF_PENALTY_GAP * (end - start - q_len);
+
+    if (score * 64 - MIN(len, 63) <= floor) {
+        *score_out = floor;
+        return 1;
+    }
+
+    score = 0;
+    prev  = -2;
+    qi    = 0;
+
+    for (i = start; i < end; i += 1) {
+        c = path[i];
+
+        if ((fold ? ff_fold(c) : c) != q[qi]) { continue; }
+
+        p = i > 0 ? path[i - 1] : '/';
+        s = FF_SCORE_MATCH;
+
+        if (p == '/') {
+            s += FF_BONUS_SEGMENT;
+        } else if (ff_is_boundary(p)) {
+            s += FF_BONUS_BOUNDARY;
+        } else if (c >= 'A' && c <= 'Z' && p >= 'a' && p <= 'z') {
+            s += FF_BONUS_CAMEL;
+        }
+
+        if (prev == i - 1) { s += FF_BONUS_CONSECUTIVE; }
+        if (i >= base)     { s += FF_BONUS_BASENAME;    }
+
+        score += s;
+        prev   = i;
+
+        if (++qi == q_len) { break; }
+    }
+
+    score -= FF_PENALTY_GAP * (end - start - q_len);
+    /* Break ties in favor of shorter paths. */
+    score  = score * 64 - MIN(len, 63);
+
+    *score_out = score;
+
+    return 1;
+}
+
+static ff_index *ff_sort_index;
+
+static int ff_match_better(const ff_match *a, const ff_match *b) {
+    if (a->score != b->score) { return a->score > b->score; }
+    return a->idx < b->idx;
+}
+
+static int ff_match_cmp(const void *_a, const void *_b) {
+    const ff_match *a;
+    const ff_match *b;
+    ff_entry       *ea;
+    ff_entry       *eb;
+
+    a = _a;
+    b = _b;
+
+    if (a->score != b->score) { return a->score > b->score ? -1 : 1; }
+
+    ea = array_item(ff_sort_index->entries, a->idx);
+    eb = array_item(ff_sort_index->entries, b->idx);
+
+    return strcmp((char*)array_data(ff_sort_index->arena) + ea->off,
+                  (char*)array_data(ff_sort_index->arena) + eb->off);
+}
+
+/* best is a min-heap, so the worst of the best is on top. */
+static void ff_heap_push(ff_match *best, int *n_best, ff_match m) {
+    ff_match tmp;
+    int      i;
+    int      child;
+
+    if (*n_best < FF_MAX_RESULTS) {
+        i          = *n_best;
+        *n_best   += 1;
+        best[i]    = m;
+        while (i > 0 && ff_match_better(&best[(i - 1) / 2], &best[i])) {
+            tmp                = best[i];
+            best[i]            = best[(i - 1) / 2];
+            best[(i - 1) / 2]  = tmp;
+            i                  = (i - 1) / 2;
+        }
+        return;
+    }
+
+    if (!ff_match_better(&m, &best[0])) { return; }
+
+    best[0] = m;
+    i       = 0;
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= *n_best) { break; }
+        if (child + 1 < *n_best && ff_match_better(&best[child], &best[child + 1])) {
+            child += 1;
+        }
+        if (!ff_match_better(&best[i], &best[child])) { break; }
+        tmp         = best[i];
+        best[i]     = best[child];
+        best[child] = tmp;
+        i           = child;
+    }
+}
+
+static void ff_score_chunk(yed_job *job, void *arg) {
+    ff_chunk   *chunk;
+    const char *arena;
+    ff_entry   *entries;
+    ff_entry   *e;
+    ff_match    m;
+    int         i;
+    int         idx;
+    int         floor;
+
+    chunk   = arg;
+    arena   = array_data(chunk->index->arena);
+    entries = array_data(chunk->index->entries);
+
+    for (i = chunk->start; i < chunk->start + chunk->n; i += 1) {
+        idx = chunk->cands == NULL ? i : chunk->cands[i];
+        e   = entries + idx;
+
+        if (e->dead
+        ||  (e->mask & chunk->query_mask) != chunk->query_mask) {
+            continue;
+        }
+
+        /* Once we have enough, only something better than the worst of them matters. */
+        floor = chunk->n_best == FF_MAX_RESULTS ? chunk->best[0].score : INT_MIN;
+
+        if (!ff_score(arena + e->off, e->len, e->base, chunk->query, chunk->query_len, chunk->fold, floor, &m.score)) {
+            continue;
+        }
+
+        m.idx = idx;
+
+        array_push(chunk->matched, idx);
+        ff_heap_push(chunk->best, &chunk->n_best, m);
+    }
+}
+
+static void ff_clear_levels(void) {
+    ff_level *level;
+
+    array_traverse(levels, level) {
+        free(level->query);
+        array_free(level->cands);
+    }
+    array_clear(levels);
+}
+
+/*
+ * Keep the levels for the prefixes of this query so that typing more only
+ * looks at what already matched and backspacing doesn't start over.
+ */
+static ff_level * ff_level_for(const char *query) {
+    ff_level *level;
+
+    if (levels_generation != file_index->generation) {
+        ff_clear_levels();
+        levels_generation = file_index->generation;
+    }
+
+    while ((level = array_last(levels)) != NULL) {
+        if (strncmp(query, level->query, strlen(level->query)) == 0) {
+            return level;
+        }
+        free(level->query);
+        array_free(level->cands);
+        array_pop(levels);
+    }
+
+    return NULL;
+}
+
+/* Fills results with the best matches, best first. */
+static void ff_query(const char *query, array_t *results) {
+    ff_chunk  *chunks;
+    ff_chunk  *chunk;
+    ff_level  *level;
+    ff_level   new_level;
+    const int *from;
+    int        n_from;
+    int        n_chunks;
+    int        per;
+    int        fold;
+    int        i;
+    int        j;
+
+    array_clear(*results);
+
+    fold = 1;
+    for (i = 0; query[i]; i += 1) {
+        if (query[i] >= 'A' && query[i] <= 'Z') { fold = 0; }
+    }
+
+    if ((level = ff_level_for(query)) != NULL) {
+        from   = array_data(level->cands);
+        n_from = array_len(level->cands);
+    } else {
+        from   = NULL;
+        n_from = array_len(file_index->entries);
+    }
+
+    n_chunks = MIN(yed_n_job_workers() + 1, MAX(1, n_from / FF_MIN_CHUNK));
+    per      = (n_from + n_chunks - 1) / MAX(n_chunks, 1);
+    chunks   = calloc(MAX(n_chunks, 1), sizeof(*chunks));
+
+    for (i = 0; i < n_chunks; i += 1) {
+        chunk             = chunks + i;
+        chunk->index      = file_index;
+        chunk->query      = query;
+        chunk->query_len  = strlen(query);
+        chunk->fold       = fold;
+        chunk->query_mask = ff_mask(query, chunk->query_len);
+        chunk->cands      = from;
+        chunk->start      = i * per;
+        chunk->n          = MAX(0, MIN(per, n_from - chunk->start));
+        chunk->matched    = array_make(int);
+    }
+
+    yed_run_jobs(ff_score_chunk, chunks, n_chunks, sizeof(*chunks));
+
+    new_level.cands = array_make(int);
+
+    for (i = 0; i < n_chunks; i += 1) {
+        chunk = chunks + i;
+
+        array_push_n(new_level.cands, array_data(chunk->matched), array_len(chunk->matched));
+        for (j = 0; j < chunk->n_best; j += 1) {
+            array_push(*results, chunk->best[j]);
+        }
+
+        array_free(chunk->matched);
+    }
+
+    free(chunks);
+
+    if (level != NULL && strcmp(level->query, query) == 0) {
+        array_free(level->cands);
+        level->cands = new_level.cands;
+    } else {
+        new_level.query = strdup(query);
+        array_push(levels, new_level);
+    }
+
+    if (last_query != NULL) { free(last_query); }
+    last_query = strdup(query);
+
+    ff_sort_index = file_index;
+    qsort(array_data(*results), array_len(*results), sizeof(ff_match), ff_match_cmp);
+
+    while (array_len(*results) > FF_MAX_RESULTS) {
+        array_pop(*results);
+    }
+}
+
+
+/*
+ * The index.
+ */
+
+static ff_index * ff_index_make(const char *root) {
+    ff_index *idx;
+
+    idx             = calloc(1, sizeof(*idx));
+    idx->root       = strdup(root);
+    idx->arena      = array_make(char);
+    idx->entries    = array_make(ff_entry);
+    idx->dirs       = array_make(ff_dir);
+    idx->dir_map    = tree_make(ff_str_t, int);
+    idx->wd_dirs    = array_make(int);
+    idx->deferred   = array_make(ff_event);
+    idx->inotify_fd = -1;
+
+    return idx;
+}
+
+static void ff_index_free(ff_index *idx) {
+    ff_dir   *dir;
+    ff_event *ev;
+
+    if (idx->inotify_fd != -1) {
+        yed_remove_fd(idx->inotify_fd);
+        close(idx->inotify_fd);
+    }
+
+    array_traverse(idx->dirs, dir) {
+        free(dir->path);
+        array_free(dir->files);
+    }
+    array_traverse(idx->deferred, ev) {
+        free(ev->name);
+    }
+
+    tree_free(idx->dir_map);
+    array_free(idx->deferred);
+    array_free(idx->wd_dirs);
+    array_free(idx->dirs);
+    array_free(idx->entries);
+    array_free(idx->arena);
+    free(idx->root);
+    free(idx);
+}
+
+static void ff_index_changed(void) {
+    file_index->generation += 1;
+    dirty              = 1;
+}
+
+static int ff_find_dir(const char *path) {
+    tree_it(ff_str_t, int) it;
+
+    it = tree_lookup(file_index->dir_map, (char*)path);
+
+    return tree_it_good(it) ? tree_it_val(it) : -1;
+}
+
+static void ff_set_wd_dir(int wd, int dir_idx) {
+    int none;
+
+    if (wd < 0) { return; }
+
+    none = -1;
+    while (array_len(file_index->wd_dirs) <= wd) {
+        array_push(file_index->wd_dirs, none);
+    }
+
+    *(int*)array_item(file_index->wd_dirs, wd) = dir_idx;
+}
+
+static int ff_wd_dir(int wd) {
+    if (wd < 0 || wd >= array_len(file_index->wd_dirs)) { return -1; }
+    return *(int*)array_item(file_index->wd_dirs, wd);
+}
+
+static int ff_add_dir(const char *path, int wd) {
+    ff_dir dir;
+    int    dir_idx;
+
+    dir.path  = strdup(path);
+    dir.wd    = wd;
+    dir.dead  = 0;
+    dir.files = array_make(int);
+
+    dir_idx = array_len(file_index->dirs);
+    array_push(file_index->dirs, dir);
+
+    tree_insert(file_index->dir_map, dir.path, dir_idx);
+    ff_set_wd_dir(wd, dir_idx);
+
+    return dir_idx;
+}
+
+static void ff_add_file(int dir_idx, const char *name) {
+    ff_dir   *dir;
+    ff_entry  e;
+    char      slash;
+    int       entry_idx;
+
+    dir   = array_item(file_index->dirs, dir_idx);
+    slash = '/';
+
+    e.off  = array_len(file_index->arena);
+    e.dir  = dir_idx;
+    e.dead = 0;
+
+    if (*dir->path) {
+        array_push_n(file_index->arena, dir->path, strlen(dir->path));
+        array_push(file_index->arena, slash);
+    }
+    e.base = array_len(file_index->arena) - e.off;
+    array_push_n(file_index->arena, (char*)name, strlen(name) + 1);
+
+    e.len  = array_len(file_index->arena) - e.off - 1;
+    e.mask = ff_mask((char*)array_data(file_index->arena) + e.off, e.len);
+
+    entry_idx = array_len(file_index->entries);
+    array_push(file_index->entries, e);
+    array_push(dir->files, entry_idx);
+}
+
+static int ff_dir_file(ff_dir *dir, const char *name) {
+    int      *it;
+    ff_entry *e;
+    int       i;
+
+    i = 0;
+    array_traverse(dir->files, it) {
+        e = array_item(file_index->entries, *it);
+        if (strcmp((char*)array_data(file_index->arena) + e->off + e->base, name) == 0) {
+            return i;
+        }
+        i += 1;
+    }
+
+    return -1;
+}
+
+static void ff_remove_file(int dir_idx, const char *name) {
+    ff_dir   *dir;
+    ff_entry *e;
+    int       i;
+
+    dir = array_item(file_index->dirs, dir_idx);
+
+    if ((i = ff_dir_file(dir, name)) == -1) { return; }
+
+    e       = array_item(file_index->entries, *(int*)array_item(dir->files, i));
+    e->dead = 1;
+
+    array_delete(dir->files, i);
+
+    file_index->n_dead += 1;
+}
+
+static void ff_kill_dir(int dir_idx, int rm_watch) {
+    ff_dir   *dir;
+    ff_entry *e;
+    int      *it;
+
+    dir = array_item(file_index->dirs, dir_idx);
+
+    array_traverse(dir->files, it) {
+        e       = array_item(file_index->entries, *it);
+        e->dead = 1;
+        file_index->n_dead += 1;
+    }
+    array_clear(dir->files);
+
+#ifdef FF_HAVE_INOTIFY
+    if (rm_watch && dir->wd >= 0) {
+        inotify_rm_watch(file_index->inotify_fd, dir->wd);
+    }
+#endif
+    if (ff_wd_dir(dir->wd) == dir_idx) {
+        ff_set_wd_dir(dir->wd, -1);
+    }
+
+    tree_delete(file_index->dir_map, dir->path);
+
+    dir->dead = 1;
+    dir->wd   = -1;
+}
+
+/* The directory and everything below it. */
+static void ff_kill_tree(const char *path, int rm_watch) {
+    tree_it(ff_str_t, int)  it;
+    array_t                 doomed;
+    char                   *prefix;
+    int                     prefix_len;
+    int                    *dit;
+    int                     dir_idx;
+
+    doomed     = array_make(int);
+    prefix_len = strlen(path) + 1;
+    prefix     = malloc(prefix_len + 1);
+
+    snprintf(prefix, prefix_len + 1, "%s/", path);
+
+    if ((dir_idx = ff_find_dir(path)) != -1) {
+        array_push(doomed, dir_idx);
+    }
+
+    for (it = tree_geq(file_index->dir_map, prefix); tree_it_good(it); tree_it_next(it)) {
+        if (strncmp(tree_it_key(it), prefix, prefix_len) != 0) { break; }
+        dir_idx = tree_it_val(it);
+        array_push(doomed, dir_idx);
+    }
+
+    array_traverse(doomed, dit) {
+        ff_kill_dir(*dit, rm_watch);
+    }
+
+    free(prefix);
+    array_free(doomed);
+}
+
+/* Throw out the dead entries and directories once there are a lot of them. */
+static void ff_compact(void) {
+    ff_index *old;
+    ff_dir   *dir;
+    ff_entry *e;
+    int      *it;
+    int       dir_idx;
+
+    /* Running crawls would have to be told about the new one. */
+    if (array_len(crawls) > 0) { return; }
+
+    if (file_index->n_dead < 4096 || file_index->n_dead < array_len(file_index->entries) / 2) { return; }
+
+    old   = file_index;
+    file_index = ff_index_make(old->root);
+
+    file_index->inotify_fd = old->inotify_fd;
+    file_index->watching   = old->watching;
+    file_index->stale      = old->stale;
+    file_index->generation = old->generation + 1;
+    file_index->deferred   = old->deferred;
+    old->deferred     = array_make(ff_event);
+    old->inotify_fd   = -1;
+
+    array_traverse(old->dirs, dir) {
+        if (dir->dead) { continue; }
+
+        dir_idx = ff_add_dir(dir->path, dir->wd);
+
+        array_traverse(dir->files, it) {
+            e = array_item(old->entries, *it);
+            ff_add_file(dir_idx, (char*)array_data(old->arena) + e->off + e->base);
+        }
+    }
+
+    ff_index_free(old);
+}
+
+
+/*
+ * Crawling.
+ */
+
+static void ff_found_dir_free(ff_found_dir *found) {
+    char **it;
+
+    array_traverse(found->names, it) {
+        free(*it);
+    }
+    array_free(found->names);
+    free(found->path);
+}
+
+static int ff_crawl_cancelled(ff_crawl *c) {
+    return __atomic_load_n(&c->cancelled, __ATOMIC_ACQUIRE);
+}
+
+static int ff_crawl_next_dir(ff_crawl *c, yed_job *job, char **path) {
+    struct timespec ts;
+
+    pthread_mutex_lock(&c->mtx);
+
+    for (;;) {
+        /* The plugin's jobs get cancelled when it is unloaded. */
+        if (yed_job_is_cancelled(job)) {
+            __atomic_store_n(&c->cancelled, 1, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&c->cond);
+        }
+
+        if (ff_crawl_cancelled(c)) { break; }
+
+        if (array_len(c->dirs) > 0) {
+            *path      = *(char**)array_last(c->dirs);
+            array_pop(c->dirs);
+            c->n_busy += 1;
+            pthread_mutex_unlock(&c->mtx);
+            return 1;
+        }
+
+        if (c->n_busy == 0) { break; }
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += FF_WAIT_MS * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec  += 1;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&c->cond, &c->mtx, &ts);
+    }
+
+    pthread_mutex_unlock(&c->mtx);
+
+    return 0;
+}
+
+static void ff_crawl_dir_done(ff_crawl *c) {
+    pthread_mutex_lock(&c->mtx);
+    c->n_busy -= 1;
+    if (c->n_busy == 0 && array_len(c->dirs) == 0) {
+        pthread_cond_broadcast(&c->cond);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+static void ff_crawl_dir(ff_crawl *c, char *path) {
+    ff_found_dir    found;
+    char            abs_path[PATH_MAX];
+    char            child[PATH_MAX];
+    char           *copy;
+    int             fd;
+    DIR            *dp;
+    struct dirent  *ent;
+    struct stat     st;
+    int             is_dir;
+    array_t         subdirs;
+    int             was_empty;
+
+    fd = openat(c->root_fd, *path ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) { return; }
+
+    if ((dp = fdopendir(fd)) == NULL) {
+        close(fd);
+        return;
+    }
+
+    found.wd = -1;
+
+#ifdef FF_HAVE_INOTIFY
+    /* Watch before reading so that nothing made in between is missed. */
+    if (c->inotify_fd != -1) {
+        snprintf(abs_path, sizeof(abs_path), "%s%s%s", c->root, *path ? "/" : "", path);
+        found.wd = inotify_add_watch(c->inotify_fd, abs_path, FF_WATCH_MASK);
+        if (found.wd == -1) {
+            __atomic_store_n(&c->watch_failed, 1, __ATOMIC_RELEASE);
+        }
+    }
+#else
+    (void)abs_path;
+#endif
+
+    found.path  = strdup(path);
+    found.names = array_make(char*);
+    subdirs     = array_make(char*);
+
+    while (!ff_crawl_cancelled(c) && (ent = readdir(dp)) != NULL) {
+        if (strcmp(ent->d_name, ".")    == 0
+        ||  strcmp(ent->d_name, "..")   == 0
+        ||  strcmp(ent->d_name, ".git") == 0) {
+            continue;
+        }
+
+        if (ent->d_type == DT_DIR) {
+            is_dir = 1;
+        } else if (ent->d_type == DT_REG) {
+            is_dir = 0;
+        } else if (ent->d_type == DT_UNKNOWN) {
+            if (fstatat(fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) { continue; }
+            if      (S_ISDIR(st.st_mode)) { is_dir = 1; }
+            else if (S_ISREG(st.st_mode)) { is_dir = 0; }
+            else                          { continue;   }
+        } else {
+            /* Like find -type f, symbolic links aren't followed or listed. */
+            continue;
+        }
+
+        if (is_dir) {
+            if (snprintf(child, sizeof(child), "%s%s%s", path, *path ? "/" : "", ent->d_name) >= (int)sizeof(child)) {
+                continue;
+            }
+            copy = strdup(child);
+            array_push(subdirs, copy);
+        } else {
+            copy = strdup(ent->d_name);
+            array_push(found.names, copy);
+        }
+    }
+
+    closedir(dp);
+
+    if (array_len(subdirs) > 0) {
+        pthread_mutex_lock(&c->mtx);
+        array_push_n(c->dirs, array_data(subdirs), array_len(subdirs));
+        pthread_cond_broadcast(&c->cond);
+        pthread_mutex_unlock(&c->mtx);
+    }
+    array_free(subdirs);
+
+    pthread_mutex_lock(&c->found_mtx);
+    was_empty = array_len(c->found) == 0;
+    array_push(c->found, found);
+    pthread_mutex_unlock(&c->found_mtx);
+
+    if (was_empty) {
+        yed_wake();
+    }
+}
+
+static void ff_crawl_work(yed_job *job, void *arg) {
+    ff_crawl *c;
+    char     *path;
+
+    c = arg;
+
+    while (ff_crawl_next_dir(c, job, &path)) {
+        ff_crawl_dir(c, path);
+        free(path);
+        ff_crawl_dir_done(c);
+    }
+}
+
+/* Main thread. Put whatever the crawl has found so far in the index. */
+static void ff_crawl_merge(ff_crawl *c) {
+    array_t       found;
+    ff_found_dir *fit;
+    char        **nit;
+    ff_dir       *dir;
+    int           dir_idx;
+
+    pthread_mutex_lock(&c->found_mtx);
+    found    = c->found;
+    c->found = array_make(ff_found_dir);
+    pthread_mutex_unlock(&c->found_mtx);
+
+    if (c->index == file_index && !ff_crawl_cancelled(c)) {
+        array_traverse(found, fit) {
+            if ((dir_idx = ff_find_dir(fit->path)) == -1) {
+                dir_idx = ff_add_dir(fit->path, fit->wd);
+                array_traverse(fit->names, nit) {
+                    ff_add_file(dir_idx, *nit);
+                }
+            } else {
+                /* We crawled it already and have been watching it since. */
+                dir = array_item(file_index->dirs, dir_idx);
+                array_traverse(fit->names, nit) {
+                    if (ff_dir_file(dir, *nit) == -1) {
+                        ff_add_file(dir_idx, *nit);
+                        dir = array_item(file_index->dirs, dir_idx);
+                    }
+                }
+            }
+        }
+
+        if (array_len(found) > 0) {
+            ff_index_changed();
+        }
+    }
+
+    array_traverse(found, fit) {
+        ff_found_dir_free(fit);
+    }
+    array_free(found);
+}
+
+static void ff_crawl_free(ff_crawl *c) {
+    char         **it;
+    ff_found_dir  *fit;
+
+    array_traverse(c->dirs, it) {
+        free(*it);
+    }
+    array_traverse(c->found, fit) {
+        ff_found_dir_free(fit);
+    }
+
+    array_free(c->dirs);
+    array_free(c->found);
+    array_free(c->jobs);
+
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->mtx);
+    pthread_mutex_destroy(&c->found_mtx);
+
+    if (c->root_fd != -1) {
+        close(c->root_fd);
+    }
+    if (c->inotify_fd != -1) {
+        close(c->inotify_fd);
+    }
+
+    free(c->root);
+    free(c);
+}
+
+static void ff_replay_deferred(void);
+static void ff_run(char *query);
+
+static void ff_crawl_job_done(yed_job *job, void *arg) {
+    ff_crawl  *c;
+    yed_job  **it;
+    ff_crawl **cit;
+    int        cancelled;
+    char      *query;
+    int        i;
+
+    c = arg;
+
+    i = 0;
+    array_traverse(c->jobs, it) {
+        if (*it == job) {
+            array_delete(c->jobs, i);
+            break;
+        }
+        i += 1;
+    }
+
+    c->n_jobs -= 1;
+
+    if (c->n_jobs > 0) { return; }
+
+    ff_crawl_merge(c);
+
+    if (c->index == file_index && !ff_crawl_cancelled(c) && c->watch_failed) {
+        /* Probably out of watches. We'll have to crawl again next time. */
+        file_index->watching = 0;
+    }
+
+    i = 0;
+    array_traverse(crawls, cit) {
+        if (*cit == c) {
+            array_delete(crawls, i);
+            break;
+        }
+        i += 1;
+    }
+
+    cancelled = ff_crawl_cancelled(c);
+
+    ff_crawl_free(c);
+
+    if (cancelled) { return; }
+
+    ff_replay_deferred();
+
+    if (array_len(crawls) == 0 && select_when_done && last_query != NULL) {
+        select_when_done = 0;
+        query            = strdup(last_query);
+        ff_run(query);
+        free(query);
+        find_file_select_if_one();
+    }
+}
+
+static void ff_crawl_start(const char *path) {
+    ff_crawl *c;
+    char     *copy;
+    yed_job  *job;
+    int       i;
+
+    c = calloc(1, sizeof(*c));
+
+    c->index      = file_index;
+    c->root       = strdup(file_index->root);
+    c->root_fd    = open(file_index->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    c->inotify_fd = -1;
+    /*
+     * Our own descriptor for the same inotify instance: a cancelled crawl
+     * can still be adding watches after the index has closed its own.
+     */
+    if (file_index->inotify_fd != -1) {
+        c->inotify_fd = fcntl(file_index->inotify_fd, F_DUPFD_CLOEXEC, 0);
+        if (c->inotify_fd == -1) {
+            c->watch_failed = 1;
+        }
+    }
+    c->dirs       = array_make(char*);
+    c->found      = array_make(ff_found_dir);
+    c->jobs       = array_make(yed_job*);
+
+    pthread_mutex_init(&c->mtx, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    pthread_mutex_init(&c->found_mtx, NULL);
+
+    if (c->root_fd != -1) {
+        copy = strdup(path);
+        array_push(c->dirs, copy);
+    }
+
+    array_push(crawls, c);
+
+    c->n_jobs = yed_n_job_workers();
+
+    for (i = 0; i < c->n_jobs; i += 1) {
+        job = yed_plugin_submit_job(Self, ff_crawl_work, ff_crawl_job_done, c);
+        array_push(c->jobs, job);
+    }
+}
+
+static void ff_cancel_crawls(void) {
+    ff_crawl **cit;
+    yed_job  **jit;
+
+    array_traverse(crawls, cit) {
+        __atomic_store_n(&(*cit)->cancelled, 1, __ATOMIC_RELEASE);
+
+        pthread_mutex_lock(&(*cit)->mtx);
+        pthread_cond_broadcast(&(*cit)->cond);
+        pthread_mutex_unlock(&(*cit)->mtx);
+
+        array_traverse((*cit)->jobs, jit) {
+            yed_cancel_job(*jit);
+        }
+    }
+}
+
+
+/*
+ * Watching.
+ */
+
+#ifdef FF_HAVE_INOTIFY
+
+static int ff_handle_event(int wd, int mask, const char *name) {
+    ff_dir *dir;
+    int     dir_idx;
+    char    path[PATH_MAX];
+    struct stat st;
+
+    if (mask & IN_Q_OVERFLOW) {
+        file_index->stale = 1;
+        return 1;
+    }
+
+    if ((dir_idx = ff_wd_dir(wd)) == -1) {
+        /* A crawl hasn't told us about this directory yet. */
+        return array_len(crawls) == 0 || (mask & IN_IGNORED);
+    }
+
+    dir = array_item(file_index->dirs, dir_idx);
+
+    if (mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        if (*dir->path == 0) { file_index->stale = 1; }
+        return 1;
+    }
+
+    if (mask & IN_IGNORED) {
+        ff_set_wd_dir(wd, -1);
+        dir->wd = -1;
+        return 1;
+    }
+
+    if (name == NULL || *name == 0 || strcmp(name, ".git") == 0) { return 1; }
+
+    if (snprintf(path, sizeof(path), "%s%s%s", dir->path, *dir->path ? "/" : "", name) >= (int)sizeof(path)) {
+        return 1;
+    }
+
+    if (mask & IN_ISDIR) {
+        if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+            ff_kill_tree(path, !!(mask & IN_MOVED_FROM));
+            ff_index_changed();
+        } else if (mask & (IN_CREATE | IN_MOVED_TO)) {
+            ff_crawl_start(path);
+        }
+    } else if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        ff_remove_file(dir_idx, name);
+        ff_index_changed();
+    } else if (mask & (IN_CREATE | IN_MOVED_TO)) {
+        snprintf(path, sizeof(path), "%s/%s%s%s", file_index->root, dir->path, *dir->path ? "/" : "", name);
+        if (lstat(path, &st) == 0
+        &&  S_ISREG(st.st_mode)
+        &&  ff_dir_file(dir, name) == -1) {
+            ff_add_file(dir_idx, name);
+            ff_index_changed();
+        }
+    }
+
+    return 1;
+}
+
+static void ff_defer_event(int wd, int mask, const char *name) {
+    ff_event ev;
+
+    ev.wd   = wd;
+    ev.mask = mask;
+    ev.name = strdup(name == NULL ? "" : name);
+
+    array_push(file_index->deferred, ev);
+}
+
+static void ff_replay_deferred(void) {
+    array_t   deferred;
+    ff_event *ev;
+
+    if (array_len(file_index->deferred) == 0) { return; }
+
+    deferred        = file_index->deferred;
+    file_index->deferred = array_make(ff_event);
+
+    array_traverse(deferred, ev) {
+        if (file_index != NULL && !ff_handle_event(ev->wd, ev->mask, ev->name)) {
+            ff_defer_event(ev->wd, ev->mask, ev->name);
+        }
+        free(ev->name);
+    }
+
+    array_free(deferred);
+}
+
+static void ff_inotify_handler(int fd, int revents, void *arg) {
+    char                        buff[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    ff_crawl                  **cit;
+    int                         n;
+    int                         i;
+
+    /* So that events for directories being crawled right now can be placed. */
+    array_traverse(crawls, cit) {
+        ff_crawl_merge(*cit);
+    }
+
+    while ((n = read(fd, buff, sizeof(buff))) > 0) {
+        for (i = 0; i < n; i += sizeof(*ev) + ev->len) {
+            ev = (const struct inotify_event*)(buff + i);
+
+            if (!ff_handle_event(ev->wd, ev->mask, ev->len ? ev->name : NULL)) {
+                ff_defer_event(ev->wd, ev->mask, ev->len ? ev->name : NULL);
+            }
+        }
+    }
+
+    ff_compact();
+}
+
+#else
+
+static void ff_replay_deferred(void) {}
+
+#endif
+
+/* Returns 0 if we can't index the current directory. */
+static int ff_index_start(void) {
+    char cwd[PATH_MAX];
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL) { return 0; }
+
+    if (file_index != NULL
+    &&  strcmp(file_index->root, cwd) == 0
+    &&  !file_index->stale
+    &&  (file_index->watching || array_len(crawls) > 0)) {
+        return 1;
+    }
+
+    ff_cancel_crawls();
+
+    if (file_index != NULL) {
+        ff_index_free(file_index);
+    }
+
+    file_index = ff_index_make(cwd);
+
+#ifdef FF_HAVE_INOTIFY
+    file_index->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (file_index->inotify_fd != -1) {
+        file_index->watching = 1;
+        yed_add_fd(file_index->inotify_fd, POLLIN, ff_inotify_handler, NULL);
+    }
+#endif
+
+    if (last_query != NULL) {
+        free(last_query);
+        last_query = NULL;
+    }
+    ff_clear_levels();
+
+    ff_crawl_start("");
+
+    return 1;
+}
+
+static void ff_write_results(array_t *results) {
+    yed_buffer *buff;
+    array_t     text;
+    ff_match   *m;
+    ff_entry   *e;
+    char        nl;
+
+    buff = get_or_make_buff();
+    text = array_make(char);
+    nl   = '\n';
+
+    array_traverse(*results, m) {
+        e = array_item(file_index->entries, m->idx);
+        if (array_len(text) > 0) {
+            array_push(text, nl);
+        }
+        array_push_n(text, (char*)array_data(file_index->arena) + e->off, e->len);
+    }
+
+    find_file_clear();
+    yed_buff_append_output(buff, array_data(text), array_len(text));
+
+    array_free(text);
+}
+
+static void ff_run(char *query) {
+    array_t results;
+
+    dirty       = 0;
+    last_run_ms = measure_time_now_ms();
+
+    if (strlen(query) == 0) {
+        find_file_clear();
+        return;
+    }
+
+    results = array_make(ff_match);
+
+    ff_query(query, &results);
+    ff_write_results(&results);
+
+    array_free(results);
+}
+
+static void ff_refresh_timer_fn(int id, void *arg) {
+    /* The pump that this causes does the refresh. */
+    refresh_timer = 0;
+}
+
+void find_file_pre_pump_handler(yed_event *event) {
+    ff_crawl           **cit;
+    unsigned long long   now;
+
+    if (file_index == NULL) { return; }
+
+    array_traverse(crawls, cit) {
+        ff_crawl_merge(*cit);
+    }
+
+    ff_replay_deferred();
+
+    /* Refine the list as the index fills in, but not on every pump. */
+    if (dirty
+    &&  ys->interactive_command != NULL
+    &&  strcmp(ys->interactive_command, "find-file") == 0
+    &&  prg == NULL) {
+        now = measure_time_now_ms();
+        if (now - last_run_ms >= FF_REFRESH_MS) {
+            array_zero_term(ys->cmd_buff);
+            ff_run(array_data(ys->cmd_buff));
+        } else if (refresh_timer == 0) {
+            refresh_timer = yed_add_timer(FF_REFRESH_MS - (now - last_run_ms), 0, ff_refresh_timer_fn, NULL);
+        }
+    }
+}
+
+void find_file_unload(yed_plugin *self) {
+    if (file_index != NULL) {
+        ff_index_free(file_index);
+        file_index = NULL;
+    }
+    if (refresh_timer != 0) {
+        yed_remove_timer(refresh_timer);
+    }
+    if (last_query != NULL) {
+        free(last_query);
+    }
+    ff_clear_levels();
+    array_free(levels);
+    array_free(crawls);
+}
+
 void find_file_run(void) {
-    char       cmd_buff[1024];
-    char      *pattern;
-    int        len, status;
+    char              cmd_buff[1024];
+    char             *pattern;
+    int               len;
+    yed_subproc_opts  opts;
 
-    get_or_make_buff()->flags &= ~BUFF_RD_ONLY;
+    if (subproc != NULL) {
+        yed_kill_subproc(subproc);
+        subproc = NULL;
+    }
+
+    select_when_done = 0;
 
     cmd_buff[0] = 0;
     pattern     = array_data(ys->cmd_buff);
 
+    if (prg == NULL) {
+        ff_run(pattern);
+        return;
+    }
+
     if (strlen(pattern) == 0)     { goto empty; }
 
     len = perc_subst(prg, pattern, cmd_buff, sizeof(cmd_buff));
@@ -138,16 +1572,16 @@ void find_file_run(void) {
 
     strcat(cmd_buff, " 2>/dev/null");
 
-    if (yed_read_subproc_into_buffer(cmd_buff, get_or_make_buff(), &status) != 0) {
-        goto empty;
-    }
+    memset(&opts, 0, sizeof(opts));
+    opts.out_buffer = get_or_make_buff();
+    opts.on_exit    = find_file_on_exit;
 
-    if (status != 0) {
+    subproc = yed_plugin_start_subproc(Self, cmd_buff, &opts);
+
+    if (subproc == NULL) {
 empty:;
-        yed_buff_clear_no_undo(get_or_make_buff());
+        find_file_clear();
     }
-
-    get_or_make_buff()->flags |= BUFF_RD_ONLY;
 }
 
 void find_file_select(void) {
@@ -1,6 +1,8 @@
 #include <yed/plugin.h>
+#include <fnmatch.h>
 
 void grep(int n_args, char **args);
+void grep_bench(int n_args, char **args);
 void grep_start(void);
 void grep_cleanup(void);
 void grep_take_key(int key);
@@ -8,6 +10,8 @@ void grep_run(void);
 void grep_select(void);
 
 void grep_key_pressed_handler(yed_event *event);
+void grep_pre_pump_handler(yed_event *event);
+void grep_buffer_pre_delete_handler(yed_event *event);
 
 yed_buffer *get_or_make_buff(void) {
     yed_buffer *buff;
@@ -22,23 +26,110 @@ yed_buffer *get_or_make_buff(void) {
     return buff;
 }
 
-static char *prg;
-static char *save_current_search;
+/*
+ * The built-in search.
+ *
+ * Unless 'grep-prg' is set, grep searches the current directory itself
+ * instead of running a command. One job per worker thread is submitted and
+ * they share a stack of directories: each job takes a directory, pushes its
+ * subdirectories and searches its files. Matches are gathered in chunks and
+ * handed to the main thread, which appends them to *grep-list as they come.
+ *
+ * Like grep -RHnIs, but .git, anything matched by a .gitignore or .ignore
+ * and symlinks to directories are skipped.
+ */
+
+#define GREP_CHUNK_SIZE   (16 * 1024)
+#define GREP_READ_SIZE    (256 * 1024) /* Files are read this much at a time. */
+#define GREP_BINARY_CHECK (8 * 1024)
+#define GREP_REGEX_BLOCK  (64 * 1024)
+#define GREP_LITERAL_MAX  (1 << 30)  /* yed_search_literal_next() takes an int. */
+#define GREP_WAIT_MS      (20)
+#define GREP_BENCH_PRG    "grep --exclude-dir={.git} -RHnIs '%' ."
+
+typedef struct {
+    char *glob;
+    int   negate;
+    int   dir_only;
+    int   anchored; /* Matched against the path below the ignore file's directory. */
+} grep_ignore_rule;
+
+typedef struct grep_ignore_t {
+    struct grep_ignore_t *parent;
+    char                 *dir;
+    array_t               rules;
+    int                   refs;
+} grep_ignore;
+
+typedef struct {
+    char        *path;
+    grep_ignore *ignore;
+} grep_dir;
+
+typedef struct {
+    yed_search_literal  literal;
+    int                 has_literal;
+    int                 literal_only;
+    regex_t             regex;
+    int                 regex_ok;
+    locale_t            regex_locale;
+    int                 root_fd;
+    int                 cancelled;
+
+    pthread_mutex_t     mtx;
+    pthread_cond_t      cond;
+    array_t             dirs;
+    int                 n_busy;
+
+    pthread_mutex_t     out_mtx;
+    array_t             out;
+    unsigned long long  n_bytes;
+    unsigned long long  n_files;
+
+    /* Main thread only. */
+    yed_buffer         *buff;
+    array_t             jobs;
+    int                 n_jobs;
+    int                 n_emitted;
+    int                 keep;
+} grep_search;
+
+typedef struct {
+    array_t  out;
+    char    *read_buff;
+    long     read_cap;  /* Grows for lines longer than GREP_READ_SIZE. */
+} grep_worker;
+
+static yed_plugin  *Self;
+static yed_subproc *subproc;
+static grep_search *search;
+static char        *prg;
+static char        *save_current_search;
 
 int yed_plugin_boot(yed_plugin *self) {
     yed_event_handler h;
 
     YED_PLUG_VERSION_CHECK();
 
+    Self = self;
+
     h.kind = EVENT_KEY_PRESSED;
     h.fn   = grep_key_pressed_handler;
 
     yed_plugin_add_event_handler(self, h);
-    yed_plugin_set_command(self, "grep", grep);
 
-    if (!yed_get_var("grep-prg")) {
-        yed_set_var("grep-prg", "grep --exclude-dir={.git} -RHnIs '%' .");
-    }
+    h.kind = EVENT_PRE_PUMP;
+    h.fn   = grep_pre_pump_handler;
+
+    yed_plugin_add_event_handler(self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = grep_buffer_pre_delete_handler;
+
+    yed_plugin_add_event_handler(self, h);
+
+    yed_plugin_set_command(self, "grep",       grep);
+    yed_plugin_set_command(self, "grep-bench", grep_bench);
 
     return 0;
 }
@@ -49,10 +140,6 @@ void grep(int n_args, char **args) {
 
     if (!ys->interactive_command) {
         prg = yed_get_var("grep-prg");
-        if (!prg) {
-            yed_cerr("'grep-prg' not set");
-            return;
-        }
         grep_start();
         if (n_args) {
             for (i = 0; i < strlen(args[0]); i += 1) {
@@ -110,12 +197,915 @@ void grep_take_key(int key) {
     }
 }
 
+static void grep_clear(void) {
+    get_or_make_buff()->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(get_or_make_buff());
+    get_or_make_buff()->flags |= BUFF_RD_ONLY;
+}
+
+static void grep_on_exit(yed_subproc *sp, int exit_status, void *arg) {
+    /* It was killed to make way for a newer pattern. */
+    if (sp != subproc) { return; }
+
+    subproc = NULL;
+
+    if (exit_status != 0) {
+        grep_clear();
+    }
+}
+
+static void grep_ignore_unref(grep_ignore *ignore) {
+    grep_ignore      *parent;
+    grep_ignore_rule *rule;
+
+    while (ignore != NULL
+    &&     __atomic_sub_fetch(&ignore->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        parent = ignore->parent;
+
+        array_traverse(ignore->rules, rule) {
+            free(rule->glob);
+        }
+        array_free(ignore->rules);
+        free(ignore->dir);
+        free(ignore);
+
+        ignore = parent;
+    }
+}
+
+static void grep_ignore_ref(grep_ignore *ignore) {
+    if (ignore != NULL) {
+        __atomic_add_fetch(&ignore->refs, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void grep_parse_ignore_line(grep_ignore *ignore, char *line) {
+    grep_ignore_rule  rule;
+    char             *end;
+
+    end = line + strlen(line);
+
+    while (end > line && (end[-1] == '\r' || end[-1] == ' ')) {
+        if (end[-1] == ' ' && end - 1 > line && end[-2] == '\\') { break; }
+        end -= 1;
+    }
+    *end = 0;
+
+    if (*line == 0 || *line == '#') { return; }
+
+    memset(&rule, 0, sizeof(rule));
+
+    if (*line == '!') {
+        rule.negate  = 1;
+        line        += 1;
+    } else if (*line == '\\' && (line[1] == '!' || line[1] == '#')) {
+        line += 1;
+    }
+
+    if (end > line && end[-1] == '/') {
+        rule.dir_only = 1;
+        end          -= 1;
+        *end          = 0;
+    }
+
+    if (strncmp(line, "**/", 3) == 0) {
+        line += 3;
+    } else if (*line == '/') {
+        rule.anchored  = 1;
+        line          += 1;
+    }
+
+    if (*line == 0) { return; }
+
+    if (strchr(line, '/') != NULL) {
+        rule.anchored = 1;
+    }
+
+    rule.glob = strdup(line);
+
+    array_push(ignore->rules, rule);
+}
+
+static void grep_read_ignore_file(grep_search *s, const char *dir, const char *name, grep_ignore *ignore) {
+    char         path[PATH_MAX];
+    struct stat  st;
+    char        *data;
+    char        *line;
+    char        *nl;
+    int          fd;
+    int          n;
+
+    snprintf(path, sizeof(path), "%s%s%s", dir, *dir ? "/" : "", name);
+
+    if ((fd = openat(s->root_fd, path, O_RDONLY | O_CLOEXEC)) == -1) { return; }
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    data = malloc(st.st_size + 1);
+    n    = read(fd, data, st.st_size);
+    close(fd);
+
+    if (n <= 0) {
+        free(data);
+        return;
+    }
+
+    data[n] = 0;
+
+    for (line = data; line != NULL; line = nl) {
+        if ((nl = strchr(line, '\n')) != NULL) {
+            *nl  = 0;
+            nl  += 1;
+        }
+        grep_parse_ignore_line(ignore, line);
+    }
+
+    free(data);
+}
+
+/* Returns a new reference. */
+static grep_ignore * grep_load_ignores(grep_search *s, grep_dir *dir) {
+    grep_ignore *ignore;
+
+    ignore         = calloc(1, sizeof(*ignore));
+    ignore->parent = dir->ignore;
+    ignore->dir    = strdup(dir->path);
+    ignore->rules  = array_make(grep_ignore_rule);
+    ignore->refs   = 1;
+
+    grep_read_ignore_file(s, dir->path, ".gitignore", ignore);
+    grep_read_ignore_file(s, dir->path, ".ignore",    ignore);
+
+    if (array_len(ignore->rules) == 0) {
+        array_free(ignore->rules);
+        free(ignore->dir);
+        free(ignore);
+
+        grep_ignore_ref(dir->ignore);
+        return dir->ignore;
+    }
+
+    grep_ignore_ref(dir->ignore);
+
+    return ignore;
+}
+
+static int grep_is_ignored(grep_ignore *ignore, const char *path, const char *name, int is_dir) {
+    const char       *rel;
+    grep_ignore_rule *rule;
+    int               i;
+
+    /* Deeper ignore files win, and later rules in a file win. */
+    for (; ignore != NULL; ignore = ignore->parent) {
+        rel = path + strlen(ignore->dir) + (*ignore->dir ? 1 : 0);
+
+        for (i = array_len(ignore->rules) - 1; i >= 0; i -= 1) {
+            rule = array_item(ignore->rules, i);
+
+            if (rule->dir_only && !is_dir) { continue; }
+
+            if (rule->anchored
+                    ? fnmatch(rule->glob, rel, FNM_PATHNAME) == 0
+                    : fnmatch(rule->glob, name, 0) == 0) {
+                return !rule->negate;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int grep_is_cancelled(grep_search *s) {
+    return __atomic_load_n(&s->cancelled, __ATOMIC_ACQUIRE);
+}
+
+static void grep_wake_workers(grep_search *s) {
+    pthread_mutex_lock(&s->mtx);
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mtx);
+}
+
+static int grep_next_dir(grep_search *s, yed_job *job, grep_dir *dir) {
+    struct timespec ts;
+
+    pthread_mutex_lock(&s->mtx);
+
+    for (;;) {
+        /* The plugin's jobs get cancelled when it is unloaded. */
+        if (yed_job_is_cancelled(job)) {
+            __atomic_store_n(&s->cancelled, 1, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&s->cond);
+        }
+
+        if (grep_is_cancelled(s)) { break; }
+
+        if (array_len(s->dirs) > 0) {
+            *dir       = *(grep_dir*)array_last(s->dirs);
+            array_pop(s->dirs);
+            s->n_busy += 1;
+            pthread_mutex_unlock(&s->mtx);
+            return 1;
+        }
+
+        if (s->n_busy == 0) { break; }
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += GREP_WAIT_MS * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec  += 1;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&s->cond, &s->mtx, &ts);
+    }
+
+    pthread_mutex_unlock(&s->mtx);
+
+    return 0;
+}
+
+static void grep_dir_done(grep_search *s) {
+    pthread_mutex_lock(&s->mtx);
+    s->n_busy -= 1;
+    if (s->n_busy == 0 && array_len(s->dirs) == 0) {
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->mtx);
+}
+
+static void grep_flush(grep_search *s, grep_worker *w) {
+    int was_empty;
+
+    if (array_len(w->out) == 0) { return; }
+
+    pthread_mutex_lock(&s->out_mtx);
+    was_empty = array_len(s->out) == 0;
+    array_push_n(s->out, array_data(w->out), array_len(w->out));
+    pthread_mutex_unlock(&s->out_mtx);
+
+    array_clear(w->out);
+
+    if (was_empty) {
+        yed_wake();
+    }
+}
+
+static void grep_emit(grep_search *s, grep_worker *w, const char *path, int row, const char *line, int len) {
+    char num[32];
+    int  num_len;
+    char nl;
+
+    if (len > 0 && line[len - 1] == '\r') { len -= 1; }
+
+    num_len = snprintf(num, sizeof(num), ":%d:", row);
+
+    array_push_n(w->out, (char*)path, strlen(path));
+    array_push_n(w->out, num, num_len);
+    array_push_n(w->out, (char*)line, len);
+    nl = '\n';
+    array_push(w->out, nl);
+
+    if (array_len(w->out) >= GREP_CHUNK_SIZE) {
+        grep_flush(s, w);
+    }
+}
+
+static long grep_find_literal(grep_search *s, const char *data, long len, long pos) {
+    long n;
+    int  i;
+
+    while (pos < len) {
+        n = MIN(len - pos, GREP_LITERAL_MAX);
+
+        if ((i = yed_search_literal_next(&s->literal, data + pos, n)) >= 0) {
+            return pos + i;
+        }
+
+        if (pos + n >= len) { break; }
+
+        pos += n - s->literal.len + 1;
+    }
+
+    return -1;
+}
+
+static const char * grep_last_newline(const char *data, long len) {
+    while (len > 0) {
+        len -= 1;
+        if (data[len] == '\n') { return data + len; }
+    }
+
+    return NULL;
+}
+
+static int grep_regex_match(grep_search *s, const char *data, long start, long end) {
+    regmatch_t range;
+
+    range.rm_so = start;
+    range.rm_eo = end;
+
+    return regexec(&s->regex, data, 1, &range, REG_STARTEND) == 0;
+}
+
+static long grep_line_end(const char *data, long len, long pos) {
+    const char *nl;
+
+    nl = memchr(data + pos, '\n', len - pos);
+
+    return nl == NULL ? len : nl - data;
+}
+
+/* Offset of a match, or the start of a matching line, at or after pos, or -1. */
+static long grep_find(grep_search *s, const char *data, long len, long pos) {
+    const char *nl;
+    long        start;
+    long        end;
+    long        match;
+
+    if (s->literal_only) {
+        return grep_find_literal(s, data, len, pos);
+    }
+
+    if (s->has_literal) {
+        /* Only lines with the literal in them can match. */
+        while ((match = grep_find_literal(s, data, len, pos)) != -1) {
+            nl    = grep_last_newline(data + pos, match - pos);
+            start = nl == NULL ? pos : (nl - data) + 1;
+            end   = grep_line_end(data, len, match);
+
+            if (grep_regex_match(s, data, start, end)) {
+                return start;
+            }
+
+            pos = end + 1;
+        }
+
+        return -1;
+    }
+
+    /*
+     * Try a block of whole lines at a time and only go line by line in a
+     * block that has a match. A whole file at once would have the regex
+     * allocate state for every byte on each call.
+     */
+    while (pos < len) {
+        end = pos + GREP_REGEX_BLOCK;
+        end = end >= len ? len : grep_line_end(data, len, end);
+
+        if (grep_regex_match(s, data, pos, end)) {
+            /*
+             * An empty line at end is a real line, unless end is the end
+             * of the file: a trailing newline doesn't start another one.
+             */
+            while (pos < end || (pos == end && end < len)) {
+                start = pos;
+                pos   = grep_line_end(data, end, pos);
+
+                if (grep_regex_match(s, data, start, pos)) {
+                    return start;
+                }
+
+                pos += 1;
+            }
+        }
+
+        pos = end + 1;
+    }
+
+    return -1;
+}
+
+/*
+ * data is whole lines, the first of which is row *row. On return, *row is
+ * the row after the last one.
+ */
+static void grep_search_data(grep_search *s, grep_worker *w, const char *path, const char *data, long len, int *row_io) {
+    long        pos;
+    long        counted;
+    long        match;
+    long        start;
+    long        end;
+    const char *nl;
+    int         row;
+
+    pos     = 0;
+    counted = 0;
+    row     = *row_io;
+
+    while (pos < len && (match = grep_find(s, data, len, pos)) != -1) {
+        nl    = grep_last_newline(data + pos, match - pos);
+        start = nl == NULL ? pos : (nl - data) + 1;
+
+        while ((nl = memchr(data + counted, '\n', start - counted)) != NULL) {
+            row     += 1;
+            counted  = (nl - data) + 1;
+        }
+        counted = start;
+
+        end = grep_line_end(data, len, match);
+
+        grep_emit(s, w, path, row, data + start, end - start);
+
+        pos = end + 1;
+    }
+
+    while ((nl = memchr(data + counted, '\n', len - counted)) != NULL) {
+        row     += 1;
+        counted  = (nl - data) + 1;
+    }
+
+    *row_io = row;
+}
+
+/*
+ * Files are read in chunks of whole lines rather than mapped, so that a file
+ * that is truncated while we search it can't fault.
+ */
+static void grep_search_file(grep_search *s, grep_worker *w, const char *path) {
+    struct stat  st;
+    long         left;
+    long         len;
+    long         end;
+    long         n;
+    const char  *nl;
+    int          row;
+    int          first;
+    int          eof;
+    int          fd;
+
+    if ((fd = openat(s->root_fd, path, O_RDONLY | O_CLOEXEC)) == -1) { return; }
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    /* Don't chase a file that is growing. */
+    left  = st.st_size;
+    len   = 0;
+    row   = 1;
+    first = 1;
+    eof   = 0;
+
+    while (!eof && !grep_is_cancelled(s)) {
+        if (len == w->read_cap) {
+            w->read_cap  *= 2;
+            w->read_buff  = realloc(w->read_buff, w->read_cap);
+        }
+
+        n = read(fd, w->read_buff + len, MIN(w->read_cap - len, left));
+        if (n == -1 && errno == EINTR) { continue; }
+
+        if (n > 0) {
+            len  += n;
+            left -= n;
+        }
+
+        eof = n <= 0 || left == 0;
+
+        if (first) {
+            /* Binary files are skipped, like grep -I. */
+            if (!eof && len < GREP_BINARY_CHECK) { continue; }
+            if (memchr(w->read_buff, 0, MIN(len, GREP_BINARY_CHECK)) != NULL) { break; }
+
+            __atomic_add_fetch(&s->n_files, 1, __ATOMIC_RELAXED);
+            first = 0;
+        }
+
+        if (eof) {
+            end = len;
+        } else {
+            nl = grep_last_newline(w->read_buff, len);
+            /* A line longer than the buffer. Read more of it. */
+            if (nl == NULL) { continue; }
+            end = (nl - w->read_buff) + 1;
+        }
+
+        __atomic_add_fetch(&s->n_bytes, end, __ATOMIC_RELAXED);
+
+        grep_search_data(s, w, path, w->read_buff, end, &row);
+
+        memmove(w->read_buff, w->read_buff + end, len - end);
+        len -= end;
+    }
+
+    close(fd);
+}
+
+static void grep_search_dir(grep_search *s, grep_worker *w, grep_dir *dir) {
+    grep_ignore    *ignore;
+    int             fd;
+    DIR            *dp;
+    struct dirent  *ent;
+    struct stat     st;
+    char            path[PATH_MAX];
+    char           *copy;
+    int             is_dir;
+    int             is_link;
+    array_t         files;
+    array_t         subdirs;
+    grep_dir        sub;
+    char          **it;
+    grep_dir       *dit;
+
+    fd = openat(s->root_fd, *dir->path ? dir->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) { return; }
+
+    if ((dp = fdopendir(fd)) == NULL) {
+        close(fd);
+        return;
+    }
+
+    ignore  = grep_load_ignores(s, dir);
+    files   = array_make(char*);
+    subdirs = array_make(grep_dir);
+
+    while (!grep_is_cancelled(s) && (ent = readdir(dp)) != NULL) {
+        if (strcmp(ent->d_name, ".")    == 0
+        ||  strcmp(ent->d_name, "..")   == 0
+        ||  strcmp(ent->d_name, ".git") == 0) {
+            continue;
+        }
+
+        if (snprintf(path, sizeof(path), "%s%s%s", dir->path, *dir->path ? "/" : "", ent->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+
+        if (ent->d_type == DT_DIR) {
+            is_dir = 1;
+        } else if (ent->d_type == DT_REG) {
+            is_dir = 0;
+        } else if (ent->d_type == DT_LNK || ent->d_type == DT_UNKNOWN) {
+            if (fstatat(s->root_fd, path, &st, AT_SYMLINK_NOFOLLOW) == -1) { continue; }
+
+            is_link = S_ISLNK(st.st_mode);
+
+            if (is_link && fstatat(s->root_fd, path, &st, 0) == -1) { continue; }
+
+            if (S_ISDIR(st.st_mode)) {
+                /* Following links to directories could loop. */
+                if (is_link) { continue; }
+                is_dir = 1;
+            } else if (S_ISREG(st.st_mode)) {
+                is_dir = 0;
+            } else {
+                continue;
+            }
+        } else {
+            continue;
+        }
+
+        if (grep_is_ignored(ignore, path, ent->d_name, is_dir)) { continue; }
+
+        if (is_dir) {
+            sub.path   = strdup(path);
+            sub.ignore = ignore;
+            grep_ignore_ref(ignore);
+            array_push(subdirs, sub);
+        } else {
+            copy = strdup(path);
+            array_push(files, copy);
+        }
+    }
+
+    closedir(dp);
+
+    /* Hand the subdirectories out first so that the other jobs have something to do. */
+    if (array_len(subdirs) > 0) {
+        pthread_mutex_lock(&s->mtx);
+        array_traverse(subdirs, dit) {
+            array_push(s->dirs, *dit);
+        }
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->mtx);
+    }
+
+    array_traverse(files, it) {
+        if (!grep_is_cancelled(s)) {
+            grep_search_file(s, w, *it);
+        }
+        free(*it);
+    }
+
+    array_free(subdirs);
+    array_free(files);
+    grep_ignore_unref(ignore);
+}
+
+static void grep_work(yed_job *job, void *arg) {
+    grep_search *s;
+    grep_worker  w;
+    grep_dir     dir;
+    locale_t     old_locale;
+
+    s           = arg;
+    w.out       = array_make(char);
+    w.read_cap  = GREP_READ_SIZE;
+    w.read_buff = malloc(w.read_cap);
+    old_locale  = (locale_t)0;
+
+    if (s->regex_locale != (locale_t)0) {
+        old_locale = uselocale(s->regex_locale);
+    }
+
+    while (grep_next_dir(s, job, &dir)) {
+        grep_search_dir(s, &w, &dir);
+
+        free(dir.path);
+        grep_ignore_unref(dir.ignore);
+
+        grep_flush(s, &w);
+        grep_dir_done(s);
+    }
+
+    grep_flush(s, &w);
+
+    if (old_locale != (locale_t)0) {
+        uselocale(old_locale);
+    }
+
+    free(w.read_buff);
+    array_free(w.out);
+}
+
+static void grep_drain(grep_search *s) {
+    array_t out;
+
+    pthread_mutex_lock(&s->out_mtx);
+    out    = s->out;
+    s->out = array_make(char);
+    pthread_mutex_unlock(&s->out_mtx);
+
+    /* Chunks always end in a newline, but the list shouldn't. */
+    if (array_len(out) > 0) {
+        if (s->n_emitted) {
+            yed_buff_append_output(s->buff, "\n", 1);
+        }
+        yed_buff_append_output(s->buff, array_data(out), array_len(out) - 1);
+        s->n_emitted += 1;
+    }
+
+    array_free(out);
+}
+
+static void grep_free_search(grep_search *s) {
+    grep_dir *dir;
+
+    array_traverse(s->dirs, dir) {
+        free(dir->path);
+        grep_ignore_unref(dir->ignore);
+    }
+    array_free(s->dirs);
+    array_free(s->out);
+    array_free(s->jobs);
+
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mtx);
+    pthread_mutex_destroy(&s->out_mtx);
+
+    if (s->regex_ok) {
+        regfree(&s->regex);
+    }
+    if (s->regex_locale != (locale_t)0) {
+        freelocale(s->regex_locale);
+    }
+    if (s->root_fd != -1) {
+        close(s->root_fd);
+    }
+
+    free(s->literal.str);
+    free(s);
+}
+
+static void grep_job_done(yed_job *job, void *arg) {
+    grep_search  *s;
+    yed_job     **it;
+    int           i;
+
+    s = arg;
+
+    i = 0;
+    array_traverse(s->jobs, it) {
+        if (*it == job) {
+            array_delete(s->jobs, i);
+            break;
+        }
+        i += 1;
+    }
+
+    s->n_jobs -= 1;
+
+    if (s->n_jobs > 0) { return; }
+
+    if (s == search) {
+        grep_drain(s);
+        search = NULL;
+    }
+
+    if (!s->keep) {
+        grep_free_search(s);
+    }
+}
+
+static void grep_cancel_search(grep_search *s) {
+    yed_job **it;
+
+    __atomic_store_n(&s->cancelled, 1, __ATOMIC_RELEASE);
+    grep_wake_workers(s);
+
+    array_traverse(s->jobs, it) {
+        yed_cancel_job(*it);
+    }
+}
+
+static int grep_is_ascii(const char *pattern) {
+    for (; *pattern; pattern += 1) {
+        if ((unsigned char)*pattern >= 0x80) { return 0; }
+    }
+
+    return 1;
+}
+
+static int grep_is_literal(const char *pattern) {
+    return strpbrk(pattern, "\\.[]*^$") == NULL;
+}
+
+static grep_search * grep_start_search(const char *pattern, yed_buffer *buff) {
+    grep_search *s;
+    grep_dir     root;
+    yed_job     *job;
+    char        *factor;
+    int          factor_len;
+    locale_t     old_locale;
+    int          i;
+
+    s = calloc(1, sizeof(*s));
+
+    s->literal_only = grep_is_literal(pattern);
+    s->root_fd      = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    s->dirs        = array_make(grep_dir);
+    s->out         = array_make(char);
+    s->jobs        = array_make(yed_job*);
+    s->buff        = buff;
+
+    pthread_mutex_init(&s->mtx, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    pthread_mutex_init(&s->out_mtx, NULL);
+
+    if (s->literal_only) {
+        yed_search_literal_compile(&s->literal, pattern, strlen(pattern), 0);
+        s->has_literal = 1;
+    } else {
+        /*
+         * glibc's regexec() is several times slower in a UTF-8 locale, and
+         * it makes no difference to which lines match an ASCII pattern. So
+         * those are compiled and run in the C locale.
+         */
+        if (grep_is_ascii(pattern)) {
+            s->regex_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+        }
+
+        old_locale = (locale_t)0;
+        if (s->regex_locale != (locale_t)0) {
+            old_locale = uselocale(s->regex_locale);
+        }
+
+        /* Basic regular expressions, like grep. */
+        s->regex_ok = regcomp(&s->regex, pattern, REG_NEWLINE | REG_NOSUB) == 0;
+
+        if (old_locale != (locale_t)0) {
+            uselocale(old_locale);
+        }
+
+        factor     = malloc(strlen(pattern) + 1);
+        factor_len = yed_search_regex_factor(pattern, 0, factor);
+
+        if (factor_len > 0) {
+            yed_search_literal_compile(&s->literal, factor, factor_len, 0);
+            s->has_literal = 1;
+        }
+
+        free(factor);
+    }
+
+    if (s->root_fd != -1 && (s->literal_only || s->regex_ok)) {
+        root.path   = strdup("");
+        root.ignore = NULL;
+        array_push(s->dirs, root);
+    }
+
+    s->n_jobs = yed_n_job_workers();
+
+    for (i = 0; i < s->n_jobs; i += 1) {
+        job = yed_plugin_submit_job(Self, grep_work, grep_job_done, s);
+        array_push(s->jobs, job);
+    }
+
+    return s;
+}
+
+static void grep_wait_search(grep_search *s) {
+    s->keep = 1;
+
+    while (array_len(s->jobs) > 0) {
+        yed_wait_job(*(yed_job**)array_item(s->jobs, 0));
+    }
+
+    grep_drain(s);
+}
+
+static void grep_run_native(char *pattern) {
+    grep_clear();
+
+    if (strlen(pattern) == 0) { return; }
+
+    search = grep_start_search(pattern, get_or_make_buff());
+}
+
+void grep_pre_pump_handler(yed_event *event) {
+    if (search != NULL) {
+        grep_drain(search);
+    }
+}
+
+void grep_buffer_pre_delete_handler(yed_event *event) {
+    if (search != NULL && event->buffer == search->buff) {
+        grep_cancel_search(search);
+        search = NULL;
+    }
+}
+
+void grep_bench(int n_args, char **args) {
+    yed_buffer         *buff;
+    grep_search        *s;
+    char                cmd_buff[1024];
+    unsigned long long  start;
+    unsigned long long  native_ms;
+    unsigned long long  prg_ms;
+    unsigned long long  n_bytes;
+    unsigned long long  n_files;
+    int                 native_lines;
+    int                 status;
+
+    if (n_args != 1) {
+        yed_cerr("expected 1 argument, but got %d", n_args);
+        return;
+    }
+
+    if (perc_subst(GREP_BENCH_PRG, args[0], cmd_buff, sizeof(cmd_buff)) <= 0) {
+        yed_cerr("pattern too long");
+        return;
+    }
+    strcat(cmd_buff, " 2>/dev/null");
+
+    buff = yed_get_or_create_special_rdonly_buffer("*grep-bench");
+
+    buff->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(buff);
+    buff->flags |= BUFF_RD_ONLY;
+
+    start = measure_time_now_ms();
+    s     = grep_start_search(args[0], buff);
+    grep_wait_search(s);
+
+    native_ms    = measure_time_now_ms() - start;
+    native_lines = s->n_emitted ? yed_buff_n_lines(buff) : 0;
+    n_bytes      = s->n_bytes;
+    n_files      = s->n_files;
+
+    grep_free_search(s);
+
+    start = measure_time_now_ms();
+    yed_read_subproc_into_buffer(cmd_buff, buff, &status);
+    prg_ms = measure_time_now_ms() - start;
+
+    yed_cprint("built-in: %d lines, %llu files, %.1fMB, %llums (%.1fMB/s)  grep: %d lines, %llums",
+               native_lines,
+               n_files,
+               n_bytes / (1024.0 * 1024.0),
+               native_ms,
+               n_bytes / (1024.0 * 1024.0) / (MAX(native_ms, 1) / 1000.0),
+               status == 0 ? yed_buff_n_lines(buff) : 0,
+               prg_ms);
+}
+
 void grep_run(void) {
-    char       cmd_buff[1024];
-    char      *pattern;
-    int        len, status;
+    char              cmd_buff[1024];
+    char             *pattern;
+    int               len;
+    yed_subproc_opts  opts;
 
-    get_or_make_buff()->flags &= ~BUFF_RD_ONLY;
+    /* Results for the old pattern are no good anymore. */
+    if (subproc != NULL) {
+        yed_kill_subproc(subproc);
+        subproc = NULL;
+    }
+    if (search != NULL) {
+        grep_cancel_search(search);
+        search = NULL;
+    }
 
     array_zero_term(ys->cmd_buff);
 
@@ -123,6 +1113,11 @@ void grep_run(void) {
     pattern            = array_data(ys->cmd_buff);
     ys->current_search = pattern;
 
+    if (prg == NULL) {
+        grep_run_native(pattern);
+        return;
+    }
+
     if (strlen(pattern) == 0)     { goto empty; }
 
     len = perc_subst(prg, pattern, cmd_buff, sizeof(cmd_buff));
@@ -131,16 +1126,17 @@ void grep_run(void) {
 
     strcat(cmd_buff, " 2>/dev/null");
 
-    if (yed_read_subproc_into_buffer(cmd_buff, get_or_make_buff(), &status) != 0) {
-        goto empty;
-    }
+    memset(&opts, 0, sizeof(opts));
+    opts.out_buffer = get_or_make_buff();
+    opts.on_exit    = grep_on_exit;
+
+    /* The list fills in as grep finds things, so typing never waits on it. */
+    subproc = yed_plugin_start_subproc(Self, cmd_buff, &opts);
 
-    if (status != 0) {
+    if (subproc == NULL) {
 empty:;
-        yed_buff_clear_no_undo(get_or_make_buff());
+        grep_clear();
     }
-
-    get_or_make_buff()->flags |= BUFF_RD_ONLY;
 }
 
 void grep_select(void) {
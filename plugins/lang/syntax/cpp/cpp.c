@@ -129,6 +129,7 @@ int yed_plugin_boot(yed_plugin *self) {
     line.kind = EVENT_LINE_PRE_DRAW;
     line.fn   = eline;
     yed_plugin_add_event_handler(self, line);
+    yed_set_line_draw_deps(line, LINE_DRAW_DEP_BUFFER);
 
 
     SYN();
@@ -16,6 +16,7 @@ int yed_plugin_boot(yed_plugin *self) {
     frame_pre_update.fn   = line_numbers_frame_pre_update;
 
     yed_plugin_add_event_handler(self, line);
+    yed_set_line_draw_deps(line, LINE_DRAW_DEP_LINE);
     yed_plugin_add_event_handler(self, frame_pre_update);
     yed_plugin_set_unload_fn(self, unload);
 
@@ -46,26 +47,14 @@ static int n_digits(int i) {
 static int scomp_save = -1;
 
 void line_numbers_line_handler(yed_event *event) {
-    int        n_lines;
     int        n_cols;
     char       num_buff[16];
     yed_attrs  attr;
     yed_attrs *dst;
 
-    if (event->frame->buffer == NULL
-    ||  (event->frame->buffer->name
-    &&  event->frame->buffer->name[0] == '*')) {
-
-        yed_frame_set_gutter_width(event->frame, 0);
-        return;
-    }
+    n_cols = event->frame->gutter_width;
 
-    n_lines = yed_buff_n_lines(event->frame->buffer);
-    n_cols  = n_digits(n_lines) + 2;
-
-    if (event->frame->gutter_width != n_cols) {
-        yed_frame_set_gutter_width(event->frame, n_cols);
-    }
+    if (n_cols <= 2) { return; }
 
     snprintf(num_buff, sizeof(num_buff),
              " %*d ", n_cols - 2, event->row);
@@ -80,14 +69,28 @@ void line_numbers_line_handler(yed_event *event) {
     }
 }
 
+/*
+ * The gutter width is set here rather than in the line handler so that
+ * it is up to date even when the frame doesn't need to redraw any lines.
+ */
 void line_numbers_frame_pre_update(yed_event *event) {
     int scomp;
+    int n_cols;
 
     scomp = yed_scomp_nr_by_name(yed_get_var("line-number-scomp"));
     scomp_save = scomp;
 
-    if (event->frame->buffer == NULL) {
-        yed_frame_set_gutter_width(event->frame, 0);
+    if (event->frame->buffer == NULL
+    ||  (event->frame->buffer->name
+    &&  event->frame->buffer->name[0] == '*')) {
+
+        n_cols = 0;
+    } else {
+        n_cols = n_digits(yed_buff_n_lines(event->frame->buffer)) + 2;
+    }
+
+    if (event->frame->gutter_width != n_cols) {
+        yed_frame_set_gutter_width(event->frame, n_cols);
     }
 }
 
@@ -18,7 +18,7 @@ array_t            keys;
 int                playback_idx;
 int                blink_count;
 yed_direct_draw_t *blink_dd;
-u64                blink_start_time;
+int                blink_timer;
 int                play_count;
 int                has_played_count;
 int                key_pressed_is_playback;
@@ -30,6 +30,7 @@ void macro_rec_key_handler(yed_event *event);
 void macro_play_key_handler(yed_event *event);
 void macro_pump_rec_handler(yed_event *event);
 void macro_pump_play_handler(yed_event *event);
+void macro_blink_timer(int id, void *arg);
 
 void macro_unload(yed_plugin *self);
 
@@ -72,6 +73,7 @@ void macro_rec_key_handler(yed_event *event) {
     if (event->key == stop_key) {
         yed_delete_event_handler(rec_key_handler);
         yed_delete_event_handler(pump_rec_handler);
+        yed_remove_timer(blink_timer);
         if (blink_dd != NULL) {
             yed_kill_direct_draw(blink_dd);
             blink_dd = NULL;
@@ -99,6 +101,7 @@ void macro_play_key_handler(yed_event *event) {
 
         yed_delete_event_handler(pump_play_handler);
         yed_delete_event_handler(play_key_handler);
+        yed_remove_timer(blink_timer);
 LOG_CMD_ENTER("macro-play");
         yed_cprint("finished playing back macro");
 LOG_EXIT();
@@ -107,8 +110,11 @@ LOG_EXIT();
     event->cancel = 1;
 }
 
+void macro_blink_timer(int id, void *arg) {
+    blink_count += 1;
+}
+
 void macro_pump_rec_handler(yed_event *event) {
-    u64       now;
     yed_attrs attrs;
     char      buff[64];
 
@@ -117,13 +123,6 @@ void macro_pump_rec_handler(yed_event *event) {
         blink_dd = NULL;
     }
 
-    now = measure_time_now_ms();
-
-    if (now - blink_start_time > 1000) {
-        blink_start_time = now;
-        blink_count += 1;
-    }
-
     if (blink_count % 2 == 0) {
         snprintf(buff, sizeof(buff), " macro recording    %s to stop ", stop_key_str);
         attrs        = yed_active_style_get_attention();
@@ -146,7 +145,6 @@ void macro_play_key_seq(key_seq_t *seq) {
 }
 
 void macro_pump_play_handler(yed_event *event) {
-    u64       now;
     yed_attrs attrs;
 
     if (blink_dd != NULL) {
@@ -154,8 +152,6 @@ void macro_pump_play_handler(yed_event *event) {
         blink_dd = NULL;
     }
 
-    now = measure_time_now_ms();
-
     if (blink_count % 2 == 0) {
         attrs        = yed_active_style_get_associate();
         attrs.flags |= ATTR_INVERSE;
@@ -163,11 +159,6 @@ void macro_pump_play_handler(yed_event *event) {
                                        " playing back macro    ctrl-c to cancel ");
     }
 
-    if (now - blink_start_time > 1000) {
-        blink_start_time = now;
-        blink_count += 1;
-    }
-
     if (playback_idx == array_len(keys)) {
         has_played_count += 1;
         if (has_played_count == play_count) {
@@ -178,6 +169,7 @@ void macro_pump_play_handler(yed_event *event) {
 
             yed_delete_event_handler(pump_play_handler);
             yed_delete_event_handler(play_key_handler);
+            yed_remove_timer(blink_timer);
 LOG_CMD_ENTER("macro-play");
             yed_cprint("finished playing back macro");
 LOG_EXIT();
@@ -188,6 +180,9 @@ LOG_EXIT();
         macro_play_key_seq(array_item(keys, playback_idx));
         playback_idx += 1;
     }
+
+    /* Keep pumping until the playback is done. */
+    yed_wake();
 }
 
 void macro_record(int n_args, char **args) {
@@ -250,7 +245,7 @@ void macro_record(int n_args, char **args) {
     stop_key_str = strdup(key_str);
     is_recording = 1;
     blink_count  = 0;
-    blink_start_time = measure_time_now_ms();
+    blink_timer  = yed_plugin_add_timer(Self, 1000, 1, macro_blink_timer, NULL);
     array_clear(keys);
     yed_plugin_add_event_handler(Self, rec_key_handler);
     yed_plugin_add_event_handler(Self, pump_rec_handler);
@@ -300,6 +295,7 @@ void macro_play(int n_args, char **args) {
     } else {
         playback_idx     = 0;
         has_played_count = 0;
+        blink_timer      = yed_plugin_add_timer(Self, 1000, 1, macro_blink_timer, NULL);
         yed_plugin_add_event_handler(Self, pump_play_handler);
         yed_plugin_add_event_handler(Self, play_key_handler);
     }
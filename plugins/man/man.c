@@ -67,6 +67,7 @@ int yed_plugin_boot(yed_plugin *self) {
     h.kind = EVENT_LINE_PRE_DRAW;
     h.fn   = man_line_handler;
     yed_plugin_add_event_handler(self, h);
+    yed_set_line_draw_deps(h, LINE_DRAW_DEP_BUFFER);
 
     h.kind = EVENT_STYLE_CHANGE;
     h.fn   = estyle;
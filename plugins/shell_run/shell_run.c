@@ -1,14 +1,12 @@
 #include <yed/plugin.h>
 
-static yed_event_handler  pump_handler;
-static int                cmd_is_running;
-static yed_nb_subproc_t   nb_subproc;
+static yed_plugin        *Self;
+static yed_subproc       *subproc;
 static char              *cmd_string;
 
 static yed_buffer * get_or_make_buffer(void);
 
 static void shell_run_unload(yed_plugin *self);
-static void shell_run_pump_handler(yed_event *event);
 
 static void shell_run(int n_args, char **args);
 static void shell_run_silent(int n_args, char **args);
@@ -17,17 +15,14 @@ static void shell_view_output(int n_args, char **args);
 int yed_plugin_boot(yed_plugin *self) {
     YED_PLUG_VERSION_CHECK();
 
+    Self = self;
+
     get_or_make_buffer();
 
     yed_plugin_set_command(self, "shell-run",         shell_run);
     yed_plugin_set_command(self, "shell-run-silent",  shell_run_silent);
     yed_plugin_set_command(self, "shell-view-output", shell_view_output);
 
-    pump_handler.kind = EVENT_PRE_PUMP;
-    pump_handler.fn   = shell_run_pump_handler;
-
-    yed_plugin_add_event_handler(self, pump_handler);
-
     yed_plugin_set_unload_fn(self, shell_run_unload);
 
     return 0;
@@ -59,28 +54,10 @@ static void shell_run_unload(yed_plugin *self) {
     }
 }
 
-static void shell_run_update(void) {
+static void shell_run_follow_output(void) {
     yed_frame **fit;
     int         last_row;
 
-LOG_CMD_ENTER("shell-run");
-
-    get_or_make_buffer()->flags &= ~BUFF_RD_ONLY;
-    cmd_is_running = yed_read_subproc_into_buffer_nb(&nb_subproc);
-    get_or_make_buffer()->flags |= BUFF_RD_ONLY;
-
-    if (!cmd_is_running) {
-        if (nb_subproc.err) {
-            yed_cerr("something went wrong -- errno = %d\n", nb_subproc.err);
-        } else {
-            if (nb_subproc.exit_status != 0) {
-                yed_cerr("'%s' failed with error code %d", cmd_string, nb_subproc.exit_status);
-            }
-        }
-        free(cmd_string);
-        cmd_string = NULL;
-    }
-
     array_traverse(ys->frames, fit) {
         if (*fit == ys->active_frame) { continue; }
         if ((*fit)->buffer == get_or_make_buffer()) {
@@ -88,21 +65,36 @@ LOG_CMD_ENTER("shell-run");
             yed_set_cursor_far_within_frame(*fit, last_row, 1);
         }
     }
+}
 
-LOG_EXIT();
+static void shell_run_on_data(yed_subproc *sp, const char *data, int len, void *arg) {
+    shell_run_follow_output();
 }
 
-static void shell_run_pump_handler(yed_event *event) {
-    if (cmd_is_running) {
-        shell_run_update();
+static void shell_run_on_exit(yed_subproc *sp, int exit_status, void *arg) {
+LOG_CMD_ENTER("shell-run");
+
+    if (sp->err) {
+        yed_cerr("something went wrong -- errno = %d\n", sp->err);
+    } else if (exit_status != 0) {
+        yed_cerr("'%s' failed with error code %d", cmd_string, exit_status);
     }
+
+    free(cmd_string);
+    cmd_string = NULL;
+    subproc    = NULL;
+
+    shell_run_follow_output();
+
+LOG_EXIT();
 }
 
 static void do_shell_run(int n_args, char **args) {
-    array_t     string_build;
-    const char *lazy_space;
-    int         i;
-    char       *full_cmd;
+    array_t           string_build;
+    const char       *lazy_space;
+    int               i;
+    char             *full_cmd;
+    yed_subproc_opts  opts;
 
     string_build = array_make(char);
 
@@ -120,36 +112,26 @@ static void do_shell_run(int n_args, char **args) {
              "(%s) 2>&1", (char*)array_data(string_build));
 
 
-    get_or_make_buffer()->flags &= ~BUFF_RD_ONLY;
+    memset(&opts, 0, sizeof(opts));
+    opts.out_buffer = get_or_make_buffer();
+    opts.on_data    = shell_run_on_data;
+    opts.on_exit    = shell_run_on_exit;
 
-    if (yed_start_read_subproc_into_buffer_nb(full_cmd, get_or_make_buffer(), &nb_subproc)) {
-        get_or_make_buffer()->flags |= BUFF_RD_ONLY;
+    subproc = yed_plugin_start_subproc(Self, full_cmd, &opts);
 
-        yed_cerr("there was an error when calling yed_start_read_subproc_into_buffer_nb()");
-        free(full_cmd);
+    free(full_cmd);
+
+    if (subproc == NULL) {
+        yed_cerr("couldn't start the command -- errno = %d", errno);
         array_free(string_build);
         return;
     }
 
-    get_or_make_buffer()->flags |= BUFF_RD_ONLY;
-
-    free(full_cmd);
-
-    cmd_string      = array_data(string_build);
-    cmd_is_running  = 1;
-
-    /*
-    ** Wait 15 milliseconds so that the subprocess has time to start and
-    ** do _something_.
-    ** This makes it so that we can start to produce output before the next
-    ** pump (which could be ~300 ms if there aren't any keypresses).
-    */
-    usleep(15000);
-    shell_run_update();
+    cmd_string = array_data(string_build);
 }
 
 static void shell_run(int n_args, char **args) {
-    if (cmd_is_running) {
+    if (subproc != NULL) {
         yed_cerr("a command is already running!");
         return;
     }
@@ -166,7 +148,7 @@ static void shell_run(int n_args, char **args) {
 }
 
 static void shell_run_silent(int n_args, char **args) {
-    if (cmd_is_running) {
+    if (subproc != NULL) {
         yed_cerr("a command is already running!");
         return;
     }
@@ -176,10 +176,12 @@ int yed_plugin_boot(yed_plugin *self) {
     h_line.kind = EVENT_LINE_PRE_DRAW;
     h_line.fn   = line_handler;
     yed_plugin_add_event_handler(self, h_line);
+    yed_set_line_draw_deps(h_line, LINE_DRAW_DEP_BUFFER);
 
     h_row.kind = EVENT_ROW_PRE_CLEAR;
     h_row.fn   = row_handler;
     yed_plugin_add_event_handler(self, h_row);
+    yed_set_line_draw_deps(h_row, LINE_DRAW_DEP_BUFFER);
 
     h_cur_pre.kind = EVENT_CURSOR_PRE_MOVE;
     h_cur_pre.fn   = cursor_pre_move_handler;
@@ -1439,13 +1441,6 @@ try:;
             goto out;
         }
         task_running = 1;
-        /*
-        ** Wait 15 milliseconds so that the subprocess has time to start and
-        ** do _something_.
-        ** This makes it so that we can start to produce output before the next
-        ** pump (which could be ~300 ms if there aren't any keypresses).
-        */
-        usleep(15000);
         goto try;
     }
 
@@ -1707,6 +1702,14 @@ static void pre_mod_handler(yed_event *event) {
             event->cancel = 1;
         }
     }
+
+    if (event->buff_mod_event == BUFF_MOD_BATCH) {
+        if (event->row != 15
+        ||  event->buff_change->n_old_rows != 1
+        ||  event->buff_change->n_new_rows != 1) {
+            event->cancel = 1;
+        }
+    }
 }
 
 static void post_mod_handler(yed_event *event) {
@@ -248,6 +248,110 @@ void yed_get_attr_str(yed_attrs attr, char *buff_p) {
     *buff_p = 0;
 }
 
+/*
+ * Writes the SGR parameter that selects the foreground (or background, if bg
+ * is set) color of attr to buff_p and returns its length. Returns 0 if attr
+ * uses the terminal's default color.
+ */
+static int attr_color_param(yed_attrs attr, int bg, char *buff_p) {
+    char     *start;
+    uint32_t  c;
+
+    start = buff_p;
+    c     = bg ? attr.bg : attr.fg;
+
+    if (c == 0) { return 0; }
+
+    if (attr.flags & ATTR_16) {
+        if (attr.flags & (bg ? ATTR_16_LIGHT_BG : ATTR_16_LIGHT_FG)) {
+            c += 60;
+        }
+        BUFFCAT(buff_p, u8_to_s(bg ? 10 + c : c));
+    } else if (attr.flags & ATTR_256) {
+        LIMIT(c, 0, 255);
+        BUFFCATN(buff_p, bg ? "48;5;" : "38;5;", 5);
+        BUFFCAT(buff_p, u8_to_s(c));
+    } else if (attr.flags & ATTR_RGB) {
+        BUFFCATN(buff_p, bg ? "48;2;" : "38;2;", 5);
+        BUFFCAT(buff_p, u8_to_s(RGB_32_r(c)));
+        BUFFCATN(buff_p, ";", 1);
+        BUFFCAT(buff_p, u8_to_s(RGB_32_g(c)));
+        BUFFCATN(buff_p, ";", 1);
+        BUFFCAT(buff_p, u8_to_s(RGB_32_b(c)));
+    }
+
+    return buff_p - start;
+}
+
+/*
+ * Like yed_get_attr_str(), but assumes that the terminal is currently using
+ * the attributes in from and only changes what differs. If a reset followed
+ * by the full attribute string would be shorter, that is used instead.
+ * Writes an empty string if the two look the same on the terminal.
+ */
+void yed_get_attr_delta_str(yed_attrs from, yed_attrs to, char *buff_p) {
+    char  full[128];
+    char *start;
+    char  from_param[32];
+    char  to_param[32];
+    int   from_len;
+    int   to_len;
+    int   bg;
+    int   i;
+    int   n;
+
+    static const struct {
+        uint32_t    flag;
+        const char *on;
+        const char *off;
+    } flag_params[] = {
+        { ATTR_BOLD,      "1", "22" },
+        { ATTR_UNDERLINE, "4", "24" },
+        { ATTR_INVERSE,   "7", "27" },
+    };
+
+    start = buff_p;
+    n     = 0;
+
+    BUFFCATN(buff_p, "\e[", 2);
+
+    for (i = 0; i < sizeof(flag_params) / sizeof(flag_params[0]); i += 1) {
+        if ((from.flags & flag_params[i].flag) == (to.flags & flag_params[i].flag)) {
+            continue;
+        }
+        if (n++) { BUFFCATN(buff_p, ";", 1); }
+        BUFFCAT(buff_p, (to.flags & flag_params[i].flag) ? flag_params[i].on : flag_params[i].off);
+    }
+
+    for (bg = 0; bg <= 1; bg += 1) {
+        from_len = attr_color_param(from, bg, from_param);
+        to_len   = attr_color_param(to,   bg, to_param);
+
+        if (from_len == to_len && memcmp(from_param, to_param, to_len) == 0) {
+            continue;
+        }
+        if (n++) { BUFFCATN(buff_p, ";", 1); }
+        if (to_len) {
+            BUFFCATN(buff_p, to_param, to_len);
+        } else {
+            BUFFCATN(buff_p, bg ? "49" : "39", 2);
+        }
+    }
+
+    BUFFCATN(buff_p, "m", 1);
+    *buff_p = 0;
+
+    if (n == 0) {
+        *start = 0;
+        return;
+    }
+
+    yed_get_attr_str(to, full);
+    if (strlen(full) < buff_p - start) {
+        strcpy(start, full);
+    }
+}
+
 int yed_attrs_eq(yed_attrs attr1, yed_attrs attr2) {
     return    (attr1.fg    == attr2.fg)
            && (attr1.bg    == attr2.bg)
@@ -38,6 +38,7 @@ typedef struct {
 #define ZERO_ATTR    ((yed_attrs){ 0, 0, 0 })
 
 void yed_get_attr_str(yed_attrs attr, char *buff_p);
+void yed_get_attr_delta_str(yed_attrs from, yed_attrs to, char *buff_p);
 int  yed_attrs_eq(yed_attrs attr1, yed_attrs attr2);
 void yed_combine_attrs(yed_attrs *dst, yed_attrs *src);
 yed_attrs yed_parse_attrs(const char *string);
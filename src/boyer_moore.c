@@ -2,19 +2,30 @@
 
 int yed_boyer_moore(char *text, int text_len, char *pattern, int pattern_len) {
     int bad_char_table[256];
-    int i;
-    int shift;
-    int j;
 
     if (unlikely(pattern_len > text_len)) { return -1; }
 
-    /* Set up the table. */
+    yed_boyer_moore_make_table(pattern, pattern_len, bad_char_table);
+
+    return yed_boyer_moore_with_table(text, text_len, pattern, pattern_len, bad_char_table);
+}
+
+void yed_boyer_moore_make_table(const char *pattern, int pattern_len, int bad_char_table[256]) {
+    int i;
+
     for (i = 0; i < 256; i += 1) {
         bad_char_table[i] = -1;
     }
     for (i = 0; i < pattern_len; i += 1) {
-        bad_char_table[(int)pattern[i]] = i;
+        bad_char_table[(unsigned char)pattern[i]] = i;
     }
+}
+
+int yed_boyer_moore_with_table(const char *text, int text_len, const char *pattern, int pattern_len, const int bad_char_table[256]) {
+    int shift;
+    int j;
+
+    if (unlikely(pattern_len > text_len)) { return -1; }
 
     shift = 0;
     while (shift <= text_len - pattern_len) {
@@ -30,7 +41,7 @@ int yed_boyer_moore(char *text, int text_len, char *pattern, int pattern_len) {
             return shift;
         }
 
-        shift += MAX(1, j - bad_char_table[(int)text[shift + j]]);
+        shift += MAX(1, j - bad_char_table[(unsigned char)text[shift + j]]);
     }
 
     return -1;
@@ -3,6 +3,8 @@
 
 #include "internal.h"
 
-int yed_boyer_moore(char *text, int text_len, char *pattern, int pattern_len);
+int  yed_boyer_moore(char *text, int text_len, char *pattern, int pattern_len);
+void yed_boyer_moore_make_table(const char *pattern, int pattern_len, int bad_char_table[256]);
+int  yed_boyer_moore_with_table(const char *text, int text_len, const char *pattern, int pattern_len, const int bad_char_table[256]);
 
 #endif
@@ -14,14 +14,145 @@ bucket_t new_bucket(bucket_array_t *array) {
 bucket_array_t _bucket_array_make(int count, int elem_size) {
     bucket_array_t array;
 
-    array.buckets   = array_make(bucket_t);
-    array.elem_size = elem_size;
-    array.n_fit     = count;
-    array.used      = 0;
+    array.buckets     = array_make(bucket_t);
+    array.index       = array_make(uint32_t);
+    array.elem_size   = elem_size;
+    array.n_fit       = count;
+    array.used        = 0;
+    array.index_valid = 0;
 
     return array;
 }
 
+/*
+ * The index is a Fenwick tree (1-based, slot 0 unused) over the used count
+ * of each bucket. It lets us find the bucket holding a given element in
+ * O(log n) rather than walking every bucket from the start.
+ *
+ * Adjusting a bucket's count is O(log n) and so is appending or popping the
+ * last bucket. Inserting or removing a bucket in the middle shifts every bucket
+ * after it, so in that case we just invalidate the index and rebuild it in O(n)
+ * the next time it's needed. That only happens once every n_fit edits or so.
+ */
+
+#define INDEX_NODE(a, i) \
+    ((uint32_t*)array_item((a)->index, (i)))
+
+#define LOWBIT(i) ((i) & -(i))
+
+static void bucket_array_index_rebuild(bucket_array_t *array) {
+    int       n_buckets,
+              i,
+              parent;
+    uint32_t  zero;
+    bucket_t *b;
+
+    n_buckets = array_len(array->buckets);
+    zero      = 0;
+
+    array_clear(array->index);
+    array_push(array->index, zero);
+
+    array_traverse(array->buckets, b) {
+        array_push(array->index, b->used);
+    }
+
+    for (i = 1; i <= n_buckets; i += 1) {
+        parent = i + LOWBIT(i);
+        if (parent <= n_buckets) {
+            *INDEX_NODE(array, parent) += *INDEX_NODE(array, i);
+        }
+    }
+
+    array->index_valid = 1;
+}
+
+static uint32_t bucket_array_index_prefix(bucket_array_t *array, int n) {
+    uint32_t sum;
+
+    sum = 0;
+    for (; n > 0; n -= LOWBIT(n)) {
+        sum += *INDEX_NODE(array, n);
+    }
+
+    return sum;
+}
+
+static void bucket_array_index_add(bucket_array_t *array, int b_idx, int delta) {
+    int i, n_nodes;
+
+    if (!array->index_valid) { return; }
+
+    n_nodes = array_len(array->index);
+
+    for (i = b_idx + 1; i < n_nodes; i += LOWBIT(i)) {
+        *INDEX_NODE(array, i) += delta;
+    }
+}
+
+static void bucket_array_index_append(bucket_array_t *array, uint32_t used) {
+    int      i;
+    uint32_t node;
+
+    if (!array->index_valid) { return; }
+
+    if (array_len(array->index) == 0) {
+        node = 0;
+        array_push(array->index, node);
+    }
+
+    i    = array_len(array->index);
+    node = used
+         + bucket_array_index_prefix(array, i - 1)
+         - bucket_array_index_prefix(array, i - LOWBIT(i));
+
+    array_push(array->index, node);
+}
+
+static void bucket_array_index_pop(bucket_array_t *array) {
+    /* Nodes before the last only cover buckets before it, so they stay valid. */
+    if (!array->index_valid) { return; }
+
+    array_pop(array->index);
+}
+
+/*
+ * Returns the index of the bucket containing element *idx and replaces *idx
+ * with the element's offset into that bucket. If *idx is past the end,
+ * returns the number of buckets and *idx holds the overflow.
+ */
+static int bucket_array_index_find(bucket_array_t *array, int *idx) {
+    int      n_buckets,
+             pos,
+             step;
+    uint32_t rem,
+             node;
+
+    if (!array->index_valid) {
+        bucket_array_index_rebuild(array);
+    }
+
+    n_buckets = array_len(array->buckets);
+    pos       = 0;
+    rem       = *idx;
+
+    for (step = 1; (step << 1) <= n_buckets; step <<= 1);
+
+    for (; step > 0; step >>= 1) {
+        if (pos + step <= n_buckets) {
+            node = *INDEX_NODE(array, pos + step);
+            if (node <= rem) {
+                pos += step;
+                rem -= node;
+            }
+        }
+    }
+
+    *idx = rem;
+
+    return pos;
+}
+
 bucket_t * bucket_array_add_new_bucket(bucket_array_t *array) {
     bucket_t  new_b,
              *b;
@@ -29,6 +160,8 @@ bucket_t * bucket_array_add_new_bucket(bucket_array_t *array) {
     new_b = new_bucket(array);
     b     = array_push(array->buckets, new_b);
 
+    bucket_array_index_append(array, 0);
+
     return b;
 }
 
@@ -40,6 +173,7 @@ void _bucket_array_free(bucket_array_t *array) {
     }
 
     array_free(array->buckets);
+    array_free(array->index);
 }
 
 #define GET_BUCKET(a, i) \
@@ -49,53 +183,39 @@ void _bucket_array_free(bucket_array_t *array) {
     ((b)->data + ((elem_size) * (idx)))
 
 int _get_bucket_and_elem_idx_for_idx(bucket_array_t *array, int *idx) {
-    int       b_idx;
-    bucket_t *b;
+    int b_idx;
 
-    if (array_len(array->buckets) == 0) {
+    if (array_len(array->buckets) == 0
+    ||  *idx < 0
+    ||  *idx >= array->used) {
         return -1;
     }
 
-    b_idx = 0;
+    b_idx = bucket_array_index_find(array, idx);
 
-    while (b_idx < array_len(array->buckets)) {
-        b = array_item(array->buckets, b_idx);
-
-        if (*idx < b->used) {
-            return b_idx;
-        } else {
-            *idx   -= b->used;
-            b_idx  += 1;
-        }
-    }
-
-    return -1;
+    return b_idx;
 }
 
 int get_bucket_and_slot_idx_for_idx(bucket_array_t *array, int *idx) {
-    int       b_idx;
-    bucket_t *b, new_b;
+    int      b_idx;
+    bucket_t new_b;
 
-    b_idx = 0;
-
-    while (b_idx < array_len(array->buckets)) {
-        b = array_item(array->buckets, b_idx);
-
-        if (*idx < b->used) {
-            return b_idx;
-        } else {
-            *idx  -= b->used;
-            b_idx += 1;
-        }
+    if (*idx < 0 || *idx > array->used) {
+        return -1;
     }
 
-    if (*idx == 0) {
-        new_b = new_bucket(array);
-        array_push(array->buckets, new_b);
-        return array_len(array->buckets) - 1;
+    if (*idx < array->used) {
+        b_idx = bucket_array_index_find(array, idx);
+        return b_idx;
     }
 
-    return -1;
+    *idx = 0;
+
+    new_b = new_bucket(array);
+    array_push(array->buckets, new_b);
+    bucket_array_index_append(array, 0);
+
+    return array_len(array->buckets) - 1;
 }
 
 void * _bucket_array_item(bucket_array_t *array, int idx) {
@@ -135,6 +255,11 @@ void bucket_delete(bucket_array_t *array, int b_idx, int idx, int elem_size) {
     if (b->used == 1) {
         free(b->data);
         array_delete(array->buckets, b_idx);
+        if (b_idx == array_len(array->buckets)) {
+            bucket_array_index_pop(array);
+        } else {
+            array->index_valid = 0;
+        }
     } else {
         if (idx != b->used - 1) {
             split = b->data + (elem_size * idx);
@@ -144,6 +269,7 @@ void bucket_delete(bucket_array_t *array, int b_idx, int idx, int elem_size) {
         }
 
         b->used -= 1;
+        bucket_array_index_add(array, b_idx, -1);
     }
 
     array->used -= 1;
@@ -185,6 +311,13 @@ void * bucket_insert(bucket_array_t *array, int b_idx, int idx, void *elem, int
             /* Make a new empty bucket. */
             new_b   = new_bucket(array);
             spill_b = array_insert(array->buckets, b_idx + 1, new_b);
+            if (b_idx + 1 == array_len(array->buckets) - 1) {
+                bucket_array_index_append(array, 0);
+            } else {
+                array->index_valid = 0;
+            }
+            /* array_insert() may have moved the buckets. */
+            b = array_item(array->buckets, b_idx);
         }
 
         if (spill_b->used) {
@@ -203,6 +336,9 @@ void * bucket_insert(bucket_array_t *array, int b_idx, int idx, void *elem, int
                elem_size);
 
         b->used -= 1;
+
+        bucket_array_index_add(array, b_idx + 1, 1);
+        bucket_array_index_add(array, b_idx, -1);
     }
 
     /*
@@ -222,6 +358,8 @@ void * bucket_insert(bucket_array_t *array, int b_idx, int idx, void *elem, int
     b->used     += 1;
     array->used += 1;
 
+    bucket_array_index_add(array, b_idx, 1);
+
     return elem_slot;
 }
 
@@ -242,14 +380,151 @@ void * _bucket_array_insert(bucket_array_t *array, int idx, void *elem) {
     return new_elem;
 }
 
-void * _bucket_array_push(bucket_array_t *array, void *elem) {
+/*
+ * Inserting elements one at a time in the middle shifts the rest of the
+ * bucket (and spills into the next one) for every element. Instead, if
+ * they don't all fit in the bucket, split it at idx and put the new
+ * elements in their own buckets in between the two halves.
+ */
+void _bucket_array_insert_n(bucket_array_t *array, int idx, void *elems, int n) {
+    array_t   new_buckets;
+    bucket_t *b,
+              new_b;
     int       elem_size,
-              created_new_bucket;
+              b_idx,
+              pos,
+              n_here,
+              n_buckets,
+              i;
+
+    if (n <= 0) { return; }
+
+    if (idx == array->used) {
+        _bucket_array_push_n(array, elems, n);
+        return;
+    }
+
+    b_idx = _get_bucket_and_elem_idx_for_idx(array, &idx);
+    ASSERT(b_idx >= 0, "index out of bounds in _bucket_array_insert_n()");
+
+    elem_size = array->elem_size;
+    b         = GET_BUCKET(array, b_idx);
+
+    if (b->capacity - b->used >= (uint32_t)n) {
+        memmove(BUCKET_ITEM(b, idx + n, elem_size),
+                BUCKET_ITEM(b, idx,     elem_size),
+                elem_size * (b->used - idx));
+        memcpy(BUCKET_ITEM(b, idx, elem_size), elems, elem_size * n);
+
+        b->used     += n;
+        array->used += n;
+
+        bucket_array_index_add(array, b_idx, n);
+
+        return;
+    }
+
+    new_buckets = array_make(bucket_t);
+
+    while (n > 0) {
+        new_b      = new_bucket(array);
+        n_here     = MIN(n, (int)array->n_fit);
+        new_b.used = n_here;
+        memcpy(new_b.data, elems, elem_size * n_here);
+        array_push(new_buckets, new_b);
+
+        elems       += elem_size * n_here;
+        n           -= n_here;
+        array->used += n_here;
+    }
+
+    if (idx > 0) {
+        new_b      = new_bucket(array);
+        new_b.used = b->used - idx;
+        memcpy(new_b.data, BUCKET_ITEM(b, idx, elem_size), elem_size * new_b.used);
+        array_push(new_buckets, new_b);
+
+        b->used = idx;
+        pos     = b_idx + 1;
+    } else {
+        pos     = b_idx;
+    }
+
+    n_buckets = array_len(array->buckets);
+
+    for (i = 0; i < array_len(new_buckets); i += 1) {
+        array_push(array->buckets, new_b);
+    }
+
+    memmove(GET_BUCKET(array, pos + array_len(new_buckets)),
+            GET_BUCKET(array, pos),
+            sizeof(bucket_t) * (n_buckets - pos));
+    memcpy(GET_BUCKET(array, pos),
+           array_data(new_buckets),
+           sizeof(bucket_t) * array_len(new_buckets));
+
+    array_free(new_buckets);
+
+    array->index_valid = 0;
+}
+
+void _bucket_array_delete_n(bucket_array_t *array, int idx, int n) {
+    bucket_t *b;
+    int       elem_size,
+              b_idx,
+              n_here,
+              first_empty,
+              n_empty;
+
+    if (n <= 0) { return; }
+
+    ASSERT(idx + n <= (int)array->used, "index out of bounds in _bucket_array_delete_n()");
+
+    b_idx = _get_bucket_and_elem_idx_for_idx(array, &idx);
+    ASSERT(b_idx >= 0, "index out of bounds in _bucket_array_delete_n()");
+
+    elem_size   = array->elem_size;
+    first_empty = -1;
+    n_empty     = 0;
+
+    while (n > 0) {
+        b      = GET_BUCKET(array, b_idx);
+        n_here = MIN(n, (int)b->used - idx);
+
+        if (n_here == (int)b->used) {
+            /* The buckets we empty are all next to each other. */
+            free(b->data);
+            if (n_empty == 0) { first_empty = b_idx; }
+            n_empty += 1;
+        } else {
+            memmove(BUCKET_ITEM(b, idx,          elem_size),
+                    BUCKET_ITEM(b, idx + n_here, elem_size),
+                    elem_size * (b->used - idx - n_here));
+            b->used -= n_here;
+        }
+
+        array->used -= n_here;
+        n           -= n_here;
+        idx          = 0;
+        b_idx       += 1;
+    }
+
+    if (n_empty > 0) {
+        memmove(GET_BUCKET(array, first_empty),
+                GET_BUCKET(array, first_empty + n_empty),
+                sizeof(bucket_t) * (array_len(array->buckets) - first_empty - n_empty));
+        array->buckets.used -= n_empty;
+    }
+
+    array->index_valid = 0;
+}
+
+void * _bucket_array_push(bucket_array_t *array, void *elem) {
+    int       elem_size;
     bucket_t *b;
     void     *elem_slot;
 
-    created_new_bucket = 0;
-    elem_size          = array->elem_size;
+    elem_size = array->elem_size;
 
     if (array_len(array->buckets) == 0) {
             b = bucket_array_add_new_bucket(array);
@@ -260,9 +535,6 @@ void * _bucket_array_push(bucket_array_t *array, void *elem) {
         }
     }
 
-    if (created_new_bucket) {
-    }
-
     elem_slot = b->data + (elem_size * b->used);
 
     memcpy(elem_slot, elem, elem_size);
@@ -270,9 +542,54 @@ void * _bucket_array_push(bucket_array_t *array, void *elem) {
     b->used     += 1;
     array->used += 1;
 
+    bucket_array_index_add(array, array_len(array->buckets) - 1, 1);
+
     return elem_slot;
 }
 
+static int bucket_array_grow_last(bucket_array_t *array, int n, void **slot) {
+    bucket_t *b;
+    int       n_here;
+
+    b = array_last(array->buckets);
+    if (b == NULL || b->used == b->capacity) {
+        b = bucket_array_add_new_bucket(array);
+    }
+
+    n_here       = MIN((int)(b->capacity - b->used), n);
+    *slot        = BUCKET_ITEM(b, b->used, array->elem_size);
+    b->used     += n_here;
+    array->used += n_here;
+
+    bucket_array_index_add(array, array_len(array->buckets) - 1, n_here);
+
+    return n_here;
+}
+
+void _bucket_array_extend(bucket_array_t *array, int n) {
+    void *slot;
+
+    while (n > 0) {
+        n -= bucket_array_grow_last(array, n, &slot);
+    }
+
+    if (!array->index_valid) {
+        bucket_array_index_rebuild(array);
+    }
+}
+
+void _bucket_array_push_n(bucket_array_t *array, void *elems, int n) {
+    void *slot;
+    int   n_here;
+
+    while (n > 0) {
+        n_here  = bucket_array_grow_last(array, n, &slot);
+        memcpy(slot, elems, n_here * array->elem_size);
+        elems  += n_here * array->elem_size;
+        n      -= n_here;
+    }
+}
+
 void _bucket_array_pop(bucket_array_t *array) {
     int       b_idx;
     bucket_t *b;
@@ -293,8 +610,10 @@ void _bucket_array_clear(bucket_array_t *array) {
     }
 
     array_clear(array->buckets);
+    array_clear(array->index);
 
-    array->used = 0;
+    array->used        = 0;
+    array->index_valid = 0;
 }
 
 
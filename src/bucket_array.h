@@ -12,9 +12,11 @@ typedef bucket_t *bucket_ptr_t;
 
 typedef struct {
     array_t  buckets;
+    array_t  index;       /* Fenwick tree over the buckets' used counts. */
     uint32_t elem_size,
              n_fit,
              used;
+    int      index_valid;
 } bucket_array_t;
 
 bucket_array_t _bucket_array_make(int count, int elem_size);
@@ -22,10 +24,14 @@ void _bucket_array_free(bucket_array_t *array);
 void * _bucket_array_item(bucket_array_t *array, int idx);
 void * _bucket_array_last(bucket_array_t *array);
 void * _bucket_array_insert(bucket_array_t *array, int idx, void *elem);
+void _bucket_array_insert_n(bucket_array_t *array, int idx, void *elems, int n);
 void * _bucket_array_push(bucket_array_t *array, void *elem);
+void _bucket_array_extend(bucket_array_t *array, int n);
+void _bucket_array_push_n(bucket_array_t *array, void *elems, int n);
 void _bucket_array_delete(bucket_array_t *array, int idx);
+void _bucket_array_delete_n(bucket_array_t *array, int idx, int n);
 void _bucket_array_pop(bucket_array_t *array);
-void _bucket_array_pop(bucket_array_t *array);
+void _bucket_array_clear(bucket_array_t *array);
 
 #define bucket_array_make(n, T) \
     (_bucket_array_make(n, sizeof(T)))
@@ -45,12 +51,29 @@ void _bucket_array_pop(bucket_array_t *array);
 #define bucket_array_insert(array, idx, elem) \
     (_bucket_array_insert(&(array), idx, &(elem)))
 
+#define bucket_array_insert_n(array, idx, elems, n) \
+    (_bucket_array_insert_n(&(array), (idx), (elems), (n)))
+
 #define bucket_array_push(array, elem) \
     (_bucket_array_push(&(array), &(elem)))
 
+/*
+ * Appends n uninitialized elements.
+ * Leaves the index built so that other threads can safely look up
+ * (but not add or remove) elements while the new ones are filled in.
+ */
+#define bucket_array_extend(array, n) \
+    (_bucket_array_extend(&(array), (n)))
+
+#define bucket_array_push_n(array, elems, n) \
+    (_bucket_array_push_n(&(array), (elems), (n)))
+
 #define bucket_array_delete(array, idx) \
     (_bucket_array_delete(&(array), idx))
 
+#define bucket_array_delete_n(array, idx, n) \
+    (_bucket_array_delete_n(&(array), (idx), (n)))
+
 #define bucket_array_pop(array) \
     (_bucket_array_pop(&(array)))
 
@@ -1,7 +1,8 @@
 void yed_init_buffers(void) {
     LOG_FN_ENTER();
 
-    ys->buffers = tree_make(yed_buffer_name_t, yed_buffer_ptr_t);
+    ys->buffers       = tree_make(yed_buffer_name_t, yed_buffer_ptr_t);
+    ys->buffers_index = hash_map_make(yed_buffer_ptr_t);
 
     yed_get_yank_buffer();
     yed_get_log_buffer();
@@ -31,6 +32,7 @@ yed_line yed_new_line_with_cap(int len) {
 
 void yed_free_line(yed_line *line) {
     array_free(line->chars);
+    yed_line_invalidate_col_index(line);
 }
 
 yed_line * yed_copy_line(yed_line *line) {
@@ -46,6 +48,94 @@ yed_line * yed_copy_line(yed_line *line) {
     return new_line;
 }
 
+void yed_line_invalidate_col_index(yed_line *line) {
+    if (line->col_index != NULL) {
+        free(line->col_index);
+        line->col_index = NULL;
+    }
+}
+
+static yed_line_col_index * yed_line_get_col_index(yed_line *line) {
+    yed_line_col_index *index;
+    yed_glyph          *g;
+    int                 len, max_checkpoints, i, col, next_col;
+
+    len   = array_len(line->chars);
+    index = line->col_index;
+
+    if (len < YED_LINE_COL_INDEX_MIN_BYTES) {
+        return NULL;
+    }
+
+    if (index != NULL
+    &&  index->n_bytes      == len
+    &&  index->visual_width == line->visual_width) {
+        return index;
+    }
+
+    yed_line_invalidate_col_index(line);
+
+    max_checkpoints = (line->visual_width / YED_LINE_COL_INDEX_STRIDE) + 1;
+
+    index = malloc(sizeof(*index) + (max_checkpoints * sizeof(yed_line_col_checkpoint)));
+
+    index->n_bytes       = len;
+    index->visual_width  = line->visual_width;
+    index->n_checkpoints = 0;
+
+    col      = 1;
+    next_col = 1;
+    for (i = 0; i < len && index->n_checkpoints < max_checkpoints;) {
+        g = array_item(line->chars, i);
+
+        if (col >= next_col) {
+            index->checkpoints[index->n_checkpoints].idx  = i;
+            index->checkpoints[index->n_checkpoints].col  = col;
+            index->n_checkpoints                         += 1;
+            next_col                                      = col + YED_LINE_COL_INDEX_STRIDE;
+        }
+
+        col += yed_get_glyph_width(*g);
+        i   += yed_get_glyph_len(*g);
+    }
+
+    line->col_index = index;
+
+    return index;
+}
+
+/* Find the last checkpoint at or before the given byte index. */
+static yed_line_col_checkpoint * yed_line_col_index_search_idx(yed_line_col_index *index, int idx) {
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = index->n_checkpoints - 1;
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo + 1) >> 1);
+        if (index->checkpoints[mid].idx <= idx) { lo = mid;     }
+        else                                    { hi = mid - 1; }
+    }
+
+    return index->checkpoints + lo;
+}
+
+/* Find the last checkpoint at or before the given column. */
+static yed_line_col_checkpoint * yed_line_col_index_search_col(yed_line_col_index *index, int col) {
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = index->n_checkpoints - 1;
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo + 1) >> 1);
+        if (index->checkpoints[mid].col <= col) { lo = mid;     }
+        else                                    { hi = mid - 1; }
+    }
+
+    return index->checkpoints + lo;
+}
+
 void yed_line_add_glyph(yed_line *line, yed_glyph g, int idx) {
     int len, i;
 
@@ -55,6 +145,8 @@ void yed_line_add_glyph(yed_line *line, yed_glyph g, int idx) {
     }
     line->visual_width += yed_get_glyph_width(g);
     line->n_glyphs     += 1;
+
+    yed_line_invalidate_col_index(line);
 }
 
 void yed_line_append_glyph(yed_line *line, yed_glyph g) {
@@ -67,6 +159,8 @@ void yed_line_append_glyph(yed_line *line, yed_glyph g) {
     }
     line->visual_width += width;
     line->n_glyphs     += 1;
+
+    yed_line_invalidate_col_index(line);
 }
 
 void yed_line_delete_glyph(yed_line *line, int idx) {
@@ -83,6 +177,8 @@ void yed_line_delete_glyph(yed_line *line, int idx) {
 
     line->visual_width -= width;
     line->n_glyphs     -= 1;
+
+    yed_line_invalidate_col_index(line);
 }
 
 void yed_line_pop_glyph(yed_line *line) {
@@ -100,6 +196,8 @@ void yed_line_pop_glyph(yed_line *line) {
 
     line->visual_width -= width;
     line->n_glyphs     -= 1;
+
+    yed_line_invalidate_col_index(line);
 }
 
 static int yed_buffer_add_line_no_undo_no_events(yed_buffer *buff) {
@@ -126,6 +224,13 @@ yed_buffer yed_new_buff(void) {
     buff.get_line_cache_row   = 0;
     buff.path                 = NULL;
     buff.mmap_underlying_buff = NULL;
+    buff.lazy_load            = NULL;
+    buff.version              = 0;
+    buff.journal              = array_make(yed_buffer_change);
+    buff.journal_base_version = 0;
+    buff.journal_sealed       = 1;
+    buff.batch_depth          = 0;
+    buff.words                = NULL;
     buff.has_selection        = 0;
     buff.flags                = 0;
     buff.undo_history         = yed_new_undo_history();
@@ -139,12 +244,9 @@ yed_buffer yed_new_buff(void) {
 }
 
 yed_buffer *yed_create_buffer(char *name) {
-    yed_buffer                                   *buff;
-    tree_it(yed_buffer_name_t, yed_buffer_ptr_t)  it;
-
-    it = tree_lookup(ys->buffers, name);
+    yed_buffer *buff;
 
-    if (tree_it_good(it)) {
+    if (hash_map_lookup(ys->buffers_index, name) != NULL) {
         return NULL;
     }
 
@@ -154,22 +256,23 @@ yed_buffer *yed_create_buffer(char *name) {
     buff->name = strdup(name);
 
     tree_insert(ys->buffers, strdup(name), buff);
+    hash_map_insert(ys->buffers_index, name, buff);
 
     return buff;
 }
 
 yed_buffer * yed_get_buffer(char *name) {
-    tree_it(yed_buffer_name_t, yed_buffer_ptr_t)  it;
+    yed_buffer_ptr_t *buff;
 
     if (name == NULL) { return NULL; }
 
-    it = tree_lookup(ys->buffers, name);
+    buff = hash_map_lookup(ys->buffers_index, name);
 
-    if (!tree_it_good(it)) {
+    if (buff == NULL) {
         return NULL;
     }
 
-    return tree_it_val(it);
+    return *buff;
 }
 
 yed_buffer * yed_get_buffer_by_path(char *path) {
@@ -202,8 +305,9 @@ yed_buffer * yed_get_or_create_special_rdonly_buffer(char *name) {
 }
 
 void yed_free_buffer(yed_buffer *buffer) {
-    yed_event  event;
-    yed_line  *line;
+    yed_event      event;
+    yed_line      *line;
+    yed_lazy_load *lazy;
 
     memset(&event, 0, sizeof(event));
     event.kind   = EVENT_BUFFER_PRE_DELETE;
@@ -214,6 +318,7 @@ void yed_free_buffer(yed_buffer *buffer) {
 
     if (buffer->name) {
         tree_delete(ys->buffers, buffer->name);
+        hash_map_delete(ys->buffers_index, buffer->name);
         free(buffer->name);
     }
 
@@ -225,14 +330,24 @@ void yed_free_buffer(yed_buffer *buffer) {
         free(buffer->mmap_underlying_buff);
     }
 
+    lazy = yed_buff_detach_lazy_load(buffer);
+
+    yed_subprocs_forget_buffer(buffer);
+
     bucket_array_traverse(buffer->lines, line) {
         yed_free_line(line);
     }
 
     bucket_array_free(buffer->lines);
 
+    yed_free_lazy_load(lazy);
+
     yed_free_undo_history(&buffer->undo_history);
 
+    yed_free_buff_words(buffer);
+
+    array_free(buffer->journal);
+
     free(buffer);
 }
 
@@ -375,45 +490,244 @@ void yed_buffer_set_ft(yed_buffer *buffer, int ft) {
 
 
 
-void yed_buff_insert_string_no_undo(yed_buffer *buff, const char *str, int row, int col) {
-    yed_glyph *g;
+/*
+ * Works out what yed_buff_insert_string() really inserts and where: str
+ * without the non-printable ASCII characters (other than newlines) that it
+ * drops, preceded by whatever newlines and spaces are needed to reach
+ * (row, col). Returns the text, which the caller must free.
+ */
+static char *yed_buff_prepare_insert_string(yed_buffer *buff, const char *str, int row, int col, int *row_out, int *idx_out, int *len_out) {
     yed_line  *line;
-    yed_glyph *line_last_glyph;
+    yed_glyph *g;
+    char      *text;
+    int        n_lines,
+               n_pad_rows,
+               n_pad_cols,
+               len,
+               g_len;
+
+    n_lines    = yed_buff_n_lines(buff);
+    n_pad_rows = MAX(row - n_lines, 0);
+
+    /*
+     * Past the end of the buffer, the text goes at the end of the last line
+     * and the new rows start out empty.
+     */
+    if (n_pad_rows > 0) {
+        row        = n_lines;
+        line       = yed_buff_get_line(buff, row);
+        n_pad_cols = col - 1;
+    } else {
+        line       = yed_buff_get_line(buff, row);
+        n_pad_cols = MAX(col - 1 - line->visual_width, 0);
+    }
+
+    text       = malloc(n_pad_rows + n_pad_cols + strlen(str) + 1);
+    len        = 0;
+
+    if (n_pad_rows > 0 || n_pad_cols > 0) {
+        *idx_out = array_len(line->chars);
+    } else {
+        *idx_out = yed_line_col_to_idx(line, col);
+    }
+
+    memset(text,              '\n', n_pad_rows);
+    memset(text + n_pad_rows, ' ',  n_pad_cols);
+    len = n_pad_rows + n_pad_cols;
+
+    while (*str) {
+        g     = (yed_glyph*)(void*)str;
+        g_len = yed_get_glyph_len(*g);
+
+        if (!G_IS_ASCII(*g) || isprint(g->c) || g->c == '\n') {
+            memcpy(text + len, str, g_len);
+            len += g_len;
+        }
+
+        str += g_len;
+    }
+
+    text[len] = 0;
+
+    *row_out = row;
+    *len_out = len;
+
+    return text;
+}
+
+void yed_buff_insert_string_no_undo(yed_buffer *buff, const char *str, int row, int col) {
+    char *text;
+    int   idx,
+          len;
 
     if (strlen(str) == 0) { return; }
 
     if (row <= 0) { row = 1; }
     if (col <= 0) { col = 1; }
 
-    while (yed_buff_n_lines(buff) < row) {
-        yed_buffer_add_line_no_undo(buff);
+    text = yed_buff_prepare_insert_string(buff, str, row, col, &row, &idx, &len);
+
+    yed_buff_replace_range_no_undo(buff, row, idx, row, idx, text, len);
+
+    free(text);
+}
+
+/*
+ * Extends change a to also cover change b, which happened right after it.
+ * Rows in between the two count as having been replaced by themselves.
+ */
+static void yed_buff_merge_change(yed_buffer_change *a, yed_buffer_change *b) {
+    int lo,
+        hi;
+
+    lo = MIN(a->row, b->row);
+    hi = MAX(a->row + a->n_new_rows, b->row + b->n_old_rows);
+
+    a->n_old_rows    = (hi - lo) - a->n_new_rows + a->n_old_rows;
+    a->n_new_rows    = (hi - lo) - b->n_old_rows + b->n_new_rows;
+    a->row           = lo;
+    a->version_after = b->version_after;
+
+    if (a->kind != b->kind) {
+        a->kind = BUFF_MOD_BATCH;
     }
+}
 
-    line = yed_buff_get_line(buff, row);
-    while (line->visual_width < col - 1) {
-        yed_append_to_line_no_undo(buff, row, G(' '));
+/*
+ * Fills in the versions of change, bumps the buffer's version, and adds the
+ * change to the journal and to the current batch (if any).
+ */
+static void yed_buff_journal_change(yed_buffer *buff, yed_buffer_change *change) {
+    yed_buffer_change *last;
+
+    change->version_before  = buff->version;
+    buff->version          += 1;
+    change->version_after   = buff->version;
+
+    last = array_len(buff->journal) ? array_last(buff->journal) : NULL;
+
+    if (last != NULL
+    &&  !buff->journal_sealed
+    &&  change->row <= last->row + last->n_new_rows
+    &&  change->row + change->n_old_rows >= last->row) {
+        yed_buff_merge_change(last, change);
+    } else {
+        if (array_len(buff->journal) == BUFF_JOURNAL_MAX_CHANGES) {
+            buff->journal_base_version = ((yed_buffer_change*)array_item(buff->journal, 0))->version_after;
+            array_delete(buff->journal, 0);
+        }
+        array_push(buff->journal, *change);
+        buff->journal_sealed = 0;
     }
 
-    while (*str) {
-        g = (yed_glyph*)(void*)str;
-
-        if (g->c == '\n') {
-            line = yed_buff_get_line(buff, row);
-            yed_buff_insert_line_no_undo(buff, row + 1);
-            while (line->visual_width > col - 1) {
-                line_last_glyph = yed_line_last_glyph(line);
-                yed_insert_into_line_no_undo(buff, row + 1, 1, *line_last_glyph);
-                yed_pop_from_line_no_undo(buff, row);
-            }
-            row += 1;
-            col  = 1;
-        } else if (!G_IS_ASCII(*g) || isprint(g->c)) {
-            yed_insert_into_line_no_undo(buff, row, col, *g);
-            col += yed_get_glyph_width(*g);
+    if (buff->batch_depth > 0) {
+        if (buff->batch.version_after == buff->batch.version_before) {
+            buff->batch = *change;
+        } else {
+            yed_buff_merge_change(&buff->batch, change);
+        }
+    }
+}
+
+void yed_buff_record_change(yed_buffer *buff, int kind, int row, int n_old_rows, int n_new_rows) {
+    yed_buffer_change change;
+
+    change.kind       = kind;
+    change.row        = row;
+    change.n_old_rows = n_old_rows;
+    change.n_new_rows = n_new_rows;
+
+    yed_buff_journal_change(buff, &change);
+}
+
+void yed_buff_reset_journal(yed_buffer *buff) {
+    buff->version              += 1;
+    buff->journal_base_version  = buff->version;
+    buff->journal_sealed        = 1;
+
+    array_clear(buff->journal);
+}
+
+unsigned long long yed_buff_get_version(yed_buffer *buff) {
+    /*
+     * Don't let later edits be coalesced into a change that's already
+     * journaled, or we couldn't tell what happened after this version.
+     */
+    buff->journal_sealed = 1;
+
+    return buff->version;
+}
+
+int yed_buff_changes_since(yed_buffer *buff, unsigned long long version, yed_buffer_change *change) {
+    yed_buffer_change *it;
+    int                found;
+
+    buff->journal_sealed = 1;
+
+    change->version_before = version;
+    change->version_after  = version;
+    change->kind           = BUFF_MOD_BATCH;
+    change->row            = 1;
+    change->n_old_rows     = 0;
+    change->n_new_rows     = 0;
+
+    if (version == buff->version) { return 1; }
+
+    if (version < buff->journal_base_version
+    ||  version > buff->version) {
+        return 0;
+    }
+
+    found = 0;
+
+    array_traverse(buff->journal, it) {
+        if (it->version_after <= version) { continue; }
+
+        /* The version is in the middle of a coalesced change. */
+        if (it->version_before < version) { return 0; }
+
+        if (found) {
+            yed_buff_merge_change(change, it);
+        } else {
+            *change = *it;
+            found   = 1;
         }
+    }
+
+    return found;
+}
 
-        str += yed_get_glyph_len(*g);
+void yed_buff_begin_batch(yed_buffer *buff) {
+    if (buff->batch_depth == 0) {
+        buff->batch.version_before = buff->version;
+        buff->batch.version_after  = buff->version;
     }
+
+    buff->batch_depth += 1;
+}
+
+void yed_buff_end_batch(yed_buffer *buff) {
+    yed_event         event;
+    yed_buffer_change change;
+
+    if (buff->batch_depth == 0) { return; }
+
+    buff->batch_depth -= 1;
+
+    if (buff->batch_depth > 0
+    ||  buff->batch.version_after == buff->batch.version_before) {
+        return;
+    }
+
+    change = buff->batch;
+
+    memset(&event, 0, sizeof(event));
+    event.kind           = EVENT_BUFFER_POST_MOD;
+    event.buffer         = buff;
+    event.buff_mod_event = BUFF_MOD_BATCH;
+    event.row            = change.row;
+    event.buff_change    = &change;
+    yed_trigger_event(&event);
 }
 
 #define DO_RD_ONLY_CHECK(_buff)                      \
@@ -433,17 +747,27 @@ do {                                                 \
     yed_trigger_event(&_event);                      \
     if (_event.cancel) { goto out; }                 \
 } while (0)
-#define DO_POST_MOD_EVT(_buff, _kind, _row, _col)    \
-do {                                                 \
-    yed_event _event;                                \
-    memset(&_event, 0, sizeof(_event));              \
-    _event.kind           = EVENT_BUFFER_POST_MOD;   \
-    _event.buffer         = (_buff);                 \
-    _event.buff_mod_event = (_kind);                 \
-    _event.row            = (_row);                  \
-    _event.col            = (_col);                  \
-    yed_trigger_event(&_event);                      \
-    (_buff)->flags |= BUFF_MODIFIED;                 \
+/* A _row of 0 means the whole buffer. */
+#define DO_POST_MOD_EVT(_buff, _kind, _row, _col, _n_old_rows, _n_new_rows) \
+do {                                                                        \
+    yed_event         _event;                                               \
+    yed_buffer_change _change;                                              \
+    _change.kind       = (_kind);                                           \
+    _change.row        = MAX((_row), 1);                                    \
+    _change.n_old_rows = (_n_old_rows);                                     \
+    _change.n_new_rows = (_n_new_rows);                                     \
+    yed_buff_journal_change((_buff), &_change);                             \
+    if ((_buff)->batch_depth == 0) {                                        \
+        memset(&_event, 0, sizeof(_event));                                 \
+        _event.kind           = EVENT_BUFFER_POST_MOD;                      \
+        _event.buffer         = (_buff);                                    \
+        _event.buff_mod_event = (_kind);                                    \
+        _event.row            = (_row);                                     \
+        _event.col            = (_col);                                     \
+        _event.buff_change    = &_change;                                   \
+        yed_trigger_event(&_event);                                         \
+    }                                                                       \
+    (_buff)->flags |= BUFF_MODIFIED;                                        \
 } while (0)
 
 void yed_append_to_line_no_undo(yed_buffer *buff, int row, yed_glyph g) {
@@ -456,7 +780,7 @@ void yed_append_to_line_no_undo(yed_buffer *buff, int row, yed_glyph g) {
     line = yed_buff_get_line(buff, row);
     yed_line_append_glyph(line, g);
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_APPEND_TO_LINE, row, 0);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_APPEND_TO_LINE, row, 0, 1, 1);
 out:;
 }
 
@@ -470,7 +794,7 @@ void yed_pop_from_line_no_undo(yed_buffer *buff, int row) {
     line = yed_buff_get_line(buff, row);
     yed_line_pop_glyph(line);
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_POP_FROM_LINE, row, 0);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_POP_FROM_LINE, row, 0, 1, 1);
 out:;
 }
 
@@ -484,8 +808,10 @@ void yed_line_clear_no_undo(yed_buffer *buff, int row) {
     line = yed_buff_get_line(buff, row);
     array_clear(line->chars);
     line->visual_width = 0;
+    line->n_glyphs     = 0;
+    yed_line_invalidate_col_index(line);
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_CLEAR, row, 0);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_CLEAR, row, 0, 1, 1);
 out:;
 }
 
@@ -506,7 +832,7 @@ int yed_buffer_add_line_no_undo(yed_buffer *buff) {
     buff->get_line_cache     = NULL;
     buff->get_line_cache_row = 0;
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_ADD_LINE, n_lines + 1, 0);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_ADD_LINE, n_lines + 1, 0, 0, 1);
 
 out:;
     return n_lines + 1;
@@ -523,10 +849,11 @@ void yed_buff_set_line_no_undo(yed_buffer *buff, int row, yed_line *line) {
 
     yed_free_line(old_line);
     old_line->visual_width = line->visual_width;
+    old_line->n_glyphs     = line->n_glyphs;
     old_line->chars        = array_make(char);
     array_copy(old_line->chars, line->chars);
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_SET_LINE, row, 0);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_SET_LINE, row, 0, 1, 1);
 out:;
 }
 
@@ -552,7 +879,7 @@ yed_line * yed_buff_insert_line_no_undo(yed_buffer *buff, int row) {
     buff->get_line_cache     = NULL;
     buff->get_line_cache_row = 0;
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_INSERT_LINE, row, 0);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_INSERT_LINE, row, 0, 0, 1);
 
 out:;
     return line;
@@ -577,7 +904,7 @@ void yed_buff_delete_line_no_undo(yed_buffer *buff, int row) {
     buff->get_line_cache     = NULL;
     buff->get_line_cache_row = 0;
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_DELETE_LINE, row, 0);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_DELETE_LINE, row, 0, 1, 0);
 
 out:;
 }
@@ -595,7 +922,7 @@ void yed_insert_into_line_no_undo(yed_buffer *buff, int row, int col, yed_glyph
     idx = yed_line_col_to_idx(line, col);
     yed_line_add_glyph(line, g, idx);
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_INSERT_INTO_LINE, row, col);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_INSERT_INTO_LINE, row, col, 1, 1);
 
 out:;
 }
@@ -613,13 +940,16 @@ void yed_delete_from_line_no_undo(yed_buffer *buff, int row, int col) {
     idx = yed_line_col_to_idx(line, col);
     yed_line_delete_glyph(line, idx);
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_DELETE_FROM_LINE, row, col);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_DELETE_FROM_LINE, row, col, 1, 1);
 
 out:;
 }
 
 void yed_buff_clear_no_undo(yed_buffer *buff) {
     yed_line *line;
+    int       n_lines;
+
+    n_lines = yed_buff_n_lines(buff);
 
     DO_RD_ONLY_CHECK(buff);
 
@@ -630,7 +960,7 @@ void yed_buff_clear_no_undo(yed_buffer *buff) {
     }
     bucket_array_clear(buff->lines);
 
-    DO_POST_MOD_EVT(buff, BUFF_MOD_CLEAR, 0, 0);
+    DO_POST_MOD_EVT(buff, BUFF_MOD_CLEAR, 0, 0, n_lines, 0);
 
     yed_buffer_add_line_no_undo(buff);
 
@@ -640,6 +970,239 @@ void yed_buff_clear_no_undo(yed_buffer *buff) {
 out:;
 }
 
+/* Appends bytes to the line, leaving out any '\r's. */
+static void yed_line_append_output(yed_line *line, const char *bytes, const char *end) {
+    const char *cr;
+    int         old_len;
+    int         n_glyphs;
+    int         width;
+
+    old_len = array_len(line->chars);
+
+    while ((cr = memchr(bytes, '\r', end - bytes)) != NULL) {
+        array_push_n(line->chars, (char*)bytes, cr - bytes);
+        bytes = cr + 1;
+    }
+    array_push_n(line->chars, (char*)bytes, end - bytes);
+
+    yed_get_string_info(array_data(line->chars) + old_len, array_len(line->chars) - old_len, &n_glyphs, &width);
+    line->n_glyphs     += n_glyphs;
+    line->visual_width += width;
+
+    yed_line_invalidate_col_index(line);
+}
+
+void yed_buff_append_output(yed_buffer *buff, const char *bytes, int len) {
+    const char *end;
+    const char *nl;
+    int         last_row;
+    array_t     new_lines;
+    yed_line    line;
+
+    if (len <= 0) { return; }
+
+    if (bucket_array_len(buff->lines) == 0) {
+        line = yed_new_line();
+        bucket_array_push(buff->lines, line);
+    }
+
+    end      = bytes + len;
+    last_row = yed_buff_n_lines(buff);
+
+    yed_buff_begin_batch(buff);
+
+    nl = memchr(bytes, '\n', len);
+
+    yed_line_append_output(bucket_array_last(buff->lines), bytes, nl ? nl : end);
+    yed_buff_record_change(buff, BUFF_MOD_APPEND_TO_LINE, last_row, 1, 1);
+
+    if (nl != NULL) {
+        new_lines = array_make(yed_line);
+
+        do {
+            bytes = nl + 1;
+            nl    = memchr(bytes, '\n', end - bytes);
+            line  = yed_new_line_with_cap((nl ? nl : end) - bytes);
+
+            yed_line_append_output(&line, bytes, nl ? nl : end);
+
+            array_push(new_lines, line);
+        } while (nl != NULL);
+
+        bucket_array_push_n(buff->lines, array_data(new_lines), array_len(new_lines));
+
+        buff->get_line_cache     = NULL;
+        buff->get_line_cache_row = 0;
+
+        yed_buff_record_change(buff, BUFF_MOD_ADD_LINE, last_row + 1, 0, array_len(new_lines));
+
+        array_free(new_lines);
+    }
+
+    yed_buff_end_batch(buff);
+}
+
+void yed_get_text_end(int row, int idx, const char *text, int len, int *end_row, int *end_idx) {
+    const char *end,
+               *nl;
+
+    *end_row = row;
+    *end_idx = idx + len;
+
+    if (len == 0) { return; }
+
+    end = text + len;
+
+    while ((nl = memchr(text, '\n', end - text)) != NULL) {
+        text      = nl + 1;
+        *end_row += 1;
+        *end_idx  = end - text;
+    }
+}
+
+static void yed_line_update_info(yed_line *line) {
+    yed_get_string_info(array_data(line->chars), array_len(line->chars), &line->n_glyphs, &line->visual_width);
+}
+
+/*
+ * Replaces rows [row, row + n_old_rows) with the n_new_rows lines in
+ * lines, which the buffer takes ownership of.
+ */
+static void yed_buff_set_rows(yed_buffer *buff, int row, int n_old_rows, yed_line *lines, int n_new_rows) {
+    yed_line *line;
+    int       n_same,
+              i;
+
+    n_same = MIN(n_old_rows, n_new_rows);
+
+    for (i = 0; i < n_old_rows; i += 1) {
+        line = bucket_array_item(buff->lines, row - 1 + i);
+        yed_free_line(line);
+        if (i < n_same) {
+            *line = lines[i];
+        }
+    }
+
+    if (n_new_rows > n_old_rows) {
+        bucket_array_insert_n(buff->lines, row - 1 + n_same, lines + n_same, n_new_rows - n_same);
+    } else if (n_old_rows > n_new_rows) {
+        bucket_array_delete_n(buff->lines, row - 1 + n_same, n_old_rows - n_same);
+    }
+
+    buff->get_line_cache     = NULL;
+    buff->get_line_cache_row = 0;
+}
+
+/* Appends the text from byte idx of row up to byte end_idx of end_row to out. */
+static void yed_buff_get_range_text(yed_buffer *buff, int row, int idx, int end_row, int end_idx, array_t *out) {
+    yed_line *line;
+    char      nl;
+    int       r,
+              start,
+              end;
+
+    nl = '\n';
+
+    for (r = row; r <= end_row; r += 1) {
+        line  = yed_buff_get_line(buff, r);
+        start = r == row     ? idx     : 0;
+        end   = r == end_row ? end_idx : array_len(line->chars);
+
+        if (end > start) {
+            array_push_n(*out, array_item(line->chars, start), end - start);
+        }
+        if (r < end_row) {
+            array_push(*out, nl);
+        }
+    }
+}
+
+int yed_buff_replace_range_no_undo(yed_buffer *buff, int row, int idx, int end_row, int end_idx, const char *text, int len) {
+    yed_event          event;
+    yed_buffer_change  change;
+    yed_line          *first,
+                      *last,
+                       line;
+    array_t            new_lines;
+    const char        *end,
+                      *p,
+                      *nl;
+    int                n_old_rows,
+                       n_new_rows,
+                       status;
+
+    status    = 0;
+    new_lines = array_make(yed_line);
+    end       = text + len;
+
+    DO_RD_ONLY_CHECK(buff);
+
+    n_old_rows = end_row - row + 1;
+    n_new_rows = 1;
+
+    for (p = text; len > 0 && (nl = memchr(p, '\n', end - p)) != NULL; p = nl + 1) {
+        n_new_rows += 1;
+    }
+
+    first = yed_buff_get_line(buff, row);
+
+    change.kind       = BUFF_MOD_BATCH;
+    change.row        = row;
+    change.n_old_rows = n_old_rows;
+    change.n_new_rows = n_new_rows;
+
+    memset(&event, 0, sizeof(event));
+    event.kind           = EVENT_BUFFER_PRE_MOD;
+    event.buffer         = buff;
+    event.buff_mod_event = BUFF_MOD_BATCH;
+    event.row            = row;
+    event.col            = yed_line_idx_to_col(first, idx);
+    event.buff_change    = &change;
+    yed_trigger_event(&event);
+    if (event.cancel) { goto out; }
+
+    first = yed_buff_get_line(buff, row);
+    last  = yed_buff_get_line(buff, end_row);
+
+    /* The first new line starts with what was before idx... */
+    line = yed_new_line();
+    if (idx > 0) {
+        array_push_n(line.chars, array_data(first->chars), idx);
+    }
+
+    for (p = text; len > 0 && (nl = memchr(p, '\n', end - p)) != NULL; p = nl + 1) {
+        if (nl > p) {
+            array_push_n(line.chars, (char*)p, nl - p);
+        }
+        yed_line_update_info(&line);
+        array_push(new_lines, line);
+
+        line = yed_new_line();
+    }
+
+    if (end > p) {
+        array_push_n(line.chars, (char*)p, end - p);
+    }
+
+    /* ...and the last one ends with what was after end_idx. */
+    if (end_idx < array_len(last->chars)) {
+        array_push_n(line.chars, array_item(last->chars, end_idx), array_len(last->chars) - end_idx);
+    }
+    yed_line_update_info(&line);
+    array_push(new_lines, line);
+
+    yed_buff_set_rows(buff, row, n_old_rows, array_data(new_lines), n_new_rows);
+
+    DO_POST_MOD_EVT(buff, BUFF_MOD_BATCH, row, event.col, n_old_rows, n_new_rows);
+
+    status = 1;
+
+out:;
+    array_free(new_lines);
+
+    return status;
+}
+
 /*
  * The following functions are the interface by which everything
  * else should modify buffers.
@@ -650,9 +1213,9 @@ void yed_buff_insert_string(yed_buffer *buff, const char *str, int row, int col)
     yed_frame  *frame;
     yed_frame **fit;
     int         num_orig_undo_records;
-    yed_glyph  *g;
-    yed_line   *line;
-    yed_glyph  *line_last_glyph;
+    char       *text;
+    int         idx,
+                len;
 
     if (strlen(str) == 0) { return; }
 
@@ -676,35 +1239,13 @@ void yed_buff_insert_string(yed_buffer *buff, const char *str, int row, int col)
 
     num_orig_undo_records = yed_get_undo_num_records(buff);
 
-    while (yed_buff_n_lines(buff) < row) {
-        yed_buffer_add_line(buff);
-    }
+    text = yed_buff_prepare_insert_string(buff, str, row, col, &row, &idx, &len);
 
-    line = yed_buff_get_line(buff, row);
-    while (line->visual_width < col - 1) {
-        yed_append_to_line(buff, row, G(' '));
+    if (yed_buff_replace_range_no_undo(buff, row, idx, row, idx, text, len)) {
+        yed_push_undo_content(buff, row, idx, NULL, 0, text, len);
     }
 
-    while (*str) {
-        g = (yed_glyph*)(void*)str;
-
-        if (g->c == '\n') {
-            line = yed_buff_get_line(buff, row);
-            yed_buff_insert_line(buff, row + 1);
-            while (line->visual_width > col - 1) {
-                line_last_glyph = yed_line_last_glyph(line);
-                yed_insert_into_line(buff, row + 1, 1, *line_last_glyph);
-                yed_pop_from_line(buff, row);
-            }
-            row += 1;
-            col  = 1;
-        } else if (!G_IS_ASCII(*g) || isprint(g->c)) {
-            yed_insert_into_line(buff, row, col, *g);
-            col += yed_get_glyph_width(*g);
-        }
-
-        str += yed_get_glyph_len(*g);
-    }
+    free(text);
 
     yed_end_undo_record(frame, buff);
 
@@ -713,6 +1254,27 @@ void yed_buff_insert_string(yed_buffer *buff, const char *str, int row, int col)
     }
 }
 
+int yed_buff_replace_range(yed_buffer *buff, int row, int idx, int end_row, int end_idx, const char *text, int len) {
+    array_t old_text;
+    int     status;
+
+    old_text = array_make(char);
+
+    yed_buff_get_range_text(buff, row, idx, end_row, end_idx, &old_text);
+
+    status = yed_buff_replace_range_no_undo(buff, row, idx, end_row, end_idx, text, len);
+
+    if (status) {
+        yed_push_undo_content(buff, row, idx,
+                              array_data(old_text), array_len(old_text),
+                              text, len);
+    }
+
+    array_free(old_text);
+
+    return status;
+}
+
 void yed_append_to_line(yed_buffer *buff, int row, yed_glyph g) {
     yed_undo_action uact;
 
@@ -741,18 +1303,13 @@ void yed_pop_from_line(yed_buffer *buff, int row) {
 }
 
 void yed_line_clear(yed_buffer *buff, int row) {
-    yed_line        *line;
-    yed_undo_action  uact;
-    yed_glyph       *git;
+    yed_line *line;
 
     line = yed_buff_get_line(buff, row);
 
-    uact.kind = UNDO_GLYPH_POP;
-    uact.row  = row;
-    yed_line_glyph_rtraverse(*line, git) {
-        uact.g = *git;
-        yed_push_undo_action(buff, &uact);
-    }
+    yed_push_undo_content(buff, row, 0,
+                          array_data(line->chars), array_len(line->chars),
+                          NULL, 0);
 
     yed_line_clear_no_undo(buff, row);
 }
@@ -771,25 +1328,13 @@ int yed_buffer_add_line(yed_buffer *buff) {
 }
 
 void yed_buff_set_line(yed_buffer *buff, int row, yed_line *line) {
-    yed_line        *old_line;
-    yed_undo_action  uact;
-    yed_glyph       *git;
+    yed_line *old_line;
 
     old_line = yed_buff_get_line(buff, row);
 
-    uact.kind = UNDO_GLYPH_POP;
-    uact.row  = row;
-    yed_line_glyph_rtraverse(*old_line, git) {
-        uact.g = *git;
-        yed_push_undo_action(buff, &uact);
-    }
-
-    uact.kind = UNDO_GLYPH_PUSH;
-    uact.row  = row;
-    yed_line_glyph_traverse(*line, git) {
-        uact.g = *git;
-        yed_push_undo_action(buff, &uact);
-    }
+    yed_push_undo_content(buff, row, 0,
+                          array_data(old_line->chars), array_len(old_line->chars),
+                          array_data(line->chars),     array_len(line->chars));
 
     yed_buff_set_line_no_undo(buff, row, line);
 }
@@ -860,29 +1405,19 @@ void yed_delete_from_line(yed_buffer *buff, int row, int col) {
 }
 
 void yed_buff_clear(yed_buffer *buff) {
-    int              row;
-    yed_line        *line;
-    yed_undo_action  uact;
-    yed_glyph       *git;
+    yed_line *last;
+    array_t   old_text;
+    int       n_lines;
 
-    for (row = bucket_array_len(buff->lines); row >= 1; row -= 1) {
-        line = yed_buff_get_line(buff, row);
+    n_lines  = bucket_array_len(buff->lines);
+    last     = yed_buff_get_line(buff, n_lines);
+    old_text = array_make(char);
 
-        uact.kind = UNDO_GLYPH_POP;
-        uact.row  = row;
-        yed_line_glyph_rtraverse(*line, git) {
-            uact.g = *git;
-            yed_push_undo_action(buff, &uact);
-        }
+    yed_buff_get_range_text(buff, 1, 0, n_lines, array_len(last->chars), &old_text);
 
-        uact.kind = UNDO_LINE_DEL;
-        uact.row  = row;
-        yed_push_undo_action(buff, &uact);
-    }
+    yed_push_undo_content(buff, 1, 0, array_data(old_text), array_len(old_text), NULL, 0);
 
-    uact.kind = UNDO_LINE_ADD;
-    uact.row  = 1;
-    yed_push_undo_action(buff, &uact);
+    array_free(old_text);
 
     yed_buff_clear_no_undo(buff);
 }
@@ -902,8 +1437,10 @@ int yed_buff_n_lines(yed_buffer *buff) {
 
 
 int yed_line_idx_to_col(yed_line *line, int idx) {
-    yed_glyph *g;
-    int        i, col, len, n_bytes;
+    yed_glyph               *g;
+    yed_line_col_index      *index;
+    yed_line_col_checkpoint *checkpoint;
+    int                      i, col, len, n_bytes;
 
     len = array_len(line->chars);
 
@@ -913,7 +1450,15 @@ int yed_line_idx_to_col(yed_line *line, int idx) {
     }
 
     col = 1;
-    for (i = 0; i < idx && i < len;) {
+    i   = 0;
+
+    if (idx > 0 && (index = yed_line_get_col_index(line)) != NULL) {
+        checkpoint = yed_line_col_index_search_idx(index, idx);
+        col        = checkpoint->col;
+        i          = checkpoint->idx;
+    }
+
+    for (; i < idx && i < len;) {
         g       = array_item(line->chars, i);
         n_bytes = yed_get_glyph_len(*g);
 
@@ -927,8 +1472,10 @@ int yed_line_idx_to_col(yed_line *line, int idx) {
 }
 
 int yed_line_col_to_idx(yed_line *line, int col) {
-    yed_glyph *g;
-    int        c, i;
+    yed_glyph               *g;
+    yed_line_col_index      *index;
+    yed_line_col_checkpoint *checkpoint;
+    int                      c, i;
 
     if (col == line->visual_width + 1) {
         return array_len(line->chars);
@@ -941,8 +1488,16 @@ int yed_line_col_to_idx(yed_line *line, int col) {
 
     ASSERT(col <= line->visual_width, "unable to convert column to glyph index");
 
+    c = 1;
     i = 0;
-    for (c = 1; c <= line->visual_width;) {
+
+    if (col > 1 && (index = yed_line_get_col_index(line)) != NULL) {
+        checkpoint = yed_line_col_index_search_col(index, col);
+        c          = checkpoint->col;
+        i          = checkpoint->idx;
+    }
+
+    for (; c <= line->visual_width;) {
         g  = array_item(line->chars, i);
         c += yed_get_glyph_width(*g);
 
@@ -1016,12 +1571,14 @@ yed_glyph * yed_buff_get_glyph(yed_buffer *buff, int row, int col) {
 
 
 int yed_fill_buff_from_file(yed_buffer *buff, char *path) {
-    char        *mode;
-    FILE        *f;
-    struct stat  fs;
-    int          fd;
-    int          status;
-    char         a_path[4096];
+    char               *mode;
+    FILE               *f;
+    struct stat         fs;
+    int                 fd;
+    int                 status;
+    char                a_path[4096];
+    unsigned long long  start_us;
+    yed_lazy_load      *old_lazy;
 
     status = BUFF_FILL_STATUS_SUCCESS;
     errno  = 0;
@@ -1054,17 +1611,40 @@ int yed_fill_buff_from_file(yed_buffer *buff, char *path) {
         return status;
     }
 
-    if ((mode = yed_get_var("buffer-load-mode"))
-    && (strcmp(mode, "map") == 0)) {
+    start_us = measure_time_now_us();
+
+    /*
+     * If the buffer was lazily loaded before, its old lines may point
+     * into the old mapping. Keep it around until they've been cleared.
+     */
+    old_lazy = yed_buff_detach_lazy_load(buff);
+
+    mode = yed_get_var("buffer-load-mode");
+    if (mode == NULL) { mode = "parallel"; }
+
+    if (strcmp(mode, "parallel") == 0) {
+        status = yed_fill_buff_from_file_parallel(buff, fd, fs.st_size);
+    } else if (strcmp(mode, "lazy") == 0) {
+        status = yed_fill_buff_from_file_lazy(buff, fd, &fs);
+    } else if (strcmp(mode, "map") == 0) {
         status = yed_fill_buff_from_file_map(buff, fd, fs.st_size);
     } else {
+        mode   = "stream";
         status = yed_fill_buff_from_file_stream(buff, f);
     }
 
+    yed_free_lazy_load(old_lazy);
+
     if (status != BUFF_FILL_STATUS_SUCCESS) {
         goto cleanup;
     }
 
+    yed_log("\nloaded %d lines from '%s' in %llums (buffer-load-mode = %s)",
+            yed_buff_n_lines(buff),
+            path,
+            (measure_time_now_us() - start_us) / 1000ULL,
+            mode);
+
     if (abs_path(path, a_path)) {
         buff->path = strdup(a_path);
     } else {
@@ -1078,6 +1658,12 @@ int yed_fill_buff_from_file(yed_buffer *buff, char *path) {
     buff->kind   = BUFF_KIND_FILE;
     buff->flags &= ~BUFF_MODIFIED;
 
+    if (yed_var_is_truthy("undo-persist")) {
+        yed_undo_load_history(buff, &fs);
+    }
+
+    yed_buff_words_loaded(buff);
+
 cleanup:
     fclose(f);
 
@@ -1167,6 +1753,8 @@ int yed_fill_buff_from_file_map(yed_buffer *buff, int fd, unsigned long long fil
         bucket_array_push(buff->lines, line);
     }
 
+    yed_buff_reset_journal(buff);
+
     return BUFF_FILL_STATUS_SUCCESS;
 }
 
@@ -1191,6 +1779,8 @@ int yed_fill_buff_from_file_stream(yed_buffer *buff, FILE *f) {
         line.chars.used      = line_len;
         line.chars.capacity  = line_cap;
         line.visual_width    = 0;
+        line.n_glyphs        = 0;
+        line.col_index       = NULL;
 
         while (array_len(line.chars)
         &&    ((c = *(char*)array_last(line.chars)) == '\n' || c == '\r')) {
@@ -1218,6 +1808,8 @@ int yed_fill_buff_from_file_stream(yed_buffer *buff, FILE *f) {
         bucket_array_push(buff->lines, line);
     }
 
+    yed_buff_reset_journal(buff);
+
     return BUFF_FILL_STATUS_SUCCESS;
 }
 
@@ -1233,6 +1825,15 @@ int yed_write_buff_to_file(yed_buffer *buff, char *path) {
     event.buffer = buff;
     yed_trigger_event(&event);
 
+    /*
+     * Don't write out a partially loaded file, and don't truncate
+     * a file that our lines still point into.
+     */
+    yed_buff_finish_loading(buff);
+    if (yed_buff_maps_file(buff, path)) {
+        yed_buff_unmap_file(buff);
+    }
+
     status = BUFF_WRITE_STATUS_SUCCESS;
     errno  = 0;
     f      = fopen(path, "w");
@@ -1276,6 +1877,11 @@ int yed_write_buff_to_file(yed_buffer *buff, char *path) {
 
     if (!(buff->flags & BUFF_SPECIAL)) {
         buff->kind = BUFF_KIND_FILE;
+
+        /* The undo file is keyed on the written file's size and mtime. */
+        if (status == BUFF_WRITE_STATUS_SUCCESS && yed_var_is_truthy("undo-persist")) {
+            yed_undo_save_history(buff);
+        }
     }
 
     if (status == BUFF_WRITE_STATUS_SUCCESS) {
@@ -1344,11 +1950,10 @@ int yed_is_in_range(yed_range *range, int row, int col) {
 
 void yed_buff_delete_selection(yed_buffer *buff) {
     yed_range *range;
-    yed_line  *line1,
-              *line2;
-    yed_glyph *g;
-    int        r1, c1, r2, c2, ctmp,
-               n, i, width;
+    yed_line  *line;
+    int        r1, c1, r2, c2,
+               n_lines,
+               row, idx, end_row, end_idx;
 
     r1 = c1 = r2 = c2 = 0;
 
@@ -1356,49 +1961,40 @@ void yed_buff_delete_selection(yed_buffer *buff) {
 
     yed_range_sorted_points(range, &r1, &c1, &r2, &c2);
 
+    n_lines = yed_buff_n_lines(buff);
+
     if (range->kind == RANGE_LINE) {
-        for (i = r1; i <= r2; i += 1) {
-            yed_buff_delete_line(buff, r1);
-        }
-    } else if (r1 == r2) {
-        line1 = yed_buff_get_line(buff, r1);
-        ctmp = c1;
-        while (ctmp < c2) {
-            g     = yed_line_col_to_glyph(line1, c1);
-            width = yed_get_glyph_width(*g);
-            yed_delete_from_line(buff, r1, c1);
-            ctmp += width;
+        r2 = MIN(r2, n_lines);
+
+        /*
+         * The lines go with the newline after them, or, if they run to the
+         * end of the buffer, the one before them.
+         */
+        if (r2 < n_lines) {
+            row     = r1;
+            idx     = 0;
+            end_row = r2 + 1;
+            end_idx = 0;
+        } else {
+            row     = MAX(r1 - 1, 1);
+            line    = yed_buff_get_line(buff, row);
+            idx     = r1 > 1 ? array_len(line->chars) : 0;
+            end_row = r2;
+            line    = yed_buff_get_line(buff, end_row);
+            end_idx = array_len(line->chars);
         }
     } else {
-        line1 = yed_buff_get_line(buff, r1);
-        ASSERT(line1, "didn't get line1 in yed_buff_delete_selection()");
-        n = 0;
-        while (c1 <= line1->visual_width) {
-            g      = yed_line_col_to_glyph(line1, c1);
-            width  = yed_get_glyph_width(*g);
-            c1    += width;
-            n     += 1;
-        }
-        for (i = 0; i < n; i += 1) {
-            yed_pop_from_line(buff, r1);
-        }
-        for (i = r1 + 1; i < r2; i += 1) {
-            yed_buff_delete_line(buff, r1 + 1);
-        }
-        line2 = yed_buff_get_line(buff, r1 + 1);
-        ASSERT(line2, "didn't get line2 in yed_buff_delete_selection()");
-        ctmp = c2;
-        while (ctmp <= line2->visual_width) {
-            g = yed_line_col_to_glyph(line2, ctmp);
-            yed_append_to_line(buff, r1, *g);
-            ctmp += yed_get_glyph_width(*g);
-        }
-        yed_buff_delete_line(buff, r1 + 1);
+        row     = r1;
+        line    = yed_buff_get_line(buff, r1);
+        ASSERT(line, "didn't get line1 in yed_buff_delete_selection()");
+        idx     = c1 > line->visual_width ? array_len(line->chars) : yed_line_col_to_idx(line, c1);
+        end_row = r2;
+        line    = yed_buff_get_line(buff, r2);
+        ASSERT(line, "didn't get line2 in yed_buff_delete_selection()");
+        end_idx = c2 > line->visual_width ? array_len(line->chars) : yed_line_col_to_idx(line, c2);
     }
 
-    if (!bucket_array_len(buff->lines)) {
-        yed_buffer_add_line(buff);
-    }
+    yed_buff_replace_range(buff, row, idx, end_row, end_idx, NULL, 0);
 
     buff->has_selection = 0;
 }
@@ -1425,6 +2021,7 @@ void yed_update_line_visual_widths(void) {
         buff = tree_it_val(bit);
         bucket_array_traverse(buff->lines, line) {
             line->visual_width = 0;
+            yed_line_invalidate_col_index(line);
             yed_line_glyph_traverse(*line, glyph) {
                 line->visual_width += yed_get_glyph_width(*glyph);
             }
@@ -2,10 +2,33 @@
 #define __BUFFER_H__
 
 
+/*
+ * Sparse map from columns to byte offsets for long lines.
+ * There's a checkpoint at the first glyph at least
+ * YED_LINE_COL_INDEX_STRIDE columns past the previous one.
+ * It's built lazily by yed_line_col_to_idx() and yed_line_idx_to_col()
+ * and thrown away by anything that changes the line's glyphs.
+ */
+#define YED_LINE_COL_INDEX_STRIDE    (64)
+#define YED_LINE_COL_INDEX_MIN_BYTES (256)
+
+typedef struct {
+    int idx;
+    int col;
+} yed_line_col_checkpoint;
+
+typedef struct {
+    int                     n_bytes;
+    int                     visual_width;
+    int                     n_checkpoints;
+    yed_line_col_checkpoint checkpoints[];
+} yed_line_col_index;
+
 typedef struct yed_line_t {
-    array_t chars;
-    int     visual_width;
-    int     n_glyphs;
+    array_t             chars;
+    int                 visual_width;
+    int                 n_glyphs;
+    yed_line_col_index *col_index;
 } yed_line;
 
 #define RANGE_NORMAL  (0x1)
@@ -38,6 +61,55 @@ typedef struct {
 #define BUFF_WRITE_STATUS_ERR_PER (2)
 #define BUFF_WRITE_STATUS_ERR_UNK (3)
 
+/*
+ * State for a buffer loaded with buffer-load-mode 'lazy'.
+ * The file stays mapped for the life of the buffer and lines point
+ * directly into the mapping. Lines past the first screenful are found
+ * by a background thread and appended to the buffer between pumps.
+ */
+typedef struct {
+    char               *map;
+    unsigned long long  map_len;
+    unsigned long long  file_size;
+    dev_t               dev;
+    ino_t               ino;
+    pthread_t           thread;
+    int                 has_thread;  /* thread is only valid if set. */
+    pthread_mutex_t     mtx;
+    array_t             batches;
+    unsigned long long  scanned;
+    unsigned long long  start_us;
+    int                 loading;
+    int                 thread_done;
+    int                 cancel;
+    int                 was_rd_only;
+} yed_lazy_load;
+
+/*
+ * A change to a buffer, in rows: rows [row, row + n_old_rows) were replaced
+ * by rows [row, row + n_new_rows). An edit within one line is 1 -> 1, an
+ * inserted line 0 -> 1, and so on.
+ * kind is the BUFF_MOD_* kind of the edit(s), or BUFF_MOD_BATCH when edits of
+ * different kinds have been coalesced into one change.
+ */
+typedef struct {
+    unsigned long long version_before;
+    unsigned long long version_after;
+    int                kind;
+    int                row;
+    int                n_old_rows;
+    int                n_new_rows;
+} yed_buffer_change;
+
+/*
+ * Each buffer keeps a journal of its most recent changes so that anything
+ * that derives state from a buffer can bring it up to date with
+ * yed_buff_changes_since() instead of handling every EVENT_BUFFER_POST_MOD.
+ * Consecutive edits to the same or adjacent rows are coalesced into one
+ * entry, so the journal stays small.
+ */
+#define BUFF_JOURNAL_MAX_CHANGES (64)
+
 typedef struct yed_buffer_t {
     int                   kind;
     int                   flags;
@@ -53,6 +125,14 @@ typedef struct yed_buffer_t {
     int                   last_cursor_row,
                           last_cursor_col;
     char                 *mmap_underlying_buff;
+    yed_lazy_load        *lazy_load;
+    unsigned long long    version;  /* Incremented by every modification. */
+    array_t               journal;  /* yed_buffer_change, oldest first */
+    unsigned long long    journal_base_version;
+    int                   journal_sealed;
+    int                   batch_depth;
+    yed_buffer_change     batch;
+    struct yed_buff_words_t *words; /* For word completion. See words.h. */
 } yed_buffer;
 
 void yed_init_buffers(void);
@@ -60,6 +140,7 @@ void yed_init_buffers(void);
 yed_line yed_new_line(void);
 yed_line yed_new_line_with_cap(int len);
 void yed_free_line(yed_line *line);
+void yed_line_invalidate_col_index(yed_line *line);
 
 yed_line * yed_copy_line(yed_line *line);
 
@@ -98,6 +179,23 @@ void yed_buff_delete_line_no_undo(yed_buffer *buff, int row);
 void yed_insert_into_line_no_undo(yed_buffer *buff, int row, int col, yed_glyph g);
 void yed_delete_from_line_no_undo(yed_buffer *buff, int row, int col);
 void yed_buff_clear_no_undo(yed_buffer *buff);
+/*
+ * Appends raw output (from a subprocess, for example) to the end of the
+ * buffer. The text continues the last line, each '\n' starts a new one and
+ * '\r's are dropped. Like loading a file, this ignores BUFF_RD_ONLY and can't
+ * be undone. Listeners get a single BUFF_MOD_BATCH post-mod event.
+ * bytes shouldn't end in the middle of a UTF-8 sequence.
+ */
+void yed_buff_append_output(yed_buffer *buff, const char *bytes, int len);
+/*
+ * Replaces the text from byte idx of row up to byte end_idx of end_row with
+ * text, in which '\n' separates lines. This is done in one go, with one
+ * EVENT_BUFFER_PRE_MOD and one EVENT_BUFFER_POST_MOD, both BUFF_MOD_BATCH.
+ * Returns 0 if the buffer is read-only or the edit was cancelled.
+ */
+int yed_buff_replace_range_no_undo(yed_buffer *buff, int row, int idx, int end_row, int end_idx, const char *text, int len);
+/* Finds where text ends if it starts at byte idx of row. */
+void yed_get_text_end(int row, int idx, const char *text, int len, int *end_row, int *end_idx);
 /*
  * The following functions are the interface by which everything
  * else should modify buffers.
@@ -114,6 +212,45 @@ void yed_buff_delete_line(yed_buffer *buff, int row);
 void yed_insert_into_line(yed_buffer *buff, int row, int col, yed_glyph g);
 void yed_delete_from_line(yed_buffer *buff, int row, int col);
 void yed_buff_clear(yed_buffer *buff);
+/*
+ * Like yed_buff_replace_range_no_undo(), but records the replacement as a
+ * single undo action holding just the bytes that changed.
+ */
+int yed_buff_replace_range(yed_buffer *buff, int row, int idx, int end_row, int end_idx, const char *text, int len);
+
+/*
+ * Edits made between yed_buff_begin_batch() and yed_buff_end_batch() still
+ * trigger EVENT_BUFFER_PRE_MOD (so they can be cancelled), but instead of an
+ * EVENT_BUFFER_POST_MOD for each of them, a single one with kind
+ * BUFF_MOD_BATCH is triggered at the end. Its row is the first changed row
+ * and its buff_change describes the whole range. Batches may nest.
+ */
+void yed_buff_begin_batch(yed_buffer *buff);
+void yed_buff_end_batch(yed_buffer *buff);
+
+/*
+ * Returns the buffer's version, to be passed to yed_buff_changes_since()
+ * later.
+ */
+unsigned long long yed_buff_get_version(yed_buffer *buff);
+/*
+ * Fills *change with one change that covers everything that has happened to
+ * the buffer since version (which may be the current version, in which case
+ * the change is empty). Returns 0 if the journal doesn't go back that far,
+ * in which case the caller should rebuild whatever it derives from the
+ * buffer from scratch.
+ */
+int yed_buff_changes_since(yed_buffer *buff, unsigned long long version, yed_buffer_change *change);
+/*
+ * Records a change made without going through the functions above (e.g. by
+ * the file loaders) and bumps the buffer's version. No events are triggered.
+ */
+void yed_buff_record_change(yed_buffer *buff, int kind, int row, int n_old_rows, int n_new_rows);
+/*
+ * Forgets the buffer's journal, so that every version before now is too old
+ * for yed_buff_changes_since().
+ */
+void yed_buff_reset_journal(yed_buffer *buff);
 
 
 int yed_buff_n_lines(yed_buffer *buff);
@@ -121,6 +258,15 @@ int yed_buff_n_lines(yed_buffer *buff);
 
 int yed_fill_buff_from_file(yed_buffer *buff, char *path);
 int yed_fill_buff_from_file_map(yed_buffer *buff, int fd, unsigned long long file_size);
+int yed_fill_buff_from_file_parallel(yed_buffer *buff, int fd, unsigned long long file_size);
+int yed_fill_buff_from_file_lazy(yed_buffer *buff, int fd, struct stat *fs);
+void yed_service_lazy_loads(void);
+int yed_buff_is_loading(yed_buffer *buff);
+void yed_buff_finish_loading(yed_buffer *buff);
+yed_lazy_load * yed_buff_detach_lazy_load(yed_buffer *buff);
+void yed_free_lazy_load(yed_lazy_load *lazy);
+int yed_buff_maps_file(yed_buffer *buff, const char *path);
+void yed_buff_unmap_file(yed_buffer *buff);
 int yed_fill_buff_from_file_stream(yed_buffer *buff, FILE *f);
 int yed_write_buff_to_file(yed_buffer *buff, char *path);
 
@@ -145,7 +291,9 @@ void yed_update_line_visual_widths(void);
          it = ((void*)it) + yed_get_glyph_len(*it))
 
 /*
- * NOTE: This is an O(n^2) traversal, so avoid if possible.
+ * NOTE: Each step of this traversal is a column lookup, so it's
+ * O(n log n) on long lines and O(n^2) on short non-ASCII ones.
+ * Avoid if possible.
  */
 #define yed_line_glyph_rtraverse(array, it)                                               \
     for (it = yed_line_last_glyph(&(array));                                              \
@@ -1,5 +1,6 @@
 void yed_init_commands(void) {
     ys->commands         = tree_make(yed_command_name_t, yed_command);
+    ys->commands_index   = hash_map_make(yed_command);
     ys->default_commands = tree_make(yed_command_name_t, yed_command);
     yed_set_default_commands();
 
@@ -16,15 +17,15 @@ void yed_init_commands(void) {
 }
 
 yed_command yed_get_command(char *name) {
-    tree_it(yed_command_name_t, yed_command) it;
+    yed_command *cmd;
 
-    it = tree_lookup(ys->commands, name);
+    cmd = hash_map_lookup(ys->commands_index, name);
 
-    if (!tree_it_good(it)) {
+    if (cmd == NULL) {
         return NULL;
     }
 
-    return tree_it_val(it);
+    return *cmd;
 }
 
 void yed_set_command(char *name, yed_command command) {
@@ -37,6 +38,8 @@ void yed_set_command(char *name, yed_command command) {
     } else {
         tree_insert(ys->commands, strdup(name), command);
     }
+
+    hash_map_insert(ys->commands_index, name, command);
 }
 
 void yed_unset_command(char *name) {
@@ -48,6 +51,7 @@ void yed_unset_command(char *name) {
     if (tree_it_good(it)) {
         old_key = tree_it_key(it);
         tree_delete(ys->commands, name);
+        hash_map_delete(ys->commands_index, name);
         free(old_key);
     }
 }
@@ -164,6 +168,7 @@ do {                                                              \
     SET_DEFAULT_COMMAND("suspend",                            suspend);
     SET_DEFAULT_COMMAND("scomps-list",                        scomps_list);
     SET_DEFAULT_COMMAND("version",                            version);
+    SET_DEFAULT_COMMAND("screen-stats",                       screen_stats);
     SET_DEFAULT_COMMAND("show-bindings",                      show_bindings);
     SET_DEFAULT_COMMAND("show-vars",                          show_vars);
     SET_DEFAULT_COMMAND("special-buffer-prepare-focus",       special_buffer_prepare_focus);
@@ -1504,9 +1509,8 @@ out:;
 }
 
 void yed_default_command_buffer_delete(int n_args, char **args) {
-    yed_buffer                                   *buffer;
-    yed_frame                                    *frame;
-    tree_it(yed_buffer_name_t, yed_buffer_ptr_t)  it;
+    yed_buffer *buffer;
+    yed_frame  *frame;
 
     if (n_args == 0) {
         if (!ys->active_frame) {
@@ -1523,10 +1527,8 @@ void yed_default_command_buffer_delete(int n_args, char **args) {
 
         buffer = frame->buffer;
     } else if (n_args == 1) {
-        it = tree_lookup(ys->buffers, args[0]);
-        if (tree_it_good(it)) {
-            buffer = tree_it_val(it);
-        } else {
+        buffer = yed_get_buffer(args[0]);
+        if (buffer == NULL) {
             yed_cerr("no such buffer '%s'", args[0]);
             return;
         }
@@ -1764,13 +1766,12 @@ void yed_default_command_buffer_set_ft(int n_args, char **args) {
 }
 
 void yed_default_command_buffer_reload(int n_args, char **args) {
-    yed_frame                                    *frame;
-    yed_buffer                                   *buffer;
-    tree_it(yed_buffer_name_t, yed_buffer_ptr_t)  it;
-    yed_event                                     event;
-    int                                           line;
-    int                                           col;
-    int                                           status;
+    yed_frame  *frame;
+    yed_buffer *buffer;
+    yed_event   event;
+    int         line;
+    int         col;
+    int         status;
 
     frame = NULL;
 
@@ -1789,10 +1790,8 @@ void yed_default_command_buffer_reload(int n_args, char **args) {
 
         buffer = frame->buffer;
     } else if (n_args == 1) {
-        it = tree_lookup(ys->buffers, args[0]);
-        if (tree_it_good(it)) {
-            buffer = tree_it_val(it);
-        } else {
+        buffer = yed_get_buffer(args[0]);
+        if (buffer == NULL) {
             yed_cerr("no such buffer '%s'", args[0]);
             return;
         }
@@ -2261,11 +2260,17 @@ void yed_default_command_insert(int n_args, char **args) {
 void yed_default_command_simple_insert_string(int n_args, char **args) {
     yed_frame  *frame;
     yed_buffer *buff;
+    yed_line   *line;
     int         row, col;
     int         tabw;
     char       *git;
     yed_glyph   g;
     int         i;
+    array_t     text;
+    char        space,
+                newline;
+    char       *nl;
+    int         num_orig_undo_records;
 
     if (n_args != 1) {
         yed_cerr("expected 1 argument, but got %d", n_args);
@@ -2296,29 +2301,54 @@ void yed_default_command_simple_insert_string(int n_args, char **args) {
     tabw = yed_get_tab_width();
     git  = args[0];
 
-    yed_start_undo_record(frame, buff);
+    text    = array_make(char);
+    space   = ' ';
+    newline = '\n';
+
     while (*git) {
         g = *(yed_glyph*)git;
         switch (*git) {
             case ENTER:
-                yed_buff_insert_line(buff, row + 1);
-                row += 1;
-                col  = 1;
+                /* "\r\n" is just one newline. */
+                if (git[1] == NEWLINE) { git += 1; }
+                /* fall through */
+            case NEWLINE:
+                array_push(text, newline);
                 break;
             case TAB:
-                g.c = ' ';
                 for (i = 0; i < tabw; i += 1) {
-                    yed_insert_into_line(buff, row, col, g);
-                    col += 1;
+                    array_push(text, space);
                 }
                 break;
             default:
-                yed_insert_into_line(buff, row, col, g);
-                col += 1;
+                array_push_n(text, git, yed_get_glyph_len(g));
         }
         git += yed_get_glyph_len(g);
     }
-    yed_end_undo_record(frame, buff);
+    array_zero_term(text);
+
+    /*
+     * Each newline starts a new line below the cursor's line, but whatever
+     * was after the cursor stays where it was. So insert everything up to
+     * the first newline at the cursor and the rest at the end of the line.
+     */
+    num_orig_undo_records = yed_get_undo_num_records(buff);
+
+    nl = strchr(array_data(text), newline);
+    if (nl != NULL) { *nl = 0; }
+    yed_buff_insert_string(buff, array_data(text), row, col);
+    if (nl != NULL) {
+        *nl  = newline;
+        line = yed_buff_get_line(buff, row);
+        yed_buff_insert_string(buff, nl, row, line->visual_width + 1);
+    }
+
+    /* Both insertions are undone together. */
+    while (yed_get_undo_num_records(buff) > num_orig_undo_records + 1) {
+        yed_merge_undo_records(buff);
+    }
+
+    array_free(text);
 
     if (ys->current_search) {
         if (yed_var_is_truthy("cursor-move-clears-search")) {
@@ -3036,10 +3066,10 @@ void yed_default_command_paste_yank_buffer(int n_args, char **args) {
     yed_frame  *frame;
     yed_buffer *buff;
     yed_buffer *yank_buff;
-    yed_line   *line_it,
-               *first_line;
-    int         yank_buff_n_lines, first_row, last_row, new_row, row, col;
-    yed_glyph  *g;
+    yed_line   *line;
+    int         yank_buff_n_lines, row, idx;
+    char        nl;
+    array_t     text;
 
     if (n_args != 0) {
         yed_cerr("expected 0 arguments, but got %d", n_args);
@@ -3070,78 +3100,46 @@ void yed_default_command_paste_yank_buffer(int n_args, char **args) {
         return;
     }
 
-    yed_start_undo_record(frame, frame->buffer);
-
     yank_buff = yed_get_yank_buffer();
     yank_buff_n_lines = yed_buff_n_lines(yank_buff);
 
     ASSERT(yank_buff_n_lines, "yank buffer has no lines");
 
-    if (yank_buff->flags & BUFF_YANK_LINES) {
-        for (row = 1; row <= yank_buff_n_lines; row += 1) {
-            new_row = frame->cursor_line + row;
-            yed_buff_insert_line(buff, new_row);
-            line_it = yed_buff_get_line(yank_buff, row);
-            for (col = 1; col <= line_it->visual_width;) {
-                g = yed_line_col_to_glyph(line_it, col);
-                yed_append_to_line(buff, new_row, *g);
-                col += yed_get_glyph_width(*g);
-            }
+    nl   = '\n';
+    text = array_make(char);
+
+    /* Lines are pasted below the cursor's line, so each one follows a newline. */
+    for (row = 1; row <= yank_buff_n_lines; row += 1) {
+        if (row > 1 || (yank_buff->flags & BUFF_YANK_LINES)) {
+            array_push(text, nl);
         }
-        yed_set_cursor_far_within_frame(frame, frame->cursor_line + 1, 1);
-    } else {
-        if (yank_buff_n_lines == 1) {
-            line_it  = yed_buff_get_line(yank_buff, 1);
-            for (col = 1; col <= line_it->visual_width;) {
-                g = yed_line_col_to_glyph(line_it, col);
-                yed_insert_into_line(buff,
-                    frame->cursor_line,
-                    frame->cursor_col + col - 1,
-                    *g);
-                col += yed_get_glyph_width(*g);
-            }
-        } else {
-            last_row   = frame->cursor_line + 1;
-            yed_buff_insert_line(buff, last_row);
-            first_row  = frame->cursor_line;
-            first_line = yed_buff_get_line(buff, first_row);
-            for (col = frame->cursor_col; col <= first_line->visual_width;) {
-                g = yed_line_col_to_glyph(first_line, col);
-                yed_append_to_line(buff, last_row, *g);
-                col += yed_get_glyph_width(*g);
-            }
-            while (first_line->visual_width >= frame->cursor_col) {
-                yed_pop_from_line(buff, first_row);
-            }
-            line_it  = yed_buff_get_line(yank_buff, 1);
-            for (col = 1; col <= line_it->visual_width;) {
-                g = yed_line_col_to_glyph(line_it, col);
-                yed_append_to_line(buff, first_row, *g);
-                col += yed_get_glyph_width(*g);
-            }
-            for (row = 2; row <= yank_buff_n_lines - 1; row += 1) {
-                new_row = frame->cursor_line + row - 1;
-                yed_buff_insert_line(buff, new_row);
-                line_it = yed_buff_get_line(yank_buff, row);
-                for (col = 1; col <= line_it->visual_width;) {
-                    g = yed_line_col_to_glyph(line_it, col);
-                    yed_append_to_line(buff, new_row, *g);
-                    col += yed_get_glyph_width(*g);
-                }
-            }
-            line_it  = yed_buff_get_line(yank_buff, yank_buff_n_lines);
-            for (col = 1; col <= line_it->visual_width;) {
-                g = yed_line_col_to_glyph(line_it, col);
-                yed_insert_into_line(buff,
-                    frame->cursor_line + yank_buff_n_lines - 1,
-                    col,
-                    *g);
-                col += yed_get_glyph_width(*g);
-            }
+        line = yed_buff_get_line(yank_buff, row);
+        if (array_len(line->chars) > 0) {
+            array_push_n(text, array_data(line->chars), array_len(line->chars));
         }
     }
 
+    line = yed_buff_get_line(buff, frame->cursor_line);
+
+    if (yank_buff->flags & BUFF_YANK_LINES
+    ||  frame->cursor_col > line->visual_width) {
+        idx = array_len(line->chars);
+    } else {
+        idx = yed_line_col_to_idx(line, frame->cursor_col);
+    }
+
+    yed_start_undo_record(frame, frame->buffer);
+
+    yed_buff_replace_range(buff, frame->cursor_line, idx, frame->cursor_line, idx,
+                           array_data(text), array_len(text));
+
+    if (yank_buff->flags & BUFF_YANK_LINES) {
+        yed_set_cursor_far_within_frame(frame, frame->cursor_line + 1, 1);
+    }
+
     yed_end_undo_record(frame, frame->buffer);
+
+    array_free(text);
 }
 
 int yed_inc_find_in_buffer(void) {
@@ -3367,7 +3365,9 @@ void yed_replace_current_search_update_line(int idx, int row) {
 
     working_line = *(yed_line**)array_item(ys->replace_working_lines, idx);
     line         = yed_copy_line(working_line);
-    yed_buff_set_line(buff, row, line);
+    yed_buff_set_line_no_undo(buff, row, line);
+    yed_free_line(line);
+    free(line);
     line = NULL;
 
     replacement = array_data(ys->cmd_buff);
@@ -3378,7 +3378,7 @@ void yed_replace_current_search_update_line(int idx, int row) {
     array_traverse(*markers, mark) {
         for (i = len - 1; i >= 0; i -= 1) {
             g = G(replacement[i]);
-            yed_insert_into_line(buff, row, *mark + (it * len), g);
+            yed_insert_into_line_no_undo(buff, row, *mark + (it * len), g);
         }
         it += 1;
     }
@@ -3417,11 +3417,63 @@ void replace_abort(void) {
     i = 0;
     for (row = r1; row <= r2; row += 1) {
         save_line = *(yed_line**)array_item(ys->replace_save_lines, i);
-        yed_buff_set_line(ys->active_frame->buffer, row, save_line);
+        yed_buff_set_line_no_undo(ys->active_frame->buffer, row, save_line);
         i += 1;
     }
 }
 
+/*
+ * The lines are edited without undo while the replacement is typed, so
+ * record the whole thing at the end as one change from the saved lines.
+ */
+void replace_push_undo(void) {
+    int         row, r1, c1, r2, c2, i;
+    yed_buffer *buff;
+    yed_line   *line;
+    array_t     old_text,
+                new_text;
+    char        nl;
+
+    buff = ys->active_frame->buffer;
+
+    if (buff->has_selection) {
+        yed_range_sorted_points(&buff->selection, &r1, &c1, &r2, &c2);
+    } else {
+        r1 = r2 = ys->active_frame->cursor_line;
+    }
+
+    old_text = array_make(char);
+    new_text = array_make(char);
+    nl       = '\n';
+
+    i = 0;
+    for (row = r1; row <= r2; row += 1) {
+        if (row > r1) {
+            array_push(old_text, nl);
+            array_push(new_text, nl);
+        }
+
+        line = *(yed_line**)array_item(ys->replace_save_lines, i);
+        if (array_len(line->chars) > 0) {
+            array_push_n(old_text, array_data(line->chars), array_len(line->chars));
+        }
+
+        line = yed_buff_get_line(buff, row);
+        if (array_len(line->chars) > 0) {
+            array_push_n(new_text, array_data(line->chars), array_len(line->chars));
+        }
+
+        i += 1;
+    }
+
+    yed_push_undo_content(buff, r1, 0,
+                          array_data(old_text), array_len(old_text),
+                          array_data(new_text), array_len(new_text));
+
+    array_free(old_text);
+    array_free(new_text);
+}
+
 void replace_free(void) {
     yed_line **line_it;
     array_t   *markers_it;
@@ -3455,6 +3507,7 @@ void yed_replace_current_search_take_key(int key) {
         case ENTER:
             yed_replace_current_search_update();
 
+            replace_push_undo();
             replace_free();
             yed_end_undo_record(ys->active_frame, ys->active_frame->buffer);
 
@@ -3483,42 +3536,68 @@ void yed_replace_current_search_take_key(int key) {
     }
 }
 
-void replace_add_line(yed_buffer *buff, int row, int len) {
+void replace_add_line(yed_buffer *buff, int row) {
     yed_line  *line,
               *save_line,
               *working_line;
-    int        idx, col, j;
-    array_t    markers;
-    yed_glyph *git;
+    int        idx, off, col, len, n_glyphs, width, removed, j;
+    yed_glyph *g;
+    array_t    markers,
+               cols,
+               counts;
 
     line      = yed_buff_get_line(buff, row);
     markers   = array_make(int);
+    cols      = array_make(int);
+    counts    = array_make(int);
     save_line = yed_copy_line(line);
 
     array_push(ys->replace_save_lines, save_line);
 
-    while (1) {
-        yed_line_glyph_traverse(*line, git) {
-            if (((void*)git) + len - 1 > array_last(line->chars)) { break; }
-            if (strncmp(&git->c, ys->current_search, len) == 0) {
-                idx = ((void*)git - line->chars.data);
-                col = yed_line_idx_to_col(line, idx);
-                array_push(markers, col);
-                ys->replace_count += 1;
+    /*
+     * Find every match in the original line first, so that a pattern can't
+     * match text that only comes together once earlier matches are gone.
+     * The markers are where each match starts once the ones before it have
+     * been deleted.
+     */
+    off     = 0;
+    removed = 0;
+    while (off < array_len(save_line->chars)
+    &&     (idx = yed_search_line_next_match(buff, save_line, off, &len)) >= 0) {
+        col = yed_line_idx_to_col(save_line, idx);
+
+        n_glyphs = 0;
+        width    = 0;
+        for (j = idx; j < idx + len; j += yed_get_glyph_len(*g)) {
+            g         = array_item(save_line->chars, j);
+            n_glyphs += 1;
+            width    += yed_get_glyph_width(*g);
+        }
 
+        array_push(cols, col);
+        array_push(counts, n_glyphs);
 
-                for (j = 0; j < len; j += 1) {
-                    yed_delete_from_line(buff, row, col);
-                }
+        col -= removed;
+        array_push(markers, col);
 
-                goto cont;
-            }
+        ys->replace_count += 1;
+        removed           += width;
+        off                = idx + len;
+    }
+
+    /* Right to left, so that the columns of the earlier matches still hold. */
+    for (j = array_len(cols) - 1; j >= 0; j -= 1) {
+        col      = *(int*)array_item(cols, j);
+        n_glyphs = *(int*)array_item(counts, j);
+
+        while (n_glyphs--) {
+            yed_delete_from_line_no_undo(buff, row, col);
         }
-        break;
-    cont:
-        continue;
     }
 
+    array_free(cols);
+    array_free(counts);
+
     array_push(ys->replace_markers, markers);
     working_line = yed_copy_line(line);
     array_push(ys->replace_working_lines, working_line);
@@ -3526,7 +3605,6 @@ void replace_add_line(yed_buffer *buff, int row, int len) {
 
 void yed_start_replace_current_search(void) {
     yed_buffer *buff;
-    int         len;
     int         row, r1, c1, r2, c2;
 
     ys->interactive_command  = "replace-current-search";
@@ -3537,7 +3615,6 @@ void yed_start_replace_current_search(void) {
     ys->replace_count        = 0;
 
     buff = ys->active_frame->buffer;
-    len  = strlen(ys->current_search);
 
     yed_start_undo_record(ys->active_frame, buff);
 
@@ -3551,7 +3628,7 @@ void yed_start_replace_current_search(void) {
     }
 
     for (row = r1; row <= r2; row += 1) {
-        replace_add_line(buff, row, len);
+        replace_add_line(buff, row);
     }
 
     yed_clear_cmd_buff();
@@ -3622,6 +3699,8 @@ void yed_default_command_style_off(int n_args, char **args) {
         ys->active_style = NULL;
     }
 
+    yed_invalidate_line_draw_caches();
+
     memset(&event, 0, sizeof(event));
     event.kind = EVENT_STYLE_CHANGE;
     yed_trigger_event(&event);
@@ -3826,6 +3905,28 @@ void yed_default_command_version(int n_args, char **args) {
     yed_cprint("%d", YED_VERSION);
 }
 
+void yed_default_command_screen_stats(int n_args, char **args) {
+    unsigned long long n_pumps;
+    unsigned long long n_renders;
+
+    if (n_args != 0) {
+        yed_cerr("expected 0 arguments, but got %d", n_args);
+        return;
+    }
+
+    n_pumps   = MAX(ys->n_pumps, 1);
+    n_renders = MAX(ys->n_renders, 1);
+
+    yed_cprint("%llu frames (%llu dropped) -- average draw: %lluus, diff: %lluus, render: %lluus (%llu bytes), write: %lluus",
+               ys->n_renders,
+               ys->n_dropped_frames,
+               ys->draw_accum_us      / n_pumps,
+               ys->diff_accum_us      / n_renders,
+               ys->render_accum_us    / n_renders,
+               ys->render_accum_bytes / n_renders,
+               ys->write_accum_us     / n_renders);
+}
+
 void yed_default_command_show_bindings(int n_args, char **args) {
     if (n_args != 0) {
         yed_cerr("expected 0 arguments, but got %d", n_args);
@@ -4037,7 +4138,6 @@ int yed_execute_command_from_split(array_t split) {
 }
 
 int yed_execute_command(char *name, int n_args, char **args) {
-    tree_it(yed_command_name_t, yed_command)   it;
     yed_command                                cmd;
     yed_event                                  evt;
     char                                       name_cpy[256];
@@ -4047,9 +4147,9 @@ int yed_execute_command(char *name, int n_args, char **args) {
         yed_clear_cmd_buff();
     }
 
-    it = tree_lookup(ys->commands, name);
+    cmd = yed_get_command(name);
 
-    if (!tree_it_good(it)) {
+    if (cmd == NULL) {
         yed_append_text_to_cmd_buff("[!] unknown command '");
         yed_append_text_to_cmd_buff(name);
         yed_append_text_to_cmd_buff("'");
@@ -4061,8 +4161,6 @@ LOG_EXIT();
         return 1;
     }
 
-    cmd = tree_it_val(it);
-
     if (!ys->interactive_command) {
         ys->cmd_prompt = YED_CMD_PROMPT;
         yed_append_text_to_cmd_buff("(");
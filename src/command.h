@@ -119,6 +119,7 @@ DEF_DEFAULT_COMMAND(multi);
 DEF_DEFAULT_COMMAND(suspend);
 DEF_DEFAULT_COMMAND(scomps_list);
 DEF_DEFAULT_COMMAND(version);
+DEF_DEFAULT_COMMAND(screen_stats);
 DEF_DEFAULT_COMMAND(show_bindings);
 DEF_DEFAULT_COMMAND(show_vars);
 DEF_DEFAULT_COMMAND(special_buffer_prepare_focus);
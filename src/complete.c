@@ -220,88 +220,68 @@ out:;
     return status;
 }
 
-static void get_all_line_words(tree(str_t, empty_t) words, yed_line *line) {
-    int  col, start_col;
-    char c, *word_start, *word;
-
-    col = 1;
-
-    while (col < line->visual_width) {
-        start_col = col;
-
-        c = ((yed_glyph*)yed_line_col_to_glyph(line, col))->c;
-
-        if (is_alnum(c) || c == '_') {
-            while (col <= line->visual_width) {
-                col += 1;
-                c    = ((yed_glyph*)yed_line_col_to_glyph(line, col))->c;
-
-                if (!is_alnum(c) && c != '_') {
-                    break;
-                }
-            }
-
-            word_start = array_data(line->chars)
-                         + yed_line_col_to_idx(line, start_col);
-
-            word = strndup(word_start, col - start_col);
-
-            tree_insert(words, word, (empty_t){});
-        } else if (!is_space(c)) {
-            while (col <= line->visual_width) {
-                col += 1;
-                c    = ((yed_glyph*)yed_line_col_to_glyph(line, col))->c;
+static int yed_compare_strings(const void *a, const void *b) {
+    return strcmp(*(char**)a, *(char**)b);
+}
 
-                if (is_alnum(c) || c == '_' || is_space(c)) {
-                    break;
-                }
-            }
+static int yed_default_completion_words(char *string, yed_completion_results *results) {
+    tree_it(yed_buffer_name_t, yed_buffer_ptr_t)   buff_it;
+    tree_it(str_t, int)                            it;
+    yed_buff_words                                *words;
+    int                                            len;
+    int                                            n_before;
+    int                                            n_sources;
+    char                                          *key;
+    char                                         **strings;
+    int                                            i;
+    int                                            j;
+
+    if (string == NULL) { return COMPL_ERR_NO_MATCH; }
+
+    len       = strlen(string);
+    n_sources = 0;
+
+    array_clear(results->strings);
+
+    tree_traverse(ys->buffers, buff_it) {
+        if ((words = yed_buff_get_words(tree_it_val(buff_it))) == NULL) { continue; }
+
+        n_before = array_len(results->strings);
+
+        for (it = tree_gtr(words->words, string); tree_it_good(it); tree_it_next(it)) {
+            key = tree_it_key(it);
+            if (strncmp(key, string, len) != 0) { break; }
+            key = strdup(key);
+            array_push(results->strings, key);
         }
 
-        if (is_space(c)) {
-            while (col <= line->visual_width) {
-                col += 1;
-                c    = ((yed_glyph*)yed_line_col_to_glyph(line, col))->c;
-
-                if (!is_space(c)) {
-                    break;
-                }
-            }
+        if (array_len(results->strings) > n_before) {
+            n_sources += 1;
         }
     }
-}
 
-static void get_all_buff_words(tree(str_t, empty_t) words) {
-    tree_it(yed_buffer_name_t, yed_buffer_ptr_t)  it;
-    yed_line                                     *line;
+    if (array_len(results->strings) == 0) { return COMPL_ERR_NO_MATCH; }
 
-    tree_traverse(ys->buffers, it) {
-        bucket_array_traverse(tree_it_val(it)->lines, line) {
-            get_all_line_words(words, line);
-        }
-    }
-}
+    /* Each buffer's words are already sorted. Merge them if there's more than one. */
+    if (n_sources > 1) {
+        strings = array_data(results->strings);
 
-static int yed_default_completion_words(char *string, yed_completion_results *results) {
-    tree(str_t, empty_t)     t;
-    tree_it(str_t, empty_t)  it;
-    int                      status;
-    char                    *key;
+        qsort(strings, array_len(results->strings), sizeof(char*), yed_compare_strings);
 
-    t = tree_make(str_t, empty_t);
-    get_all_buff_words(t);
-
-    FN_BODY_FOR_COMPLETE_FROM_TREE(string, t, it, results, status);
+        j = 0;
+        for (i = 0; i < array_len(results->strings); i += 1) {
+            if (j > 0 && strcmp(strings[i], strings[j - 1]) == 0) {
+                free(strings[i]);
+            } else {
+                strings[j] = strings[i];
+                j         += 1;
+            }
+        }
 
-    while (tree_len(t)) {
-        it  = tree_begin(t);
-        key = tree_it_key(it);
-        tree_delete(t, key);
-        free(key);
+        results->strings.used = j;
     }
-    tree_free(t);
 
-    return status;
+    return COMPL_ERR_NO_ERR;
 }
 
 
@@ -415,56 +395,18 @@ none:
 }
 
 int get_buff_word_completion(char *in, char ***out) {
-    tree(str_t, empty_t)      words;
-    tree_it(str_t, empty_t)   it;
-    int                       in_len,
-                              i,
-                              n_items;
-    char                    **items,
-                             *key;
+    yed_completion_results results;
 
-    words   = tree_make(str_t, empty_t);
-    in_len  = strlen(in);
-    n_items = 0;
-
-    get_all_buff_words(words);
-
-    it  = tree_gtr(words, in);
-
-    if (!tree_it_good(it))    { goto none; }
-
-    i   = 0;
-    key = tree_it_key(it);
-    while (strncmp(key, in, in_len) == 0) {
-        i += 1;
-        tree_it_next(it);
-        if (!tree_it_good(it)) {
-            break;
-        }
-        key = tree_it_key(it);
-    }
+    results.strings = array_make(char*);
 
-    n_items = i;
-
-    if (n_items) {
-        items = malloc(i * sizeof(char*));
-
-        it = tree_gtr(words, in);
-        i  = 0;
-        while (i < n_items) {
-            items[i] = tree_it_key(it);
-            tree_it_next(it);
-            i += 1;
-        }
-    } else {
-none:
-        items = NULL;
+    if (yed_default_completion_words(in, &results) != COMPL_ERR_NO_ERR) {
+        array_free(results.strings);
+        *out = NULL;
+        return 0;
     }
 
-    tree_free(words);
-
-    *out = items;
-    return n_items;
+    *out = array_data(results.strings);
+    return array_len(results.strings);
 }
 
 int yed_complete(char *compl_name, char *string, yed_completion_results *results) {
@@ -21,6 +21,9 @@ static void yed_var_change_handler(yed_event *event) {
         if (ys->tabw != old_tabw) {
             yed_update_line_visual_widths();
         }
+    } else if (strcmp(event->var_name, "search-mode")     == 0
+           ||  strcmp(event->var_name, "use-boyer-moore") == 0) {
+        yed_search_invalidate();
     } else if (strcmp(event->var_name, "cursor-line") == 0) {
     } else if (strcmp(event->var_name, "fill-string") == 0) {
     }
@@ -37,17 +40,14 @@ static void yed_var_buffer_focus_handler(yed_event *event) {
 }
 
 void yed_search_line_handler(yed_event *event) {
-    yed_frame  *frame;
-    yed_buffer *buff;
-    yed_line   *line;
-    yed_attrs  *attr, search, search_cursor, *set;
-    char       *line_data,
-               *line_data_end,
-               *scan;
-    int         i, idx, col,
-                search_len,
-                search_width,
-                data_len;
+    yed_frame        *frame;
+    yed_buffer       *buff;
+    yed_line         *line;
+    yed_attrs        *attr, search, search_cursor, *set;
+    array_t          *matches;
+    yed_search_match *match;
+    int               i, col,
+                      search_width;
 
     if (!ys->current_search) {
         return;
@@ -67,27 +67,21 @@ void yed_search_line_handler(yed_event *event) {
         return;
     }
 
-    buff         = frame->buffer;
-    line         = yed_buff_get_line(buff, event->row);
-    data_len     = array_len(line->chars);
-    search_len   = strlen(ys->current_search);
-    search_width = yed_get_string_width(ys->current_search);
+    buff = frame->buffer;
+    line = yed_buff_get_line(buff, event->row);
 
-    if (!line->visual_width || !search_len)    { return; }
+    if (!line->visual_width)    { return; }
 
-    line_data     = scan = array_data(line->chars);
-    line_data_end = line_data + data_len;
+    matches = yed_search_row_matches(buff, event->row);
+
+    if (matches == NULL)    { return; }
 
     search        = yed_active_style_get_search();
     search_cursor = yed_active_style_get_search_cursor();
 
-    while (scan < line_data_end && line_data_end - scan >= search_len) {
-        if (!(scan = strnstr(scan, ys->current_search, line_data_end - scan))) {
-            break;
-        }
-
-        idx = scan - line_data;
-        col = yed_line_idx_to_col(line, idx);
+    array_traverse(*matches, match) {
+        col          = yed_line_idx_to_col(line, match->idx);
+        search_width = yed_line_idx_to_col(line, match->idx + match->len) - col;
 
         set = (event->row == frame->cursor_line
                 &&    col == frame->cursor_col)
@@ -102,7 +96,5 @@ void yed_search_line_handler(yed_event *event) {
                 attr->flags ^= ATTR_INVERSE;
             }
         }
-
-        scan += 1;
     }
 }
@@ -5,6 +5,9 @@ void yed_init_events(void) {
         ys->event_handlers[i] = array_make(yed_event_handler);
     }
 
+    ys->line_draw_deps = array_make(yed_line_draw_deps_entry);
+    ys->line_draw_gen  = 1;
+
     yed_reload_default_event_handlers();
 }
 
@@ -15,15 +18,26 @@ void yed_reload_default_event_handlers(void) {
     for (i = 0; i < N_EVENTS; i += 1) {
         array_clear(ys->event_handlers[i]);
     }
+    array_clear(ys->line_draw_deps);
+    yed_invalidate_line_draw_caches();
 
     h.kind = EVENT_LINE_PRE_DRAW;
     h.fn   = yed_search_line_handler;
     yed_add_event_handler(h);
+    yed_set_line_draw_deps(h, LINE_DRAW_DEP_LINE);
 
     h.kind = EVENT_BUFFER_POST_MOD;
     h.fn   = yed_log_buff_mod_handler;
     yed_add_event_handler(h);
 
+    h.kind = EVENT_BUFFER_POST_MOD;
+    h.fn   = yed_search_buff_mod_handler;
+    yed_add_event_handler(h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = yed_search_buff_delete_handler;
+    yed_add_event_handler(h);
+
     h.kind = EVENT_KEY_POST_BIND;
     h.fn = yed_key_bind_handler;
     yed_add_event_handler(h);
@@ -51,6 +65,10 @@ void yed_reload_default_event_handlers(void) {
 
 void yed_add_event_handler(yed_event_handler handler) {
     array_push(ys->event_handlers[handler.kind], handler);
+
+    if (handler.kind == EVENT_ROW_PRE_CLEAR || handler.kind == EVENT_LINE_PRE_DRAW) {
+        yed_invalidate_line_draw_caches();
+    }
 }
 
 void yed_delete_event_handler(yed_event_handler handler) {
@@ -65,6 +83,10 @@ void yed_delete_event_handler(yed_event_handler handler) {
         }
         i += 1;
     }
+
+    if (handler.kind == EVENT_ROW_PRE_CLEAR || handler.kind == EVENT_LINE_PRE_DRAW) {
+        yed_set_line_draw_deps(handler, LINE_DRAW_DEP_ANY);
+    }
 }
 
 void yed_trigger_event(yed_event *event) {
@@ -102,3 +124,64 @@ void yed_trigger_event(yed_event *event) {
         }
     }
 }
+
+void yed_set_line_draw_deps(yed_event_handler handler, unsigned deps) {
+    yed_line_draw_deps_entry *it;
+    yed_line_draw_deps_entry  entry;
+    int                       i;
+
+    i = 0;
+    array_traverse(ys->line_draw_deps, it) {
+        if (it->fn == handler.fn) {
+            array_delete(ys->line_draw_deps, i);
+            break;
+        }
+        i += 1;
+    }
+
+    /* Anything not in the list is LINE_DRAW_DEP_ANY. */
+    if (!(deps & LINE_DRAW_DEP_ANY)) {
+        entry.fn   = handler.fn;
+        entry.deps = deps;
+        array_push(ys->line_draw_deps, entry);
+    }
+
+    yed_invalidate_line_draw_caches();
+}
+
+static unsigned yed_handler_line_draw_deps(yed_event_handler_fn_t fn) {
+    yed_line_draw_deps_entry *it;
+
+    array_traverse(ys->line_draw_deps, it) {
+        if (it->fn == fn) { return it->deps; }
+    }
+
+    return LINE_DRAW_DEP_ANY;
+}
+
+unsigned yed_get_line_draw_deps(void) {
+    yed_event_handler *handler_it;
+    unsigned           deps;
+
+    if (ys->line_draw_deps_gen == ys->line_draw_gen) {
+        return ys->line_draw_deps_all;
+    }
+
+    deps = LINE_DRAW_DEP_LINE;
+
+    array_traverse(ys->event_handlers[EVENT_ROW_PRE_CLEAR], handler_it) {
+        deps |= yed_handler_line_draw_deps(handler_it->fn);
+    }
+    array_traverse(ys->event_handlers[EVENT_LINE_PRE_DRAW], handler_it) {
+        deps |= yed_handler_line_draw_deps(handler_it->fn);
+    }
+
+    ys->line_draw_deps_all = deps;
+    ys->line_draw_deps_gen = ys->line_draw_gen;
+
+    return deps;
+}
+
+void yed_invalidate_line_draw_caches(void) {
+    ys->line_draw_gen += 1;
+}
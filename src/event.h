@@ -75,6 +75,7 @@ typedef enum {
     BUFF_MOD_INSERT_INTO_LINE,
     BUFF_MOD_DELETE_FROM_LINE,
     BUFF_MOD_CLEAR,
+    BUFF_MOD_BATCH,
 
     N_BUFF_MOD_EVENTS,
 } yed_buff_mod_event;
@@ -97,6 +98,7 @@ typedef struct {
     char                       *path;
     int                         buffer_is_new_file;
     int                         buff_mod_event;
+    yed_buffer_change          *buff_change;
     union { const char         *plugin_name;
             const char         *cmd_name;
             const char         *var_name; };
@@ -125,4 +127,38 @@ void yed_delete_event_handler(yed_event_handler handler);
 
 void yed_trigger_event(yed_event *event);
 
+/*
+ * Line draw dependencies.
+ *
+ * Frames keep the results of EVENT_ROW_PRE_CLEAR and EVENT_LINE_PRE_DRAW for
+ * the rows they draw and only trigger those events again for a row when
+ * something that the handlers might look at has changed. Handlers of those
+ * events should declare what their output depends on:
+ *
+ *     LINE_DRAW_DEP_LINE      Only the row number, the contents of the line,
+ *                             and where the cursor is if it's on that line.
+ *     LINE_DRAW_DEP_BUFFER    Anything in the buffer (e.g. syntax state carried
+ *                             over from the lines above).
+ *     LINE_DRAW_DEP_CURSOR    The cursor position, wherever it is.
+ *
+ * The style, variables, the selection, the search, and the frame/buffer
+ * pairing are always accounted for. A handler that hasn't declared its
+ * dependencies (or that declares LINE_DRAW_DEP_ANY) disables the caching.
+ * If a handler's output changes for some other reason, it should call
+ * yed_invalidate_line_draw_caches().
+ */
+#define LINE_DRAW_DEP_LINE   (0x0)
+#define LINE_DRAW_DEP_BUFFER (0x1)
+#define LINE_DRAW_DEP_CURSOR (0x2)
+#define LINE_DRAW_DEP_ANY    (0x80000000)
+
+typedef struct {
+    yed_event_handler_fn_t fn;
+    unsigned               deps;
+} yed_line_draw_deps_entry;
+
+void     yed_set_line_draw_deps(yed_event_handler handler, unsigned deps);
+unsigned yed_get_line_draw_deps(void);
+void     yed_invalidate_line_draw_caches(void);
+
 #endif
@@ -1,177 +1,972 @@
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define SEARCH_MIN_CHUNK_ROWS (16384)
+#define SEARCH_MAX_WORKERS    (16)
+
+typedef struct {
+    yed_search_pattern *pattern;
+    regex_t            *regex;
+    regex_t             own_regex;
+    bucket_array_t     *lines;
+    int                 first_row;
+    int                 n_rows;
+    array_t             matches;
+    int                *total;
+} yed_search_chunk;
+
 void yed_init_search(void) {
     ys->replace_markers       = array_make(array_t);
     ys->replace_save_lines    = array_make(yed_line*);
     ys->replace_working_lines = array_make(yed_line*);
+
+    memset(&ys->search_index, 0, sizeof(ys->search_index));
+    ys->search_index.matches     = array_make(yed_search_match);
+    ys->search_index.row_matches = array_make(yed_search_match);
 }
 
 int search_can_move_cursor(void) {
-    return yed_var_is_truthy("enable-search-cursor-move");
+    static yed_var_handle handle = YED_VAR_HANDLE("enable-search-cursor-move");
+
+    return yed_var_handle_is_truthy(&handle);
 }
 
-int yed_find_next(int row, int col, int *row_out, int *col_out) {
-    yed_frame  *frame;
-    yed_buffer *buff;
-    yed_line   *line;
-    char       *line_data,
-               *line_data_end,
-               *scan;
-    int         idx,
-                r,
-                c,
-                search_len,
-                data_len,
-                junk_row, junk_col;
+#define SEARCH_FOLD(c) (((c) >= 'A' && (c) <= 'Z') ? (c) + ('a' - 'A') : (c))
 
-    if (!ys->current_search)    { return 0; }
-    if (!ys->active_frame)      { return 0; }
+void yed_search_literal_compile(yed_search_literal *literal, const char *str, int len, int fold) {
+    static yed_var_handle use_bm = YED_VAR_HANDLE("use-boyer-moore");
+    int                   i;
 
-    frame = ys->active_frame;
+    if (literal->str != NULL) {
+        free(literal->str);
+    }
 
-    if (!frame->buffer)    { return 0; }
+    literal->str  = malloc(len + 1);
+    literal->len  = len;
+    literal->fold = fold;
 
-    buff = frame->buffer;
+    for (i = 0; i < len; i += 1) {
+        literal->str[i] = fold ? SEARCH_FOLD(str[i]) : str[i];
+    }
+    literal->str[len] = 0;
 
-    if (buff->has_selection && !search_can_move_cursor()) {
-        *row_out = row;
-        *col_out = col;
-        row_out  = &junk_row;
-        col_out  = &junk_col;
+    literal->use_boyer_moore = !fold && yed_var_handle_is_truthy(&use_bm);
+
+    yed_boyer_moore_make_table(literal->str, literal->len, literal->bad_char_table);
+}
+
+static int yed_search_literal_match_at(yed_search_literal *literal, const char *text) {
+    int i;
+
+    if (!literal->fold) {
+        return memcmp(text, literal->str, literal->len) == 0;
     }
 
-    search_len = strlen(ys->current_search);
+    for (i = 0; i < literal->len; i += 1) {
+        if (SEARCH_FOLD(text[i]) != literal->str[i]) { return 0; }
+    }
 
-    if (!search_len)    { return 0; }
+    return 1;
+}
 
-    line = yed_buff_get_line(buff, row);
-    if (col > line->visual_width) {
-        row += 1;
-        col = 1;
+/*
+ * Returns the offset of the first occurrence of the literal in text, or -1.
+ * The vector loops only look at candidates whose first and last bytes both
+ * match (in either case, when folding) before comparing the whole literal.
+ */
+int yed_search_literal_next(yed_search_literal *literal, const char *text, int len) {
+    const char *p,
+               *end;
+    int         m,
+                i;
+    char        first_lo, first_up,
+                last_lo,  last_up;
+
+    m = literal->len;
+
+    if (m == 0 || m > len) { return -1; }
+
+    if (literal->use_boyer_moore) {
+        return yed_boyer_moore_with_table(text, len, literal->str, m, literal->bad_char_table);
     }
 
-    r = row;
-    bucket_array_traverse_from(buff->lines, line, r - 1) {
-        data_len = array_len(line->chars);
+    first_lo = first_up = literal->str[0];
+    last_lo  = last_up  = literal->str[m - 1];
 
-        if (!line->visual_width) {
-            r += 1;
-            continue;
-        }
+    if (literal->fold) {
+        first_up = toupper((unsigned char)first_lo);
+        last_up  = toupper((unsigned char)last_lo);
+    }
 
-        line_data     = scan = array_data(line->chars);
-        line_data_end = line_data + data_len;
+    i = 0;
 
-        if (r == row) {
-            scan += yed_line_col_to_idx(line, col + 1);
-        }
+#if defined(__AVX2__)
+    {
+        __m256i  flo, fup, llo, lup, a, b;
+        unsigned mask;
+        int      bit;
 
-        if (yed_var_is_truthy("use-boyer-moore")) {
-            while (scan < line_data_end) {
-                idx = yed_boyer_moore(scan, line_data_end - scan,
-                                ys->current_search, search_len);
-                if (idx >= 0) {
-                    c = yed_line_idx_to_col(line, scan - line_data + idx);
-                    if (r != row || c != col) {
-                        *row_out = r;
-                        *col_out = c;
-                        return 1;
-                    }
-                    scan += idx + 1;
-                } else {
-                    break;
+        flo = _mm256_set1_epi8(first_lo);
+        fup = _mm256_set1_epi8(first_up);
+        llo = _mm256_set1_epi8(last_lo);
+        lup = _mm256_set1_epi8(last_up);
+
+        for (; i + m - 1 + 32 <= len; i += 32) {
+            a    = _mm256_loadu_si256((const __m256i*)(const void*)(text + i));
+            b    = _mm256_loadu_si256((const __m256i*)(const void*)(text + i + m - 1));
+            a    = _mm256_or_si256(_mm256_cmpeq_epi8(a, flo), _mm256_cmpeq_epi8(a, fup));
+            b    = _mm256_or_si256(_mm256_cmpeq_epi8(b, llo), _mm256_cmpeq_epi8(b, lup));
+            mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+            while (mask) {
+                bit = __builtin_ctz(mask);
+                if (yed_search_literal_match_at(literal, text + i + bit)) {
+                    return i + bit;
                 }
+                mask &= mask - 1;
             }
-        } else {
-            while (scan < line_data_end && line_data_end - scan >= search_len) {
-                if ((scan = strnstr(scan, ys->current_search, line_data_end - scan))) {
-                    idx = scan - line_data;
-                    c   = yed_line_idx_to_col(line, idx);
-
-                    if (r != row || c != col) {
-                        *row_out = r;
-                        *col_out = c;
-                        return 1;
-                    }
-
-                    scan += 1;
-                } else {
-                    break;
+        }
+    }
+#elif defined(__SSE2__)
+    {
+        __m128i  flo, fup, llo, lup, a, b;
+        unsigned mask;
+        int      bit;
+
+        flo = _mm_set1_epi8(first_lo);
+        fup = _mm_set1_epi8(first_up);
+        llo = _mm_set1_epi8(last_lo);
+        lup = _mm_set1_epi8(last_up);
+
+        for (; i + m - 1 + 16 <= len; i += 16) {
+            a    = _mm_loadu_si128((const __m128i*)(const void*)(text + i));
+            b    = _mm_loadu_si128((const __m128i*)(const void*)(text + i + m - 1));
+            a    = _mm_or_si128(_mm_cmpeq_epi8(a, flo), _mm_cmpeq_epi8(a, fup));
+            b    = _mm_or_si128(_mm_cmpeq_epi8(b, llo), _mm_cmpeq_epi8(b, lup));
+            mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(a, b));
+            while (mask) {
+                bit = __builtin_ctz(mask);
+                if (yed_search_literal_match_at(literal, text + i + bit)) {
+                    return i + bit;
                 }
+                mask &= mask - 1;
+            }
+        }
+    }
+#endif
+
+    if (literal->fold) {
+        for (; i + m <= len; i += 1) {
+            if (SEARCH_FOLD(text[i]) == first_lo
+            &&  yed_search_literal_match_at(literal, text + i)) {
+                return i;
             }
         }
+        return -1;
+    }
+
+    p   = text + i;
+    end = text + len - m + 1;
+
+    while (p < end) {
+        p = memchr(p, first_lo, end - p);
+        if (p == NULL) { break; }
+
+        if (memcmp(p, literal->str, m) == 0) {
+            return p - text;
+        }
+
+        p += 1;
+    }
+
+    return -1;
+}
 
-        r += 1;
+static void yed_search_factor_end_run(char *run, int *run_len, char *best, int *best_len) {
+    if (*run_len > *best_len) {
+        memcpy(best, run, *run_len);
+        *best_len = *run_len;
     }
+    *run_len = 0;
+}
+
+/*
+ * p is at the '[' that starts a bracket expression. Returns the ']' that
+ * ends it, or the last character of the string if nothing does.
+ */
+static const char * yed_search_skip_bracket(const char *p) {
+    char delim;
+
+    p += 1;
+    if (*p == '^') { p += 1; }
+    if (*p == ']') { p += 1; }
+    while (*p && *p != ']') {
+        if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+            delim = p[1];
+            p    += 2;
+            while (*p && !(p[0] == delim && p[1] == ']')) { p += 1; }
+            if (*p) { p += 2; }
+        } else {
+            p += 1;
+        }
+    }
+    if (*p == 0) { p -= 1; }
+
+    return p;
+}
 
-    r = 1;
-    bucket_array_traverse(buff->lines, line) {
-        data_len = array_len(line->chars);
+/* In a basic regex, these are operators when escaped and plain characters otherwise. */
+#define SEARCH_BRE_OPS "(){}|+?"
 
-        if (!line->visual_width) {
-            r += 1;
+/* Whether p starts with a '*', '?' or '{' operator, after any more '+'s. */
+static int yed_search_optional_follows(const char *p, int extended) {
+    if (extended) {
+        while (*p == '+') { p += 1; }
+    } else {
+        while (p[0] == '\\' && p[1] == '+') { p += 2; }
+    }
+
+    if (*p == '*') { return 1; }
+
+    if (extended) { return *p == '?' || *p == '{'; }
+
+    return p[0] == '\\' && (p[1] == '?' || p[1] == '{');
+}
+
+/*
+ * Finds a literal string that every match of the regex re must contain.
+ * We only look at the top level of the expression and give up on anything
+ * we don't understand, so this is conservative. Returns the length of the
+ * string written to out, which may be 0.
+ */
+int yed_search_regex_factor(const char *re, int extended, char *out) {
+    const char *p;
+    char       *run;
+    int         run_len,
+                best_len,
+                depth,
+                is_op;
+    char        c;
+
+    run      = malloc(strlen(re) + 1);
+    run_len  = 0;
+    best_len = 0;
+    depth    = 0;
+
+    for (p = re; *p; p += 1) {
+        c     = *p;
+        is_op = 1;
+
+        if (!extended) {
+            if (c == '\\' && p[1] != 0 && strchr(SEARCH_BRE_OPS, p[1]) != NULL) {
+                p += 1;
+                c  = *p;
+            } else if (strchr(SEARCH_BRE_OPS, c) != NULL) {
+                is_op = 0;
+            }
+        }
+
+        /* Parentheses in a bracket expression are just characters. */
+        if (is_op && c == '[') {
+            p = yed_search_skip_bracket(p);
+            yed_search_factor_end_run(run, &run_len, out, &best_len);
             continue;
         }
 
-        line_data     = scan = array_data(line->chars);
-        line_data_end = line_data + array_len(line->chars);
+        if (depth > 0) {
+            if (!is_op)                       { continue;          }
+            if      (c == '(')                { depth += 1;        }
+            else if (c == ')')                { depth -= 1;        }
+            else if (c == '\\' && p[1] != 0)  { p += 1;            }
+            continue;
+        }
 
-        if (r == row) {
-            line_data_end = line_data + yed_line_col_to_idx(line, col);
+        if (!is_op) {
+            run[run_len++] = c;
+            continue;
         }
 
-        if (yed_var_is_truthy("use-boyer-moore")) {
-            while (scan < line_data_end) {
-                idx = yed_boyer_moore(scan, line_data_end - scan,
-                                ys->current_search, search_len);
-                if (idx >= 0) {
-                    c = yed_line_idx_to_col(line, scan - line_data + idx);
-                    if (r != row || c != col) {
-                        *row_out = r;
-                        *col_out = c;
-                        return 1;
-                    }
-                    scan += idx + 1;
-                } else {
-                    break;
+        switch (c) {
+            case '|':
+                /* Alternatives at the top level. We'd have to intersect them. */
+                best_len = 0;
+                goto out;
+            case '(':
+                depth += 1;
+                yed_search_factor_end_run(run, &run_len, out, &best_len);
+                break;
+            case '*':
+            case '?':
+            case '{':
+                /* The previous character is optional. Drop all of its bytes. */
+                while (run_len > 0 && (run[run_len - 1] & 0xC0) == 0x80) { run_len -= 1; }
+                if (run_len > 0) { run_len -= 1; }
+                yed_search_factor_end_run(run, &run_len, out, &best_len);
+                if (*p == '{') {
+                    while (*p && *p != '}') { p += 1; }
+                    if (*p == 0) { p -= 1; }
                 }
-            }
-        } else {
-            while (scan < line_data_end && line_data_end - scan >= search_len) {
-                if ((scan = strnstr(scan, ys->current_search, line_data_end - scan))) {
-                    idx = scan - line_data;
-                    c   = yed_line_idx_to_col(line, idx);
-
-                    if (r != row || c != col) {
-                        *row_out = r;
-                        *col_out = c;
-                        return 1;
-                    }
-
-                    scan += 1;
+                break;
+            case '+':
+                /* In b+? or b+*, the b is optional after all. */
+                if (yed_search_optional_follows(p + 1, extended)) {
+                    while (run_len > 0 && (run[run_len - 1] & 0xC0) == 0x80) { run_len -= 1; }
+                    if (run_len > 0) { run_len -= 1; }
+                }
+                yed_search_factor_end_run(run, &run_len, out, &best_len);
+                break;
+            case '.':
+            case '^':
+            case '$':
+                yed_search_factor_end_run(run, &run_len, out, &best_len);
+                break;
+            case '\\':
+                /* GNU word and buffer anchors match no characters, like \b. */
+                if (p[1] != 0 && strchr("<>`'", p[1]) == NULL && ispunct((unsigned char)p[1])) {
+                    p += 1;
+                    run[run_len++] = *p;
                 } else {
-                    break;
+                    if (p[1] != 0) { p += 1; }
+                    yed_search_factor_end_run(run, &run_len, out, &best_len);
                 }
-            }
+                break;
+            default:
+                run[run_len++] = *p;
         }
+    }
+
+    yed_search_factor_end_run(run, &run_len, out, &best_len);
+
+out:;
+    free(run);
+
+    return best_len;
+}
+
+static int yed_search_get_mode(void) {
+    char *mode;
 
-        r += 1;
+    mode = yed_get_var("search-mode");
+
+    if (mode != NULL) {
+        if (strcmp(mode, "case-fold") == 0) { return SEARCH_MODE_CASE_FOLD; }
+        if (strcmp(mode, "regex")     == 0) { return SEARCH_MODE_REGEX;     }
     }
 
-    return 0;
+    return SEARCH_MODE_LITERAL;
 }
 
-int yed_find_prev(int row, int col, int *row_out, int *col_out) {
-    yed_frame  *frame;
-    yed_buffer *buff;
-    yed_line   *line;
-    char       *line_data,
-               *line_data_end,
-               *scan;
-    int         idx,
-                r,
-                c,
-                search_len,
-                data_len,
-                junk_row, junk_col;
+static void yed_search_pattern_compile(yed_search_pattern *pattern, const char *str) {
+    char *factor;
+    int   factor_len;
+
+    if (pattern->str != NULL) {
+        free(pattern->str);
+    }
+    if (pattern->regex_ok) {
+        regfree(&pattern->regex);
+    }
+
+    pattern->str         = strdup(str);
+    pattern->mode        = yed_search_get_mode();
+    pattern->has_literal = 0;
+    pattern->regex_ok    = 0;
+
+    if (pattern->mode == SEARCH_MODE_REGEX) {
+        if (regcomp(&pattern->regex, str, REG_EXTENDED) != 0) {
+            /* An incomplete or invalid regex just doesn't match anything. */
+            return;
+        }
+
+        pattern->regex_ok = 1;
+
+        factor     = malloc(strlen(str) + 1);
+        factor_len = yed_search_regex_factor(str, 1, factor);
+
+        if (factor_len > 0) {
+            yed_search_literal_compile(&pattern->literal, factor, factor_len, 0);
+            pattern->has_literal = 1;
+        }
+
+        free(factor);
+    } else {
+        yed_search_literal_compile(&pattern->literal, str, strlen(str),
+                                   pattern->mode == SEARCH_MODE_CASE_FOLD);
+        pattern->has_literal = 1;
+    }
+}
+
+/* Can the line possibly have a match? */
+static int yed_search_line_may_match(yed_search_pattern *pattern, const char *data, int len) {
+    if (pattern->mode == SEARCH_MODE_REGEX) {
+        if (!pattern->regex_ok) { return 0; }
+        if (!pattern->has_literal) { return 1; }
+    }
+
+    return yed_search_literal_next(&pattern->literal, data, len) >= 0;
+}
+
+/*
+ * Returns the offset of the first match in data at or after off and sets
+ * *len_out to its length, or returns -1. regex is the pattern's compiled
+ * regex, or a copy of it owned by the calling thread.
+ * Empty regex matches are skipped.
+ */
+static int yed_search_next(yed_search_pattern *pattern, regex_t *regex, const char *data, int len, int off, int *len_out) {
+    regmatch_t match;
+    int        i;
+
+    if (pattern->mode != SEARCH_MODE_REGEX) {
+        i = yed_search_literal_next(&pattern->literal, data + off, len - off);
+        if (i < 0) { return -1; }
+
+        *len_out = pattern->literal.len;
+        return off + i;
+    }
+
+    while (off <= len) {
+        match.rm_so = off;
+        match.rm_eo = len;
+
+        if (regexec(regex, data, 1, &match, REG_STARTEND | (off > 0 ? REG_NOTBOL : 0)) != 0) { break; }
+
+        if (match.rm_eo > match.rm_so) {
+            *len_out = match.rm_eo - match.rm_so;
+            return match.rm_so;
+        }
+
+        if (match.rm_so >= len) { break; }
+
+        off = match.rm_so + yed_get_glyph_len(*(yed_glyph*)(void*)(data + match.rm_so));
+    }
+
+    return -1;
+}
+
+/*
+ * Pushes a yed_search_match for every match in the line. Literal matches
+ * may overlap; regex matches don't.
+ */
+static void yed_search_scan_line(yed_search_pattern *pattern, regex_t *regex, yed_line *line, int row, array_t *matches) {
+    const char       *data;
+    int               len,
+                      off,
+                      i;
+    yed_search_match  match;
+
+    if (!line->visual_width) { return; }
+
+    data = array_data(line->chars);
+    len  = array_len(line->chars);
+
+    if (!yed_search_line_may_match(pattern, data, len)) { return; }
+
+    off = 0;
+
+    while ((i = yed_search_next(pattern, regex, data, len, off, &match.len)) >= 0) {
+        match.row = row;
+        match.idx = i;
+        array_push(*matches, match);
+
+        off = (pattern->mode == SEARCH_MODE_REGEX) ? i + match.len : i + 1;
+    }
+}
+
+static void yed_search_scan_chunk(yed_job *job, void *arg) {
+    yed_search_chunk *chunk;
+    yed_line         *line;
+    int               row,
+                      n;
+
+    chunk = arg;
+    row   = chunk->first_row;
+
+    bucket_array_traverse_from(*chunk->lines, line, row - 1) {
+        if (row >= chunk->first_row + chunk->n_rows) { break; }
+
+        n = array_len(chunk->matches);
+
+        yed_search_scan_line(chunk->pattern, chunk->regex, line, row, &chunk->matches);
+
+        n = array_len(chunk->matches) - n;
+        if (n > 0
+        &&  __atomic_add_fetch(chunk->total, n, __ATOMIC_RELAXED) > SEARCH_INDEX_MAX_MATCHES) {
+            break;
+        }
+
+        row += 1;
+    }
+}
+
+static int yed_search_n_workers(int n_rows) {
+    int n;
+
+    n = n_rows / SEARCH_MIN_CHUNK_ROWS;
+
+    n = MIN(n, yed_n_job_workers());
+    n = MIN(n, SEARCH_MAX_WORKERS);
+    n = MAX(n, 1);
+
+    return n;
+}
+
+/*
+ * Appends the matches for rows first_row through last_row to the index.
+ * Those rows must come after every row that the index already has matches for.
+ */
+static void yed_search_index_scan_rows(yed_search_index *index, int first_row, int last_row) {
+    yed_search_chunk chunks[SEARCH_MAX_WORKERS];
+    int              n_rows,
+                     n_workers,
+                     per_worker,
+                     total,
+                     i;
+
+    n_rows = last_row - first_row + 1;
+
+    if (n_rows <= 0 || index->overflow) { return; }
+
+    /*
+     * Looking up a row may rebuild the bucket index, so make sure that
+     * happens here and not in one of the workers.
+     */
+    (void)bucket_array_item(index->buffer->lines, first_row - 1);
+
+    n_workers  = yed_search_n_workers(n_rows);
+    per_worker = (n_rows + n_workers - 1) / n_workers;
+    total      = array_len(index->matches);
+
+    for (i = 0; i < n_workers; i += 1) {
+        chunks[i].pattern   = &index->pattern;
+        chunks[i].regex     = &index->pattern.regex;
+        chunks[i].lines     = &index->buffer->lines;
+        chunks[i].first_row = first_row + (i * per_worker);
+        chunks[i].n_rows    = MIN(per_worker, last_row - chunks[i].first_row + 1);
+        chunks[i].matches   = array_make(yed_search_match);
+        chunks[i].total     = &total;
+
+        /*
+         * glibc serializes regexec() calls on the same regex_t, so give
+         * each worker its own copy.
+         */
+        if (n_workers > 1
+        &&  index->pattern.regex_ok
+        &&  regcomp(&chunks[i].own_regex, index->pattern.str, REG_EXTENDED) == 0) {
+            chunks[i].regex = &chunks[i].own_regex;
+        }
+    }
+
+    yed_run_jobs(yed_search_scan_chunk, chunks, n_workers, sizeof(*chunks));
+
+    if (total > SEARCH_INDEX_MAX_MATCHES) {
+        index->overflow = 1;
+        array_clear(index->matches);
+    }
+
+    for (i = 0; i < n_workers; i += 1) {
+        if (!index->overflow && array_len(chunks[i].matches) > 0) {
+            array_push_n(index->matches, array_data(chunks[i].matches), array_len(chunks[i].matches));
+        }
+        array_free(chunks[i].matches);
+        if (chunks[i].regex == &chunks[i].own_regex) {
+            regfree(&chunks[i].own_regex);
+        }
+    }
+}
+
+static void yed_search_index_build(yed_search_index *index, yed_buffer *buff, const char *str) {
+    index->buffer   = buff;
+    index->n_rows   = yed_buff_n_lines(buff);
+    index->valid    = 1;
+    index->overflow = 0;
+
+    array_clear(index->matches);
+
+    yed_search_pattern_compile(&index->pattern, str);
+    yed_search_index_scan_rows(index, 1, index->n_rows);
+}
+
+/*
+ * When the new pattern extends the old one (e.g. the user typed another
+ * character), its matches are a subset of the old ones, so we only need
+ * to check the old matches instead of scanning the whole buffer again.
+ * This doesn't hold for regexes.
+ */
+static void yed_search_index_refine(yed_search_index *index, const char *str) {
+    yed_search_match *match,
+                     *out;
+    yed_line         *line;
+    int               row,
+                      len;
+
+    yed_search_pattern_compile(&index->pattern, str);
+
+    len  = index->pattern.literal.len;
+    row  = 0;
+    line = NULL;
+    out  = array_data(index->matches);
+
+    array_traverse(index->matches, match) {
+        if (match->row != row) {
+            row  = match->row;
+            line = yed_buff_get_line(index->buffer, row);
+        }
+
+        if (array_len(line->chars) - match->idx >= len
+        &&  yed_search_literal_match_at(&index->pattern.literal, array_item(line->chars, match->idx))) {
+            match->len = len;
+            *out++     = *match;
+        }
+    }
+
+    index->matches.used = out - (yed_search_match*)array_data(index->matches);
+}
+
+/* Returns the position of the first match at or after (row, idx). */
+static int yed_search_index_lower_bound(yed_search_index *index, int row, int idx) {
+    yed_search_match *matches;
+    int               lo,
+                      hi,
+                      mid;
+
+    matches = array_data(index->matches);
+    lo      = 0;
+    hi      = array_len(index->matches);
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        if (matches[mid].row < row
+        ||  (matches[mid].row == row && matches[mid].idx < idx)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static void yed_search_index_rescan_row(yed_search_index *index, int row) {
+    array_t           row_matches;
+    yed_search_match *matches;
+    int               n_total,
+                      lo,
+                      hi,
+                      n_old,
+                      n_new,
+                      i;
+
+    if (index->overflow) { return; }
+
+    row_matches = array_make(yed_search_match);
+    yed_search_scan_line(&index->pattern, &index->pattern.regex, yed_buff_get_line(index->buffer, row), row, &row_matches);
+
+    n_total = array_len(index->matches);
+    lo      = yed_search_index_lower_bound(index, row,     0);
+    hi      = yed_search_index_lower_bound(index, row + 1, 0);
+    n_old   = hi - lo;
+    n_new   = array_len(row_matches);
+
+    /* Make room if the row has more matches than before. */
+    for (i = n_old; i < n_new; i += 1) {
+        array_push(index->matches, *(yed_search_match*)array_data(row_matches));
+    }
+
+    matches = array_data(index->matches);
+
+    if (n_new != n_old) {
+        memmove(matches + lo + n_new, matches + hi, sizeof(*matches) * (n_total - hi));
+    }
+    if (n_new > 0) {
+        memcpy(matches + lo, array_data(row_matches), sizeof(*matches) * n_new);
+    }
+
+    index->matches.used = n_total + n_new - n_old;
+
+    array_free(row_matches);
+}
+
+static void yed_search_index_shift_rows(yed_search_index *index, int row, int delta) {
+    yed_search_match *match;
+
+    array_traverse_from(index->matches, match, yed_search_index_lower_bound(index, row, 0)) {
+        match->row += delta;
+    }
+}
+
+static void yed_search_index_delete_row(yed_search_index *index, int row) {
+    yed_search_match *matches;
+    int               lo,
+                      hi;
+
+    lo      = yed_search_index_lower_bound(index, row,     0);
+    hi      = yed_search_index_lower_bound(index, row + 1, 0);
+    matches = array_data(index->matches);
+
+    if (hi > lo) {
+        memmove(matches + lo, matches + hi, sizeof(*matches) * (array_len(index->matches) - hi));
+        index->matches.used -= hi - lo;
+    }
+
+    yed_search_index_shift_rows(index, row, -1);
+}
+
+/*
+ * Rows [row, row + n_old_rows) were replaced by [row, row + n_new_rows).
+ * Drop the old rows' matches, shift the ones below, and scan the new rows.
+ */
+static void yed_search_index_replace_rows(yed_search_index *index, int row, int n_old_rows, int n_new_rows) {
+    array_t           tail;
+    yed_search_match *match;
+    int               lo,
+                      hi;
+
+    if (index->overflow) { return; }
+
+    lo   = yed_search_index_lower_bound(index, row,              0);
+    hi   = yed_search_index_lower_bound(index, row + n_old_rows, 0);
+    tail = array_make(yed_search_match);
+
+    if (hi < array_len(index->matches)) {
+        array_push_n(tail, array_item(index->matches, hi), array_len(index->matches) - hi);
+    }
+
+    index->matches.used = lo;
+
+    yed_search_index_scan_rows(index, row, row + n_new_rows - 1);
+
+    if (!index->overflow) {
+        array_traverse(tail, match) {
+            match->row += n_new_rows - n_old_rows;
+        }
+        if (array_len(tail) > 0) {
+            array_push_n(index->matches, array_data(tail), array_len(tail));
+        }
+    }
+
+    array_free(tail);
+}
+
+/*
+ * Returns the index for the current search in buff, bringing it up to date
+ * first if needed, or NULL if there is no current search.
+ */
+static yed_search_index *yed_search_get_index(yed_buffer *buff) {
+    yed_search_index *index;
+    int               n_lines;
+
+    if (!ys->current_search || !ys->current_search[0]) { return NULL; }
+
+    index   = &ys->search_index;
+    n_lines = yed_buff_n_lines(buff);
+
+    if (!index->valid || index->buffer != buff || n_lines < index->n_rows) {
+        yed_search_index_build(index, buff, ys->current_search);
+        return index;
+    }
+
+    if (n_lines > index->n_rows) {
+        /*
+         * Lines were appended without events (e.g. a lazy load finished
+         * another batch). Just scan the new ones.
+         */
+        yed_search_index_scan_rows(index, index->n_rows + 1, n_lines);
+        index->n_rows = n_lines;
+    }
+
+    if (strcmp(index->pattern.str, ys->current_search) != 0) {
+        if (!index->overflow
+        &&  index->pattern.mode != SEARCH_MODE_REGEX
+        &&  strncmp(index->pattern.str, ys->current_search, strlen(index->pattern.str)) == 0) {
+            yed_search_index_refine(index, ys->current_search);
+        } else {
+            yed_search_index_build(index, buff, ys->current_search);
+        }
+    }
+
+    return index;
+}
+
+static void yed_search_index_load_row(yed_search_index *index, int row) {
+    yed_search_match *match;
+
+    array_clear(index->row_matches);
+
+    if (index->overflow) {
+        yed_search_scan_line(&index->pattern, &index->pattern.regex,
+                             yed_buff_get_line(index->buffer, row), row, &index->row_matches);
+        return;
+    }
+
+    array_traverse_from(index->matches, match, yed_search_index_lower_bound(index, row, 0)) {
+        if (match->row != row) { break; }
+        array_push(index->row_matches, *match);
+    }
+}
+
+/*
+ * Returns the first row >= row (or the last row <= row when dir < 0) that
+ * has a match and loads its matches into index->row_matches, or 0 if there
+ * is no such row.
+ */
+static int yed_search_index_seek_row(yed_search_index *index, int row, int dir) {
+    yed_search_match *match;
+    int               pos;
+
+    if (row < 1 || row > index->n_rows) { return 0; }
+
+    if (index->overflow) {
+        for (; row >= 1 && row <= index->n_rows; row += dir) {
+            yed_search_index_load_row(index, row);
+            if (array_len(index->row_matches) > 0) { return row; }
+        }
+        return 0;
+    }
+
+    if (dir > 0) {
+        pos = yed_search_index_lower_bound(index, row, 0);
+        if (pos == array_len(index->matches)) { return 0; }
+    } else {
+        pos = yed_search_index_lower_bound(index, row + 1, 0) - 1;
+        if (pos < 0) { return 0; }
+    }
+
+    match = array_item(index->matches, pos);
+    yed_search_index_load_row(index, match->row);
+
+    return match->row;
+}
+
+array_t *yed_search_row_matches(yed_buffer *buff, int row) {
+    yed_search_index *index;
+
+    index = yed_search_get_index(buff);
+    if (index == NULL) { return NULL; }
+
+    if (row < 1 || row > index->n_rows) {
+        array_clear(index->row_matches);
+    } else {
+        yed_search_index_load_row(index, row);
+    }
+
+    return &index->row_matches;
+}
+
+/*
+ * Returns the byte index of the first match at or after off in the line, or
+ * -1 if there isn't one. off is only where the search starts, so an anchored
+ * regex won't match there unless off is 0.
+ */
+int yed_search_line_next_match(yed_buffer *buff, yed_line *line, int off, int *len_out) {
+    yed_search_index *index;
+    const char       *data;
+    int               len;
+
+    index = yed_search_get_index(buff);
+    if (index == NULL) { return -1; }
+
+    data = array_data(line->chars);
+    len  = array_len(line->chars);
+
+    if (!line->visual_width
+    ||  !yed_search_line_may_match(&index->pattern, data, len)) {
+        return -1;
+    }
+
+    return yed_search_next(&index->pattern, &index->pattern.regex, data, len, off, len_out);
+}
+
+void yed_search_invalidate(void) {
+    ys->search_index.valid = 0;
+    array_clear(ys->search_index.matches);
+}
+
+void yed_search_buff_mod_handler(yed_event *event) {
+    yed_search_index *index;
+    int               n_lines,
+                      expected;
+
+    index = &ys->search_index;
+
+    if (!index->valid || event->buffer != index->buffer) { return; }
+
+    if (!ys->current_search) {
+        /* Nobody needs the index anymore. Don't keep paying to maintain it. */
+        index->valid = 0;
+        array_clear(index->matches);
+        return;
+    }
+
+    n_lines  = yed_buff_n_lines(event->buffer);
+    expected = index->n_rows;
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_ADD_LINE:
+        case BUFF_MOD_INSERT_LINE: expected += 1; break;
+        case BUFF_MOD_DELETE_LINE: expected -= 1; break;
+        case BUFF_MOD_BATCH:
+            expected += event->buff_change->n_new_rows - event->buff_change->n_old_rows;
+            break;
+    }
+
+    if (n_lines != expected
+    ||  (event->buff_mod_event == BUFF_MOD_CLEAR && event->row == 0)) {
+        index->valid = 0;
+        return;
+    }
+
+    switch (event->buff_mod_event) {
+        case BUFF_MOD_APPEND_TO_LINE:
+        case BUFF_MOD_POP_FROM_LINE:
+        case BUFF_MOD_INSERT_INTO_LINE:
+        case BUFF_MOD_DELETE_FROM_LINE:
+        case BUFF_MOD_CLEAR_LINE:
+        case BUFF_MOD_SET_LINE:
+        case BUFF_MOD_CLEAR:
+            yed_search_index_rescan_row(index, event->row);
+            break;
+        case BUFF_MOD_ADD_LINE:
+            /* The new line is empty and last, so there's nothing to do. */
+            break;
+        case BUFF_MOD_INSERT_LINE:
+            if (!index->overflow) {
+                yed_search_index_shift_rows(index, event->row, 1);
+            }
+            break;
+        case BUFF_MOD_DELETE_LINE:
+            if (!index->overflow) {
+                yed_search_index_delete_row(index, event->row);
+            }
+            break;
+        case BUFF_MOD_BATCH:
+            yed_search_index_replace_rows(index, event->buff_change->row,
+                                          event->buff_change->n_old_rows,
+                                          event->buff_change->n_new_rows);
+            break;
+    }
+
+    index->n_rows = n_lines;
+}
+
+void yed_search_buff_delete_handler(yed_event *event) {
+    if (event->buffer == ys->search_index.buffer) {
+        ys->search_index.buffer = NULL;
+        ys->search_index.valid  = 0;
+        array_clear(ys->search_index.matches);
+    }
+}
+
+int yed_find_next(int row, int col, int *row_out, int *col_out) {
+    yed_frame        *frame;
+    yed_buffer       *buff;
+    yed_line         *line;
+    yed_search_index *index;
+    yed_search_match *match;
+    int               start_idx,
+                      end_idx,
+                      r,
+                      c,
+                      junk_row, junk_col;
 
     if (!ys->current_search)    { return 0; }
     if (!ys->active_frame)      { return 0; }
@@ -189,80 +984,130 @@ int yed_find_prev(int row, int col, int *row_out, int *col_out) {
         col_out  = &junk_col;
     }
 
-    search_len = strlen(ys->current_search);
+    index = yed_search_get_index(buff);
 
-    if (!search_len)    { return 0; }
+    if (index == NULL)    { return 0; }
 
-    r = row;
-    bucket_array_rtraverse_from(buff->lines, line, r - 1) {
-        data_len = array_len(line->chars);
+    line = yed_buff_get_line(buff, row);
+    if (col > line->visual_width) {
+        row += 1;
+        col = 1;
+    }
 
-        if (!line->visual_width) {
-            r -= 1;
-            continue;
-        }
+    /* From just after the cursor to the end of the buffer. */
+    start_idx = 0;
+    if (row <= index->n_rows) {
+        start_idx = yed_line_col_to_idx(yed_buff_get_line(buff, row), col + 1);
+    }
 
-        line_data     = array_data(line->chars);
-        line_data_end = line_data + data_len;
+    for (r = yed_search_index_seek_row(index, row, 1); r; r = yed_search_index_seek_row(index, r + 1, 1)) {
+        line = yed_buff_get_line(buff, r);
+        array_traverse(index->row_matches, match) {
+            if (r == row && match->idx < start_idx) { continue; }
 
-        if (r == row) {
-            if (col <= search_len) {
-                r -= 1;
-                continue;
+            c = yed_line_idx_to_col(line, match->idx);
+            if (r != row || c != col) {
+                *row_out = r;
+                *col_out = c;
+                return 1;
             }
-            line_data_end = line_data + yed_line_col_to_idx(line, col - 1);
         }
+    }
 
-        while (line_data < line_data_end && line_data_end - line_data >= search_len) {
-            if ((scan = last_strnstr(line_data, ys->current_search, line_data_end - line_data))) {
-                idx = scan - line_data;
-                c   = yed_line_idx_to_col(line, idx);
+    /* Wrap around: from the top of the buffer to just before the cursor. */
+    for (r = yed_search_index_seek_row(index, 1, 1); r && r <= row; r = yed_search_index_seek_row(index, r + 1, 1)) {
+        line    = yed_buff_get_line(buff, r);
+        end_idx = array_len(line->chars);
+        if (r == row) {
+            end_idx = yed_line_col_to_idx(line, col);
+        }
 
-                if (r != row || c != col) {
-                    *row_out = r;
-                    *col_out = c;
-                    return 1;
-                }
+        array_traverse(index->row_matches, match) {
+            if (match->idx + match->len > end_idx) { break; }
 
-                line_data_end = scan;
-            } else {
-                break;
+            c = yed_line_idx_to_col(line, match->idx);
+            if (r != row || c != col) {
+                *row_out = r;
+                *col_out = c;
+                return 1;
             }
         }
+    }
+
+    return 0;
+}
+
+int yed_find_prev(int row, int col, int *row_out, int *col_out) {
+    yed_frame        *frame;
+    yed_buffer       *buff;
+    yed_line         *line;
+    yed_search_index *index;
+    yed_search_match *match;
+    int               end_idx,
+                      r,
+                      c,
+                      i,
+                      junk_row, junk_col;
+
+    if (!ys->current_search)    { return 0; }
+    if (!ys->active_frame)      { return 0; }
+
+    frame = ys->active_frame;
 
-        r -= 1;
+    if (!frame->buffer)    { return 0; }
+
+    buff = frame->buffer;
+
+    if (buff->has_selection && !search_can_move_cursor()) {
+        *row_out = row;
+        *col_out = col;
+        row_out  = &junk_row;
+        col_out  = &junk_col;
     }
 
-    r = bucket_array_len(buff->lines);
-    bucket_array_rtraverse_from(buff->lines, line, r - 1) {
-        data_len = array_len(line->chars);
+    index = yed_search_get_index(buff);
 
-        if (!line->visual_width) {
-            r -= 1;
-            continue;
+    if (index == NULL)    { return 0; }
+
+    /* From just before the cursor to the top of the buffer. */
+    for (r = yed_search_index_seek_row(index, row, -1); r; r = yed_search_index_seek_row(index, r - 1, -1)) {
+        line    = yed_buff_get_line(buff, r);
+        end_idx = array_len(line->chars);
+        if (r == row) {
+            if (index->pattern.mode != SEARCH_MODE_REGEX
+            &&  col <= index->pattern.literal.len) {
+                continue;
+            }
+            end_idx = yed_line_col_to_idx(line, col - 1);
         }
 
-        line_data     = array_data(line->chars);
-        line_data_end = line_data + data_len;
+        for (i = array_len(index->row_matches) - 1; i >= 0; i -= 1) {
+            match = array_item(index->row_matches, i);
+            if (match->idx + match->len > end_idx) { continue; }
+
+            c = yed_line_idx_to_col(line, match->idx);
+            if (r != row || c != col) {
+                *row_out = r;
+                *col_out = c;
+                return 1;
+            }
+        }
+    }
 
-        while (line_data < line_data_end && line_data_end - line_data >= search_len) {
-            if ((scan = last_strnstr(line_data, ys->current_search, line_data_end - line_data))) {
-                idx = scan - line_data;
-                c   = yed_line_idx_to_col(line, idx);
+    /* Wrap around: from the bottom of the buffer back up. */
+    for (r = yed_search_index_seek_row(index, index->n_rows, -1); r; r = yed_search_index_seek_row(index, r - 1, -1)) {
+        line = yed_buff_get_line(buff, r);
 
-                if (r != row || c != col) {
-                    *row_out = r;
-                    *col_out = c;
-                    return 1;
-                }
+        for (i = array_len(index->row_matches) - 1; i >= 0; i -= 1) {
+            match = array_item(index->row_matches, i);
 
-                line_data_end = scan;
-            } else {
-                break;
+            c = yed_line_idx_to_col(line, match->idx);
+            if (r != row || c != col) {
+                *row_out = r;
+                *col_out = c;
+                return 1;
             }
         }
-
-        r -= 1;
     }
 
     return 0;
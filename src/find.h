@@ -1,9 +1,96 @@
 #ifndef __FIND_H__
 #define __FIND_H__
 
-void yed_init_search(void);
-void yed_search_line_handler(yed_event *event);
-int  yed_find_next(int row, int col, int *row_out, int *col_out);
-int  yed_find_prev(int row, int col, int *row_out, int *col_out);
+/*
+ * The search index.
+ *
+ * Rather than scanning the buffer line by line every time we need to
+ * know where the current search matches (find-next, find-prev, and the
+ * highlighter, which runs for every drawn line), we keep a sorted array
+ * of every match in the buffer and answer those questions with a binary
+ * search.
+ *
+ * The index is built on demand, by scanning ranges of rows in parallel,
+ * and is kept up to date incrementally from EVENT_BUFFER_POST_MOD: edits
+ * to a line rescan just that line, inserted/deleted lines shift the
+ * rows of the matches below them, and batched edits rescan just the rows
+ * they replaced.
+ *
+ * If a pattern matches too many times, we don't keep the matches around
+ * (the index is marked as overflowed) and fall back to scanning lines as
+ * they are needed.
+ */
+
+#define SEARCH_INDEX_MAX_MATCHES (1 << 22)
+
+/*
+ * Search modes, chosen with the 'search-mode' variable:
+ *
+ *     literal      Match the search string exactly.
+ *     case-fold    Match the search string ignoring (ASCII) case.
+ *     regex        Match the search string as a POSIX extended regular expression.
+ */
+#define SEARCH_MODE_LITERAL   (0)
+#define SEARCH_MODE_CASE_FOLD (1)
+#define SEARCH_MODE_REGEX     (2)
+
+typedef struct {
+    char *str;
+    int   len;
+    int   fold;
+    int   use_boyer_moore;
+    int   bad_char_table[256];
+} yed_search_literal;
+
+typedef struct {
+    char               *str;
+    int                 mode;
+    /*
+     * In the literal modes, this is the whole pattern. In regex mode,
+     * it's a string that every match must contain (if we found one), which
+     * lets us skip running the regex on most lines.
+     */
+    yed_search_literal  literal;
+    int                 has_literal;
+    regex_t             regex;
+    int                 regex_ok;
+} yed_search_pattern;
+
+typedef struct {
+    int row;
+    int idx;
+    int len;
+} yed_search_match;
+
+typedef struct {
+    yed_buffer         *buffer;
+    yed_search_pattern  pattern;
+    array_t             matches;      /* yed_search_match, sorted by (row, idx) */
+    array_t             row_matches;  /* yed_search_match, the matches in one row */
+    int                 n_rows;
+    int                 valid;
+    int                 overflow;
+} yed_search_index;
+
+/*
+ * The literal matcher is also used outside of buffer search. A literal
+ * starts out zeroed and its str is owned by it. yed_search_literal_next()
+ * returns the offset of the first occurrence in text or -1, and
+ * yed_search_regex_factor() finds a string that every match of a basic or
+ * extended regex must contain (see find.c).
+ */
+void     yed_search_literal_compile(yed_search_literal *literal, const char *str, int len, int fold);
+int      yed_search_literal_next(yed_search_literal *literal, const char *text, int len);
+int      yed_search_regex_factor(const char *re, int extended, char *out);
+
+void     yed_init_search(void);
+void     yed_search_line_handler(yed_event *event);
+void     yed_search_buff_mod_handler(yed_event *event);
+void     yed_search_buff_delete_handler(yed_event *event);
+void     yed_search_invalidate(void);
+array_t *yed_search_row_matches(yed_buffer *buff, int row);
+int      yed_search_line_next_match(yed_buffer *buff, yed_line *line, int off, int *len_out);
+int      yed_find_next(int row, int col, int *row_out, int *col_out);
+int      yed_find_prev(int row, int col, int *row_out, int *col_out);
 
 #endif
@@ -61,6 +61,31 @@ void frame_get_rect(yed_frame *frame, int *top,  int *left,  int *height,  int *
     if (*width   <= 0) { *width   = 1; }
 }
 
+static void yed_line_draw_cache_free_entries(yed_line_draw_cache *cache) {
+    yed_line_draw_cache_entry *entry;
+
+    array_traverse(cache->entries, entry) {
+        array_free(entry->line_chars);
+        array_free(entry->line_attrs);
+        array_free(entry->gutter_glyphs);
+        array_free(entry->gutter_attrs);
+    }
+
+    array_clear(cache->entries);
+}
+
+static void yed_line_draw_cache_free(yed_line_draw_cache *cache) {
+    yed_line_draw_cache_free_entries(cache);
+    array_free(cache->entries);
+
+    if (cache->search != NULL) {
+        free(cache->search);
+        cache->search = NULL;
+    }
+
+    cache->valid = 0;
+}
+
 yed_frame * yed_new_frame(float top_f, float left_f, float height_f, float width_f) {
     yed_frame *frame;
 
@@ -96,6 +121,9 @@ yed_frame * yed_new_frame(float top_f, float left_f, float height_f, float width
     frame->gutter_glyphs   = array_make(char);
     frame->gutter_attrs    = array_make(yed_attrs);
 
+    memset(&frame->line_draw_cache, 0, sizeof(frame->line_draw_cache));
+    frame->line_draw_cache.entries = array_make(yed_line_draw_cache_entry);
+
     frame->tree = yed_frame_tree_add_root(frame);
 
     return frame;
@@ -165,6 +193,7 @@ void yed_delete_frame(yed_frame *frame) {
     }
 
     array_free(frame->line_attrs);
+    yed_line_draw_cache_free(&frame->line_draw_cache);
 
     free(frame);
 
@@ -589,13 +618,8 @@ out:
     return c;
 }
 
-void yed_frame_draw_line(yed_frame *frame, yed_line *line, int row, int y_offset, int x_offset) {
-    yed_attrs  cur_attr, base_attr, sel_attr, *attr_it;
-    int        col, n_col, first_idx, first_col, width_skip, col_off, width, n_bytes, i, nprint_glyph_pos;
-    char       nprint_chars[2] = { '^', '?' };
-    char      *bytes, *gutter_bytes;
-    yed_event  event;
-    int        save_gutter_width;
+static yed_attrs yed_frame_line_base_attr(yed_frame *frame, int row) {
+    static yed_var_handle cursor_line = YED_VAR_HANDLE("cursor-line");
 
     /*
      * Determine what the baseline attributes of text should
@@ -604,15 +628,55 @@ void yed_frame_draw_line(yed_frame *frame, yed_line *line, int row, int y_offset
     if (frame == ys->active_frame
     &&  frame->cursor_line == row
     &&  !frame->buffer->has_selection
-    &&  yed_var_is_truthy("cursor-line")) {
+    &&  yed_var_handle_is_truthy(&cursor_line)) {
 
-        base_attr = yed_active_style_get_cursor_line();
+        return yed_active_style_get_cursor_line();
     } else if (frame == ys->active_frame) {
-        base_attr = yed_active_style_get_active();
-    } else {
-        base_attr = yed_active_style_get_inactive();
+        return yed_active_style_get_active();
     }
 
+    return yed_active_style_get_inactive();
+}
+
+/*
+ * Find the columns [start, end) of the line that are in the selection.
+ * Both are 0 if there aren't any.
+ */
+static void yed_frame_line_selection_cols(yed_frame *frame, yed_line *line, int row, int *start, int *end) {
+    yed_range *range;
+    int        r1, c1, r2, c2;
+
+    *start = *end = 0;
+
+    if (ys->active_frame != frame || !frame->buffer->has_selection) { return; }
+
+    range = &frame->buffer->selection;
+
+    yed_range_sorted_points(range, &r1, &c1, &r2, &c2);
+
+    if (row < r1 || row > r2) { return; }
+
+    *start = 1;
+    *end   = line->visual_width + 1;
+
+    if (range->kind == RANGE_NORMAL) {
+        if (row == r1) { *start = MAX(c1, 1);    }
+        if (row == r2) { *end   = MIN(c2, *end); }
+    }
+
+    if (*start >= *end) { *start = *end = 0; }
+}
+
+/*
+ * Run EVENT_ROW_PRE_CLEAR and EVENT_LINE_PRE_DRAW for the row, leaving the
+ * results in the frame's line_attrs, gutter_glyphs, and gutter_attrs arrays.
+ * Returns the row's base attributes.
+ */
+static yed_attrs yed_frame_line_draw_events(yed_frame *frame, yed_line *line, int row, yed_attrs base_attr, int sel_start, int sel_end) {
+    yed_attrs  cur_attr, sel_attr, *attr_it;
+    int        col;
+    yed_event  event;
+    int        save_gutter_width;
 
     memset(&event, 0, sizeof(event));
     event.kind          = EVENT_ROW_PRE_CLEAR;
@@ -634,12 +698,10 @@ void yed_frame_draw_line(yed_frame *frame, yed_line *line, int row, int y_offset
     }
 
     /*
-     * Find out if there are any columns that are in a selection.
-     * If there are, apply the selection attributes to them in the
-     * line_attrs array.
+     * Apply the selection attributes to the columns that
+     * are in the selection.
      */
-     if (ys->active_frame == frame && frame->buffer->has_selection) {
-        col = 1;
+    if (sel_start) {
         if (ys->active_style) {
             sel_attr = yed_active_style_get_selection();
         } else {
@@ -647,11 +709,9 @@ void yed_frame_draw_line(yed_frame *frame, yed_line *line, int row, int y_offset
             sel_attr.flags |= ATTR_INVERSE;
         }
 
-        array_traverse(frame->line_attrs, attr_it) {
-            if (yed_is_in_range(&frame->buffer->selection, row, col)) {
-                yed_combine_attrs(attr_it, &sel_attr);
-            }
-            col += 1;
+        for (col = sel_start; col < sel_end; col += 1) {
+            attr_it = array_item(frame->line_attrs, col - 1);
+            yed_combine_attrs(attr_it, &sel_attr);
         }
     }
 
@@ -691,29 +751,34 @@ again_gutter:
     frame->gutter_glyphs = event.gutter_glyphs;
     frame->gutter_attrs  = event.gutter_attrs;
 
-    /*
-     * Okay, let's draw..
-     */
+    return base_attr;
+}
+
+static void yed_frame_paint_line(yed_frame *frame, yed_line *line, int y_offset, int x_offset,
+                                 yed_attrs base_attr, array_t *line_attrs, array_t *gutter_glyphs, array_t *gutter_attrs) {
+    yed_attrs  cur_attr;
+    int        n_col, first_idx, first_col, width_skip, col_off, width, n_bytes, i, nprint_glyph_pos;
+    char       nprint_chars[2] = { '^', '?' };
+    char      *bytes, *gutter_bytes;
 
     /*
      * First, draw the gutter.
      */
     if (frame->gutter_width > 0) {
-        array_zero_term(frame->gutter_glyphs);
-        gutter_bytes = array_data(frame->gutter_glyphs);
+        array_zero_term(*gutter_glyphs);
 
         col_off = 0;
 
         yed_set_cursor(frame->top + y_offset, frame->left);
 
-        for (gutter_bytes = event.gutter_glyphs.data;
-            (void*)gutter_bytes < (event.gutter_glyphs.data + (event.gutter_glyphs.used * event.gutter_glyphs.elem_size)); ) {
+        for (gutter_bytes = gutter_glyphs->data;
+            (void*)gutter_bytes < (gutter_glyphs->data + (gutter_glyphs->used * gutter_glyphs->elem_size)); ) {
 
             width = yed_get_glyph_width(*(yed_glyph*)gutter_bytes);
             if (col_off + width > frame->gutter_width) { break; }
 
             n_bytes  = yed_get_glyph_len(*(yed_glyph*)gutter_bytes);
-            cur_attr = *(yed_attrs*)array_item(frame->gutter_attrs, col_off);
+            cur_attr = *(yed_attrs*)array_item(*gutter_attrs, col_off);
 
             yed_set_attr(cur_attr);
             yed_screen_print_n(gutter_bytes, n_bytes);
@@ -723,7 +788,7 @@ again_gutter:
         }
 
         for (; col_off < frame->gutter_width; col_off += 1) {
-            cur_attr = *(yed_attrs*)array_item(frame->gutter_attrs, col_off);
+            cur_attr = *(yed_attrs*)array_item(*gutter_attrs, col_off);
             yed_set_attr(cur_attr);
             yed_screen_print(" ");
         }
@@ -731,7 +796,7 @@ again_gutter:
 
     /* Set the initial attrs. */
     if (line->visual_width) {
-        cur_attr = *(yed_attrs*)array_item(frame->line_attrs, 0);
+        cur_attr = *(yed_attrs*)array_item(*line_attrs, 0);
         yed_set_attr(cur_attr);
     } else {
         cur_attr = base_attr;
@@ -760,7 +825,7 @@ again_gutter:
         if (*bytes == '\t') {
             for (i = width_skip; i < width && col_off < n_col; i += 1) {
                 yed_set_cursor(frame->top + y_offset, frame->left + frame->gutter_width + col_off);
-                cur_attr = *(yed_attrs*)array_item(frame->line_attrs, first_col + col_off - 1);
+                cur_attr = *(yed_attrs*)array_item(*line_attrs, first_col + col_off - 1);
                 yed_set_attr(cur_attr);
                 yed_screen_print_n(" ", 1);
                 col_off += 1;
@@ -772,7 +837,7 @@ again_gutter:
 
             for (i = width_skip; i < width && col_off < n_col; i += 1) {
                 yed_set_cursor(frame->top + y_offset, frame->left + frame->gutter_width + col_off);
-                cur_attr = *(yed_attrs*)array_item(frame->line_attrs, first_col + col_off - 1);
+                cur_attr = *(yed_attrs*)array_item(*line_attrs, first_col + col_off - 1);
                 yed_set_attr(cur_attr);
                 yed_screen_print_n(nprint_chars + nprint_glyph_pos, 1);
                 col_off          += 1;
@@ -781,7 +846,7 @@ again_gutter:
         } else {
             if (col_off + width <= n_col) {
                 yed_set_cursor(frame->top + y_offset, frame->left + frame->gutter_width + col_off);
-                cur_attr = *(yed_attrs*)array_item(frame->line_attrs, first_col + col_off - 1);
+                cur_attr = *(yed_attrs*)array_item(*line_attrs, first_col + col_off - 1);
                 yed_set_attr(cur_attr);
                 yed_screen_print_n(bytes, n_bytes);
                 col_off += width;
@@ -802,6 +867,132 @@ again_gutter:
     }
 }
 
+/*
+ * Check the frame-wide inputs to the line draw events and throw out
+ * the cached rows if any of them have changed.
+ * Returns NULL if the rows can't be cached at all.
+ */
+static yed_line_draw_cache *yed_frame_prepare_line_draw_cache(yed_frame *frame, int x_offset) {
+    yed_line_draw_cache       *cache;
+    yed_line_draw_cache_entry *entry;
+    yed_line_draw_cache_entry  empty;
+    yed_buffer                *buff;
+    unsigned                   deps;
+    int                        active;
+    char                      *search;
+    int                        i;
+
+    cache = &frame->line_draw_cache;
+    deps  = yed_get_line_draw_deps();
+
+    if (deps & LINE_DRAW_DEP_ANY) {
+        cache->valid = 0;
+        return NULL;
+    }
+
+    buff   = frame->buffer;
+    active = frame == ys->active_frame;
+    search = active ? ys->current_search : NULL;
+
+    if (!cache->valid
+    ||  cache->gen           != ys->line_draw_gen
+    ||  cache->buffer        != buff
+    ||  cache->ft            != buff->ft
+    ||  cache->active        != active
+    ||  cache->has_selection != buff->has_selection
+    ||  cache->gutter_width  != frame->gutter_width
+    ||  cache->x_offset      != x_offset
+    ||  ((deps & LINE_DRAW_DEP_BUFFER)
+        && cache->buffer_version != buff->version)
+    ||  ((deps & LINE_DRAW_DEP_CURSOR)
+        && (cache->cursor_row != frame->cursor_line || cache->cursor_col != frame->cursor_col))
+    ||  (cache->search == NULL) != (search == NULL)
+    ||  (search != NULL && strcmp(cache->search, search) != 0)) {
+
+        cache->gen            = ys->line_draw_gen;
+        cache->buffer         = buff;
+        cache->buffer_version = buff->version;
+        cache->ft             = buff->ft;
+        cache->active         = active;
+        cache->has_selection  = buff->has_selection;
+        cache->gutter_width   = frame->gutter_width;
+        cache->x_offset       = x_offset;
+        cache->cursor_row     = frame->cursor_line;
+        cache->cursor_col     = frame->cursor_col;
+
+        if (cache->search != NULL) {
+            free(cache->search);
+        }
+        cache->search = search == NULL ? NULL : strdup(search);
+
+        array_traverse(cache->entries, entry) {
+            entry->row = 0;
+        }
+    }
+
+    if (array_len(cache->entries) != frame->height) {
+        yed_line_draw_cache_free_entries(cache);
+
+        memset(&empty, 0, sizeof(empty));
+        empty.line_chars    = array_make(char);
+        empty.line_attrs    = array_make(yed_attrs);
+        empty.gutter_glyphs = array_make(char);
+        empty.gutter_attrs  = array_make(yed_attrs);
+
+        for (i = 0; i < frame->height; i += 1) {
+            array_push(cache->entries, empty);
+        }
+    }
+
+    cache->valid = 1;
+
+    return cache;
+}
+
+static void yed_frame_draw_line(yed_frame *frame, yed_line_draw_cache *cache, yed_line *line, int row, int y_offset, int x_offset) {
+    yed_line_draw_cache_entry *entry;
+    yed_attrs                  in_base_attr, base_attr;
+    int                        cursor_col, sel_start, sel_end;
+
+    in_base_attr = yed_frame_line_base_attr(frame, row);
+    yed_frame_line_selection_cols(frame, line, row, &sel_start, &sel_end);
+
+    if (cache == NULL) {
+        base_attr = yed_frame_line_draw_events(frame, line, row, in_base_attr, sel_start, sel_end);
+        yed_frame_paint_line(frame, line, y_offset, x_offset, base_attr,
+                             &frame->line_attrs, &frame->gutter_glyphs, &frame->gutter_attrs);
+        return;
+    }
+
+    entry      = array_item(cache->entries, (row - 1) % array_len(cache->entries));
+    cursor_col = frame->cursor_line == row ? frame->cursor_col : 0;
+
+    if (entry->row           != row
+    ||  entry->cursor_col    != cursor_col
+    ||  entry->sel_start_col != sel_start
+    ||  entry->sel_end_col   != sel_end
+    ||  !yed_attrs_eq(entry->in_base_attr, in_base_attr)
+    ||  array_len(entry->line_chars) != array_len(line->chars)
+    ||  (array_len(line->chars)
+        && memcmp(array_data(entry->line_chars), array_data(line->chars), array_len(line->chars)) != 0)) {
+
+        entry->base_attr     = yed_frame_line_draw_events(frame, line, row, in_base_attr, sel_start, sel_end);
+        entry->row           = row;
+        entry->cursor_col    = cursor_col;
+        entry->sel_start_col = sel_start;
+        entry->sel_end_col   = sel_end;
+        entry->in_base_attr  = in_base_attr;
+
+        array_copy(entry->line_chars,    line->chars);
+        array_copy(entry->line_attrs,    frame->line_attrs);
+        array_copy(entry->gutter_glyphs, frame->gutter_glyphs);
+        array_copy(entry->gutter_attrs,  frame->gutter_attrs);
+    }
+
+    yed_frame_paint_line(frame, line, y_offset, x_offset, entry->base_attr,
+                         &entry->line_attrs, &entry->gutter_glyphs, &entry->gutter_attrs);
+}
+
 void yed_frame_draw_fill(yed_frame *frame, int y_offset) {
     char *fill_str;
     int   fill_str_len;
@@ -874,17 +1065,20 @@ void yed_frame_draw_fill(yed_frame *frame, int y_offset) {
 }
 
 void yed_frame_draw_buff(yed_frame *frame, yed_buffer *buff, int y_offset, int x_offset) {
-    yed_line *line;
-    int lines_drawn;
-    int row;
+    yed_line            *line;
+    int                  lines_drawn;
+    int                  row;
+    yed_line_draw_cache *cache;
 
     yed_reset_attr();
 
     lines_drawn = 0;
 
+    cache = yed_frame_prepare_line_draw_cache(frame, x_offset);
+
     row = y_offset + 1;
     bucket_array_traverse_from(buff->lines, line, y_offset) {
-        yed_frame_draw_line(frame, line, row, lines_drawn, x_offset);
+        yed_frame_draw_line(frame, cache, line, row, lines_drawn, x_offset);
         yed_reset_attr();
 
         lines_drawn += 1;
@@ -893,6 +1087,11 @@ void yed_frame_draw_buff(yed_frame *frame, yed_buffer *buff, int y_offset, int x
         row += 1;
     }
 
+    /* A handler changed the gutter width part way through. */
+    if (cache != NULL && frame->gutter_width != cache->gutter_width) {
+        cache->valid = 0;
+    }
+
     yed_frame_draw_fill(frame, lines_drawn);
     yed_reset_attr();
 }
@@ -931,7 +1130,8 @@ void yed_frame_set_buff(yed_frame *frame, yed_buffer *buff) {
     event.frame = frame;
     yed_trigger_event(&event);
 
-    frame->buffer = buff;
+    frame->buffer                = buff;
+    frame->line_draw_cache.valid = 0;
 
     if (old_buff) {
         if (!yed_buff_is_visible(old_buff)) {
@@ -3,6 +3,40 @@
 
 #include "frame_tree.h"
 
+/*
+ * What a row looked like after EVENT_ROW_PRE_CLEAR and EVENT_LINE_PRE_DRAW
+ * the last time that it was drawn, along with the inputs that went into
+ * those events. See the LINE_DRAW_DEP_* flags in event.h.
+ */
+typedef struct {
+    int                 row;            /* 0 if the entry is empty. */
+    array_t             line_chars;
+    yed_attrs           in_base_attr;
+    int                 cursor_col;     /* 0 if the cursor isn't on this row. */
+    int                 sel_start_col,
+                        sel_end_col;
+    yed_attrs           base_attr;
+    array_t             line_attrs;
+    array_t             gutter_glyphs;
+    array_t             gutter_attrs;
+} yed_line_draw_cache_entry;
+
+typedef struct {
+    int                 valid;
+    array_t             entries;        /* Indexed by (row - 1) % frame height. */
+    unsigned long long  gen;
+    yed_buffer         *buffer;
+    unsigned long long  buffer_version;
+    int                 ft;
+    int                 active;
+    int                 has_selection;
+    int                 gutter_width;
+    int                 x_offset;
+    int                 cursor_row,
+                        cursor_col;
+    char               *search;
+} yed_line_draw_cache;
+
 typedef struct yed_frame_t {
     yed_frame_tree     *tree;
     yed_buffer         *buffer;
@@ -28,6 +62,7 @@ typedef struct yed_frame_t {
     array_t             line_attrs;
     array_t             gutter_glyphs;
     array_t             gutter_attrs;
+    yed_line_draw_cache line_draw_cache;
 } yed_frame;
 
 void yed_init_frames(void);
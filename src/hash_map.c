@@ -0,0 +1,216 @@
+#include "hash_map.h"
+
+#define HASH_MAP_SLOT(map, i) \
+    ((hash_map_slot_t*)((map)->slots + ((uint64_t)(i) * (map)->slot_size)))
+
+#define HASH_MAP_SLOT_VAL(slot) \
+    ((void*)(slot) + sizeof(hash_map_slot_t))
+
+uint32_t hash_string(const char *str) {
+    uint32_t h;
+
+    /* FNV-1a */
+    h = 2166136261u;
+    while (*str) {
+        h ^= (unsigned char)*str;
+        h *= 16777619u;
+        str += 1;
+    }
+
+    return h;
+}
+
+hash_map_t _hash_map_make(int val_size) {
+    hash_map_t m;
+
+    m.slots     = NULL;
+    m.val_size  = val_size;
+    m.slot_size = sizeof(hash_map_slot_t) + ((val_size + 7) & ~7);
+    m.capacity  = 0;
+    m.used      = 0;
+
+    return m;
+}
+
+void _hash_map_free(hash_map_t *map) {
+    if (map->slots) {
+        free(map->slots);
+    }
+    map->slots    = NULL;
+    map->capacity = 0;
+    map->used     = 0;
+}
+
+static hash_map_slot_t * hash_map_find_slot(hash_map_t *map, const char *key, uint32_t hash) {
+    uint32_t         mask;
+    uint32_t         i;
+    hash_map_slot_t *slot;
+
+    if (map->capacity == 0) { return NULL; }
+
+    mask = map->capacity - 1;
+    i    = hash & mask;
+
+    for (;;) {
+        slot = HASH_MAP_SLOT(map, i);
+
+        if (slot->key == NULL) { return NULL; }
+
+        if (slot->hash == hash
+        &&  (slot->key == key || strcmp(slot->key, key) == 0)) {
+            return slot;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    return NULL;
+}
+
+static void hash_map_grow(hash_map_t *map) {
+    void            *old_slots;
+    uint32_t         old_cap;
+    uint32_t         i;
+    uint32_t         j;
+    uint32_t         mask;
+    hash_map_slot_t *old;
+    hash_map_slot_t *new;
+
+    old_slots = map->slots;
+    old_cap   = map->capacity;
+
+    map->capacity = old_cap ? old_cap * 2 : HASH_MAP_DEFAULT_CAP;
+    map->slots    = calloc(map->capacity, map->slot_size);
+    mask          = map->capacity - 1;
+
+    for (i = 0; i < old_cap; i += 1) {
+        old = (hash_map_slot_t*)(old_slots + ((uint64_t)i * map->slot_size));
+        if (old->key == NULL) { continue; }
+
+        j = old->hash & mask;
+        while (HASH_MAP_SLOT(map, j)->key != NULL) {
+            j = (j + 1) & mask;
+        }
+
+        new = HASH_MAP_SLOT(map, j);
+        memcpy(new, old, map->slot_size);
+    }
+
+    if (old_slots) {
+        free(old_slots);
+    }
+}
+
+/*
+ * Insert a key we know isn't in the map yet. The key is stored as is.
+ */
+static hash_map_slot_t * hash_map_insert_new(hash_map_t *map, const char *key, uint32_t hash) {
+    uint32_t         mask;
+    uint32_t         i;
+    hash_map_slot_t *slot;
+
+    /* Keep the load factor under 3/4. */
+    if ((map->used + 1) * 4 > map->capacity * 3) {
+        hash_map_grow(map);
+    }
+
+    mask = map->capacity - 1;
+    i    = hash & mask;
+
+    while ((slot = HASH_MAP_SLOT(map, i))->key != NULL) {
+        i = (i + 1) & mask;
+    }
+
+    slot->key   = key;
+    slot->hash  = hash;
+    map->used  += 1;
+
+    return slot;
+}
+
+const char * intern_string(const char *str) {
+    uint32_t         hash;
+    hash_map_slot_t *slot;
+
+    if (ys->interned_strings.slot_size == 0) {
+        ys->interned_strings = hash_map_make(empty_t);
+    }
+
+    hash = hash_string(str);
+    slot = hash_map_find_slot(&ys->interned_strings, str, hash);
+
+    if (slot == NULL) {
+        slot = hash_map_insert_new(&ys->interned_strings, strdup(str), hash);
+    }
+
+    return slot->key;
+}
+
+void * _hash_map_lookup(hash_map_t *map, const char *key) {
+    hash_map_slot_t *slot;
+
+    if (map->used == 0) { return NULL; }
+
+    slot = hash_map_find_slot(map, key, hash_string(key));
+
+    if (slot == NULL) { return NULL; }
+
+    return HASH_MAP_SLOT_VAL(slot);
+}
+
+void * _hash_map_insert(hash_map_t *map, const char *key, void *val) {
+    uint32_t         hash;
+    hash_map_slot_t *slot;
+
+    hash = hash_string(key);
+    slot = hash_map_find_slot(map, key, hash);
+
+    if (slot == NULL) {
+        slot = hash_map_insert_new(map, intern_string(key), hash);
+    }
+
+    memcpy(HASH_MAP_SLOT_VAL(slot), val, map->val_size);
+
+    return HASH_MAP_SLOT_VAL(slot);
+}
+
+int _hash_map_delete(hash_map_t *map, const char *key) {
+    hash_map_slot_t *slot;
+    uint32_t         mask;
+    uint32_t         i;
+    uint32_t         j;
+    uint32_t         home;
+
+    if (map->used == 0) { return 0; }
+
+    slot = hash_map_find_slot(map, key, hash_string(key));
+
+    if (slot == NULL) { return 0; }
+
+    mask = map->capacity - 1;
+    i    = ((void*)slot - map->slots) / map->slot_size;
+    j    = i;
+
+    /*
+     * Move later entries of the probe run back into the hole as long as
+     * that doesn't put them before their home slot.
+     */
+    for (;;) {
+        j    = (j + 1) & mask;
+        slot = HASH_MAP_SLOT(map, j);
+
+        if (slot->key == NULL) { break; }
+
+        home = slot->hash & mask;
+
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            memcpy(HASH_MAP_SLOT(map, i), slot, map->slot_size);
+            i = j;
+        }
+    }
+
+    HASH_MAP_SLOT(map, i)->key = NULL;
+    map->used -= 1;
+
+    return 1;
+}
@@ -0,0 +1,59 @@
+#ifndef __HASH_MAP_H__
+#define __HASH_MAP_H__
+
+/*
+ * An open-addressing (linear probing) hash map keyed by strings.
+ *
+ * Keys are interned (see intern_string()), so a map never owns or frees
+ * them and a key pointer handed out by the map stays valid forever.
+ * Values are stored inline in the slots, like array_t's elements.
+ *
+ * Deletion shifts the following entries of the probe run back into the
+ * hole, so there are no tombstones and lookups stay short no matter how
+ * much churn the map sees.
+ */
+
+#define HASH_MAP_DEFAULT_CAP (16)
+
+typedef struct {
+    const char *key;      /* NULL if the slot is empty. */
+    uint32_t    hash;
+    uint32_t    _pad;
+} hash_map_slot_t;
+
+typedef struct {
+    void     *slots;
+    int       val_size;
+    int       slot_size;
+    uint32_t  capacity;   /* Always 0 or a power of 2. */
+    uint32_t  used;
+} hash_map_t;
+
+uint32_t     hash_string(const char *str);
+const char * intern_string(const char *str);
+
+hash_map_t _hash_map_make(int val_size);
+void _hash_map_free(hash_map_t *map);
+void * _hash_map_lookup(hash_map_t *map, const char *key);
+void * _hash_map_insert(hash_map_t *map, const char *key, void *val);
+int _hash_map_delete(hash_map_t *map, const char *key);
+
+#define hash_map_make(V_T) \
+    (_hash_map_make(sizeof(V_T)))
+
+#define hash_map_free(map) \
+    (_hash_map_free(&(map)))
+
+#define hash_map_len(map) \
+    ((map).used)
+
+#define hash_map_lookup(map, key) \
+    (_hash_map_lookup(&(map), (key)))
+
+#define hash_map_insert(map, key, val) \
+    (_hash_map_insert(&(map), (key), &(val)))
+
+#define hash_map_delete(map, key) \
+    (_hash_map_delete(&(map), (key)))
+
+#endif
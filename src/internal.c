@@ -134,6 +134,7 @@ void yed_service_reload(int core) {
         tree_reset_fns(yed_completion_name_t, yed_completion,        ys->completions);
         tree_reset_fns(yed_completion_name_t, yed_completion,        ys->default_completions);
         tree_reset_fns(yed_plugin_name_t,     yed_plugin_ptr_t,      ys->plugins);
+        yed_reset_words_fns();
     }
 
     ys->cur_log_name = NULL; /* This could be memory from a plugin that got unloaded. */
@@ -168,6 +169,7 @@ void yed_service_reload(int core) {
         cmd_it = tree_begin(ys->commands);
         key = tree_it_key(cmd_it);
         tree_delete(ys->commands, key);
+        hash_map_delete(ys->commands_index, key);
         free(key);
     }
     while (tree_len(ys->default_commands)) {
@@ -207,27 +209,18 @@ void yed_service_reload(int core) {
         yed_register_sigwinch_handler();
         yed_register_sigstop_handler();
         yed_register_sigcont_handler();
+        yed_register_sigchld_handler();
     }
 }
 
-static void start_update_forcer(void);
-
 int yed_get_update_hz(void) { return ys->update_hz; }
 
 void yed_set_update_hz(int hz) {
-    int need_to_start_updater;
-
     if      (hz < MIN_UPDATE_HZ) { hz = 0;             }
     else if (hz > MAX_UPDATE_HZ) { hz = MAX_UPDATE_HZ; }
 
-    need_to_start_updater = ys->update_hz < MIN_UPDATE_HZ && hz;
-
     ys->update_hz = hz;
 
-    if (need_to_start_updater) {
-        start_update_forcer();
-    }
-
     LOG_FN_ENTER();
     yed_log("update rate: %d Hz", ys->update_hz);
     LOG_EXIT();
@@ -245,6 +238,7 @@ const char *u8_to_s(u8 u) { return _u8_to_s[u]; }
 
 #include "array.c"
 #include "bucket_array.c"
+#include "hash_map.c"
 #include "term.c"
 #include "screen.c"
 #include "key.c"
@@ -252,6 +246,7 @@ const char *u8_to_s(u8 u) { return _u8_to_s[u]; }
 #include "utf8.c"
 #include "undo.c"
 #include "buffer.c"
+#include "load.c"
 #include "attrs.c"
 #include "ft.c"
 #include "frame.c"
@@ -261,6 +256,8 @@ const char *u8_to_s(u8 u) { return _u8_to_s[u]; }
 #include "measure_time.c"
 #include "default_event_handlers.c"
 #include "event.c"
+#include "loop.c"
+#include "job.c"
 #include "plugin.c"
 #include "boyer_moore.c"
 #include "find.c"
@@ -269,6 +266,7 @@ const char *u8_to_s(u8 u) { return _u8_to_s[u]; }
 #include "style.c"
 #include "subproc.c"
 #include "complete.c"
+#include "words.c"
 #include "direct_draw.c"
 #include "frame_tree.c"
 #include "version.c"
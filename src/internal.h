@@ -25,6 +25,10 @@
 #include <stdint.h>
 #include <math.h>
 #include <pthread.h>
+#include <regex.h>
+#include <poll.h>
+#include <spawn.h>
+#include <limits.h>
 
 #define _GNU_SOURCE
 #include <dlfcn.h>
@@ -132,11 +136,13 @@ use_tree_c(yed_plugin_name_t, yed_plugin_ptr_t, strcmp);
 use_tree_c(yed_var_name_t, yed_var_val_t, strcmp);
 use_tree_c(yed_style_name_t, yed_style_ptr_t, strcmp);
 use_tree_c(str_t, empty_t, strcmp);
+use_tree_c(str_t, int, strcmp);
 use_tree_c(yed_completion_name_t, yed_completion, strcmp);
 use_tree_c(yed_ft_name_t, empty_t, strcmp);
 
 #include "array.h"
 #include "bucket_array.h"
+#include "hash_map.h"
 #include "yed.h"
 #include "term.h"
 #include "attrs.h"
@@ -156,8 +162,11 @@ int mk_wcwidth(wchar_t ucs);
 #include "getRSS.h"
 #include "measure_time.h"
 #include "event.h"
+#include "loop.h"
+#include "job.h"
 #include "plugin.h"
 #include "find.h"
+#include "words.h"
 #include "var.h"
 #include "util.h"
 #include "style.h"
@@ -179,14 +188,19 @@ typedef struct yed_state_t {
     char                        *argv0;
     array_t                      output_buffer;
     array_t                      writer_buffer;
+    array_t                      ready_output;
     pthread_mutex_t              write_ready_mtx;
     pthread_cond_t               write_ready_cond;
+    int                          write_pending;
+    pthread_mutex_t              write_mtx;
+    pthread_mutex_t              term_write_mtx;
     pthread_t                    writer_id;
     struct termios               sav_term;
     int                          term_cols,
                                  term_rows;
     tree(yed_buffer_name_t,
          yed_buffer_ptr_t)       buffers;
+    hash_map_t                   buffers_index;
     int                          unnamed_buff_counter;
     array_t                      log_name_stack;
     const char                  *cur_log_name;
@@ -203,6 +217,7 @@ typedef struct yed_state_t {
                                  search_save_col;
     array_t                      search_hist;
     yed_cmd_line_readline_ptr_t  search_readline;
+    yed_search_index             search_index;
     array_t                      replace_save_lines;
     array_t                      replace_working_lines;
     array_t                      replace_markers;
@@ -221,6 +236,7 @@ typedef struct yed_state_t {
     int                          tabw;
     tree(yed_command_name_t,
          yed_command)            commands;
+    hash_map_t                   commands_index;
     tree(yed_command_name_t,
          yed_command)            default_commands;
     tree(yed_plugin_name_t,
@@ -234,8 +250,14 @@ typedef struct yed_state_t {
     int                          virt_key_counter;
     array_t                      released_virt_keys;
     array_t                      event_handlers[N_EVENTS];
+    array_t                      line_draw_deps;
+    unsigned long long           line_draw_gen;
+    unsigned long long           line_draw_deps_gen;
+    unsigned                     line_draw_deps_all;
     tree(yed_var_name_t,
          yed_var_val_t)          vars;
+    hash_map_t                   vars_index;
+    unsigned long long           var_gen;
     tree(yed_style_name_t,
          yed_style_ptr_t)        styles;
     yed_style_ptr_t              active_style;
@@ -245,6 +267,14 @@ typedef struct yed_state_t {
     unsigned long long           n_pumps;
     unsigned long long           draw_accum_us;
     unsigned long long           draw_avg_us;
+    unsigned long long           diff_accum_us;
+    unsigned long long           n_renders;
+    unsigned long long           render_accum_us;
+    unsigned long long           render_accum_bytes;
+    unsigned long long           write_accum_us;
+    unsigned long long           n_dropped_frames;
+    unsigned long long           undo_mem;
+    hash_map_t                   interned_strings;
 
     array_t                      direct_draws;
     char                        *working_dir;
@@ -261,12 +291,24 @@ typedef struct yed_state_t {
 
     int                          mouse_reporting_ref_count;
     int                          update_hz;
-    int                          skip_force_update;
-    pthread_t                    update_forcer_id;
-    yed_screen                   screen1;
-    yed_screen                   screen2;
+    int                          wake_fds[2];
+    array_t                      timers;
+    int                          timer_id_counter;
+    array_t                      loop_fds;
+    unsigned long long           last_wake_ms;
+    char                         input_buff[YED_INPUT_BUFF_SIZE];
+    int                          input_len,
+                                 input_pos;
+    yed_job_pool                *job_pool;
+    array_t                      owned_jobs;
+    array_t                      subprocs;
+    yed_screen                   screens[4];
     yed_screen                  *screen_update;
+    yed_screen                  *screen_ready;
     yed_screen                  *screen_render;
+    yed_screen                  *screen_shown;
+    yed_screen                  *screen_published;
+    yed_attr_palette             attr_palette;
 } yed_state;
 
 extern yed_state *ys;
@@ -0,0 +1,389 @@
+#include "job.h"
+
+#define JOB_QUEUED   (0)
+#define JOB_RUNNING  (1)
+#define JOB_FINISHED (2)
+
+static void * yed_job_worker(void *arg);
+
+void yed_init_jobs(void) {
+    ys->owned_jobs = array_make(yed_job*);
+}
+
+static yed_job_pool * yed_get_job_pool(void) {
+    yed_job_pool *pool;
+    long          n_cpus;
+    long          i;
+
+    if (ys->job_pool != NULL) { return ys->job_pool; }
+
+    n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    LIMIT(n_cpus, 1, JOB_MAX_WORKERS);
+
+    pool = calloc(1, sizeof(*pool));
+
+    pthread_mutex_init(&pool->mtx, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->finish_cond, NULL);
+
+    for (i = 0; i < n_cpus; i += 1) {
+        pthread_mutex_init(&pool->queues[i].mtx, NULL);
+        pool->queues[i].jobs = array_make(yed_job*);
+    }
+
+    pool->n_workers = n_cpus;
+    ys->job_pool    = pool;
+
+    /*
+     * If some of the threads don't start, the others will steal the jobs
+     * that land in their queues.
+     */
+    for (i = 0; i < n_cpus; i += 1) {
+        if (pthread_create(&pool->threads[i], NULL, yed_job_worker, (void*)i) != 0) {
+            break;
+        }
+        pool->n_threads += 1;
+    }
+
+    if (pool->n_threads == 0) {
+        pool->n_workers = 0;
+    }
+
+    return pool;
+}
+
+int yed_n_job_workers(void) {
+    return MAX(yed_get_job_pool()->n_workers, 1);
+}
+
+static void yed_job_unref(yed_job *job) {
+    if (__atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(job);
+    }
+}
+
+static int yed_job_claim(yed_job *job) {
+    int expected;
+
+    expected = JOB_QUEUED;
+
+    return __atomic_compare_exchange_n(&job->state, &expected, JOB_RUNNING,
+                                       0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void yed_job_push_done(yed_job_pool *pool, yed_job *job) {
+    yed_job *head;
+
+    head = __atomic_load_n(&pool->done_head, __ATOMIC_RELAXED);
+    do {
+        job->next_done = head;
+    } while (!__atomic_compare_exchange_n(&pool->done_head, &head, job,
+                                          1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    yed_wake();
+}
+
+/* The caller must have claimed the job. */
+static void yed_job_run(yed_job_pool *pool, yed_job *job) {
+    if (!__atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE)) {
+        job->work(job, job->arg);
+    }
+
+    yed_job_push_done(pool, job);
+
+    pthread_mutex_lock(&pool->mtx);
+    __atomic_store_n(&job->state, JOB_FINISHED, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool->finish_cond);
+    pthread_mutex_unlock(&pool->mtx);
+}
+
+static yed_job * yed_job_take(yed_job_pool *pool, int idx) {
+    yed_job_queue  *q;
+    yed_job        *job;
+    int             i;
+
+    job = NULL;
+
+    /* Newest of our own first, then the oldest of somebody else's. */
+    for (i = 0; i < pool->n_workers && job == NULL; i += 1) {
+        q = pool->queues + ((idx + i) % pool->n_workers);
+
+        pthread_mutex_lock(&q->mtx);
+        if (array_len(q->jobs) > 0) {
+            if (i == 0) {
+                job = *(yed_job**)array_last(q->jobs);
+                array_pop(q->jobs);
+            } else {
+                job = *(yed_job**)array_item(q->jobs, 0);
+                array_delete(q->jobs, 0);
+            }
+        }
+        pthread_mutex_unlock(&q->mtx);
+    }
+
+    if (job != NULL) {
+        pthread_mutex_lock(&pool->mtx);
+        pool->n_queued -= 1;
+        pthread_mutex_unlock(&pool->mtx);
+    }
+
+    return job;
+}
+
+static void * yed_job_worker(void *arg) {
+    yed_job_pool *pool;
+    int           idx;
+    yed_job      *job;
+
+    pool = ys->job_pool;
+    idx  = (int)(long)arg;
+
+    for (;;) {
+        if ((job = yed_job_take(pool, idx)) == NULL) {
+            pthread_mutex_lock(&pool->mtx);
+            while (pool->n_queued <= 0 && !pool->stop) {
+                pthread_cond_wait(&pool->work_cond, &pool->mtx);
+            }
+            if (pool->n_queued <= 0 && pool->stop) {
+                pthread_mutex_unlock(&pool->mtx);
+                break;
+            }
+            pthread_mutex_unlock(&pool->mtx);
+            continue;
+        }
+
+        /* Someone waiting on the job may have run it already. */
+        if (yed_job_claim(job)) {
+            yed_job_run(pool, job);
+        }
+
+        yed_job_unref(job);
+    }
+
+    return NULL;
+}
+
+static yed_job * yed_job_make(yed_job_fn work, yed_job_fn done, void *arg, int refs) {
+    yed_job_pool  *pool;
+    yed_job       *job;
+    yed_job_queue *q;
+
+    pool = yed_get_job_pool();
+
+    job            = malloc(sizeof(*job));
+    job->work      = work;
+    job->done      = done;
+    job->arg       = arg;
+    job->owner     = NULL;
+    job->state     = JOB_QUEUED;
+    job->cancelled = 0;
+    job->next_done = NULL;
+    /* One for the queue and one for the completion, plus any the caller wants. */
+    job->refs      = 2 + refs;
+
+    /* We couldn't start any workers, so just do it now. */
+    if (pool->n_workers == 0) {
+        job->refs -= 1;
+        yed_job_claim(job);
+        yed_job_run(pool, job);
+        return job;
+    }
+
+    q = pool->queues + (__atomic_fetch_add(&pool->next_queue, 1, __ATOMIC_RELAXED) % pool->n_workers);
+
+    pthread_mutex_lock(&q->mtx);
+    array_push(q->jobs, job);
+    pthread_mutex_unlock(&q->mtx);
+
+    pthread_mutex_lock(&pool->mtx);
+    pool->n_queued += 1;
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mtx);
+
+    return job;
+}
+
+yed_job *yed_submit_job(yed_job_fn work, yed_job_fn done, void *arg) {
+    return yed_job_make(work, done, arg, 0);
+}
+
+yed_job *yed_submit_owned_job(void *owner, yed_job_fn work, yed_job_fn done, void *arg) {
+    yed_job *job;
+
+    job        = yed_job_make(work, done, arg, 0);
+    job->owner = owner;
+
+    array_push(ys->owned_jobs, job);
+
+    return job;
+}
+
+void yed_cancel_job(yed_job *job) {
+    __atomic_store_n(&job->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+int yed_job_is_cancelled(yed_job *job) {
+    return __atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE);
+}
+
+/* Any thread. Doesn't call the done function. */
+static void yed_job_wait_finished(yed_job_pool *pool, yed_job *job) {
+    if (yed_job_claim(job)) {
+        yed_job_run(pool, job);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mtx);
+    while (__atomic_load_n(&job->state, __ATOMIC_ACQUIRE) != JOB_FINISHED) {
+        pthread_cond_wait(&pool->finish_cond, &pool->mtx);
+    }
+    pthread_mutex_unlock(&pool->mtx);
+}
+
+void yed_wait_job(yed_job *job) {
+    yed_job_wait_finished(ys->job_pool, job);
+
+    /* It's on the completion queue now. */
+    yed_service_jobs();
+}
+
+void yed_run_jobs(yed_job_fn work, void *args, int n, int arg_size) {
+    yed_job_pool  *pool;
+    yed_job      **jobs;
+    int            i;
+
+    if (n <= 0) { return; }
+
+    if (n == 1) {
+        work(NULL, args);
+        return;
+    }
+
+    pool = yed_get_job_pool();
+    jobs = malloc(n * sizeof(*jobs));
+
+    /*
+     * We hold a reference to each job so that this works from any thread,
+     * even if the main thread services the completions in the meantime.
+     */
+    for (i = 0; i < n; i += 1) {
+        jobs[i] = yed_job_make(work, NULL, args + (i * arg_size), 1);
+    }
+
+    /* Help out with whatever the workers haven't gotten to yet. */
+    for (i = n - 1; i >= 0; i -= 1) {
+        if (yed_job_claim(jobs[i])) {
+            yed_job_run(pool, jobs[i]);
+        }
+    }
+
+    for (i = 0; i < n; i += 1) {
+        yed_job_wait_finished(pool, jobs[i]);
+        yed_job_unref(jobs[i]);
+    }
+
+    free(jobs);
+}
+
+static void yed_remove_owned_job(yed_job *job) {
+    yed_job **it;
+    int       i;
+
+    i = 0;
+    array_traverse(ys->owned_jobs, it) {
+        if (*it == job) {
+            array_delete(ys->owned_jobs, i);
+            return;
+        }
+        i += 1;
+    }
+}
+
+void yed_service_jobs(void) {
+    yed_job *list;
+    yed_job *rev;
+    yed_job *next;
+
+    if (ys->job_pool == NULL) { return; }
+
+    list = __atomic_exchange_n(&ys->job_pool->done_head, NULL, __ATOMIC_ACQUIRE);
+
+    /* The queue is a stack. Flip it so that completions go in order. */
+    rev = NULL;
+    while (list != NULL) {
+        next            = list->next_done;
+        list->next_done = rev;
+        rev             = list;
+        list            = next;
+    }
+
+    while (rev != NULL) {
+        next = rev->next_done;
+
+        if (rev->owner != NULL) {
+            yed_remove_owned_job(rev);
+        }
+        if (rev->done != NULL) {
+            rev->done(rev, rev->arg);
+        }
+
+        yed_job_unref(rev);
+
+        rev = next;
+    }
+}
+
+void yed_cancel_jobs_for_owner(void *owner) {
+    yed_job **it;
+    yed_job  *job;
+
+    /* Done functions may submit more jobs, so look again each time. */
+    for (;;) {
+        job = NULL;
+        array_traverse(ys->owned_jobs, it) {
+            if ((*it)->owner == owner) {
+                job = *it;
+                break;
+            }
+        }
+
+        if (job == NULL) { break; }
+
+        yed_cancel_job(job);
+        yed_wait_job(job);
+    }
+}
+
+void yed_stop_jobs(void) {
+    yed_job_pool *pool;
+    int           i;
+
+    if ((pool = ys->job_pool) == NULL) { return; }
+
+    /* Workers finish what's queued before they exit. */
+    pthread_mutex_lock(&pool->mtx);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mtx);
+
+    for (i = 0; i < pool->n_threads; i += 1) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    yed_service_jobs();
+
+    for (i = 0; i < JOB_MAX_WORKERS; i += 1) {
+        if (pool->queues[i].jobs.elem_size) {
+            array_free(pool->queues[i].jobs);
+            pthread_mutex_destroy(&pool->queues[i].mtx);
+        }
+    }
+
+    pthread_cond_destroy(&pool->finish_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->mtx);
+
+    free(pool);
+
+    ys->job_pool = NULL;
+}
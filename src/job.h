@@ -0,0 +1,90 @@
+#ifndef __JOB_H__
+#define __JOB_H__
+
+/*
+ * Background jobs.
+ *
+ * yed keeps a fixed pool of worker threads (one per core). Each worker has
+ * its own queue and idle workers steal from the others, so a burst of jobs
+ * gets spread out without a thread per task.
+ *
+ * A job's work function runs on a worker and must not touch editor state.
+ * When it's done, the job is put on a lock-free completion queue and the
+ * main loop is woken up. The done function is then called on the main
+ * thread at the start of the next pump, where it is safe to use the rest
+ * of the API.
+ *
+ * A yed_job handle is valid until its done function has returned (or, for
+ * a job without one, until the pump after it finishes). Cancelling a job
+ * that hasn't started yet means its work function is never called. A job
+ * that is already running can check yed_job_is_cancelled() and bail out.
+ * The done function is called either way, so it can free the job's arg.
+ *
+ * Plugins should submit with yed_plugin_submit_job() (see plugin.h). Any of
+ * their jobs that are still around when the plugin is unloaded are
+ * cancelled and waited for first.
+ */
+
+#define JOB_MAX_WORKERS (64)
+
+struct yed_job_t;
+
+typedef void (*yed_job_fn)(struct yed_job_t *job, void *arg);
+
+typedef struct yed_job_t {
+    yed_job_fn        work;
+    yed_job_fn        done;
+    void             *arg;
+    void             *owner;
+    int               state;
+    int               cancelled;
+    int               refs;
+    struct yed_job_t *next_done;
+} yed_job;
+
+typedef struct {
+    pthread_mutex_t  mtx;
+    array_t          jobs;    /* The owner pops from the back, thieves take from the front. */
+} yed_job_queue;
+
+typedef struct {
+    int              n_workers;
+    int              n_threads;
+    pthread_t        threads[JOB_MAX_WORKERS];
+    yed_job_queue    queues[JOB_MAX_WORKERS];
+    unsigned         next_queue;
+    pthread_mutex_t  mtx;
+    pthread_cond_t   work_cond;
+    pthread_cond_t   finish_cond;
+    int              n_queued;
+    int              stop;
+    yed_job         *done_head;
+} yed_job_pool;
+
+yed_job *yed_submit_job(yed_job_fn work, yed_job_fn done, void *arg);
+void     yed_cancel_job(yed_job *job);
+int      yed_job_is_cancelled(yed_job *job);
+
+/*
+ * Main thread only. Returns once the job's done function has run. If no
+ * worker has picked the job up yet, it is run right here instead.
+ */
+void     yed_wait_job(yed_job *job);
+
+/*
+ * Split work into n pieces, run them on the pool (and the calling thread)
+ * and return when all of them are finished. Piece i gets args + i * arg_size
+ * as its arg. The pieces can't be cancelled and may be passed a NULL job.
+ * For core code that wants to fan out a loop.
+ */
+void     yed_run_jobs(yed_job_fn work, void *args, int n, int arg_size);
+
+int      yed_n_job_workers(void);
+
+void     yed_init_jobs(void);
+yed_job *yed_submit_owned_job(void *owner, yed_job_fn work, yed_job_fn done, void *arg);
+void     yed_service_jobs(void);
+void     yed_cancel_jobs_for_owner(void *owner);
+void     yed_stop_jobs(void);
+
+#endif
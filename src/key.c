@@ -1,4 +1,5 @@
-static int ctrl_h_is_bs;
+static int            ctrl_h_is_bs;
+static yed_var_handle ctrl_h_is_bs_var = YED_VAR_HANDLE("ctrl-h-is-backspace");
 
 void yed_init_keys(void) {
     ys->vkey_binding_map     = tree_make(int, yed_key_binding_ptr_t);
@@ -9,13 +10,21 @@ void yed_init_keys(void) {
     yed_set_default_key_bindings();
 }
 
+/*
+ * Read the next byte of a key sequence, giving up if it doesn't arrive
+ * within the terminal read timeout.
+ */
+static int read_key_byte(char *c) {
+    return yed_read_input_byte(c, TERM_DEFAULT_READ_TIMEOUT * 100);
+}
+
 static int esc_timeout(int *input) {
     int  seq_key;
     char c;
 
     /* input[0] is ESC */
 
-    if (read(0, &c, 1) == 0) {
+    if (read_key_byte(&c) == 0) {
         return 1;
     }
     input[1] = c;
@@ -27,7 +36,7 @@ static int esc_timeout(int *input) {
         return 1;
     }
 
-    if (read(0, &c, 1) == 0) {
+    if (read_key_byte(&c) == 0) {
         return 2;
     }
     input[2] = c;
@@ -57,7 +66,7 @@ static int esc_sequence(int *input) {
     if (input[1] == '[') { /* ESC [ sequences. */
         if (input[2] >= '0' && input[2] <= '9') {
             /* Extended escape, read additional byte. */
-            if (read(0, &c, 1) == 0) {
+            if (read_key_byte(&c) == 0) {
                 return 3;
             } else if (input[2] == '1') {
                 input[3] = c;
@@ -65,10 +74,10 @@ static int esc_sequence(int *input) {
                     input[0] = HOME_KEY;
                     return 1;
                 } else if (c == ';') {
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
                     if (c == '3') {
-                        if (read(0, &c, 1) == 0) { return 5; }
+                        if (read_key_byte(&c) == 0) { return 5; }
                         input[5] = c;
                         switch (c) {
                             case 'A':
@@ -88,7 +97,7 @@ static int esc_sequence(int *input) {
                     }
                     return 5;
                 } else if (c == '5') {
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
                     if (c == '~') {
                         input[0] = FN5;
@@ -96,7 +105,7 @@ static int esc_sequence(int *input) {
                     }
                     return 5;
                 } else if (c == '7') {
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
                     if (c == '~') {
                         input[0] = FN6;
@@ -104,7 +113,7 @@ static int esc_sequence(int *input) {
                     }
                     return 5;
                 } else if (c == '8') {
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
                     if (c == '~') {
                         input[0] = FN7;
@@ -112,7 +121,7 @@ static int esc_sequence(int *input) {
                     }
                     return 5;
                 } else if (c == '9') {
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
                     if (c == '~') {
                         input[0] = FN8;
@@ -125,19 +134,19 @@ static int esc_sequence(int *input) {
                 if (c == '0') {
                     input[3] = c;
 
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
 
                     if (c == '~') {
                         input[0] = FN9;
                         return 1;
                     } else if (c == '0') {
-                        if (read(0, &c, 1) == 0) { return 5; }
+                        if (read_key_byte(&c) == 0) { return 5; }
                         input[5] = c;
                         if (c == '~') { input[0] = _BRACKETED_PASTE_BEGIN; return 1; }
                         return 6;
                     } else if (c == '1') {
-                        if (read(0, &c, 1) == 0) { return 5; }
+                        if (read_key_byte(&c) == 0) { return 5; }
                         input[5] = c;
                         if (c == '~') { input[0] = _BRACKETED_PASTE_END; return 1; }
                         return 6;
@@ -145,7 +154,7 @@ static int esc_sequence(int *input) {
                     return 5;
                 } else if (c == '1') {
                     input[3] = c;
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
                     if (c == '~') {
                         input[0] = FN10;
@@ -154,7 +163,7 @@ static int esc_sequence(int *input) {
                     return 5;
                 } else if (c == '3') {
                     input[3] = c;
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
                     if (c == '~') {
                         input[0] = FN11;
@@ -163,7 +172,7 @@ static int esc_sequence(int *input) {
                     return 5;
                 } else if (c == '4') {
                     input[3] = c;
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
                     if (c == '~') {
                         input[0] = FN12;
@@ -185,16 +194,16 @@ static int esc_sequence(int *input) {
                 if (c == '7') {
                     input[3] = c;
 
-                    if (read(0, &c, 1) == 0) { return 4; }
+                    if (read_key_byte(&c) == 0) { return 4; }
                     input[4] = c;
                     if (c == '3') {
-                        if (read(0, &c, 1) == 0) { return 5; }
+                        if (read_key_byte(&c) == 0) { return 5; }
                         input[5] = c;
                         if (c == '6') {
-                            if (read(0, &c, 1) == 0) { return 6; }
+                            if (read_key_byte(&c) == 0) { return 6; }
                             input[6] = c;
                             if (c == '3') {
-                                if (read(0, &c, 1) == 0) { return 7; }
+                                if (read_key_byte(&c) == 0) { return 7; }
                                 input[7] = c;
                                 if (c == 'u') {
                                     input[0] = MENU_KEY;
@@ -225,7 +234,7 @@ static int esc_sequence(int *input) {
                     k = 0;
 
                     memset(buff, 0, sizeof(buff));
-                    for (i = 0; read(0, &c, 1) && c != ';'; i += 1) { buff[i] = c; }
+                    for (i = 0; read_key_byte(&c) && c != ';'; i += 1) { buff[i] = c; }
                     buff[i] = 0;
                     b = s_to_i(buff);
 
@@ -237,12 +246,12 @@ static int esc_sequence(int *input) {
                     }
 
                     memset(buff, 0, sizeof(buff));
-                    for (i = 0; read(0, &c, 1) && c != ';'; i += 1) { buff[i] = c; }
+                    for (i = 0; read_key_byte(&c) && c != ';'; i += 1) { buff[i] = c; }
                     buff[i] = 0;
                     x = s_to_i(buff);
 
                     memset(buff, 0, sizeof(buff));
-                    for (i = 0; read(0, &c, 1) && toupper(c) != 'M'; i += 1) { buff[i] = c; }
+                    for (i = 0; read_key_byte(&c) && toupper(c) != 'M'; i += 1) { buff[i] = c; }
                     buff[i] = 0;
                     y = s_to_i(buff);
 
@@ -272,7 +281,7 @@ static int esc_sequence(int *input) {
     }
 
     if (input[1] == ESC) {
-        if (read(0, &c, 1)) {
+        if (read_key_byte(&c)) {
             input[3] = c;
             if (input[2] == ESC && input[3] == ESC) { return 4; }
             return 1 + esc_sequence(input + 1);
@@ -334,7 +343,7 @@ int yed_read_key_sequences(int len, int *input) {
                 }
             }
         }
-    } while (keep_reading && read(0, &c, 1) && ((new_key = c), len < MAX_SEQ_LEN));
+    } while (keep_reading && read_key_byte(&c) && ((new_key = c), len < MAX_SEQ_LEN));
 
     seq_key = yed_get_key_sequence(len, input);
 
@@ -361,7 +370,7 @@ int yed_read_mbyte_keys(char first_byte, int n_bytes) {
          * the caller that we could not get all of the bytes
          * that we needed.
          */
-        if (read(0, &c, 1) == 0) { return 0; }
+        if (read_key_byte(&c) == 0) { return 0; }
 
         ys->mbyte.bytes[i] = c;
     }
@@ -369,7 +378,7 @@ int yed_read_mbyte_keys(char first_byte, int n_bytes) {
     return 1;
 }
 
-static int _yed_read_keys(int *input) {
+static int _yed_read_keys(int *input, int timeout_ms) {
     int       len;
     int       nread;
     char      c;
@@ -378,23 +387,10 @@ static int _yed_read_keys(int *input) {
 
     len     = 0;
 
-    ctrl_h_is_bs = yed_var_is_truthy("ctrl-h-is-backspace");
-
-/*
- * BLOCKING(ish):
- **********************************************/
-/*    while ((nread = read(0, &c, 1)) == 0); */
-/**********************************************/
+    ctrl_h_is_bs = yed_var_handle_is_truthy(&ctrl_h_is_bs_var);
 
-/*
- * NON-BLOCKING:
- **********************************************/
-    nread = read(0, &c, 1);
+    nread = yed_read_input_byte(&c, timeout_ms);
     if (nread == 0)     { return 0; }
-/**********************************************/
-
-
-    if (nread == -1)    { return 0; }
 
     n_bytes = nread;
 
@@ -440,13 +436,14 @@ int yed_read_keys(int *input) {
     int  key;
     char key_ch;
 
-    n = _yed_read_keys(input);
+    /* The main loop has already waited for input, so don't block here. */
+    n = _yed_read_keys(input, 0);
 
     if (n == 1 && input[0] == _BRACKETED_PASTE_BEGIN) {
         ys->doing_bracketed_paste = 1;
         array_clear(ys->bracketed_paste_buff);
 
-        while ((p = _yed_read_keys(paste_keys)) && paste_keys[0] != _BRACKETED_PASTE_END) {
+        while ((p = _yed_read_keys(paste_keys, TERM_DEFAULT_READ_TIMEOUT * 100)) && paste_keys[0] != _BRACKETED_PASTE_END) {
             for (i = 0; i < p; i += 1) {
                 key = paste_keys[i];
 
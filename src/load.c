@@ -0,0 +1,679 @@
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Parallel file loading.
+ *
+ * The file is split into chunks that each begin at the start of a line.
+ * The load runs in two passes over the chunks, each on one thread per chunk:
+ *
+ *     1. Count the newlines in the chunk.
+ *     2. Copy the chunk into the buffer's underlying memory and fill in
+ *        the yed_line structs for the lines in the chunk.
+ *
+ * After the first pass, we know exactly how many lines there are and
+ * which line each chunk starts with, so all of the lines are allocated in
+ * the bucket array at once and the workers write straight into their
+ * own part of it.
+ */
+
+#define LOAD_MIN_CHUNK_SIZE (MiB(1))
+#define LOAD_MAX_WORKERS    (16)
+
+typedef struct {
+    const char     *src;
+    char           *dst;
+    u64             len;
+    u64             n_lines;
+    u64             first_line;
+    bucket_array_t *lines;
+} yed_load_chunk;
+
+static u64 yed_load_count_newlines(const char *bytes, u64 len) {
+    u64 i, count;
+
+    i     = 0;
+    count = 0;
+
+#if defined(__AVX2__)
+    {
+        __m256i nl, v;
+
+        nl = _mm256_set1_epi8('\n');
+        for (; i + 32 <= len; i += 32) {
+            v      = _mm256_loadu_si256((const __m256i*)(const void*)(bytes + i));
+            count += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+        }
+    }
+#elif defined(__SSE2__)
+    {
+        __m128i nl, v;
+
+        nl = _mm_set1_epi8('\n');
+        for (; i + 16 <= len; i += 16) {
+            v      = _mm_loadu_si128((const __m128i*)(const void*)(bytes + i));
+            count += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+        }
+    }
+#endif
+
+    for (; i < len; i += 1) {
+        count += bytes[i] == '\n';
+    }
+
+    return count;
+}
+
+/*
+ * Returns the number of tabs in the line if every byte is either
+ * printable ASCII or a tab. Otherwise, returns -1.
+ */
+static int yed_load_printable_ascii_tabs(const char *bytes, int len) {
+    int  i, tabs;
+    char c;
+
+    i    = 0;
+    tabs = 0;
+
+#if defined(__AVX2__)
+    {
+        __m256i lo, hi, tab, v, t;
+        unsigned ok;
+
+        lo  = _mm256_set1_epi8(0x1f);
+        hi  = _mm256_set1_epi8(0x7f);
+        tab = _mm256_set1_epi8('\t');
+        for (; i + 32 <= len; i += 32) {
+            v  = _mm256_loadu_si256((const __m256i*)(const void*)(bytes + i));
+            t  = _mm256_cmpeq_epi8(v, tab);
+            /* Signed compares, so bytes >= 0x80 fail the first test. */
+            ok = _mm256_movemask_epi8(_mm256_or_si256(t,
+                    _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v))));
+            if (ok != 0xFFFFFFFF) { return -1; }
+            tabs += __builtin_popcount((unsigned)_mm256_movemask_epi8(t));
+        }
+    }
+#elif defined(__SSE2__)
+    {
+        __m128i lo, hi, tab, v, t;
+        unsigned ok;
+
+        lo  = _mm_set1_epi8(0x1f);
+        hi  = _mm_set1_epi8(0x7f);
+        tab = _mm_set1_epi8('\t');
+        for (; i + 16 <= len; i += 16) {
+            v  = _mm_loadu_si128((const __m128i*)(const void*)(bytes + i));
+            t  = _mm_cmpeq_epi8(v, tab);
+            ok = _mm_movemask_epi8(_mm_or_si128(t,
+                    _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmpgt_epi8(hi, v))));
+            if (ok != 0xFFFF) { return -1; }
+            tabs += __builtin_popcount((unsigned)_mm_movemask_epi8(t));
+        }
+    }
+#endif
+
+    for (; i < len; i += 1) {
+        c = bytes[i];
+        if (c == '\t') {
+            tabs += 1;
+        } else if (c < 0x20 || c > 0x7e) {
+            return -1;
+        }
+    }
+
+    return tabs;
+}
+
+static void yed_load_line_info(char *bytes, int len, int *n_glyphs, int *width) {
+    int tabs;
+
+    tabs = yed_load_printable_ascii_tabs(bytes, len);
+
+    if (likely(tabs >= 0)) {
+        *n_glyphs = len;
+        *width    = len + (tabs * (ys->tabw - 1));
+    } else {
+        yed_get_string_info(bytes, len, n_glyphs, width);
+    }
+}
+
+static void yed_load_count_chunk(yed_job *job, void *arg) {
+    yed_load_chunk *chunk;
+
+    chunk          = arg;
+    chunk->n_lines = yed_load_count_newlines(chunk->src, chunk->len);
+
+    /* The last chunk may end in a line that has no newline. */
+    if (chunk->len && chunk->src[chunk->len - 1] != '\n') {
+        chunk->n_lines += 1;
+    }
+}
+
+static void yed_load_fill_chunk(yed_job *job, void *arg) {
+    yed_load_chunk *chunk;
+    char           *scan,
+                   *end,
+                   *nl;
+    int             line_len;
+    yed_line       *line;
+    u64             n;
+
+    chunk = arg;
+
+    memcpy(chunk->dst, chunk->src, chunk->len);
+
+    scan = chunk->dst;
+    end  = chunk->dst + chunk->len;
+    n    = 0;
+
+    bucket_array_traverse_from(*chunk->lines, line, chunk->first_line) {
+        if (n == chunk->n_lines) { break; }
+
+        nl       = memchr(scan, '\n', end - scan);
+        line_len = (nl ? nl : end) - scan;
+
+        /* Remove '\r' from line. */
+        while (line_len && scan[line_len - 1] == '\r') {
+            line_len -= 1;
+        }
+
+        memset(line, 0, sizeof(*line));
+        line->chars             = array_make_with_cap(char, line_len);
+        line->chars.should_free = 0;
+        line->chars.data        = scan;
+        line->chars.used        = line_len;
+
+        yed_load_line_info(scan, line_len, &line->n_glyphs, &line->visual_width);
+
+        n    += 1;
+        scan  = nl ? nl + 1 : end;
+    }
+}
+
+static int yed_load_n_workers(u64 file_size) {
+    u64 n;
+
+    n = file_size / LOAD_MIN_CHUNK_SIZE;
+
+    n = MIN(n, (u64)yed_n_job_workers());
+    n = MIN(n, (u64)LOAD_MAX_WORKERS);
+    n = MAX(n, 1ULL);
+
+    return n;
+}
+
+int yed_fill_buff_from_file_parallel(yed_buffer *buff, int fd, unsigned long long file_size) {
+    char           *file_data,
+                   *underlying_buff,
+                   *nl;
+    yed_load_chunk  chunks[LOAD_MAX_WORKERS];
+    int             n_workers,
+                    n_chunks,
+                    i;
+    u64             target,
+                    start,
+                    stop,
+                    n_lines;
+    yed_line       *last_line,
+                    line;
+
+    yed_buff_clear_no_undo(buff);
+
+    if (file_size == 0) {
+        return BUFF_FILL_STATUS_SUCCESS;
+    }
+
+    file_data = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (file_data == MAP_FAILED) {
+        errno = 0;
+        return BUFF_FILL_STATUS_ERR_MAP;
+    }
+
+    /*
+     * Add 3 bytes of padding so that we don't violate anything
+     * when we call yed_get_string_info().
+     * See the comment there (src/utf8.c) for more info.
+     */
+    underlying_buff = malloc(file_size + 3);
+
+    /*
+     * Split the file into chunks that each start at the beginning
+     * of a line.
+     */
+    n_workers = yed_load_n_workers(file_size);
+    n_chunks  = 0;
+    start     = 0;
+
+    for (i = 0; i < n_workers && start < file_size; i += 1) {
+        if (i == n_workers - 1) {
+            stop = file_size;
+        } else {
+            target = MAX(start, (file_size * (i + 1)) / n_workers);
+            nl     = memchr(file_data + target, '\n', file_size - target);
+            stop   = nl ? (u64)(nl - file_data) + 1 : file_size;
+        }
+
+        chunks[n_chunks].src   = file_data + start;
+        chunks[n_chunks].dst   = underlying_buff + start;
+        chunks[n_chunks].len   = stop - start;
+        chunks[n_chunks].lines = &buff->lines;
+        n_chunks              += 1;
+
+        start = stop;
+    }
+
+    yed_run_jobs(yed_load_count_chunk, chunks, n_chunks, sizeof(*chunks));
+
+    n_lines = 0;
+    for (i = 0; i < n_chunks; i += 1) {
+        chunks[i].first_line  = n_lines;
+        n_lines              += chunks[i].n_lines;
+    }
+
+    /*
+     * This buffer is going to come to us with a pre-made
+     * empty line.
+     * We don't need it though.
+     */
+    last_line = bucket_array_last(buff->lines);
+    yed_free_line(last_line);
+    bucket_array_pop(buff->lines);
+
+    bucket_array_extend(buff->lines, n_lines);
+
+    yed_run_jobs(yed_load_fill_chunk, chunks, n_chunks, sizeof(*chunks));
+
+    munmap(file_data, file_size);
+    buff->mmap_underlying_buff = underlying_buff;
+
+    buff->get_line_cache     = NULL;
+    buff->get_line_cache_row = 0;
+
+    if (bucket_array_len(buff->lines) > 1) {
+        last_line = bucket_array_last(buff->lines);
+        if (array_len(last_line->chars) == 0) {
+            bucket_array_pop(buff->lines);
+        }
+    } else if (bucket_array_len(buff->lines) == 0) {
+        line = yed_new_line();
+        bucket_array_push(buff->lines, line);
+    }
+
+    yed_buff_reset_journal(buff);
+
+    return BUFF_FILL_STATUS_SUCCESS;
+}
+
+
+/*
+ * Lazy file loading.
+ *
+ * The file is mapped privately (so that edits to a line never reach the
+ * file) and never copied. Lines point straight into the mapping and only
+ * get their own memory once they're edited, so the memory used by the
+ * file's contents is proportional to what has actually been viewed or
+ * changed.
+ *
+ * Enough of the file to fill the first screen is indexed right away.
+ * The rest is indexed by a background thread in batches of lines, which
+ * the main thread appends to the buffer in yed_service_lazy_loads()
+ * once per pump. The buffer is read-only until the whole file has been
+ * indexed.
+ */
+
+#define LAZY_LOAD_INITIAL_BYTES (KiB(256))
+#define LAZY_LOAD_BATCH_BYTES   (MiB(8))
+
+/* Index the lines in (roughly) the next max_bytes bytes of the file. */
+static array_t yed_lazy_load_scan(yed_lazy_load *lazy, u64 max_bytes) {
+    array_t   lines;
+    char     *scan,
+             *end,
+             *stop,
+             *nl;
+    int       line_len;
+    yed_line  line;
+
+    lines = array_make(yed_line);
+
+    scan = lazy->map + lazy->scanned;
+    end  = lazy->map + lazy->file_size;
+    stop = (u64)(end - scan) > max_bytes ? scan + max_bytes : end;
+
+    while (scan < stop) {
+        nl       = memchr(scan, '\n', end - scan);
+        line_len = (nl ? nl : end) - scan;
+
+        /* Remove '\r' from line. */
+        while (line_len && scan[line_len - 1] == '\r') {
+            line_len -= 1;
+        }
+
+        memset(&line, 0, sizeof(line));
+        line.chars             = array_make_with_cap(char, line_len);
+        line.chars.should_free = 0;
+        line.chars.data        = scan;
+        line.chars.used        = line_len;
+
+        yed_load_line_info(scan, line_len, &line.n_glyphs, &line.visual_width);
+
+        array_push(lines, line);
+
+        scan = nl ? nl + 1 : end;
+    }
+
+    lazy->scanned = scan - lazy->map;
+
+    return lines;
+}
+
+static void * yed_lazy_load_thread(void *arg) {
+    yed_lazy_load *lazy;
+    array_t        batch;
+
+    lazy = arg;
+
+    while (lazy->scanned < lazy->file_size) {
+        if (__atomic_load_n(&lazy->cancel, __ATOMIC_ACQUIRE)) { break; }
+
+        batch = yed_lazy_load_scan(lazy, LAZY_LOAD_BATCH_BYTES);
+
+        pthread_mutex_lock(&lazy->mtx);
+        array_push(lazy->batches, batch);
+        pthread_mutex_unlock(&lazy->mtx);
+
+        yed_wake();
+    }
+
+    __atomic_store_n(&lazy->thread_done, 1, __ATOMIC_RELEASE);
+
+    yed_wake();
+
+    return NULL;
+}
+
+static void yed_lazy_load_append(yed_buffer *buff, array_t *lines) {
+    int n_lines;
+
+    if (array_len(*lines)) {
+        n_lines = bucket_array_len(buff->lines);
+
+        bucket_array_push_n(buff->lines, array_data(*lines), array_len(*lines));
+
+        buff->get_line_cache     = NULL;
+        buff->get_line_cache_row = 0;
+
+        yed_buff_record_change(buff, BUFF_MOD_ADD_LINE, n_lines + 1, 0, array_len(*lines));
+    }
+
+    array_free(*lines);
+}
+
+static void yed_lazy_load_done(yed_buffer *buff) {
+    yed_lazy_load *lazy;
+    yed_line      *last_line;
+    yed_line       line;
+
+    lazy = buff->lazy_load;
+
+    if (lazy->has_thread) {
+        pthread_join(lazy->thread, NULL);
+        lazy->has_thread = 0;
+    }
+
+    lazy->loading = 0;
+
+    if (!lazy->was_rd_only) {
+        buff->flags &= ~BUFF_RD_ONLY;
+    }
+
+    if (bucket_array_len(buff->lines) > 1) {
+        last_line = bucket_array_last(buff->lines);
+        if (array_len(last_line->chars) == 0) {
+            bucket_array_pop(buff->lines);
+            yed_buff_record_change(buff, BUFF_MOD_DELETE_LINE, bucket_array_len(buff->lines) + 1, 1, 0);
+        }
+    } else if (bucket_array_len(buff->lines) == 0) {
+        line = yed_new_line();
+        bucket_array_push(buff->lines, line);
+        yed_buff_record_change(buff, BUFF_MOD_ADD_LINE, 1, 0, 1);
+    }
+
+    buff->get_line_cache     = NULL;
+    buff->get_line_cache_row = 0;
+
+    yed_buff_words_loaded(buff);
+
+    LOG_FN_ENTER();
+    yed_log("finished loading %d lines into '%s' in %llums",
+            yed_buff_n_lines(buff),
+            buff->name,
+            (measure_time_now_us() - lazy->start_us) / 1000ULL);
+    LOG_EXIT();
+}
+
+static void yed_lazy_load_drain(yed_buffer *buff) {
+    yed_lazy_load *lazy;
+    array_t        batches;
+    array_t       *batch;
+    int            thread_done;
+
+    lazy = buff->lazy_load;
+
+    /* Check this before taking the batches so that we can't miss the last one. */
+    thread_done = __atomic_load_n(&lazy->thread_done, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&lazy->mtx);
+    batches       = lazy->batches;
+    lazy->batches = array_make(array_t);
+    pthread_mutex_unlock(&lazy->mtx);
+
+    array_traverse(batches, batch) {
+        yed_lazy_load_append(buff, batch);
+    }
+    array_free(batches);
+
+    if (thread_done) {
+        yed_lazy_load_done(buff);
+    }
+}
+
+int yed_buff_is_loading(yed_buffer *buff) {
+    return buff->lazy_load != NULL && buff->lazy_load->loading;
+}
+
+void yed_buff_finish_loading(yed_buffer *buff) {
+    while (yed_buff_is_loading(buff)) {
+        if (!__atomic_load_n(&buff->lazy_load->thread_done, __ATOMIC_ACQUIRE)) {
+            usleep(1000);
+        }
+        yed_lazy_load_drain(buff);
+    }
+}
+
+void yed_service_lazy_loads(void) {
+    tree_it(yed_buffer_name_t, yed_buffer_ptr_t)  it;
+    yed_buffer                                   *buff;
+
+    tree_traverse(ys->buffers, it) {
+        buff = tree_it_val(it);
+        if (yed_buff_is_loading(buff)) {
+            yed_lazy_load_drain(buff);
+        }
+    }
+}
+
+/*
+ * Stop any background work and detach the lazy load state from the buffer.
+ * The mapping stays alive until yed_free_lazy_load() is called, since the
+ * buffer's lines may still point into it.
+ */
+yed_lazy_load * yed_buff_detach_lazy_load(yed_buffer *buff) {
+    yed_lazy_load *lazy;
+    array_t       *batch;
+
+    lazy = buff->lazy_load;
+
+    if (lazy == NULL) { return NULL; }
+
+    if (lazy->loading) {
+        __atomic_store_n(&lazy->cancel, 1, __ATOMIC_RELEASE);
+        if (lazy->has_thread) {
+            pthread_join(lazy->thread, NULL);
+            lazy->has_thread = 0;
+        }
+        lazy->loading = 0;
+
+        array_traverse(lazy->batches, batch) {
+            array_free(*batch);
+        }
+        array_clear(lazy->batches);
+
+        if (!lazy->was_rd_only) {
+            buff->flags &= ~BUFF_RD_ONLY;
+        }
+    }
+
+    buff->lazy_load = NULL;
+
+    return lazy;
+}
+
+void yed_free_lazy_load(yed_lazy_load *lazy) {
+    if (lazy == NULL) { return; }
+
+    munmap(lazy->map, lazy->map_len);
+    array_free(lazy->batches);
+    pthread_mutex_destroy(&lazy->mtx);
+    free(lazy);
+}
+
+/*
+ * Give every line that still points into the mapping its own copy of the
+ * file's bytes and drop the mapping.
+ * This has to happen before the file is overwritten, since truncating a
+ * mapped file out from under us would crash us the next time we touched
+ * one of its lines.
+ */
+void yed_buff_unmap_file(yed_buffer *buff) {
+    yed_lazy_load *lazy;
+    char          *underlying_buff;
+    yed_line      *line;
+    char          *data;
+
+    yed_buff_finish_loading(buff);
+
+    lazy = yed_buff_detach_lazy_load(buff);
+
+    if (lazy == NULL) { return; }
+
+    underlying_buff = malloc(lazy->file_size + 3);
+    memcpy(underlying_buff, lazy->map, lazy->file_size);
+
+    bucket_array_traverse(buff->lines, line) {
+        data = array_data(line->chars);
+        if (data >= lazy->map && data < lazy->map + lazy->map_len) {
+            line->chars.data = underlying_buff + (data - lazy->map);
+        }
+    }
+
+    if (buff->mmap_underlying_buff != NULL) {
+        free(buff->mmap_underlying_buff);
+    }
+    buff->mmap_underlying_buff = underlying_buff;
+
+    yed_free_lazy_load(lazy);
+}
+
+int yed_buff_maps_file(yed_buffer *buff, const char *path) {
+    struct stat fs;
+
+    if (buff->lazy_load == NULL) { return 0; }
+    if (stat(path, &fs) != 0)    { return 0; }
+
+    return fs.st_dev == buff->lazy_load->dev
+        && fs.st_ino == buff->lazy_load->ino;
+}
+
+int yed_fill_buff_from_file_lazy(yed_buffer *buff, int fd, struct stat *fs) {
+    yed_lazy_load *lazy;
+    char          *map;
+    u64            file_size,
+                   map_len;
+    long           page_size;
+    yed_line      *last_line;
+    array_t        first_lines;
+
+    yed_buff_clear_no_undo(buff);
+
+    file_size = fs->st_size;
+
+    if (file_size == 0) {
+        return BUFF_FILL_STATUS_SUCCESS;
+    }
+
+    /*
+     * Reserve at least a page past the end of the file so that the
+     * 3 bytes of padding yed_get_string_info() needs are always mapped.
+     * See the comment there (src/utf8.c) for more info.
+     */
+    page_size = sysconf(_SC_PAGESIZE);
+    map_len   = ((file_size / page_size) + 1) * page_size;
+
+    map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        errno = 0;
+        return BUFF_FILL_STATUS_ERR_MAP;
+    }
+
+    if (mmap(map, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(map, map_len);
+        errno = 0;
+        return BUFF_FILL_STATUS_ERR_MAP;
+    }
+
+    lazy = malloc(sizeof(*lazy));
+    memset(lazy, 0, sizeof(*lazy));
+
+    lazy->map         = map;
+    lazy->map_len     = map_len;
+    lazy->file_size   = file_size;
+    lazy->dev         = fs->st_dev;
+    lazy->ino         = fs->st_ino;
+    lazy->batches     = array_make(array_t);
+    lazy->start_us    = measure_time_now_us();
+    lazy->loading     = 1;
+    lazy->was_rd_only = !!(buff->flags & BUFF_RD_ONLY);
+
+    pthread_mutex_init(&lazy->mtx, NULL);
+
+    buff->lazy_load = lazy;
+
+    /*
+     * This buffer is going to come to us with a pre-made
+     * empty line.
+     * We don't need it though.
+     */
+    last_line = bucket_array_last(buff->lines);
+    yed_free_line(last_line);
+    bucket_array_pop(buff->lines);
+
+    /* Get enough lines for the first screen before anything is drawn. */
+    first_lines = yed_lazy_load_scan(lazy, LAZY_LOAD_INITIAL_BYTES);
+    yed_lazy_load_append(buff, &first_lines);
+
+    buff->flags |= BUFF_RD_ONLY;
+
+    if (pthread_create(&lazy->thread, NULL, yed_lazy_load_thread, lazy) == 0) {
+        lazy->has_thread = 1;
+    } else {
+        /* Scan the rest here. The next pump appends the batches. */
+        yed_lazy_load_thread(lazy);
+    }
+
+    yed_buff_reset_journal(buff);
+
+    return BUFF_FILL_STATUS_SUCCESS;
+}
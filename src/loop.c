@@ -0,0 +1,282 @@
+#include "loop.h"
+
+static unsigned long long yed_loop_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return 1000ULL * ts.tv_sec + (ts.tv_nsec / 1000000ULL);
+}
+
+void yed_init_loop(void) {
+    int i;
+
+    if (pipe(ys->wake_fds) == -1) {
+        ASSERT(0, "pipe failed for the wake fds");
+    }
+
+    for (i = 0; i < 2; i += 1) {
+        fcntl(ys->wake_fds[i], F_SETFL, fcntl(ys->wake_fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(ys->wake_fds[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    ys->timers       = array_make(yed_timer);
+    ys->loop_fds     = array_make(yed_loop_fd);
+    ys->last_wake_ms = yed_loop_now_ms();
+}
+
+void yed_wake(void) {
+    char c;
+    int  save_errno;
+
+    save_errno = errno;
+    c          = 0;
+
+    /* If the pipe is full, there's already a wake pending. */
+    if (write(ys->wake_fds[1], &c, 1) == -1) {}
+
+    errno = save_errno;
+}
+
+static void yed_drain_wake_fd(void) {
+    char buff[64];
+
+    while (read(ys->wake_fds[0], buff, sizeof(buff)) > 0) {}
+}
+
+int yed_add_timer(unsigned long long ms, int repeat, yed_timer_fn fn, void *arg) {
+    yed_timer timer;
+
+    ys->timer_id_counter += 1;
+
+    timer.id        = ys->timer_id_counter;
+    timer.due_ms    = yed_loop_now_ms() + ms;
+    timer.period_ms = repeat ? MAX(ms, 1) : 0;
+    timer.fn        = fn;
+    timer.arg       = arg;
+
+    array_push(ys->timers, timer);
+
+    return timer.id;
+}
+
+void yed_remove_timer(int id) {
+    yed_timer *timer;
+    int        i;
+
+    i = 0;
+    array_traverse(ys->timers, timer) {
+        if (timer->id == id) {
+            array_delete(ys->timers, i);
+            return;
+        }
+        i += 1;
+    }
+}
+
+static yed_loop_fd * yed_find_loop_fd(int fd) {
+    yed_loop_fd *lfd;
+
+    array_traverse(ys->loop_fds, lfd) {
+        if (lfd->fd == fd) { return lfd; }
+    }
+
+    return NULL;
+}
+
+void yed_add_fd(int fd, int events, yed_fd_handler_fn fn, void *arg) {
+    yed_loop_fd  new_lfd;
+    yed_loop_fd *lfd;
+
+    if ((lfd = yed_find_loop_fd(fd)) == NULL) {
+        new_lfd.fd = fd;
+        lfd        = array_push(ys->loop_fds, new_lfd);
+    }
+
+    lfd->events  = events;
+    lfd->hung_up = 0;
+    lfd->fn      = fn;
+    lfd->arg     = arg;
+}
+
+void yed_remove_fd(int fd) {
+    yed_loop_fd *it;
+    int          i;
+
+    i = 0;
+    array_traverse(ys->loop_fds, it) {
+        if (it->fd == fd) {
+            array_delete(ys->loop_fds, i);
+            return;
+        }
+        i += 1;
+    }
+}
+
+static int yed_input_is_buffered(void) {
+    return ys->input_pos < ys->input_len;
+}
+
+int yed_read_input_byte(char *c, int timeout_ms) {
+    struct pollfd pfd;
+    int           n;
+
+    if (!yed_input_is_buffered()) {
+        pfd.fd     = 0;
+        pfd.events = POLLIN;
+
+        if (timeout_ms > 0 && poll(&pfd, 1, timeout_ms) <= 0) {
+            return 0;
+        }
+
+        n = read(0, ys->input_buff, sizeof(ys->input_buff));
+        if (n <= 0) {
+            return 0;
+        }
+
+        ys->input_len = n;
+        ys->input_pos = 0;
+    }
+
+    *c             = ys->input_buff[ys->input_pos];
+    ys->input_pos += 1;
+
+    return 1;
+}
+
+static void yed_run_timers(void) {
+    unsigned long long  now;
+    array_t             due;
+    yed_timer          *timer;
+    int                 i;
+
+    if (array_len(ys->timers) == 0) { return; }
+
+    now = yed_loop_now_ms();
+    due = array_make(yed_timer);
+
+    /*
+     * Collect everything that is due before calling anything, since the
+     * callbacks may add or remove timers.
+     */
+    for (i = 0; i < array_len(ys->timers);) {
+        timer = array_item(ys->timers, i);
+
+        if (timer->due_ms > now) {
+            i += 1;
+            continue;
+        }
+
+        array_push(due, *timer);
+
+        if (timer->period_ms) {
+            timer->due_ms += timer->period_ms;
+            /* Don't try to catch up on ticks that we slept through. */
+            if (timer->due_ms <= now) {
+                timer->due_ms = now + timer->period_ms;
+            }
+            i += 1;
+        } else {
+            array_delete(ys->timers, i);
+        }
+    }
+
+    array_traverse(due, timer) {
+        if (timer->fn != NULL) {
+            timer->fn(timer->id, timer->arg);
+        }
+    }
+
+    array_free(due);
+}
+
+static void yed_run_fd_handlers(struct pollfd *pfds, int n) {
+    yed_loop_fd *lfd;
+    int          i;
+
+    for (i = 0; i < n; i += 1) {
+        if (pfds[i].revents == 0) { continue; }
+
+        /* Look it up again since an earlier handler may have removed it. */
+        if ((lfd = yed_find_loop_fd(pfds[i].fd)) == NULL) { continue; }
+
+        if (lfd->fn != NULL) {
+            lfd->fn(lfd->fd, pfds[i].revents, lfd->arg);
+        } else if (pfds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            lfd->hung_up = 1;
+        }
+    }
+}
+
+static int yed_loop_timeout_ms(void) {
+    unsigned long long  now;
+    unsigned long long  due;
+    unsigned long long  period;
+    yed_timer          *timer;
+    int                 have_due;
+
+    if (yed_input_is_buffered()) { return 0; }
+
+    now      = yed_loop_now_ms();
+    have_due = 0;
+    due      = 0;
+
+    if (ys->update_hz >= MIN_UPDATE_HZ) {
+        period   = 1000 / MIN(ys->update_hz, MAX_UPDATE_HZ);
+        due      = ys->last_wake_ms + period;
+        have_due = 1;
+    }
+
+    array_traverse(ys->timers, timer) {
+        if (!have_due || timer->due_ms < due) {
+            due      = timer->due_ms;
+            have_due = 1;
+        }
+    }
+
+    if (!have_due)  { return -1; }
+    if (due <= now) { return 0;  }
+
+    return MIN(due - now, INT_MAX);
+}
+
+void yed_loop_wait(void) {
+    array_t        pfds;
+    struct pollfd  pfd;
+    yed_loop_fd   *lfd;
+    int            n_ready;
+
+    pfds = array_make(struct pollfd);
+
+    pfd.fd      = 0;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    array_push(pfds, pfd);
+
+    pfd.fd = ys->wake_fds[0];
+    array_push(pfds, pfd);
+
+    array_traverse(ys->loop_fds, lfd) {
+        if (lfd->hung_up) { continue; }
+
+        pfd.fd     = lfd->fd;
+        pfd.events = lfd->events;
+        array_push(pfds, pfd);
+    }
+
+    n_ready = poll(array_data(pfds), array_len(pfds), yed_loop_timeout_ms());
+
+    ys->last_wake_ms = yed_loop_now_ms();
+
+    if (n_ready > 0) {
+        if (((struct pollfd*)array_item(pfds, 1))->revents) {
+            yed_drain_wake_fd();
+        }
+
+        yed_run_fd_handlers(array_item(pfds, 2), array_len(pfds) - 2);
+    }
+
+    yed_run_timers();
+
+    array_free(pfds);
+}
@@ -0,0 +1,68 @@
+#ifndef __LOOP_H__
+#define __LOOP_H__
+
+/*
+ * The main loop.
+ *
+ * Each pump sleeps in poll() until there is something to do: input on
+ * stdin, a registered file descriptor becoming ready, a timer coming due,
+ * a signal (SIGWINCH, SIGCHLD), or an explicit yed_wake() from another
+ * thread. When none of those happen, yed doesn't wake up at all.
+ *
+ * Plugins that need to do something periodically should add a timer (or
+ * raise the update rate with yed_set_update_hz()). Plugins with background
+ * threads should call yed_wake() when they have results for the main
+ * thread, and work done in EVENT_PRE_PUMP will be drawn right away.
+ *
+ * Timer callbacks and fd handlers run on the main thread at the start of a
+ * pump, before keys are handled. A NULL callback is allowed: the timer or
+ * fd then just causes a pump. An fd without a handler is ignored after it
+ * hangs up until it is removed.
+ */
+
+#define YED_INPUT_BUFF_SIZE (4096)
+
+typedef void (*yed_timer_fn)(int id, void *arg);
+typedef void (*yed_fd_handler_fn)(int fd, int revents, void *arg);
+
+typedef struct {
+    int                 id;
+    unsigned long long  due_ms;
+    unsigned long long  period_ms;
+    yed_timer_fn        fn;
+    void               *arg;
+} yed_timer;
+
+typedef struct {
+    int                fd;
+    short              events;
+    int                hung_up;
+    yed_fd_handler_fn  fn;
+    void              *arg;
+} yed_loop_fd;
+
+void yed_init_loop(void);
+void yed_loop_wait(void);
+
+/*
+ * Get the next byte of terminal input, waiting at most timeout_ms for
+ * one to arrive. Input is read from the terminal in large chunks.
+ * Returns 1 if a byte was read and 0 on timeout.
+ */
+int yed_read_input_byte(char *c, int timeout_ms);
+
+/* Safe to call from any thread or from a signal handler. */
+void yed_wake(void);
+
+/*
+ * Returns a timer id (> 0). If repeat is non-zero, the timer fires every
+ * ms milliseconds until it is removed. Otherwise it fires once.
+ */
+int yed_add_timer(unsigned long long ms, int repeat, yed_timer_fn fn, void *arg);
+void yed_remove_timer(int id);
+
+/* events is a mask of poll() events (POLLIN, POLLOUT, ...). */
+void yed_add_fd(int fd, int events, yed_fd_handler_fn fn, void *arg);
+void yed_remove_fd(int fd);
+
+#endif
@@ -373,6 +373,8 @@ int yed_load_plugin(char *plug_name) {
     plug->added_styles         = array_make(char*);
     plug->added_fts            = array_make(char*);
     plug->added_compls         = array_make(char*);
+    plug->added_timers         = array_make(int);
+    plug->added_fds            = array_make(yed_loop_fd);
 
     plug->boot = dlsym(plug->handle, "yed_plugin_boot");
     if (!plug->boot) {
@@ -425,6 +427,16 @@ void yed_plugin_uninstall_features(yed_plugin *plug) {
     tree_it(yed_completion_name_t,
             yed_completion)          compl_it;
     char                           **compl_name_it;
+    int                             *timer_it;
+    yed_loop_fd                     *fd_it;
+    yed_loop_fd                     *lfd;
+
+    /*
+     * Jobs run plugin code on the workers and call back into it when they
+     * finish, so they have to be done before anything else goes away.
+     */
+    yed_cancel_jobs_for_owner(plug);
+    yed_kill_subprocs_for_owner(plug);
 
     array_traverse(plug->added_cmds, cmd_name_it) {
         yed_unset_command(*cmd_name_it);
@@ -478,6 +490,20 @@ void yed_plugin_uninstall_features(yed_plugin *plug) {
     }
     FREE_AND_ZERO_PLUGIN_STRING_ARRAY(plug->added_compls);
 
+    array_traverse(plug->added_timers, timer_it) {
+        yed_remove_timer(*timer_it);
+    }
+    FREE_AND_ZERO_PLUGIN_ARRAY(plug->added_timers);
+
+    array_traverse(plug->added_fds, fd_it) {
+        /* Only if it's still ours -- the fd may have been reused since. */
+        lfd = yed_find_loop_fd(fd_it->fd);
+        if (lfd != NULL && lfd->fn == fd_it->fn && lfd->arg == fd_it->arg) {
+            yed_remove_fd(fd_it->fd);
+        }
+    }
+    FREE_AND_ZERO_PLUGIN_ARRAY(plug->added_fds);
+
     if (plug->requested_mouse_reporting) {
         if (ys->mouse_reporting_ref_count == 1) {
             yed_term_disable_mouse_reporting();
@@ -512,6 +538,9 @@ int yed_unload_plugin(char *plug_name) {
     tree_delete(ys->plugins, old_key);
 
     if (old_plug) {
+        yed_cancel_jobs_for_owner(old_plug);
+        yed_kill_subprocs_for_owner(old_plug);
+
         if (old_plug->unload) {
             old_plug->unload(old_plug);
         }
@@ -667,6 +696,35 @@ void yed_plugin_add_event_handler(yed_plugin *plug, yed_event_handler handler) {
     yed_add_event_handler(handler);
 }
 
+int yed_plugin_add_timer(yed_plugin *plug, unsigned long long ms, int repeat, yed_timer_fn fn, void *arg) {
+    int id;
+
+    id = yed_add_timer(ms, repeat, fn, arg);
+    array_push(plug->added_timers, id);
+
+    return id;
+}
+
+void yed_plugin_add_fd(yed_plugin *plug, int fd, int events, yed_fd_handler_fn fn, void *arg) {
+    yed_loop_fd lfd;
+
+    yed_add_fd(fd, events, fn, arg);
+
+    memset(&lfd, 0, sizeof(lfd));
+    lfd.fd  = fd;
+    lfd.fn  = fn;
+    lfd.arg = arg;
+    array_push(plug->added_fds, lfd);
+}
+
+yed_job *yed_plugin_submit_job(yed_plugin *plug, yed_job_fn work, yed_job_fn done, void *arg) {
+    return yed_submit_owned_job(plug, work, done, arg);
+}
+
+yed_subproc *yed_plugin_start_subproc(yed_plugin *plug, char *cmd, yed_subproc_opts *opts) {
+    return yed_start_owned_subproc(plug, cmd, opts);
+}
+
 void yed_plugin_set_style(yed_plugin *plug, char *name, yed_style *style) {
     char *name_dup;
 
@@ -17,6 +17,8 @@ typedef int (*yed_plugin_boot_t)(struct yed_plugin_t*);
 typedef void (*yed_plugin_unload_fn_t)(struct yed_plugin_t*);
 
 struct yed_style_t;
+struct yed_subproc_t;
+struct yed_subproc_opts_t;
 
 typedef struct yed_plugin_t {
     yed_plugin_handle_t    handle;
@@ -31,6 +33,8 @@ typedef struct yed_plugin_t {
     array_t                added_styles;
     array_t                added_fts;
     array_t                added_compls;
+    array_t                added_timers;
+    array_t                added_fds;
     int                    requested_mouse_reporting;
 } yed_plugin;
 
@@ -55,6 +59,10 @@ void yed_plugin_set_style(yed_plugin *plug, char *name, struct yed_style_t *styl
 int yed_plugin_make_ft(yed_plugin *plug, const char *ft_name);
 void yed_plugin_set_completion(yed_plugin *plug, char *name, yed_completion comp);
 void yed_plugin_set_unload_fn(yed_plugin *plug, yed_plugin_unload_fn_t fn);
+int yed_plugin_add_timer(yed_plugin *plug, unsigned long long ms, int repeat, yed_timer_fn fn, void *arg);
+void yed_plugin_add_fd(yed_plugin *plug, int fd, int events, yed_fd_handler_fn fn, void *arg);
+yed_job *yed_plugin_submit_job(yed_plugin *plug, yed_job_fn work, yed_job_fn done, void *arg);
+struct yed_subproc_t *yed_plugin_start_subproc(yed_plugin *plug, char *cmd, struct yed_subproc_opts_t *opts);
 void yed_plugin_request_mouse_reporting(yed_plugin *plug);
 void yed_plugin_request_no_mouse_reporting(yed_plugin *plug);
 
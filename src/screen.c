@@ -1,33 +1,228 @@
 #include "screen.h"
 
+static int  attr_id(yed_attrs attr);
+static void palette_clear_caches(void);
+
+static void init_palette(void) {
+    yed_attr_palette *pal;
+
+    pal = &ys->attr_palette;
+
+    /*
+     * Never moves, so that the writer thread can look up ids while the main
+     * thread is adding new ones.
+     */
+    pal->attrs   = malloc(SCREEN_MAX_ATTRS * sizeof(yed_attrs));
+    pal->cap     = 256;
+    pal->slots   = calloc(2 * pal->cap, sizeof(uint32_t));
+    pal->n_attrs = 0;
+    pal->deltas  = malloc(SCREEN_DELTA_CACHE_SIZE * sizeof(yed_attr_delta));
+
+    palette_clear_caches();
+
+    /* Id 0 is ZERO_ATTR, which is what zeroed cells have. */
+    attr_id(ZERO_ATTR);
+}
+
 void yed_init_screen(void) {
-    ys->screen_update = &ys->screen1;
-    ys->screen_render = &ys->screen2;
+    ys->screen_update    = &ys->screens[0];
+    ys->screen_ready     = &ys->screens[1];
+    ys->screen_render    = &ys->screens[2];
+    ys->screen_shown     = &ys->screens[3];
+    ys->screen_published = ys->screen_ready;
+
+    ys->ready_output = array_make(char);
+
+    init_palette();
 
     yed_resize_screen();
 }
 
+
+/*
+ * The attribute palette.
+ */
+
+static inline uint32_t attr_hash(yed_attrs attr) {
+    uint32_t h;
+
+    h = (attr.flags * 0x9E3779B1u) ^ (attr.fg * 0x85EBCA77u) ^ (attr.bg * 0xC2B2AE3Du);
+
+    return h ^ (h >> 15);
+}
+
+static void palette_clear_caches(void) {
+    yed_attr_palette *pal;
+    int               i;
+
+    pal = &ys->attr_palette;
+
+    pal->combine_dst = -1;
+
+    for (i = 0; i < SCREEN_DELTA_CACHE_SIZE; i += 1) {
+        pal->deltas[i].len = -1;
+    }
+}
+
+static void palette_rehash(void) {
+    yed_attr_palette *pal;
+    uint32_t          mask;
+    uint32_t          i;
+    int               id;
+
+    pal  = &ys->attr_palette;
+    mask = 2 * pal->cap - 1;
+
+    memset(pal->slots, 0, 2 * pal->cap * sizeof(uint32_t));
+
+    for (id = 0; id < pal->n_attrs; id += 1) {
+        for (i = attr_hash(pal->attrs[id]) & mask; pal->slots[i] != 0; i = (i + 1) & mask);
+        pal->slots[i] = id + 1;
+    }
+}
+
+/*
+ * Rebuilds the palette with only the attributes that the screens still use
+ * and gives the cells their new ids. The writer can't be running: it reads
+ * both the palette and the screens that it's given.
+ */
+void yed_compact_attr_palette(void) {
+    yed_attr_palette *pal;
+    char             *used;
+    uint16_t         *new_ids;
+    yed_screen       *screens;
+    yed_screen_cell  *cell;
+    yed_screen_cell  *end;
+    int               n_cells;
+    int               id;
+    int               n;
+    int               i;
+
+    pal        = &ys->attr_palette;
+    used       = calloc(SCREEN_MAX_ATTRS, 1);
+    new_ids    = malloc(SCREEN_MAX_ATTRS * sizeof(uint16_t));
+    screens    = ys->screens;
+    n_cells    = ys->term_rows * ys->term_cols;
+
+    used[0] = 1;
+    for (i = 0; i < 4; i += 1) {
+        used[screens[i].cur_attr] = 1;
+        for (cell = screens[i].cells, end = cell + n_cells; cell < end; cell += 1) {
+            used[cell->attr] = 1;
+        }
+    }
+
+    n = 0;
+    for (id = 0; id < pal->n_attrs; id += 1) {
+        if (!used[id]) { continue; }
+
+        pal->attrs[n] = pal->attrs[id];
+        new_ids[id]   = n;
+        n += 1;
+    }
+
+    for (i = 0; i < 4; i += 1) {
+        screens[i].cur_attr = new_ids[screens[i].cur_attr];
+        for (cell = screens[i].cells, end = cell + n_cells; cell < end; cell += 1) {
+            cell->attr = new_ids[cell->attr];
+        }
+    }
+
+    pal->n_attrs = n;
+
+    palette_rehash();
+    palette_clear_caches();
+
+    free(new_ids);
+    free(used);
+}
+
+static int attr_id(yed_attrs attr) {
+    yed_attr_palette *pal;
+    uint32_t          mask;
+    uint32_t          i;
+    uint32_t          slot;
+    int               id;
+
+    pal  = &ys->attr_palette;
+    mask = 2 * pal->cap - 1;
+
+    for (i = attr_hash(attr) & mask; (slot = pal->slots[i]) != 0; i = (i + 1) & mask) {
+        if (yed_attrs_eq(pal->attrs[slot - 1], attr)) { return slot - 1; }
+    }
+
+    /*
+     * Ids are only reclaimed between frames (yed_compact_attr_palette()),
+     * so a single frame with this many new attributes draws the rest plain.
+     */
+    if (pal->n_attrs == SCREEN_MAX_ATTRS) { return 0; }
+
+    if (pal->n_attrs == pal->cap) {
+        pal->cap   *= 2;
+        pal->slots  = realloc(pal->slots, 2 * pal->cap * sizeof(uint32_t));
+
+        palette_rehash();
+
+        return attr_id(attr);
+    }
+
+    id             = pal->n_attrs;
+    pal->n_attrs  += 1;
+    pal->attrs[id] = attr;
+    pal->slots[i]  = id + 1;
+
+    return id;
+}
+
+
+/*
+ * Drawing.
+ */
+
+/* The writer can't be running. */
 void yed_resize_screen(void) {
-    int n_cells;
-    int n_bytes;
+    yed_screen *screen;
+    int         n_cells;
+    int         n_bytes;
+    int         n_words;
+    int         i;
 
     n_cells = ys->term_rows * ys->term_cols;
     n_bytes = n_cells * sizeof(yed_screen_cell);
+    n_words = ys->term_rows * SCREEN_DIRTY_WORDS(ys->term_cols);
 
-    ys->screen_update->cells = realloc(ys->screen_update->cells, n_bytes);
-    ys->screen_render->cells = realloc(ys->screen_render->cells, n_bytes);
+    for (i = 0; i < 4; i += 1) {
+        screen = &ys->screens[i];
 
-    memset(ys->screen_update->cells, 0, n_bytes);
-    memset(ys->screen_render->cells, 0, n_bytes);
+        screen->cells        = realloc(screen->cells,        n_bytes);
+        screen->touched_rows = realloc(screen->touched_rows, ys->term_rows);
+        screen->dirty_rows   = realloc(screen->dirty_rows,   ys->term_rows);
+        screen->dirty_cells  = realloc(screen->dirty_cells,  n_words * sizeof(uint64_t));
+
+        memset(screen->cells,        0, n_bytes);
+        memset(screen->touched_rows, 0, ys->term_rows);
+        memset(screen->dirty_rows,   0, ys->term_rows);
+        memset(screen->dirty_cells,  0, n_words * sizeof(uint64_t));
+    }
 }
 
+/*
+ * The clear goes out with the next frame, after anything the writer is
+ * still writing, and that frame is diffed against the blank screen_shown.
+ */
 void yed_clear_screen(void) {
-    printf(TERM_RESET TERM_CURSOR_HOME TERM_CLEAR_SCREEN);
+    const char *clear = TERM_RESET TERM_CURSOR_HOME TERM_CLEAR_SCREEN;
+
+    pthread_mutex_lock(&ys->write_mtx);
+
+    array_push_n(ys->output_buffer, (char*)clear, strlen(clear));
     yed_resize_screen();
+
+    pthread_mutex_unlock(&ys->write_mtx);
 }
 
 void yed_set_attr(yed_attrs attr) {
-    ys->screen_update->cur_attrs = attr;
+    ys->screen_update->cur_attr = attr_id(attr);
 }
 
 void yed_reset_attr(void) {
@@ -41,22 +236,45 @@ static void set_cell(int row, int col, yed_glyph g) {
 
     cell = ys->screen_update->cells + ((row - 1) * ys->term_cols) + (col - 1);
 
-    cell->attrs = ys->screen_update->cur_attrs;
+    ys->screen_update->touched_rows[row - 1] = 1;
+
+    cell->attr  = ys->screen_update->cur_attr;
     cell->glyph = g;
 }
 
 static void set_cell_combine(int row, int col, yed_glyph g) {
-    yed_screen_cell *cell;
+    yed_attr_palette *pal;
+    yed_screen_cell  *cell;
+    yed_attrs         attrs;
+    int               id;
 
     if (row > ys->term_rows || col > ys->term_cols) { return; }
 
+    pal  = &ys->attr_palette;
     cell = ys->screen_update->cells + ((row - 1) * ys->term_cols) + (col - 1);
 
-    cell->attrs.flags &= ~(ATTR_BOLD);
-    cell->attrs.flags &= ~(ATTR_UNDERLINE);
-    cell->attrs.flags &= ~(ATTR_INVERSE);
+    ys->screen_update->touched_rows[row - 1] = 1;
+
+    /* Runs of cells are usually combined with the same attributes. */
+    if (cell->attr == pal->combine_dst && ys->screen_update->cur_attr == pal->combine_src) {
+        id = pal->combine_result;
+    } else {
+        attrs = pal->attrs[cell->attr];
+
+        attrs.flags &= ~(ATTR_BOLD);
+        attrs.flags &= ~(ATTR_UNDERLINE);
+        attrs.flags &= ~(ATTR_INVERSE);
+
+        yed_combine_attrs(&attrs, &pal->attrs[ys->screen_update->cur_attr]);
 
-    yed_combine_attrs(&cell->attrs, &ys->screen_update->cur_attrs);
+        id = attr_id(attrs);
+
+        pal->combine_dst    = cell->attr;
+        pal->combine_src    = ys->screen_update->cur_attr;
+        pal->combine_result = id;
+    }
+
+    cell->attr  = id;
     cell->glyph = g;
 }
 
@@ -154,123 +372,535 @@ void yed_draw_background(void) {
     write_welcome();
 }
 
-void yed_diff_and_swap_screens(void) {
-    yed_screen_cell *ucell;
-    yed_screen_cell *rcell;
-    int              row;
-    int              col;
-    int              dirty;
+/*
+ * Hands the frame that was just drawn to the writer thread. This never
+ * waits for the writer. If the last frame hasn't been picked up yet, it's
+ * dropped in favor of this one.
+ *
+ * A pump normally draws every cell of screen_update from scratch (starting
+ * with the background), so it can start out holding any old frame. The
+ * exception is a row that wasn't drawn to at all, which we bring up to date
+ * from the last frame that was published.
+ */
+void yed_publish_screen(void) {
+    yed_screen *update;
+    yed_screen *last;
+    yed_screen *tmp;
+    int         n_cols;
+    int         row;
+
+    /* Make room for the next frame's attributes while we know that the screens are complete. */
+    if (2 * ys->attr_palette.n_attrs > SCREEN_MAX_ATTRS) {
+        pthread_mutex_lock(&ys->write_mtx);
+        yed_compact_attr_palette();
+        pthread_mutex_unlock(&ys->write_mtx);
+    }
 
-    ucell = ys->screen_update->cells;
-    rcell = ys->screen_render->cells;
+    update = ys->screen_update;
+    last   = ys->screen_published;
+    n_cols = ys->term_cols;
 
-    for (row = 1; row <= ys->term_rows; row += 1) {
-        for (col = 1; col <= ys->term_cols; col += 1) {
-            dirty = (   rcell->glyph.data != ucell->glyph.data
-                     || !yed_attrs_eq(rcell->attrs, ucell->attrs));
+    /* Nobody writes to last now, wherever it is. */
+    for (row = 0; row < ys->term_rows; row += 1) {
+        if (!update->touched_rows[row]) {
+            memcpy(update->cells + (row * n_cols), last->cells + (row * n_cols), n_cols * sizeof(yed_screen_cell));
+        }
+        update->touched_rows[row] = 0;
+    }
 
-            *rcell       = *ucell;
-            rcell->dirty = dirty;
+    if (ys->interactive_command != NULL) {
+        update->cursor_y    = ys->term_rows;
+        update->cursor_x    = ys->cmd_cursor_x;
+        update->show_cursor = 1;
+    } else if (ys->active_frame != NULL) {
+        update->cursor_y    = ys->active_frame->cur_y;
+        update->cursor_x    = ys->active_frame->cur_x;
+        update->show_cursor = 1;
+    } else {
+        update->cursor_y    = 1;
+        update->cursor_x    = 1;
+        update->show_cursor = 0;
+    }
+
+    pthread_mutex_lock(&ys->write_ready_mtx);
+
+    if (ys->write_pending) {
+        ys->n_dropped_frames += 1;
+    }
+
+    tmp                  = ys->screen_ready;
+    ys->screen_ready     = update;
+    ys->screen_update    = tmp;
+    ys->screen_published = update;
+    ys->write_pending    = 1;
+
+    /* Drawing picks up where it left off. */
+    tmp->cur_attr = update->cur_attr;
+    tmp->cur_y    = update->cur_y;
+    tmp->cur_x    = update->cur_x;
+
+    /* Output that isn't part of a frame can't be dropped. */
+    array_push_n(ys->ready_output, array_data(ys->output_buffer), array_len(ys->output_buffer));
+    array_clear(ys->output_buffer);
+
+    pthread_cond_signal(&ys->write_ready_cond);
+    pthread_mutex_unlock(&ys->write_ready_mtx);
+}
+
+/* Called by the writer to wait for the next frame and make it screen_render. */
+void yed_take_screen(void) {
+    yed_screen *tmp;
+
+    pthread_mutex_lock(&ys->write_ready_mtx);
+
+    while (!ys->write_pending) {
+        pthread_cond_wait(&ys->write_ready_cond, &ys->write_ready_mtx);
+    }
 
-            ucell += 1;
-            rcell += 1;
+    tmp               = ys->screen_render;
+    ys->screen_render = ys->screen_ready;
+    ys->screen_ready  = tmp;
+    ys->write_pending = 0;
+
+    array_copy(ys->writer_buffer, ys->ready_output);
+    array_clear(ys->ready_output);
+
+    pthread_mutex_unlock(&ys->write_ready_mtx);
+}
+
+static inline int cells_differ(const yed_screen_cell *a, const yed_screen_cell *b) {
+    return memcmp(a, b, sizeof(*a)) != 0;
+}
+
+/*
+ * Compares the frame that the writer took with what's on the terminal,
+ * marks what changed in screen_shown's dirty rows and bits, and copies the
+ * changed rows over.
+ *
+ * Rows, and then 64 cell chunks within changed rows, are compared with
+ * memcmp() first so that we only look at individual cells where something
+ * is actually different.
+ */
+void yed_diff_screens(void) {
+    unsigned long long  start_us;
+    yed_screen         *render;
+    yed_screen         *shown;
+    yed_screen_cell    *rrow;
+    yed_screen_cell    *srow;
+    uint64_t           *bits;
+    uint64_t            word;
+    int                 n_cols;
+    int                 n_words;
+    int                 row;
+    int                 w;
+    int                 col;
+    int                 end;
+
+    start_us = measure_time_now_us();
+
+    render  = ys->screen_render;
+    shown   = ys->screen_shown;
+    n_cols  = ys->term_cols;
+    n_words = SCREEN_DIRTY_WORDS(n_cols);
+
+    rrow = render->cells;
+    srow = shown->cells;
+    bits = shown->dirty_cells;
+
+    for (row = 0; row < ys->term_rows; row += 1) {
+        shown->dirty_rows[row] = 0;
+
+        if (memcmp(rrow, srow, n_cols * sizeof(yed_screen_cell)) != 0) {
+            for (w = 0; w < n_words; w += 1) {
+                col = w * 64;
+                end = MIN(col + 64, n_cols);
+
+                word = 0;
+
+                if (memcmp(rrow + col, srow + col, (end - col) * sizeof(yed_screen_cell)) != 0) {
+                    for (; col < end; col += 1) {
+                        word |= (uint64_t)cells_differ(rrow + col, srow + col) << (col & 63);
+                    }
+                }
+
+                bits[w] = word;
+            }
+
+            memcpy(srow, rrow, n_cols * sizeof(yed_screen_cell));
+
+            shown->dirty_rows[row] = 1;
         }
+
+        rrow += n_cols;
+        srow += n_cols;
+        bits += n_words;
     }
+
+    ys->diff_accum_us += measure_time_now_us() - start_us;
 }
 
-void yed_render_screen(void) {
-    array_t          output_buffer;
+static char *put_int(char *p, int n) {
+    char digits[16];
+    int  len;
+
+    len = 0;
+    do {
+        digits[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+
+    while (len) { *p++ = digits[--len]; }
+
+    return p;
+}
+
+/*
+ * Writes the CSI sequence "\e[<n><final>" to p, leaving out n when it's 1,
+ * since that's the default. Returns a pointer past the end.
+ */
+static char *csi_n(char *p, int n, char final) {
+    *p++ = '\e';
+    *p++ = '[';
+    if (n != 1) { p = put_int(p, n); }
+    *p++ = final;
+
+    return p;
+}
+
+/*
+ * Writes the shortest sequence we know of that moves the cursor to col,
+ * staying in the same row, to p. Returns a pointer past the end.
+ */
+static char *column_move_seq(char *p, int col) {
+    yed_screen *screen;
+    char        rel[32];
+    char       *end;
+    int         dx;
+
+    screen = ys->screen_shown;
+
+    if (col == screen->cur_x) { return p;                 }
+    if (col == 1)             { *p++ = '\r'; return p;    }
+
+    end = csi_n(p, col, 'G');
+
+    if (screen->cur_x != 0) {
+        dx = col - screen->cur_x;
+
+        if (dx > 0) {
+            dx = csi_n(rel, dx, 'C') - rel;
+        } else {
+            dx = csi_n(rel, -dx, 'D') - rel;
+        }
+
+        if (dx < end - p) {
+            memcpy(p, rel, dx);
+            end = p + dx;
+        }
+    }
+
+    return end;
+}
+
+/*
+ * Writes the shortest sequence we know of that moves the terminal's cursor
+ * to (row, col) to buff and returns its length.
+ *
+ * The cursor's current position is in screen_shown->cur_y and cur_x. Either
+ * can be 0, meaning that we don't know where it is. In that case, we only
+ * use moves that don't depend on it.
+ */
+static int cursor_move_seq(char *buff, int row, int col) {
+    yed_screen *screen;
+    char        rel[64];
+    char       *p;
+    char       *q;
+    int         dy;
+    int         i;
+
+    screen = ys->screen_shown;
+
+    /* Absolute position: "\e[<row>;<col>H", where both default to 1. */
+    p    = buff;
+    *p++ = '\e';
+    *p++ = '[';
+    if (row != 1 || col != 1) { p = put_int(p, row); }
+    if (col != 1)             { *p++ = ';'; p = put_int(p, col); }
+    *p++ = 'H';
+
+    if (screen->cur_y == 0) { goto out; }
+
+    /* Relative to where the cursor is now. */
+    q  = rel;
+    dy = row - screen->cur_y;
+
+    if (col == 1 && dy > 0 && dy <= 4) {
+        /* The '\r' comes first so that this works whether or not the tty adds one for '\n'. */
+        *q++ = '\r';
+        for (i = 0; i < dy; i += 1) { *q++ = '\n'; }
+    } else {
+        if (dy > 0) {
+            q = csi_n(q, dy, 'B');
+        } else if (dy < 0) {
+            q = csi_n(q, -dy, 'A');
+        }
+        q = column_move_seq(q, col);
+    }
+
+    if (q - rel < p - buff) {
+        memcpy(buff, rel, q - rel);
+        p = buff + (q - rel);
+    }
+
+out:;
+    return p - buff;
+}
+
+/*
+ * Can we move the cursor from cur_x to col (in the same row) by writing the
+ * cells in between again? They must be plain ASCII in the current attributes.
+ */
+static int can_rewrite_cells(yed_screen_cell *row_cells, int col) {
+    yed_screen      *screen;
+    yed_screen_cell *cell;
+    int              c;
+
+    screen = ys->screen_shown;
+
+    for (c = screen->cur_x; c < col; c += 1) {
+        cell = row_cells + (c - 1);
+
+        if (!G_IS_ASCII(cell->glyph) || !isprint(cell->glyph.c)) { return 0; }
+        if (cell->attr != screen->cur_attr)                      { return 0; }
+    }
+
+    return 1;
+}
+
+#define WR(s, n) array_push_n(ys->writer_buffer, (s), (n))
+
+static void render_attr_change(int from, int to) {
+    yed_attr_palette *pal;
+    yed_attr_delta   *delta;
+    char              buff[512];
+    int               len;
+
+    pal   = &ys->attr_palette;
+    delta = pal->deltas + (((from * 31) + to) & (SCREEN_DELTA_CACHE_SIZE - 1));
+
+    if (delta->len >= 0 && delta->from == from && delta->to == to) {
+        WR(delta->str, delta->len);
+        return;
+    }
+
+    yed_get_attr_delta_str(pal->attrs[from], pal->attrs[to], buff);
+    len = strlen(buff);
+
+    WR(buff, len);
+
+    if (len < (int)sizeof(delta->str)) {
+        delta->from = from;
+        delta->to   = to;
+        delta->len  = len;
+        memcpy(delta->str, buff, len);
+    }
+}
+
+static void render_cell(yed_screen_cell *row_cells, int row, int col) {
+    yed_screen      *screen;
     yed_screen_cell *cell;
-    int              row;
-    int              col;
     char             buff[512];
-    int              cursor_x;
-    int              cursor_y;
-    int              write_ret;
+    int              len;
+    int              c;
 
-#define WR(s, n) array_push_n(output_buffer, s, n)
+    screen = ys->screen_shown;
+    cell   = row_cells + (col - 1);
 
-    output_buffer = array_make(char);
+    /* The right half of a wide glyph. Writing the glyph covers it. */
+    if (cell->glyph.data == 0) { return; }
 
-    WR(TERM_CURSOR_HIDE, strlen(TERM_CURSOR_HIDE));
+    if (screen->cur_y != row || screen->cur_x != col) {
+        len = cursor_move_seq(buff, row, col);
+
+        if (screen->cur_y == row
+        &&  screen->cur_x != 0
+        &&  screen->cur_x < col
+        &&  col - screen->cur_x < len
+        &&  can_rewrite_cells(row_cells, col)) {
+
+            for (c = screen->cur_x; c < col; c += 1) {
+                WR(&row_cells[c - 1].glyph.c, 1);
+            }
+        } else {
+            WR(buff, len);
+        }
+
+        screen->cur_y = row;
+        screen->cur_x = col;
+    }
+
+    if (cell->attr != screen->cur_attr) {
+        render_attr_change(screen->cur_attr, cell->attr);
+        screen->cur_attr = cell->attr;
+    }
+
+    WR(&cell->glyph.c, yed_get_glyph_len(cell->glyph));
+
+    if (G_IS_ASCII(cell->glyph) && !isprint(cell->glyph.c)) {
+        /* Who knows what a control character will do to the cursor. */
+        screen->cur_y = 0;
+        screen->cur_x = 0;
+    } else {
+        screen->cur_x += yed_get_glyph_width(cell->glyph);
+
+        /* The terminal may be waiting to wrap, so relative moves aren't safe. */
+        if (screen->cur_x > ys->term_cols) {
+            screen->cur_x = 0;
+        }
+    }
+}
+
+/*
+ * Writes all of s to the terminal. This is the only place where the writer
+ * waits on the terminal, and the time it spends here is counted, so that a
+ * slow terminal shows up in screen-stats along with the frames that were
+ * dropped because of it.
+ *
+ * It's written a piece at a time under term_write_mtx, so that
+ * yed_stop_writer() only ever waits for one piece.
+ */
+static void write_out(const char *s, int len) {
+    unsigned long long start_us;
+    struct pollfd      pfd;
+    int                n;
+
+    start_us = measure_time_now_us();
+
+    while (len > 0) {
+        pthread_mutex_lock(&ys->term_write_mtx);
+        n = write(1, s, MIN(len, SCREEN_WRITE_PIECE));
+        pthread_mutex_unlock(&ys->term_write_mtx);
+
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                pfd.fd     = 1;
+                pfd.events = POLLOUT;
+                poll(&pfd, 1, -1);
+                continue;
+            }
+
+            break;
+        }
+
+        s   += n;
+        len -= n;
+    }
 
-    ys->screen_render->cur_x = ys->screen_render->cur_y = 1;
-    snprintf(buff, sizeof(buff), "%s1%s1%s",
-        TERM_CURSOR_MOVE_BEG,
-        TERM_CURSOR_MOVE_SEP,
-        TERM_CURSOR_MOVE_END);
-    WR(buff, strlen(buff));
+    ys->write_accum_us += measure_time_now_us() - start_us;
+}
 
-    ys->screen_render->cur_attrs = ZERO_ATTR;
+/*
+ * Renders the dirty cells of screen_shown to bytes for yed_write_screen().
+ *
+ * The output is built up in ys->writer_buffer, which is kept around between
+ * frames. To keep it small (this matters over slow connections), we move the
+ * cursor with the shortest sequence we can find, only emit the attributes
+ * that change from one cell to the next, and just write over short runs of
+ * clean cells instead of moving past them.
+ */
+void yed_render_screen(void) {
+    unsigned long long  start_us;
+    yed_screen         *screen;
+    yed_screen_cell    *row_cells;
+    uint64_t           *bits;
+    int                 n_words;
+    int                 row;
+    int                 col;
+    int                 w;
+    char                buff[512];
+    int                 len;
+    int                 cursor_x;
+    int                 cursor_y;
+
+    start_us = measure_time_now_us();
+
+    screen = ys->screen_shown;
+
+    WR(TERM_CURSOR_HIDE, strlen(TERM_CURSOR_HIDE));
+
+    /*
+     * Something else could have written to the terminal since the last
+     * frame, so we don't know where the cursor is or which attributes
+     * are set.
+     */
+    screen->cur_y     = 0;
+    screen->cur_x     = 0;
+    screen->cur_attr  = 0;
     WR(TERM_RESET, strlen(TERM_RESET));
 
-    cell = ys->screen_render->cells;
+    n_words = SCREEN_DIRTY_WORDS(ys->term_cols);
 
     for (row = 1; row <= ys->term_rows; row += 1) {
-        for (col = 1; col <= ys->term_cols; col += 1) {
-            if (cell->dirty) {
-                if (ys->screen_render->cur_y != row
-                ||  ys->screen_render->cur_x != col) {
-                    snprintf(buff, sizeof(buff), "%s%d%s%d%s",
-                             TERM_CURSOR_MOVE_BEG,
-                             row,
-                             TERM_CURSOR_MOVE_SEP,
-                             col,
-                             TERM_CURSOR_MOVE_END);
-
-                    WR(buff, strlen(buff));
-
-                    ys->screen_render->cur_y = row;
-                    ys->screen_render->cur_x = col;
-                }
+        if (!screen->dirty_rows[row - 1]) { continue; }
 
-                if (!yed_attrs_eq(cell->attrs, ys->screen_render->cur_attrs)) {
-                    WR(TERM_RESET, strlen(TERM_RESET));
-                    yed_get_attr_str(cell->attrs, buff);
-                    WR(buff, strlen(buff));
-                    ys->screen_render->cur_attrs = cell->attrs;
-                }
+        screen->dirty_rows[row - 1] = 0;
 
-                WR(&cell->glyph.c, yed_get_glyph_len(cell->glyph));
+        row_cells = screen->cells + ((row - 1) * ys->term_cols);
+        bits      = screen->dirty_cells + ((row - 1) * n_words);
 
-                ys->screen_render->cur_x += yed_get_glyph_width(cell->glyph);
+        for (w = 0; w < n_words; w += 1) {
+            while (bits[w]) {
+                col      = (w * 64) + __builtin_ctzll(bits[w]) + 1;
+                bits[w] &= bits[w] - 1;
 
-                cell->dirty = 0;
+                render_cell(row_cells, row, col);
             }
-
-            cell += 1;
         }
     }
 
-    if (ys->interactive_command != NULL) {
-        cursor_y = ys->term_rows;
-        cursor_x = ys->cmd_cursor_x;
+    if (ys->screen_render->show_cursor) {
         WR(TERM_CURSOR_SHOW, strlen(TERM_CURSOR_SHOW));
-    } else if (ys->active_frame != NULL) {
-        cursor_y = ys->active_frame->cur_y;
-        cursor_x = ys->active_frame->cur_x;
-        WR(TERM_CURSOR_SHOW, strlen(TERM_CURSOR_SHOW));
-    } else {
-        cursor_y = cursor_x = 1;
     }
 
-    snprintf(buff, sizeof(buff), "%s%d%s%d%s",
-             TERM_CURSOR_MOVE_BEG,
-             cursor_y,
-             TERM_CURSOR_MOVE_SEP,
-             cursor_x,
-             TERM_CURSOR_MOVE_END);
+    cursor_y = ys->screen_render->cursor_y;
+    cursor_x = ys->screen_render->cursor_x;
 
-    WR(buff, strlen(buff));
+    if (screen->cur_y != cursor_y || screen->cur_x != cursor_x) {
+        len = cursor_move_seq(buff, cursor_y, cursor_x);
+        WR(buff, len);
+    }
 
-    write_ret = write(1, array_data(output_buffer), array_len(output_buffer));
-    (void)write_ret;
+    ys->render_accum_bytes += array_len(ys->writer_buffer);
+    ys->render_accum_us    += measure_time_now_us() - start_us;
+    ys->n_renders          += 1;
+}
 
-    array_free(output_buffer);
+/* Writes what yed_render_screen() rendered. Only the writer uses writer_buffer. */
+void yed_write_screen(void) {
+    write_out(array_data(ys->writer_buffer), array_len(ys->writer_buffer));
 
-#undef WR
+    array_clear(ys->writer_buffer);
 }
 
+/*
+ * For code that is about to leave the terminal (or the process): keeps the
+ * writer from rendering or writing anything more. The writer finishes the
+ * piece of output that it's in the middle of, at most.
+ */
+void yed_stop_writer(void) {
+    pthread_mutex_lock(&ys->write_mtx);
+    pthread_mutex_lock(&ys->term_write_mtx);
+}
+
+void yed_resume_writer(void) {
+    pthread_mutex_unlock(&ys->term_write_mtx);
+    pthread_mutex_unlock(&ys->write_mtx);
+}
+
+#undef WR
+
 static void screen_print_n(const char *s, int n, int combine) {
     const char *end;
     yed_glyph  *g;
@@ -1,17 +1,98 @@
 #ifndef __SCREEN_H__
 #define __SCREEN_H__
 
+/*
+ * Cells don't hold their attributes, but an id for them from the attribute
+ * palette. That keeps a cell at 8 bytes and lets two cells be compared as
+ * one integer.
+ */
 typedef struct {
-    yed_attrs attrs;
     yed_glyph glyph;
-    int       dirty;
+    uint16_t  attr;
+    uint16_t  _pad;
 } yed_screen_cell;
 
+/*
+ * Every distinct yed_attrs that has been drawn gets an id. Id 0 is always
+ * ZERO_ATTR. Between frames, once more than half of the ids are taken, the
+ * palette is rebuilt with only the attributes still on the screens, and the
+ * cells are given their new ids. That happens when a frame is handed to the
+ * writer, so a frame always has room for its new attributes.
+ *
+ * The writer thread reads attrs and owns the delta cache. The rest of the
+ * palette belongs to the main thread.
+ */
+#define SCREEN_MAX_ATTRS (1 << 16)
+
+/*
+ * yed_get_attr_delta_str() output for a pair of ids. yed_render_screen()
+ * keeps recent ones so that it doesn't rebuild the same strings on every
+ * attribute change.
+ */
+#define SCREEN_DELTA_CACHE_SIZE (256)
+
+/* The most that the writer writes to the terminal in one go. */
+#define SCREEN_WRITE_PIECE (16 * 1024)
+
+typedef struct {
+    uint16_t from;
+    uint16_t to;
+    int      len;           /* -1 if the entry is empty. */
+    char     str[56];
+} yed_attr_delta;
+
+typedef struct {
+    yed_attrs      *attrs;  /* By id. SCREEN_MAX_ATTRS of them. */
+    uint32_t       *slots;  /* Hash table of 1 + id, 0 if the slot is empty. */
+    int             n_attrs;
+    int             cap;    /* How many ids slots has room for. */
+    /* The last yed_combine_attrs() that set_cell_combine() did, by id. */
+    int             combine_dst;
+    int             combine_src;
+    int             combine_result;
+    yed_attr_delta *deltas;
+} yed_attr_palette;
+
+/* The number of uint64_t words of dirty bits for one row of cells. */
+#define SCREEN_DIRTY_WORDS(n_cols) (((n_cols) + 63) / 64)
+
+/*
+ * Frames are triple buffered between the main thread and the writer thread:
+ *
+ *     screen_update  The main thread draws the next frame here.
+ *     screen_ready   The latest finished frame, if write_pending is set.
+ *     screen_render  The frame that the writer is working on.
+ *
+ * yed_publish_screen() and yed_take_screen() trade them around under
+ * write_ready_mtx, which is only ever held for a moment. If the writer
+ * falls behind (say, over a slow connection), a new frame just replaces the
+ * one that was waiting, so the main thread never waits for the terminal.
+ *
+ * screen_shown belongs to the writer and holds what is on the terminal.
+ * yed_diff_screens() compares the frame it's rendering with it, so frames
+ * that were dropped along the way don't matter.
+ */
 typedef struct {
-    yed_attrs        cur_attrs;
+    int              cur_attr;  /* A palette id. */
     int              cur_y;
     int              cur_x;
+    /* Where the terminal's cursor goes when the frame has been written. */
+    int              cursor_y;
+    int              cursor_x;
+    int              show_cursor;
     yed_screen_cell *cells;
+    /*
+     * Only used in screen_update. Rows that have been drawn to since the
+     * last call to yed_publish_screen().
+     */
+    char            *touched_rows;
+    /*
+     * Only used in screen_shown. yed_diff_screens() sets these to say which
+     * rows changed since the last frame that was rendered and, in those
+     * rows, which cells (one bit each).
+     */
+    char            *dirty_rows;
+    uint64_t        *dirty_cells;
 } yed_screen;
 
 void yed_init_screen(void);
@@ -19,9 +100,15 @@ void yed_resize_screen(void);
 void yed_clear_screen(void);
 void yed_set_attr(yed_attrs attr);
 void yed_reset_attr(void);
+void yed_compact_attr_palette(void);
 void yed_draw_background(void);
-void yed_diff_and_swap_screens(void);
+void yed_publish_screen(void);
+void yed_take_screen(void);
+void yed_diff_screens(void);
 void yed_render_screen(void);
+void yed_write_screen(void);
+void yed_stop_writer(void);
+void yed_resume_writer(void);
 void yed_screen_print(const char *s);
 void yed_screen_print_n(const char *s, int n);
 void yed_screen_print_over(const char *s);
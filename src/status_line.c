@@ -1,5 +1,8 @@
 #include "status_line.h"
 
+static int                status_line_has_clock;
+static unsigned long long status_line_clock_due_ms;
+
 static char *get_expanded(char *s) {
     char       *result;
     int         just;
@@ -103,12 +106,14 @@ static char *get_expanded(char *s) {
             }
             break;
         case 't':
+            status_line_has_clock = 1;
             t  = time(NULL);
             tm = localtime(&t);
             strftime(tbuff, sizeof(tbuff), "%I:%M:%S", tm);
             result = strdup(tbuff);
             break;
         case 'T':
+            status_line_has_clock = 1;
             t  = time(NULL);
             tm = localtime(&t);
             strftime(tbuff, sizeof(tbuff), "%H:%M:%S", tm);
@@ -432,6 +437,24 @@ static void write_status_line_right(void) {
     put_status_line_string(var, col);
 }
 
+/*
+ * The main loop sleeps when nothing is happening, so if the status line
+ * shows the time, make sure there's a pump when the second changes.
+ */
+static void schedule_clock_update(void) {
+    unsigned long long now;
+
+    if (!status_line_has_clock) { return; }
+
+    now = measure_time_now_ms();
+
+    if (now < status_line_clock_due_ms) { return; }
+
+    /* Aim a little past the second so that we don't wake up just early. */
+    status_line_clock_due_ms = ((now / 1000ULL) + 1) * 1000ULL;
+    yed_add_timer(status_line_clock_due_ms - now + 10, 0, NULL, NULL);
+}
+
 void yed_write_status_line(void) {
     yed_event event;
     yed_attrs inv;
@@ -452,7 +475,11 @@ void yed_write_status_line(void) {
     }
     for (i = 0; i < ys->term_cols; i += 1) { yed_screen_print_n(" ", 1); }
 
+    status_line_has_clock = 0;
+
     write_status_line_left();   yed_reset_attr();
     write_status_line_center(); yed_reset_attr();
     write_status_line_right();  yed_reset_attr();
+
+    schedule_clock_update();
 }
@@ -85,6 +85,7 @@ void yed_remove_style(char *name) {
     &&  strcmp(name, ys->active_style->_name) == 0) {
         free(ys->active_style);
         ys->active_style = NULL;
+        yed_invalidate_line_draw_caches();
     }
 
     it = tree_lookup(ys->styles, name);
@@ -134,6 +135,8 @@ int yed_activate_style(char *name) {
         }
     }
 
+    yed_invalidate_line_draw_caches();
+
     memset(&event, 0, sizeof(event));
     event.kind = EVENT_STYLE_CHANGE;
     yed_trigger_event(&event);
@@ -1,23 +1,180 @@
+extern char **environ;
+
+static void yed_free_subproc(yed_subproc *sp);
+static int  yed_write_no_sigpipe(int fd, const char *data, int len);
+
+/*
+ * Starts /bin/sh -c cmd in its own process group. The child's stdin is
+ * in_fd, or /dev/null if in_fd is -1. Its stdout (and stderr, if
+ * merge_stderr is set) is out_fd. Returns 0 or an errno value.
+ */
+static int yed_spawn_sh(char *cmd, int in_fd, int out_fd, int merge_stderr, pid_t *pid) {
+    posix_spawn_file_actions_t  actions;
+    posix_spawnattr_t           attr;
+    sigset_t                    sigs;
+    char                       *argv[4];
+    int                         status;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    if (in_fd == -1) {
+        posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    } else {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, 0);
+    }
+    posix_spawn_file_actions_adddup2(&actions, out_fd, 1);
+    if (merge_stderr) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, 2);
+    }
+
+    /*
+     * Its own process group so that we can kill whatever it starts, and
+     * no signal dispositions or mask from the editor.
+     */
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+    sigfillset(&sigs);
+    sigdelset(&sigs, SIGKILL);
+    sigdelset(&sigs, SIGSTOP);
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+
+    argv[0] = "sh";
+    argv[1] = "-c";
+    argv[2] = cmd;
+    argv[3] = NULL;
+
+    status = posix_spawn(pid, "/bin/sh", &actions, &attr, argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    return status;
+}
+
+static int yed_make_pipe(int fds[2]) {
+    if (pipe(fds) == -1) { return errno; }
+
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    return 0;
+}
+
+static int yed_wait_status_to_exit_status(int wait_status) {
+    return WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : -1;
+}
+
+/*
+ * How many bytes at the end of data are the start of a UTF-8 sequence
+ * that isn't all there yet.
+ */
+static int yed_utf8_incomplete_tail(const char *data, int len) {
+    int           i;
+    unsigned char c;
+    int           need;
+
+    for (i = 1; i <= 3 && i <= len; i += 1) {
+        c = data[len - i];
+
+        if ((c & 0xC0) == 0x80) { continue; }
+
+        if      (c >= 0xF0) { need = 4; }
+        else if (c >= 0xE0) { need = 3; }
+        else if (c >= 0xC0) { need = 2; }
+        else                { need = 1; }
+
+        return need > i ? i : 0;
+    }
+
+    return 0;
+}
+
+/* Output is appended regardless of BUFF_RD_ONLY, so clear it the same way. */
+static void yed_subproc_clear_output(yed_buffer *buff) {
+    int save_flags;
+
+    save_flags   = buff->flags;
+    buff->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(buff);
+    buff->flags  = save_flags;
+}
+
+static void yed_subproc_trim_output(yed_buffer *buff) {
+    yed_line *last_line;
+
+    if (yed_buff_n_lines(buff) > 1) {
+        last_line = bucket_array_last(buff->lines);
+        if (array_len(last_line->chars) == 0) {
+            yed_free_line(last_line);
+            bucket_array_pop(buff->lines);
+
+            buff->get_line_cache     = NULL;
+            buff->get_line_cache_row = 0;
+
+            yed_buff_record_change(buff, BUFF_MOD_DELETE_LINE, yed_buff_n_lines(buff) + 1, 1, 0);
+        }
+    }
+}
+
+static int yed_read_fd_blocking(int fd, char *buff, int len) {
+    int n;
+
+    do {
+        n = read(fd, buff, len);
+    } while (n == -1 && errno == EINTR);
+
+    return n;
+}
+
+static int yed_waitpid_blocking(pid_t pid, int *wait_status) {
+    int r;
+
+    do {
+        r = waitpid(pid, wait_status, 0);
+    } while (r == -1 && errno == EINTR);
+
+    return r;
+}
+
 char * yed_run_subproc(char *cmd, int *output_len, int *status) {
-    FILE    *stream;
+    int      fds[2];
+    pid_t    pid;
     array_t  out;
-    int      c;
+    char     buff[SUBPROC_READ_SIZE];
+    char    *scan;
+    char    *end;
+    char    *cr;
+    int      n;
     int      w;
 
-    stream = popen(cmd, "r");
+    if (yed_make_pipe(fds) != 0) { return NULL; }
 
-    if (stream == NULL)    { return NULL; }
+    if (yed_spawn_sh(cmd, -1, fds[1], 0, &pid) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        errno = 0;
+        return NULL;
+    }
+
+    close(fds[1]);
 
     out = array_make(char);
 
-    c = 0;
-    while ((c = fgetc(stream)) != EOF) {
-        if (c == '\r') {
-            continue;
+    while ((n = yed_read_fd_blocking(fds[0], buff, sizeof(buff))) > 0) {
+        scan = buff;
+        end  = buff + n;
+        while ((cr = memchr(scan, '\r', end - scan)) != NULL) {
+            array_push_n(out, scan, cr - scan);
+            scan = cr + 1;
         }
-        array_push(out, c);
+        array_push_n(out, scan, end - scan);
     }
 
+    close(fds[0]);
+
     if (array_len(out)
     &&  *(char*)array_last(out) == '\n') {
         array_pop(out);
@@ -27,16 +184,14 @@ char * yed_run_subproc(char *cmd, int *output_len, int *status) {
         *output_len = array_len(out);
     }
 
-    w = pclose(stream);
-
-    if (w == -1) {
+    if (yed_waitpid_blocking(pid, &w) == -1) {
         if (status != NULL) {
             *status = errno;
         }
         errno = 0;
     } else {
         if (status != NULL) {
-            *status = WIFEXITED(w) ? WEXITSTATUS(w) : -1;
+            *status = yed_wait_status_to_exit_status(w);
         }
     }
 
@@ -46,317 +201,594 @@ char * yed_run_subproc(char *cmd, int *output_len, int *status) {
 }
 
 int yed_read_subproc_into_buffer(char *cmd, yed_buffer *buff, int *exit_status) {
-    FILE *stream;
+    int   fds[2];
+    pid_t pid;
+    char  data[SUBPROC_READ_SIZE + 3];
+    int   n_carry;
+    int   n;
+    int   n_tail;
     int   status;
     int   w;
 
-    stream = popen(cmd, "r");
-    if (stream == NULL) {
-        status = errno;
-        errno  = 0;
+    if ((status = yed_make_pipe(fds)) != 0) {
+        errno = 0;
+        return status;
+    }
+
+    if ((status = yed_spawn_sh(cmd, -1, fds[1], 0, &pid)) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        errno = 0;
         return status;
     }
 
-    status = yed_fill_buff_from_file_stream(buff, stream);
-    if (status) {
-        pclose(stream);
-        return -status;
+    close(fds[1]);
+
+    yed_subproc_clear_output(buff);
+
+    n_carry = 0;
+    while ((n = yed_read_fd_blocking(fds[0], data + n_carry, SUBPROC_READ_SIZE)) > 0) {
+        n      += n_carry;
+        n_tail  = yed_utf8_incomplete_tail(data, n);
+
+        yed_buff_append_output(buff, data, n - n_tail);
+
+        memmove(data, data + n - n_tail, n_tail);
+        n_carry = n_tail;
     }
 
-    w = pclose(stream);
-    if (w == -1) {
+    yed_buff_append_output(buff, data, n_carry);
+
+    close(fds[0]);
+
+    yed_subproc_trim_output(buff);
+    yed_buff_reset_journal(buff);
+
+    if (yed_waitpid_blocking(pid, &w) == -1) {
         status = errno;
         errno  = 0;
         return status;
     }
 
     if (exit_status != NULL) {
-        *exit_status = WIFEXITED(w) ? WEXITSTATUS(w) : -1;
+        *exit_status = yed_wait_status_to_exit_status(w);
     }
 
     return 0;
 }
 
-int _yed_write_buffer_to_subproc(yed_buffer *buff, char *cmd, int *exit_status) {
-    FILE     *stream;
-    int       status;
+/*
+ * The lines of buff joined with newlines, as a subprocess should see them
+ * on its stdin.
+ */
+static void yed_buff_to_subproc_input(yed_buffer *buff, array_t *data) {
     int       n_lines;
     int       row;
     yed_line *line;
-    int       w;
-
-    stream = popen(cmd, "w");
-    if (stream == NULL) {
-        status = errno;
-        errno  = 0;
-        return status;
-    }
 
     n_lines = yed_buff_n_lines(buff);
     row     = 1;
     bucket_array_traverse(buff->lines, line) {
-        fwrite(array_data(line->chars), 1, array_len(line->chars), stream);
+        array_push_n(*data, array_data(line->chars), array_len(line->chars));
         if (row < n_lines) {
-            fwrite("\n", 1, 1, stream);
+            array_push(*data, (char){'\n'});
         }
         row += 1;
     }
+}
 
-    w = pclose(stream);
-    if (w == -1) {
-        status = errno;
-        errno  = 0;
+/*
+ * This one blocks until the child has exited, so it doesn't go through
+ * yed_start_subproc(): that would need the main loop to run underneath
+ * the caller. Input and output are pumped with poll() so that a child
+ * that writes a lot before it has read all of its input can't deadlock
+ * with us. When output isn't wanted, stdout is /dev/null and we don't
+ * wait for EOF, so a child that leaves something running in the
+ * background (e.g. xclip) doesn't hang the editor.
+ */
+int yed_write_buffer_to_subproc(yed_buffer *buff, char *cmd, int *exit_status, char **output) {
+    int            in_fds[2];
+    int            out_fds[2];
+    pid_t          pid;
+    array_t        in_data;
+    int            in_pos;
+    array_t        out;
+    struct pollfd  pfds[2];
+    int            n_pfds;
+    int            i;
+    char           read_buff[SUBPROC_READ_SIZE];
+    int            n;
+    int            w;
+    int            status;
+
+    if (buff == NULL) { return EINVAL; }
+
+    if ((status = yed_make_pipe(in_fds)) != 0) {
+        errno = 0;
         return status;
     }
 
-    if (exit_status != NULL) {
-        *exit_status = WIFEXITED(w) ? WEXITSTATUS(w) : -1;
+    if (output != NULL) {
+        status = yed_make_pipe(out_fds);
+    } else {
+        out_fds[0] = -1;
+        out_fds[1] = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        status     = out_fds[1] == -1 ? errno : 0;
     }
 
-    return 0;
-}
+    if (status != 0) {
+        close(in_fds[0]);
+        close(in_fds[1]);
+        errno = 0;
+        return status;
+    }
 
-int _yed_write_buffer_to_subproc_2(yed_buffer *buff, char *cmd, int *exit_status, char **output) {
-    int            status;
-    int            fds_to_child[2];
-    int            fds_from_child[2];
-    pid_t          pid;
-    int            n_lines;
-    int            row;
-    int            write_ret;
-    yed_line      *line;
-    array_t        out;
-    char           read_buff[4096];
-    int            n_read;
-    int            wait_status;
+    status = yed_spawn_sh(cmd, in_fds[0], out_fds[1], 0, &pid);
 
-    status = 0;
+    close(in_fds[0]);
+    close(out_fds[1]);
 
-    if (buff == NULL) {
-        status = EINVAL;
-        goto out;
+    if (status != 0) {
+        close(in_fds[1]);
+        if (out_fds[0] != -1) { close(out_fds[0]); }
+        errno = 0;
+        return status;
     }
 
-    if (pipe(fds_to_child) == -1) {
-        status = errno;
-        errno  = 0;
-        goto out;
+    in_data = array_make(char);
+    in_pos  = 0;
+    out     = array_make(char);
+
+    yed_buff_to_subproc_input(buff, &in_data);
+
+    fcntl(in_fds[1], F_SETFL, fcntl(in_fds[1], F_GETFL) | O_NONBLOCK);
+
+    while (in_fds[1] != -1 || out_fds[0] != -1) {
+        n_pfds = 0;
+        if (in_fds[1] != -1) {
+            pfds[n_pfds].fd     = in_fds[1];
+            pfds[n_pfds].events = POLLOUT;
+            n_pfds += 1;
+        }
+        if (out_fds[0] != -1) {
+            pfds[n_pfds].fd     = out_fds[0];
+            pfds[n_pfds].events = POLLIN;
+            n_pfds += 1;
+        }
+
+        if (poll(pfds, n_pfds, -1) == -1) {
+            if (errno == EINTR) { continue; }
+            status = errno;
+            break;
+        }
+
+        for (i = 0; i < n_pfds; i += 1) {
+            if (pfds[i].revents == 0) { continue; }
+
+            if (pfds[i].fd == in_fds[1]) {
+                n = 0;
+                if (in_pos < array_len(in_data)) {
+                    n = yed_write_no_sigpipe(in_fds[1],
+                                             array_item(in_data, in_pos),
+                                             array_len(in_data) - in_pos);
+                }
+                if (n > 0) {
+                    in_pos += n;
+                } else if (n == -1 && (errno == EINTR || errno == EAGAIN)) {
+                    continue;
+                }
+
+                /* All written, or the child isn't reading anymore. */
+                if (n <= 0 || in_pos == array_len(in_data)) {
+                    close(in_fds[1]);
+                    in_fds[1] = -1;
+                }
+            } else {
+                n = read(out_fds[0], read_buff, sizeof(read_buff));
+                if (n > 0) {
+                    array_push_n(out, read_buff, n);
+                } else if (n == -1 && errno == EINTR) {
+                    continue;
+                } else {
+                    if (n == -1) { status = errno; }
+                    close(out_fds[0]);
+                    out_fds[0] = -1;
+                }
+            }
+        }
     }
-    if (pipe(fds_from_child) == -1) {
+
+    if (in_fds[1]  != -1) { close(in_fds[1]);  }
+    if (out_fds[0] != -1) { close(out_fds[0]); }
+
+    array_free(in_data);
+
+    if (yed_waitpid_blocking(pid, &w) == -1) {
         status = errno;
-        errno  = 0;
-        goto out;
+    } else if (exit_status != NULL) {
+        *exit_status = yed_wait_status_to_exit_status(w);
     }
 
-    pid = fork();
+    errno = 0;
 
-    if (pid == -1) {
-        status = errno;
-        errno  = 0;
-        close(fds_to_child[0]);   close(fds_to_child[1]);
-        close(fds_from_child[0]); close(fds_from_child[1]);
-        goto out;
+    if (status != 0) {
+        array_free(out);
+        return status;
     }
 
-    if (pid == 0) {
-        while ((dup2(fds_to_child[0],   0) == -1) && (errno == EINTR)) {}
-        while ((dup2(fds_from_child[1], 1) == -1) && (errno == EINTR)) {}
-        close(fds_to_child[0]);   close(fds_to_child[1]);
-        close(fds_from_child[0]); close(fds_from_child[1]);
-        execl("/bin/sh", "sh", "-c", cmd, NULL);
-        exit(99);
+    if (output != NULL) {
+        array_zero_term(out);
+        *output = array_data(out);
+    } else {
+        array_free(out);
     }
 
-    close(fds_to_child[0]);
-    close(fds_from_child[1]);
+    return 0;
+}
 
-    n_lines = yed_buff_n_lines(buff);
-    row     = 1;
-    bucket_array_traverse(buff->lines, line) {
-        write_ret = write(fds_to_child[1], array_data(line->chars), array_len(line->chars));
-        (void)write_ret;
-        if (row < n_lines) {
-            write_ret = write(fds_to_child[1], "\n", 1);
-            (void)write_ret;
-        }
-        row += 1;
-    }
-    close(fds_to_child[1]);
+int yed_start_read_subproc_into_buffer_nb(char *cmd, yed_buffer *buff, yed_nb_subproc_t *nb_subproc) {
+    yed_subproc_opts opts;
+    yed_subproc      *sp;
+    int               status;
 
-    out = array_make(char);
-    while ((n_read = read(fds_from_child[0], read_buff, sizeof(read_buff))) > 0) {
-        array_push_n(out, read_buff, n_read);
+    if (buff == NULL || nb_subproc == NULL) {
+        return EINVAL;
     }
 
-    if (n_read == -1) {
+    memset(nb_subproc, 0, sizeof(*nb_subproc));
+    memset(&opts, 0, sizeof(opts));
+
+    opts.out_buffer = buff;
+
+    if ((sp = yed_start_subproc(cmd, &opts)) == NULL) {
         status = errno;
         errno  = 0;
-        close(fds_from_child[0]);
-        array_free(out);
-        goto out;
+        return status;
     }
 
-    close(fds_from_child[0]);
-    array_zero_term(out);
-    *output = array_data(out);
+    /* The caller frees it when it asks after it. */
+    sp->keep = 1;
 
-    do {
-        status = waitpid(pid, &wait_status, 0);
-        if (status == -1) {
-            status = errno;
-            errno  = 0;
-            array_free(out);
-            *output = NULL;
-            goto out;
+    nb_subproc->pid    = sp->pid;
+    nb_subproc->buffer = buff;
+    nb_subproc->sp     = sp;
+
+    return 0;
+}
+
+int yed_read_subproc_into_buffer_nb(yed_nb_subproc_t *nb_subproc) {
+    yed_subproc *sp;
+
+    if ((sp = nb_subproc->sp) == NULL) { return 0; }
+
+    /* The main loop does the reading. */
+    if (!sp->done) { return 1; }
+
+    nb_subproc->exit_status = sp->exit_status;
+    nb_subproc->err         = sp->err;
+    nb_subproc->sp          = NULL;
+
+    yed_free_subproc(sp);
+
+    return 0;
+}
+
+
+void yed_init_subprocs(void) {
+    ys->subprocs = array_make(yed_subproc*);
+}
+
+static void yed_free_subproc(yed_subproc *sp) {
+    array_free(sp->in_data);
+    free(sp);
+}
+
+static void yed_subproc_close_in(yed_subproc *sp) {
+    if (sp->in_fd == -1) { return; }
+
+    yed_remove_fd(sp->in_fd);
+    close(sp->in_fd);
+    sp->in_fd = -1;
+    array_clear(sp->in_data);
+}
+
+static void yed_subproc_close_out(yed_subproc *sp) {
+    if (sp->out_fd == -1) { return; }
+
+    yed_remove_fd(sp->out_fd);
+    close(sp->out_fd);
+    sp->out_fd = -1;
+}
+
+/* Like write(), but a closed pipe gives EPIPE without raising SIGPIPE. */
+static int yed_write_no_sigpipe(int fd, const char *data, int len) {
+    sigset_t        pipe_set;
+    sigset_t        old_set;
+    sigset_t        pending;
+    struct timespec zero;
+    int             n;
+    int             save_errno;
+
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+    n          = write(fd, data, len);
+    save_errno = errno;
+
+    if (n == -1 && errno == EPIPE) {
+        sigpending(&pending);
+        if (sigismember(&pending, SIGPIPE)) {
+            zero.tv_sec  = 0;
+            zero.tv_nsec = 0;
+            sigtimedwait(&pipe_set, NULL, &zero);
         }
-        status = 0;
-    } while (!WIFEXITED(wait_status));
+    }
 
-    if (exit_status != NULL) {
-        *exit_status = WEXITSTATUS(wait_status);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+    errno = save_errno;
+
+    return n;
+}
+
+static void yed_subproc_write_input(int fd, int revents, void *arg) {
+    yed_subproc *sp;
+    int          n;
+
+    sp = arg;
+
+    while (sp->in_pos < array_len(sp->in_data)) {
+        n = yed_write_no_sigpipe(sp->in_fd,
+                                 array_item(sp->in_data, sp->in_pos),
+                                 array_len(sp->in_data) - sp->in_pos);
+        if (n > 0) {
+            sp->in_pos += n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && errno == EAGAIN) {
+            errno = 0;
+            return;
+        } else {
+            /* The child isn't reading anymore. */
+            errno = 0;
+            break;
+        }
     }
 
-out:;
-    return status;
+    yed_subproc_close_in(sp);
 }
 
-int yed_write_buffer_to_subproc(yed_buffer *buff, char *cmd, int *exit_status, char **output) {
-    if (output == NULL) {
-        return _yed_write_buffer_to_subproc(buff, cmd, exit_status);
+static void yed_subproc_take_output(yed_subproc *sp, char *data, int len) {
+    static char buff[SUBPROC_READ_SIZE + sizeof(sp->partial)];
+    int         n;
+    int         n_tail;
+
+    if (sp->opts.out_buffer != NULL) {
+        /* Don't split a glyph between two appends. */
+        memcpy(buff, sp->partial, sp->n_partial);
+        memcpy(buff + sp->n_partial, data, len);
+
+        n      = sp->n_partial + len;
+        n_tail = yed_utf8_incomplete_tail(buff, n);
+
+        yed_buff_append_output(sp->opts.out_buffer, buff, n - n_tail);
+
+        memcpy(sp->partial, buff + n - n_tail, n_tail);
+        sp->n_partial = n_tail;
     }
 
-    return _yed_write_buffer_to_subproc_2(buff, cmd, exit_status, output);
+    if (sp->opts.on_data != NULL) {
+        sp->opts.on_data(sp, data, len, sp->opts.arg);
+    }
 }
 
-int yed_start_read_subproc_into_buffer_nb(char *cmd, yed_buffer *buff, yed_nb_subproc_t *nb_subproc) {
-    int   status;
-    int   fds[2];
-    pid_t pid;
+static void yed_subproc_read_output(int fd, int revents, void *arg) {
+    yed_subproc *sp;
+    char         buff[SUBPROC_READ_SIZE];
+    int          total;
+    int          n;
 
-    status = 0;
+    sp    = arg;
+    total = 0;
 
-    if (buff == NULL || nb_subproc == NULL) {
-        status = EINVAL;
-        goto out;
+    /* Leave some for the next pump if there's a flood, so that we keep up with input. */
+    while (total < SUBPROC_MAX_READ_PER_PUMP) {
+        n = read(sp->out_fd, buff, sizeof(buff));
+
+        if (n > 0) {
+            yed_subproc_take_output(sp, buff, n);
+            total += n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && errno == EAGAIN) {
+            errno = 0;
+            return;
+        } else {
+            if (n == -1) {
+                sp->err = errno;
+                errno   = 0;
+            }
+            yed_subproc_close_out(sp);
+            /* The child may have been reaped already. */
+            yed_wake();
+            return;
+        }
     }
+}
 
-    memset(nb_subproc, 0, sizeof(*nb_subproc));
+yed_subproc * yed_start_subproc(char *cmd, yed_subproc_opts *opts) {
+    yed_subproc *sp;
+    int          out_fds[2];
+    int          in_fds[2];
+    int          status;
 
-    if (pipe(fds) == -1) {
-        status = errno;
-        errno  = 0;
-        goto out;
+    in_fds[0] = in_fds[1] = -1;
+
+    if ((status = yed_make_pipe(out_fds)) != 0) {
+        errno = status;
+        return NULL;
     }
 
-    pid = fork();
+    if (opts->in_buffer != NULL
+    &&  (status = yed_make_pipe(in_fds)) != 0) {
+        close(out_fds[0]);
+        close(out_fds[1]);
+        errno = status;
+        return NULL;
+    }
 
-    if (pid == -1) {
-        status = errno;
-        errno  = 0;
-        close(fds[0]);
-        close(fds[1]);
-        goto out;
+    sp         = calloc(1, sizeof(*sp));
+    sp->opts   = *opts;
+    sp->out_fd = out_fds[0];
+    sp->in_fd  = in_fds[1];
+
+    status = yed_spawn_sh(cmd, in_fds[0], out_fds[1], opts->merge_stderr, &sp->pid);
+
+    close(out_fds[1]);
+    if (in_fds[0] != -1) { close(in_fds[0]); }
+
+    if (status != 0) {
+        close(out_fds[0]);
+        if (in_fds[1] != -1) { close(in_fds[1]); }
+        free(sp);
+        errno = status;
+        return NULL;
     }
 
-    if (pid == 0) {
-        while ((dup2(fds[1], 1) == -1) && (errno == EINTR)) {}
-        close(fds[1]);
-        close(fds[0]);
-        execl("/bin/sh", "sh", "-c", cmd, NULL);
-        exit(99);
+    sp->in_data = array_make(char);
+
+    if (opts->in_buffer != NULL) {
+        yed_buff_to_subproc_input(opts->in_buffer, &sp->in_data);
+
+        fcntl(sp->in_fd, F_SETFL, fcntl(sp->in_fd, F_GETFL) | O_NONBLOCK);
+        yed_add_fd(sp->in_fd, POLLOUT, yed_subproc_write_input, sp);
     }
 
-    close(fds[1]);
+    fcntl(sp->out_fd, F_SETFL, fcntl(sp->out_fd, F_GETFL) | O_NONBLOCK);
+    yed_add_fd(sp->out_fd, POLLIN, yed_subproc_read_output, sp);
 
-    if (fcntl(fds[0], F_SETFL, O_NONBLOCK) == -1) {
-        status = errno;
-        errno  = 0;
-        close(fds[0]);
-        goto out;
+    if (opts->out_buffer != NULL) {
+        yed_subproc_clear_output(opts->out_buffer);
     }
 
-    yed_buff_clear_no_undo(buff);
+    array_push(ys->subprocs, sp);
+
+    return sp;
+}
 
-    nb_subproc->pid         = pid;
-    nb_subproc->fd          = fds[0];
-    nb_subproc->buffer      = buff;
-    nb_subproc->exit_status = 0;
-    nb_subproc->err         = 0;
+yed_subproc * yed_start_owned_subproc(void *owner, char *cmd, yed_subproc_opts *opts) {
+    yed_subproc *sp;
 
-out:;
-    return status;
+    if ((sp = yed_start_subproc(cmd, opts)) != NULL) {
+        sp->owner = owner;
+    }
+
+    return sp;
 }
 
-int yed_read_subproc_into_buffer_nb(yed_nb_subproc_t *nb_subproc) {
-    int        status;
-    int        wait_status;
-    int        exited;
-    int        last_row;
-    int        n_read;
-    char       buff[4096];
-    yed_glyph *g_start;
-    yed_glyph *g;
-    yed_line  *last_line;
+void yed_kill_subproc(yed_subproc *sp) {
+    if (sp->done) { return; }
+
+    if (!sp->exited) {
+        kill(-sp->pid, SIGTERM);
+    }
+
+    sp->killed          = 1;
+    sp->n_partial       = 0;
+    sp->opts.out_buffer = NULL;
+    sp->opts.on_data    = NULL;
+
+    yed_subproc_close_in(sp);
+}
 
-    status = 0;
+static void yed_subproc_finish(yed_subproc *sp) {
+    yed_subproc_close_in(sp);
 
-    if (waitpid(nb_subproc->pid, &wait_status, WNOHANG) == -1) {
-        status          = 0;
-        nb_subproc->err = errno;
-        errno           = 0;
-        goto out;
+    if (sp->opts.out_buffer != NULL) {
+        yed_buff_append_output(sp->opts.out_buffer, sp->partial, sp->n_partial);
+        yed_subproc_trim_output(sp->opts.out_buffer);
     }
 
-    exited = WIFEXITED(wait_status);
+    sp->done = 1;
 
-    last_row = yed_buff_n_lines(nb_subproc->buffer);
-    while ((n_read = read(nb_subproc->fd, buff, sizeof(buff))) > 0) {
+    if (sp->opts.on_exit != NULL) {
+        sp->opts.on_exit(sp, sp->exit_status, sp->opts.arg);
+    }
 
-        g_start = (yed_glyph*)(&buff[0]);
-        for (g = g_start; ((void*)g) - ((void*)g_start) < n_read;) {
+    if (!sp->keep) {
+        yed_free_subproc(sp);
+    }
+}
 
-            if (g->c == '\r') { /* Ignore */
-            } else if (g->c == '\n') {
-                last_row = yed_buffer_add_line_no_undo(nb_subproc->buffer);
-            } else {
-                yed_append_to_line_no_undo(nb_subproc->buffer, last_row, *g);
+void yed_service_subprocs(void) {
+    yed_subproc **it;
+    yed_subproc  *sp;
+    array_t       finished;
+    int           wait_status;
+    int           i;
+    pid_t         r;
+
+    if (array_len(ys->subprocs) == 0) { return; }
+
+    finished = array_make(yed_subproc*);
+
+    for (i = 0; i < array_len(ys->subprocs);) {
+        sp = *(yed_subproc**)array_item(ys->subprocs, i);
+
+        if (!sp->exited) {
+            r = waitpid(sp->pid, &wait_status, WNOHANG);
+            if (r == sp->pid) {
+                sp->exited      = 1;
+                sp->exit_status = yed_wait_status_to_exit_status(wait_status);
+            } else if (r == -1 && errno != EINTR) {
+                /* Somebody else reaped it. */
+                sp->exited      = 1;
+                sp->exit_status = -1;
+                sp->err         = errno;
             }
-
-            g = ((void*)g) + yed_get_glyph_len(*g);
+            errno = 0;
         }
-    }
 
-    if (n_read < 0) {
-        if (errno == EAGAIN) {
-            errno  = 0;
-            status = 1;
-            goto out;
+        /* We're done once the output has all been read, too. */
+        if (sp->exited && sp->out_fd == -1) {
+            array_push(finished, sp);
+            array_delete(ys->subprocs, i);
         } else {
-            status          = 0;
-            nb_subproc->err = errno;
-            errno           = 0;
-            goto out;
+            i += 1;
         }
     }
 
-    if (exited) {
-        if (yed_buff_n_lines(nb_subproc->buffer) > 1) {
-            last_line = bucket_array_last(nb_subproc->buffer->lines);
-            if (last_line->visual_width == 0) {
-                yed_buff_delete_line_no_undo(nb_subproc->buffer, yed_buff_n_lines(nb_subproc->buffer));
-            }
-        }
-        nb_subproc->exit_status = WEXITSTATUS(wait_status);
-        status = 0;
-    } else {
-        status = 1;
+    /* The callbacks may start new subprocesses. */
+    array_traverse(finished, it) {
+        yed_subproc_finish(*it);
     }
 
-out:;
-    if (status == 0) {
-        close(nb_subproc->fd);
-        nb_subproc->fd = -1;
+    array_free(finished);
+}
+
+void yed_kill_subprocs_for_owner(void *owner) {
+    yed_subproc **it;
+
+    array_traverse(ys->subprocs, it) {
+        if ((*it)->owner == owner) {
+            yed_kill_subproc(*it);
+            (*it)->opts.on_exit = NULL;
+            (*it)->owner        = NULL;
+        }
     }
+}
 
-    return status;
+void yed_subprocs_forget_buffer(yed_buffer *buff) {
+    yed_subproc **it;
+
+    array_traverse(ys->subprocs, it) {
+        if ((*it)->opts.out_buffer == buff) {
+            (*it)->opts.out_buffer = NULL;
+            (*it)->n_partial       = 0;
+        }
+        if ((*it)->opts.in_buffer == buff) {
+            (*it)->opts.in_buffer = NULL;
+        }
+    }
 }
@@ -36,18 +36,18 @@ int yed_write_buffer_to_subproc(yed_buffer *buff, char *cmd, int *exit_status, c
 
 
 typedef struct {
-    pid_t       pid;
-    int         fd;
-    yed_buffer *buffer;
-    int         exit_status;
-    int         err;
+    pid_t                 pid;
+    yed_buffer           *buffer;
+    int                   exit_status;
+    int                   err;
+    struct yed_subproc_t *sp;
 } yed_nb_subproc_t;
 
 /*
 ** The return values of this function is as follows:
 **
 ** 0 indicates success.
-** In the case that pipe, fork, or fcntl fail, the value
+** In the case that pipe or posix_spawn fail, the value
 **   returned will be the value of errno at the time of failure.
 */
 int yed_start_read_subproc_into_buffer_nb(char *cmd, yed_buffer *buff, yed_nb_subproc_t *nb_subproc);
@@ -66,4 +66,71 @@ int yed_start_read_subproc_into_buffer_nb(char *cmd, yed_buffer *buff, yed_nb_su
 */
 int yed_read_subproc_into_buffer_nb(yed_nb_subproc_t *nb_subproc);
 
+
+/*
+** Subprocesses that run alongside the editor.
+**
+** yed_start_subproc() runs cmd with /bin/sh in its own process group and
+** returns right away. Output is read in large chunks as it arrives, from
+** the main loop. If out_buffer is set, it is cleared and the output is
+** appended to it line by line (see yed_buff_append_output()). Then on_data
+** gets the raw bytes. If in_buffer is set, its contents are written to the
+** child's stdin as the child reads them. Otherwise stdin is /dev/null.
+**
+** on_exit is called on the main thread once the child has exited and all
+** of its output has been read. exit_status is -1 if the child didn't exit
+** normally. The handle is freed when on_exit returns.
+**
+** yed_kill_subproc() sends SIGTERM to the process group. No more output is
+** delivered after that, but on_exit is still called.
+**
+** Plugins should use yed_plugin_start_subproc() (see plugin.h), so that
+** their subprocesses are killed and forgotten when they are unloaded.
+*/
+
+#define SUBPROC_READ_SIZE         (64 * 1024)
+#define SUBPROC_MAX_READ_PER_PUMP (1024 * 1024)
+
+struct yed_subproc_t;
+
+typedef void (*yed_subproc_data_fn)(struct yed_subproc_t *sp, const char *data, int len, void *arg);
+typedef void (*yed_subproc_exit_fn)(struct yed_subproc_t *sp, int exit_status, void *arg);
+
+typedef struct yed_subproc_opts_t {
+    yed_buffer          *out_buffer;
+    yed_buffer          *in_buffer;
+    int                  merge_stderr;
+    yed_subproc_data_fn  on_data;
+    yed_subproc_exit_fn  on_exit;
+    void                *arg;
+} yed_subproc_opts;
+
+typedef struct yed_subproc_t {
+    pid_t             pid;
+    int               out_fd;
+    int               in_fd;
+    array_t           in_data;
+    int               in_pos;
+    char              partial[4];
+    int               n_partial;
+    int               exited;
+    int               exit_status;
+    int               err;
+    int               killed;
+    int               done;
+    int               keep;
+    void             *owner;
+    yed_subproc_opts  opts;
+} yed_subproc;
+
+/* Returns NULL and sets errno if the subprocess couldn't be started. */
+yed_subproc * yed_start_subproc(char *cmd, yed_subproc_opts *opts);
+void          yed_kill_subproc(yed_subproc *sp);
+
+void yed_init_subprocs(void);
+yed_subproc * yed_start_owned_subproc(void *owner, char *cmd, yed_subproc_opts *opts);
+void yed_service_subprocs(void);
+void yed_kill_subprocs_for_owner(void *owner);
+void yed_subprocs_forget_buffer(yed_buffer *buff);
+
 #endif
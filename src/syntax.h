@@ -18,6 +18,8 @@
  *
  * Matching of regular expressions on a single line
  *     Submatches can be specified.
+ *     Each pattern needs certain bytes to be in the line before it can match. One pass over the line rules out
+ *     the patterns that can't, so that most of them never get run through regexec() on most lines.
  *
  * Single/multi-line ranges defined by start/end regular expressions.
  *     Can include regular expression ranges to skip (e.g. skip \" in a string literal).
@@ -29,6 +31,8 @@
  *     Always keeps the most recently drawn line in cache so that scrolling and full frame redraws are very quick.
  *     Must parse whole buffer at least once so that the cache can always be correct (if highlighting is to be correct
  *     100% of the time, this is an unfortunate necessity). :(
+ *     For large buffers, that happens on the job pool, in parallel chunks, from a copy of the buffer. Until it's
+ *     done, rows are highlighted from a best guess of their state and redrawn once the real one is known.
  *
  * A declarative interface for defining syntax.
  *
@@ -104,6 +108,9 @@
 
 #define YED_SYN_CACHE_SIZE         (8192)
 #define YED_SYN_N_EVICTION_BUCKETS (4096)
+#define YED_SYN_BACKGROUND_ROWS    (5000)
+#define YED_SYN_MIN_CHUNK_ROWS     (16384)
+#define YED_SYN_GUESS_ROWS         (128)
 
 #ifdef YED_DEBUG
 
@@ -128,10 +135,20 @@ typedef struct {
 typedef struct {
     _yed_syntax_attr *attr;
     char             *kwd;
+    u32               len;
+    u32               hash;
 } _yed_syntax_kwd;
 
 typedef struct {
-    array_t kwds_by_len;
+    u32 hash;
+    u32 idx;   /* 1 + index into kwds, 0 if the slot is empty. */
+} _yed_syntax_kwd_slot;
+
+typedef struct {
+    array_t               kwds;
+    _yed_syntax_kwd_slot *slots;
+    u32                   mask;
+    u32                   max_len;
 } _yed_syntax_kwd_set;
 
 use_tree(char, _yed_syntax_kwd_set);
@@ -145,6 +162,9 @@ typedef struct {
     _yed_syntax_attr *attr;
     regex_t           reg;
     int               group;
+    char             *pattern;
+    u64               bit;
+    int               bol;
 } _yed_syntax_regex;
 
 typedef struct {
@@ -154,6 +174,13 @@ typedef struct {
     array_t            skips;
     int                one_line;
     _yed_syntax_items  items;
+    char              *start_pattern;
+    char              *end_pattern;
+    array_t            skip_patterns;
+    u64                start_bit;
+    int                start_bol;
+    u64                end_bit;
+    int                end_bol;
 } _yed_syntax_range;
 
 typedef struct {
@@ -161,9 +188,16 @@ typedef struct {
     u32 range_idx;
 } _yed_syntax_cache_entry;
 
+struct _yed_syntax_build_t;
+
 typedef struct {
-    array_t entries;
-    u32     size;
+    array_t                     entries;
+    u32                         size;
+    int                         ready;
+    struct _yed_syntax_build_t *build;           /* If it's being built in the background. */
+    u32                         guess_anchor;    /* The last best-effort state we worked out. */
+    u32                         guess_row;
+    u32                         guess_range_idx;
 } _yed_syntax_cache;
 
 typedef yed_buffer *_yed_syntax_bp;
@@ -185,87 +219,165 @@ typedef struct {
     int                max_group;
     regmatch_t        *matches;
     CACHE_TREE         caches;
+    array_t            builds;
     int                needs_state;
     int                finalized;
+    u64                byte_items[256];
+    int                n_prefilter_items;
+    u64               *line_items;
+    int                line_items_cap;
+    const char        *line_base;
 } yed_syntax;
 
+typedef struct _yed_syntax_build_t {
+    yed_syntax         *syntax;
+    yed_buffer         *buffer;     /* Main thread only. NULL if the cache went away. */
+    yed_job            *job;
+    unsigned long long  version;
+    char               *text;       /* A copy of the buffer, each row NUL terminated. */
+    array_t             offsets;    /* u64, where each row starts in text, plus one past the end. */
+    u32                 n_lines;
+    u32                 bump;
+    int                 n_chunks;
+    array_t             entries;    /* The result. */
+    u64                 start_ms;
+    u64                 parse_ms;
+} _yed_syntax_build;
+
+typedef struct {
+    _yed_syntax_build *build;
+    yed_job           *job;
+    yed_syntax         parser;
+    u32                first_row;
+    u32                end_row;
+    array_t            entries;
+    u32                end_range_idx;
+    int                cancelled;
+} _yed_syntax_chunk;
+
 
 /************************************************************************************/
 /*                                 Data management                                  */
 /************************************************************************************/
 
+/*
+ * Keywords are only collected until the syntax is finished. Then they're put
+ * into an open-addressed hash table, so that a lookup costs the same however
+ * many keywords there are (the ctags plugin adds every tag in the project).
+ */
+
 static inline void _yed_syntax_make_kwd_set(_yed_syntax_kwd_set *set) {
-    set->kwds_by_len = array_make(array_t);
+    memset(set, 0, sizeof(*set));
+
+    set->kwds = array_make(_yed_syntax_kwd);
 }
 
 static inline void _yed_syntax_free_kwd_set(_yed_syntax_kwd_set *set) {
-    array_t         *kwd_list_it;
     _yed_syntax_kwd *kwd_it;
 
-    array_traverse(set->kwds_by_len, kwd_list_it) {
-        array_traverse(*kwd_list_it, kwd_it) {
-            free(kwd_it->kwd);
-        }
-        array_free(*kwd_list_it);
+    array_traverse(set->kwds, kwd_it) {
+        free(kwd_it->kwd);
     }
-    array_free(set->kwds_by_len);
+    array_free(set->kwds);
+
+    if (set->slots != NULL) { free(set->slots); }
 }
 
-static inline void _yed_syntax_kwd_set_ensure_list_for_len(_yed_syntax_kwd_set *set, int len) {
-    array_t a;
+static inline u32 _yed_syntax_kwd_hash(const char *kwd, int len) {
+    u32 hash;
+    int i;
 
-    while (array_len(set->kwds_by_len) < len) {
-        a = array_make(_yed_syntax_kwd);
-        array_push(set->kwds_by_len, a);
+    hash = 2166136261u;
+    for (i = 0; i < len; i += 1) {
+        hash = (hash ^ (unsigned char)kwd[i]) * 16777619u;
     }
-}
 
-static inline _yed_syntax_kwd * _yed_syntax_kwd_set_add(_yed_syntax_kwd_set *set, const char *kwd) {
-    int              len;
-    array_t         *kwd_list;
-    _yed_syntax_kwd *it, k;
-    int              idx, cmp;
+    return hash;
+}
 
-    if (!kwd) { return NULL; }
+static inline void _yed_syntax_kwd_set_build(_yed_syntax_kwd_set *set) {
+    u32              size;
+    _yed_syntax_kwd *it;
+    u32              idx;
+    u32              i;
+    _yed_syntax_kwd *other;
 
-    len = strlen(kwd);
+    if (set->slots != NULL) { free(set->slots); }
 
-    if (len == 0) { return NULL; }
+    size = 16;
+    while (size < 2 * array_len(set->kwds)) { size <<= 1; }
 
-    _yed_syntax_kwd_set_ensure_list_for_len(set, len);
-    kwd_list = array_item(set->kwds_by_len, len - 1);
+    set->slots   = calloc(size, sizeof(*set->slots));
+    set->mask    = size - 1;
+    set->max_len = 0;
 
     idx = 0;
-    array_traverse(*kwd_list, it) {
-        cmp = strcmp(kwd, it->kwd);
+    array_traverse(set->kwds, it) {
+        idx += 1;
 
-        if      (cmp == 0) { return NULL; }
-        else if (cmp < 0)  { break;       }
+        for (i = it->hash & set->mask; set->slots[i].idx != 0; i = (i + 1) & set->mask) {
+            other = array_item(set->kwds, set->slots[i].idx - 1);
 
-        idx += 1;
+            /* The first one added wins. */
+            if (other->hash == it->hash
+            &&  other->len  == it->len
+            &&  memcmp(other->kwd, it->kwd, it->len) == 0) {
+                goto next;
+            }
+        }
+
+        set->slots[i].hash = it->hash;
+        set->slots[i].idx  = idx;
+
+        set->max_len = MAX(set->max_len, it->len);
+next:;
     }
+}
 
-    k.kwd = strdup(kwd);
+static inline _yed_syntax_kwd * _yed_syntax_kwd_set_add(_yed_syntax_kwd_set *set, const char *kwd) {
+    _yed_syntax_kwd k;
+
+    if (!kwd || !kwd[0]) { return NULL; }
 
-    return array_insert(*kwd_list, idx, k);
+    k.attr = NULL;
+    k.kwd  = strdup(kwd);
+    k.len  = strlen(kwd);
+    k.hash = _yed_syntax_kwd_hash(kwd, k.len);
+
+    /* Added after the syntax was finished. Build the table again when it's needed. */
+    if (set->slots != NULL) {
+        free(set->slots);
+        set->slots = NULL;
+    }
+
+    return array_push(set->kwds, k);
 }
 
 static inline _yed_syntax_kwd * _yed_syntax_kwd_set_lookup(_yed_syntax_kwd_set *set, const char *kwd, int len) {
-    array_t         *kwd_list;
+    u32              hash;
+    u32              i;
     _yed_syntax_kwd *it;
 
-    if (!len || len > array_len(set->kwds_by_len)) {
+    if (!len || array_len(set->kwds) == 0) {
         return NULL;
     }
 
-    kwd_list = array_item(set->kwds_by_len, len - 1);
+    if (set->slots == NULL) {
+        _yed_syntax_kwd_set_build(set);
+    }
 
-    array_traverse(*kwd_list, it) {
-        if (it->kwd[0] > kwd[0]) {
-            continue;
-        }
+    if ((u32)len > set->max_len) {
+        return NULL;
+    }
+
+    hash = _yed_syntax_kwd_hash(kwd, len);
+
+    for (i = hash & set->mask; set->slots[i].idx != 0; i = (i + 1) & set->mask) {
+        if (set->slots[i].hash != hash) { continue; }
+
+        it = array_item(set->kwds, set->slots[i].idx - 1);
 
-        if (strncmp(it->kwd, kwd, len) == 0) {
+        if (it->len == (u32)len && memcmp(it->kwd, kwd, len) == 0) {
             return it;
         }
     }
@@ -316,6 +428,7 @@ static inline void _yed_syntax_free_items(_yed_syntax_items *items);
 
 static inline void _yed_syntax_free_regex(_yed_syntax_regex *regex) {
     regfree(&regex->reg);
+    free(regex->pattern);
 }
 
 static inline void _yed_syntax_make_empty_items(_yed_syntax_items *items) {
@@ -339,17 +452,27 @@ static inline void _yed_syntax_make_range(_yed_syntax_range *range) {
     memset(range, 0, sizeof(*range));
 
     _yed_syntax_make_empty_items(&range->items);
-    range->skips = array_make(regex_t);
+    range->skips         = array_make(regex_t);
+    range->skip_patterns = array_make(char*);
 }
 
 static inline void _yed_syntax_free_range(_yed_syntax_range *range) {
-    regex_t *sit;
+    regex_t  *sit;
+    char    **pit;
 
     array_traverse(range->skips, sit) {
         regfree(sit);
     }
     array_free(range->skips);
 
+    array_traverse(range->skip_patterns, pit) {
+        free(*pit);
+    }
+    array_free(range->skip_patterns);
+
+    if (range->start_pattern != NULL) { free(range->start_pattern); }
+    if (range->end_pattern   != NULL) { free(range->end_pattern);   }
+
     regfree(&range->end);
     regfree(&range->start);
 
@@ -359,6 +482,8 @@ static inline void _yed_syntax_free_range(_yed_syntax_range *range) {
 }
 
 static inline void _yed_syntax_make_cache(_yed_syntax_cache *cache, u32 size) {
+    memset(cache, 0, sizeof(*cache));
+
     cache->entries = array_make_with_cap(_yed_syntax_cache_entry, size);
     cache->size    = size;
 }
@@ -393,21 +518,450 @@ static inline int _yed_syntax_get_range_idx(yed_syntax *syntax, _yed_syntax_rang
 
 
 
+/************************************************************************************/
+/*                                    Prefilter                                     */
+/************************************************************************************/
+
+/*
+ * Most regexes can't match a line unless some particular bytes are in it
+ * (e.g. "\\\\." needs a '\\' and a function call regex needs a '('). When the
+ * syntax is finished, each pattern is looked at to find a set of bytes that
+ * every match has to contain at least one of. Those sets are merged into one
+ * table that maps each byte to the patterns that it could be a part of.
+ *
+ * Before a line is parsed, one pass over it works out which patterns could
+ * match somewhere in each suffix of it. Patterns that can't are never
+ * handed to regexec(). Since this only ever rules out patterns that would
+ * not have matched anyway, the results are exactly the same as before.
+ *
+ * Patterns that can match without any particular byte (e.g. "$"), that use
+ * something this doesn't understand, or that don't fit in the table aren't
+ * filtered.
+ */
+
+typedef struct {
+    int any; /* Could match without any particular byte. */
+    u64 bytes[4];
+} _yed_syntax_req;
+
+typedef struct {
+    const char *s;
+    int         bad;
+    int         depth;
+    int         top_level_alt;
+} _yed_syntax_re_parser;
+
+static inline void _yed_syntax_req_add(_yed_syntax_req *req, int c) {
+    req->bytes[(c & 0xFF) >> 6] |= 1ULL << (c & 63);
+}
+
+static inline int _yed_syntax_req_has(_yed_syntax_req *req, int c) {
+    return !!(req->bytes[(c & 0xFF) >> 6] & (1ULL << (c & 63)));
+}
+
+static inline int _yed_syntax_req_count(_yed_syntax_req *req) {
+    return __builtin_popcountll(req->bytes[0])
+         + __builtin_popcountll(req->bytes[1])
+         + __builtin_popcountll(req->bytes[2])
+         + __builtin_popcountll(req->bytes[3]);
+}
+
+static inline void _yed_syntax_req_all(_yed_syntax_req *req) {
+    memset(req, 0, sizeof(*req));
+    memset(req->bytes, 0xFF, sizeof(req->bytes));
+}
+
+static inline void _yed_syntax_req_any(_yed_syntax_req *req) {
+    memset(req, 0, sizeof(*req));
+    req->any = 1;
+}
+
+static inline int _yed_syntax_re_class(_yed_syntax_req *req, const char *name, int len) {
+    int c;
+    int in;
+
+#define CLASS_IS(s) (len == sizeof(s) - 1 && strncmp(name, s, len) == 0)
+
+    for (c = 1; c < 128; c += 1) {
+        if      (CLASS_IS("alpha"))  { in = isalpha(c);                }
+        else if (CLASS_IS("digit"))  { in = isdigit(c);                }
+        else if (CLASS_IS("alnum"))  { in = isalnum(c);                }
+        else if (CLASS_IS("upper"))  { in = isupper(c);                }
+        else if (CLASS_IS("lower"))  { in = islower(c);                }
+        else if (CLASS_IS("space"))  { in = isspace(c);                }
+        else if (CLASS_IS("blank"))  { in = c == ' ' || c == '\t';     }
+        else if (CLASS_IS("punct"))  { in = ispunct(c);                }
+        else if (CLASS_IS("print"))  { in = isprint(c);                }
+        else if (CLASS_IS("graph"))  { in = isgraph(c);                }
+        else if (CLASS_IS("cntrl"))  { in = iscntrl(c);                }
+        else if (CLASS_IS("xdigit")) { in = isxdigit(c);               }
+        else                         { return 0;                       }
+
+        if (in) { _yed_syntax_req_add(req, c); }
+    }
+
+#undef CLASS_IS
+
+    /* Multibyte characters could be in any class, depending on the locale. */
+    for (c = 128; c < 256; c += 1) {
+        _yed_syntax_req_add(req, c);
+    }
+
+    return 1;
+}
+
+static inline void _yed_syntax_re_bracket(_yed_syntax_re_parser *p, _yed_syntax_req *req) {
+    const char      *s;
+    int              negate;
+    int              first;
+    const char      *name;
+    int              lo;
+    int              hi;
+    int              c;
+    _yed_syntax_req  set;
+
+    s = p->s;
+
+    /* The BSD word boundaries. */
+    if (strncmp(s, "[:<:]]", 6) == 0 || strncmp(s, "[:>:]]", 6) == 0) {
+        p->s = s + 6;
+        _yed_syntax_req_any(req);
+        return;
+    }
+
+    memset(&set, 0, sizeof(set));
+
+    negate = 0;
+    if (*s == '^') {
+        negate  = 1;
+        s      += 1;
+    }
+
+    first = 1;
+    while (*s && (first || *s != ']')) {
+        first = 0;
+
+        if (s[0] == '[' && s[1] == ':') {
+            name = s + 2;
+            s    = strstr(name, ":]");
+            if (s == NULL || !_yed_syntax_re_class(&set, name, s - name)) { goto bad; }
+            s += 2;
+            continue;
+        }
+
+        if (s[0] == '[' && (s[1] == '=' || s[1] == '.')) { goto bad; }
+
+        lo = (unsigned char)s[0];
+        s += 1;
+
+        if (s[0] == '-' && s[1] != ']' && s[1] != 0) {
+            hi  = (unsigned char)s[1];
+            s  += 2;
+            /* Outside of ASCII, ranges depend on the locale. */
+            if (lo >= 128 || hi >= 128 || hi < lo) { goto bad; }
+        } else {
+            hi = lo;
+        }
+
+        for (c = lo; c <= hi; c += 1) {
+            _yed_syntax_req_add(&set, c);
+        }
+    }
+
+    if (*s != ']') { goto bad; }
+    p->s = s + 1;
+
+    memset(req, 0, sizeof(*req));
+
+    for (c = 1; c < 256; c += 1) {
+        if (_yed_syntax_req_has(&set, c) != negate || (negate && c >= 128)) {
+            _yed_syntax_req_add(req, c);
+        }
+    }
+
+    return;
+
+bad:;
+    p->bad = 1;
+}
+
+static inline void _yed_syntax_re_alt(_yed_syntax_re_parser *p, _yed_syntax_req *req);
+
+static inline void _yed_syntax_re_atom(_yed_syntax_re_parser *p, _yed_syntax_req *req) {
+    int c;
+
+    memset(req, 0, sizeof(*req));
+
+    c     = (unsigned char)*p->s;
+    p->s += 1;
+
+    switch (c) {
+        case '(':
+            p->depth += 1;
+            _yed_syntax_re_alt(p, req);
+            p->depth -= 1;
+            if (*p->s != ')') { p->bad = 1; }
+            else              { p->s += 1;  }
+            break;
+
+        case '[':
+            _yed_syntax_re_bracket(p, req);
+            break;
+
+        case '^':
+        case '$':
+            _yed_syntax_req_any(req);
+            break;
+
+        case '.':
+            _yed_syntax_req_all(req);
+            break;
+
+        case '\\':
+            c     = (unsigned char)*p->s;
+            p->s += 1;
+
+            switch (c) {
+                case 0:
+                    p->bad = 1;
+                    p->s  -= 1;
+                    break;
+                case 'b': case 'B': case '<': case '>': case '`': case '\'':
+                    _yed_syntax_req_any(req);
+                    break;
+                case 'w': case 'W': case 's': case 'S':
+                    _yed_syntax_req_all(req);
+                    break;
+                default:
+                    if (c >= '1' && c <= '9') {
+                        /* Back-references can be empty. */
+                        _yed_syntax_req_any(req);
+                    } else {
+                        _yed_syntax_req_add(req, c);
+                    }
+            }
+            break;
+
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+        case ')':
+        case '|':
+        case 0:
+            p->bad = 1;
+            p->s  -= 1;
+            break;
+
+        default:
+            _yed_syntax_req_add(req, c);
+    }
+}
+
+static inline void _yed_syntax_re_piece(_yed_syntax_re_parser *p, _yed_syntax_req *req) {
+    const char *s;
+    int         min;
+
+    _yed_syntax_re_atom(p, req);
+
+    while (!p->bad) {
+        switch (*p->s) {
+            case '*':
+            case '?':
+                p->s += 1;
+                _yed_syntax_req_any(req);
+                break;
+
+            case '+':
+                p->s += 1;
+                break;
+
+            case '{':
+                s = p->s + 1;
+                if (!isdigit((unsigned char)*s)) { p->bad = 1; break; }
+                min = 0;
+                while (isdigit((unsigned char)*s)) { min = 10 * min + (*s - '0'); s += 1; }
+                if (*s == ',') {
+                    s += 1;
+                    while (isdigit((unsigned char)*s)) { s += 1; }
+                }
+                if (*s != '}') { p->bad = 1; break; }
+                p->s = s + 1;
+                if (min == 0) { _yed_syntax_req_any(req); }
+                break;
+
+            default:
+                return;
+        }
+    }
+}
+
+static inline void _yed_syntax_re_concat(_yed_syntax_re_parser *p, _yed_syntax_req *req) {
+    _yed_syntax_req piece;
+
+    _yed_syntax_req_any(req);
+
+    /* Any piece that has to match will do, so pick the one with the fewest bytes. */
+    while (!p->bad && *p->s && *p->s != '|' && *p->s != ')') {
+        _yed_syntax_re_piece(p, &piece);
+
+        if (!piece.any
+        &&  (req->any || _yed_syntax_req_count(&piece) < _yed_syntax_req_count(req))) {
+            *req = piece;
+        }
+    }
+}
+
+static inline void _yed_syntax_re_alt(_yed_syntax_re_parser *p, _yed_syntax_req *req) {
+    _yed_syntax_req branch;
+    int             i;
+
+    _yed_syntax_re_concat(p, req);
+
+    while (!p->bad && *p->s == '|') {
+        if (p->depth == 0) { p->top_level_alt = 1; }
+
+        p->s += 1;
+        _yed_syntax_re_concat(p, &branch);
+
+        req->any |= branch.any;
+        for (i = 0; i < 4; i += 1) {
+            req->bytes[i] |= branch.bytes[i];
+        }
+    }
+}
+
+/*
+ * Fills *req with the bytes that every match of the (extended) pattern has
+ * one of. Sets *bol if it can only match at the start of the string.
+ */
+static inline void _yed_syntax_analyze_pattern(const char *pattern, _yed_syntax_req *req, int *bol) {
+    _yed_syntax_re_parser p;
+
+    memset(&p, 0, sizeof(p));
+    p.s = pattern;
+
+    _yed_syntax_re_alt(&p, req);
+
+    if (p.bad || *p.s != 0) {
+        _yed_syntax_req_any(req);
+        *bol = 0;
+        return;
+    }
+
+    if (_yed_syntax_req_count(req) == 0) { req->any = 1; }
+
+    *bol = pattern[0] == '^' && !p.top_level_alt;
+}
+
+/*
+ * Returns the pattern's bit in syntax->byte_items, or 0 if it isn't filtered.
+ * Sets *bol if it can only match at the start of the string.
+ */
+static inline u64 _yed_syntax_add_prefilter(yed_syntax *syntax, const char *pattern, int *bol) {
+    _yed_syntax_req req;
+    u64             bit;
+    int             c;
+
+    *bol = 0;
+
+    if (pattern == NULL) { return 0; }
+
+    _yed_syntax_analyze_pattern(pattern, &req, bol);
+
+    if (req.any || syntax->n_prefilter_items == 64) { return 0; }
+
+    bit                        = 1ULL << syntax->n_prefilter_items;
+    syntax->n_prefilter_items += 1;
+
+    for (c = 0; c < 256; c += 1) {
+        if (_yed_syntax_req_has(&req, c)) {
+            syntax->byte_items[c] |= bit;
+        }
+    }
+
+    return bit;
+}
+
+static inline void _yed_syntax_compile_prefilter(yed_syntax *syntax) {
+    _yed_syntax_range **rit;
+    _yed_syntax_range  *r;
+    _yed_syntax_regex  *regit;
+
+    array_traverse(syntax->ranges, rit) {
+        r = *rit;
+
+        r->start_bit = _yed_syntax_add_prefilter(syntax, r->start_pattern, &r->start_bol);
+        r->end_bit   = _yed_syntax_add_prefilter(syntax, r->end_pattern,   &r->end_bol);
+
+        array_traverse(r->items.regs, regit) {
+            regit->bit = _yed_syntax_add_prefilter(syntax, regit->pattern, &regit->bol);
+        }
+    }
+}
+
+/* Works out which patterns could match in each suffix of the (NUL terminated) line. */
+static inline void _yed_syntax_prepare_line(yed_syntax *syntax, const char *line_start, int line_len) {
+    u64 acc;
+    int i;
+
+    if (line_len + 1 > syntax->line_items_cap) {
+        syntax->line_items_cap = MAX(line_len + 1, 2 * syntax->line_items_cap);
+        syntax->line_items     = realloc(syntax->line_items, sizeof(u64) * syntax->line_items_cap);
+    }
+
+    syntax->line_base = line_start;
+
+    acc = 0;
+    syntax->line_items[line_len] = 0;
+    for (i = line_len - 1; i >= 0; i -= 1) {
+        acc                   |= syntax->byte_items[(unsigned char)line_start[i]];
+        syntax->line_items[i]  = acc;
+    }
+}
+
+/* Could the pattern match anywhere from start on? */
+static inline int _yed_syntax_may_match(yed_syntax *syntax, u64 bit, int bol, const char *start) {
+    if (bol && start != syntax->line_base) { return 0; }
+
+    return bit == 0 || (syntax->line_items[start - syntax->line_base] & bit);
+}
+
+
+
 /************************************************************************************/
 /*                                      cache                                       */
 /************************************************************************************/
 
-static inline void _yed_syntax_build_cache(yed_syntax *syntax, yed_buffer *buffer);
-static inline _yed_syntax_range *_yed_syntax_get_line_end_state(yed_syntax *syntax, yed_buffer *buffer, yed_line *line, _yed_syntax_range *start_range);
+static inline void _yed_syntax_build_cache(yed_syntax *syntax, yed_buffer *buffer, _yed_syntax_cache *cache);
+static inline _yed_syntax_range *_yed_syntax_get_line_end_state(yed_syntax *syntax, const char *line_start, int line_len, _yed_syntax_range *start_range);
+static inline void _yed_syntax_cache_rebuild(yed_syntax *syntax, _yed_syntax_cache *cache, yed_buffer *buffer, int row, int mod_event, yed_buffer_change *change);
+
+static inline _yed_syntax_range *_yed_syntax_get_buff_line_end_state(yed_syntax *syntax, yed_line *line, _yed_syntax_range *start_range) {
+    array_zero_term(line->chars);
+    return _yed_syntax_get_line_end_state(syntax, array_data(line->chars), array_len(line->chars), start_range);
+}
 
+/*
+ * Returns the buffer's cache, starting to build it if that hasn't happened
+ * yet. It might not be ready, in which case it has no entries.
+ */
 static inline _yed_syntax_cache *_yed_syntax_get_cache(yed_syntax *syntax, yed_buffer *buffer) {
-    CACHE_IT it;
+    CACHE_IT          it;
+    _yed_syntax_cache new_cache;
 
     it = tree_lookup(syntax->caches, buffer);
 
     if (!tree_it_good(it)) {
-        _yed_syntax_build_cache(syntax, buffer);
-        it = tree_lookup(syntax->caches, buffer);
+        _yed_syntax_make_cache(&new_cache, YED_SYN_CACHE_SIZE);
+        it = tree_insert(syntax->caches, buffer, new_cache);
+    }
+
+    /* Wait until a lazily loaded buffer is all there before building. */
+    if (!tree_it_val(it).ready
+    &&  tree_it_val(it).build == NULL
+    &&  !yed_buff_is_loading(buffer)) {
+        _yed_syntax_build_cache(syntax, buffer, &tree_it_val(it));
     }
 
     return &tree_it_val(it);
@@ -421,6 +975,10 @@ static inline void _yed_syntax_remove_cache(yed_syntax *syntax, yed_buffer *buff
     it = tree_lookup(syntax->caches, buffer);
 
     if (tree_it_good(it)) {
+        if (tree_it_val(it).build != NULL) {
+            tree_it_val(it).build->buffer = NULL;
+            yed_cancel_job(tree_it_val(it).build->job);
+        }
         _yed_syntax_free_cache(&tree_it_val(it));
         tree_delete(syntax->caches, buffer);
     }
@@ -624,40 +1182,35 @@ static inline _yed_syntax_cache_entry *_yed_syntax_add_to_cache(yed_syntax *synt
     return array_insert(cache->entries, idx, new_entry);
 }
 
-static inline void _yed_syntax_build_cache(yed_syntax *syntax, yed_buffer *buffer) {
-    u64                start;
+/*
+ * When the cache is built from scratch, it gets the state of every bump'th
+ * row, spaced out so that they all fit.
+ */
+static inline u32 _yed_syntax_cache_bump(_yed_syntax_cache *cache, u32 n_lines) {
+    return n_lines < cache->size
+            ? 1
+            : MAX((n_lines + cache->size - 1) / cache->size, 2);
+}
+
+static inline int _yed_syntax_cache_samples_row(u32 bump, u32 row) {
+    return row > bump && (row - 1) % bump == 0;
+}
 
-    CACHE_IT           it;
-    _yed_syntax_cache  new_cache;
-    _yed_syntax_cache *cache;
+static inline void _yed_syntax_build_cache_now(yed_syntax *syntax, yed_buffer *buffer, _yed_syntax_cache *cache) {
+    u64                start;
     u32                n_lines;
     u32                bump;
-    u32                lim;
     _yed_syntax_range *range;
-    int                row;
+    u32                row;
     yed_line          *line;
     _yed_syntax_range *new_range;
 
-    if (!syntax->finalized || !syntax->needs_state) { return; }
-
     start = measure_time_now_ms();
 
-    it = tree_lookup(syntax->caches, buffer);
-
-    if (!tree_it_good(it)) {
-        _yed_syntax_make_cache(&new_cache, YED_SYN_CACHE_SIZE);
-        it = tree_insert(syntax->caches, buffer, new_cache);
-    }
-
-    cache = &tree_it_val(it);
-
     array_clear(cache->entries);
 
     n_lines = yed_buff_n_lines(buffer);
-    bump    = n_lines < cache->size
-                ? 1
-                : MAX(n_lines / cache->size, 2);
-    lim     = 1 + bump;
+    bump    = _yed_syntax_cache_bump(cache, n_lines);
     range   = syntax->global;
     row     = 1;
 
@@ -665,22 +1218,378 @@ static inline void _yed_syntax_build_cache(yed_syntax *syntax, yed_buffer *buffe
         if (row == n_lines) { break; }
 
         if (line->visual_width > 0) {
-            array_zero_term(line->chars);
-            new_range = _yed_syntax_get_line_end_state(syntax, buffer, line, range);
+            new_range = _yed_syntax_get_buff_line_end_state(syntax, line, range);
             if (!new_range->one_line) { range = new_range; }
         }
 
-        if (row == lim) {
+        if (_yed_syntax_cache_samples_row(bump, row)) {
             _yed_syntax_add_to_cache(syntax, cache, row + 1, range);
-            lim += bump;
         }
 
         row += 1;
     }
 
+    cache->ready = 1;
+
     DBG("cache: %llu ms", measure_time_now_ms() - start);
 }
 
+/*
+ * Building in the background.
+ *
+ * Large buffers are parsed on the job pool from a copy of their lines, so
+ * that they can be edited in the meantime. Once the result is in, whatever
+ * happened since the copy was made is caught up with yed_buff_changes_since().
+ *
+ * The rows are split into a chunk per worker. Only the first chunk knows its
+ * start state for sure. The others guess that it's the global state (which
+ * it usually is) and are parsed at the same time. Then the chunks are put
+ * together in order, and a chunk that guessed wrong is parsed again from the
+ * state the chunk before it ended in, but only until a sampled state agrees
+ * with the first pass. Everything from there on is the same.
+ */
+
+/*
+ * glibc serializes regexec() calls on the same regex_t, so each chunk gets
+ * its own copy of the range regexes. Only what _yed_syntax_get_line_end_state()
+ * needs is filled in.
+ */
+static inline void _yed_syntax_make_parser(yed_syntax *syntax, yed_syntax *parser) {
+    _yed_syntax_range **rit;
+    _yed_syntax_range  *r;
+    char              **pit;
+    regex_t             reg;
+
+    memset(parser, 0, sizeof(*parser));
+
+    parser->ranges    = array_make(_yed_syntax_range*);
+    parser->max_group = syntax->max_group;
+    parser->matches   = malloc(sizeof(*parser->matches) * (syntax->max_group + 1));
+    parser->finalized = 1;
+
+    memcpy(parser->byte_items, syntax->byte_items, sizeof(parser->byte_items));
+
+    array_traverse(syntax->ranges, rit) {
+        r = malloc(sizeof(*r));
+        _yed_syntax_make_range(r);
+
+        r->one_line  = (*rit)->one_line;
+        r->start_bit = (*rit)->start_bit;
+        r->start_bol = (*rit)->start_bol;
+        r->end_bit   = (*rit)->end_bit;
+        r->end_bol   = (*rit)->end_bol;
+
+        if ((*rit)->start_pattern != NULL) { regcomp(&r->start, (*rit)->start_pattern, REG_EXTENDED); }
+        if ((*rit)->end_pattern   != NULL) { regcomp(&r->end,   (*rit)->end_pattern,   REG_EXTENDED); }
+
+        array_traverse((*rit)->skip_patterns, pit) {
+            regcomp(&reg, *pit, REG_EXTENDED);
+            array_push(r->skips, reg);
+        }
+
+        array_push(parser->ranges, r);
+    }
+
+    parser->global = *(_yed_syntax_range**)array_item(parser->ranges, 0);
+}
+
+static inline void _yed_syntax_free_parser(yed_syntax *parser) {
+    _yed_syntax_range **rit;
+
+    array_traverse(parser->ranges, rit) {
+        _yed_syntax_free_range(*rit);
+    }
+    array_free(parser->ranges);
+
+    free(parser->matches);
+
+    if (parser->line_items != NULL) { free(parser->line_items); }
+}
+
+/*
+ * Parses rows [first, end) of the build's copy of the buffer starting in
+ * *range and adds an entry for each row that the cache samples. If spec has
+ * the entries from a first pass over the same rows, stops at the first one
+ * that agrees. Returns the index of that entry (array_len(*spec) if none did),
+ * or -1 if the job was cancelled.
+ */
+static inline int _yed_syntax_parse_build_rows(yed_syntax *parser, _yed_syntax_build *build, yed_job *job, u32 first, u32 end, _yed_syntax_range **range, array_t *entries, array_t *spec) {
+    u64                     *offsets;
+    int                      spec_idx;
+    u32                      row;
+    int                      len;
+    _yed_syntax_range       *new_range;
+    _yed_syntax_cache_entry  entry;
+    _yed_syntax_cache_entry *spec_entry;
+
+    offsets  = array_data(build->offsets);
+    spec_idx = 0;
+
+    for (row = first; row < end; row += 1) {
+        if ((row & 4095) == 0 && yed_job_is_cancelled(job)) { return -1; }
+
+        len = offsets[row] - offsets[row - 1] - 1;
+
+        if (len > 0) {
+            new_range = _yed_syntax_get_line_end_state(parser, build->text + offsets[row - 1], len, *range);
+            if (!new_range->one_line) { *range = new_range; }
+        }
+
+        if (_yed_syntax_cache_samples_row(build->bump, row)) {
+            entry.row       = row + 1;
+            entry.range_idx = _yed_syntax_get_range_idx(parser, *range);
+
+            if (spec != NULL) {
+                spec_entry = array_item(*spec, spec_idx);
+                if (spec_entry->range_idx == entry.range_idx) { return spec_idx; }
+                spec_idx += 1;
+            }
+
+            array_push(*entries, entry);
+        }
+    }
+
+    return spec_idx;
+}
+
+static inline void _yed_syntax_build_chunk_work(yed_job *unused, void *arg) {
+    _yed_syntax_chunk *chunk;
+    _yed_syntax_range *range;
+
+    chunk = arg;
+
+    _yed_syntax_make_parser(chunk->build->syntax, &chunk->parser);
+
+    range = chunk->parser.global;
+
+    if (_yed_syntax_parse_build_rows(&chunk->parser, chunk->build, chunk->job, chunk->first_row, chunk->end_row, &range, &chunk->entries, NULL) < 0) {
+        chunk->cancelled = 1;
+        return;
+    }
+
+    chunk->end_range_idx = _yed_syntax_get_range_idx(&chunk->parser, range);
+}
+
+static inline void _yed_syntax_build_work(yed_job *job, void *arg) {
+    _yed_syntax_build *build;
+    u64                start;
+    _yed_syntax_chunk *chunks;
+    u32                n_rows;
+    int                i;
+    _yed_syntax_chunk *chunk;
+    u32                range_idx;
+    _yed_syntax_range *range;
+    int                agreed;
+
+    build  = arg;
+    start  = measure_time_now_ms();
+    chunks = calloc(build->n_chunks, sizeof(*chunks));
+
+    /* The last row's end state isn't needed. */
+    n_rows = build->n_lines - 1;
+
+    for (i = 0; i < build->n_chunks; i += 1) {
+        chunk            = chunks + i;
+        chunk->build     = build;
+        chunk->job       = job;
+        chunk->first_row = 1 + ((u64)n_rows * i)       / build->n_chunks;
+        chunk->end_row   = 1 + ((u64)n_rows * (i + 1)) / build->n_chunks;
+        chunk->entries   = array_make(_yed_syntax_cache_entry);
+    }
+
+    yed_run_jobs(_yed_syntax_build_chunk_work, chunks, build->n_chunks, sizeof(*chunks));
+
+    range_idx = 0;
+
+    for (i = 0; i < build->n_chunks; i += 1) {
+        chunk = chunks + i;
+
+        if (chunk->cancelled) { break; }
+
+        agreed = 0;
+
+        if (range_idx != 0) {
+            /* Guessed wrong. */
+            range  = *(_yed_syntax_range**)array_item(chunk->parser.ranges, range_idx);
+            agreed = _yed_syntax_parse_build_rows(&chunk->parser, build, job, chunk->first_row, chunk->end_row, &range, &build->entries, &chunk->entries);
+
+            if (agreed < 0) { break; }
+
+            if (agreed == array_len(chunk->entries)) {
+                range_idx = _yed_syntax_get_range_idx(&chunk->parser, range);
+                continue;
+            }
+        }
+
+        if (agreed < array_len(chunk->entries)) {
+            array_push_n(build->entries, array_item(chunk->entries, agreed), array_len(chunk->entries) - agreed);
+        }
+
+        range_idx = chunk->end_range_idx;
+    }
+
+    for (i = 0; i < build->n_chunks; i += 1) {
+        _yed_syntax_free_parser(&chunks[i].parser);
+        array_free(chunks[i].entries);
+    }
+    free(chunks);
+
+    build->parse_ms = measure_time_now_ms() - start;
+}
+
+static inline void _yed_syntax_build_done(yed_job *job, void *arg) {
+    _yed_syntax_build  *build;
+    yed_syntax         *syntax;
+    _yed_syntax_build **bit;
+    int                 i;
+    CACHE_IT            it;
+    _yed_syntax_cache  *cache;
+    array_t             tmp;
+    yed_buffer_change   change;
+
+    build  = arg;
+    syntax = build->syntax;
+
+    i = 0;
+    array_traverse(syntax->builds, bit) {
+        if (*bit == build) {
+            array_delete(syntax->builds, i);
+            break;
+        }
+        i += 1;
+    }
+
+    if (build->buffer != NULL && !yed_job_is_cancelled(job)) {
+        it = tree_lookup(syntax->caches, build->buffer);
+
+        if (tree_it_good(it) && tree_it_val(it).build == build) {
+            cache = &tree_it_val(it);
+
+            tmp            = cache->entries;
+            cache->entries = build->entries;
+            build->entries = tmp;
+            cache->build   = NULL;
+            cache->ready   = 1;
+
+            DBG("cache: %llu ms (%llu ms parsing in %d chunks)",
+                measure_time_now_ms() - build->start_ms, build->parse_ms, build->n_chunks);
+
+            if (!yed_buff_changes_since(build->buffer, build->version, &change)) {
+                cache->ready = 0;
+                _yed_syntax_build_cache(syntax, build->buffer, cache);
+            } else if (change.version_after != change.version_before) {
+                _yed_syntax_cache_rebuild(syntax, cache, build->buffer, change.row, BUFF_MOD_BATCH, &change);
+            }
+
+            /* Rows that were drawn with a guessed state need to be drawn again. */
+            yed_invalidate_line_draw_caches();
+        }
+    }
+
+    free(build->text);
+    array_free(build->offsets);
+    array_free(build->entries);
+    free(build);
+}
+
+static inline void _yed_syntax_start_build(yed_syntax *syntax, yed_buffer *buffer, _yed_syntax_cache *cache) {
+    _yed_syntax_build *build;
+    u64                size;
+    yed_line          *line;
+    u64                offset;
+
+    build           = calloc(1, sizeof(*build));
+    build->syntax   = syntax;
+    build->buffer   = buffer;
+    build->version  = yed_buff_get_version(buffer);
+    build->n_lines  = yed_buff_n_lines(buffer);
+    build->bump     = _yed_syntax_cache_bump(cache, build->n_lines);
+    build->n_chunks = MAX(1, MIN(yed_n_job_workers(), (int)(build->n_lines / YED_SYN_MIN_CHUNK_ROWS)));
+    build->offsets  = array_make_with_cap(u64, build->n_lines + 1);
+    build->entries  = array_make_with_cap(_yed_syntax_cache_entry, cache->size);
+    build->start_ms = measure_time_now_ms();
+
+    size = 0;
+    bucket_array_traverse(buffer->lines, line) {
+        size += array_len(line->chars) + 1;
+    }
+
+    build->text = malloc(size);
+    offset      = 0;
+
+    bucket_array_traverse(buffer->lines, line) {
+        array_push(build->offsets, offset);
+        memcpy(build->text + offset, array_data(line->chars), array_len(line->chars));
+        offset              += array_len(line->chars);
+        build->text[offset]  = 0;
+        offset              += 1;
+    }
+    array_push(build->offsets, offset);
+
+    array_clear(cache->entries);
+    cache->build     = build;
+    cache->guess_row = 0;
+
+    array_push(syntax->builds, build);
+
+    build->job = yed_submit_job(_yed_syntax_build_work, _yed_syntax_build_done, build);
+}
+
+static inline void _yed_syntax_build_cache(yed_syntax *syntax, yed_buffer *buffer, _yed_syntax_cache *cache) {
+    if (!syntax->finalized || !syntax->needs_state) { return; }
+
+    if (yed_buff_n_lines(buffer) < YED_SYN_BACKGROUND_ROWS) {
+        _yed_syntax_build_cache_now(syntax, buffer, cache);
+    } else {
+        _yed_syntax_start_build(syntax, buffer, cache);
+    }
+}
+
+/*
+ * Until the cache is ready, rows are highlighted as if nothing more than
+ * YED_SYN_GUESS_ROWS (or so) above them mattered. All of the rows in a block
+ * of YED_SYN_GUESS_ROWS start from the same place so that they at least
+ * agree with each other.
+ */
+static inline _yed_syntax_range *_yed_syntax_guess_start_state(yed_syntax *syntax, yed_buffer *buffer, _yed_syntax_cache *cache, int row) {
+    u32                block;
+    u32                anchor;
+    u32                r;
+    _yed_syntax_range *range;
+    _yed_syntax_range *new_range;
+    yed_line          *line;
+
+    block  = (row - 1) / YED_SYN_GUESS_ROWS;
+    anchor = block > 0 ? (block - 1) * YED_SYN_GUESS_ROWS + 1 : 1;
+
+    if (cache->guess_row != 0
+    &&  cache->guess_anchor == anchor
+    &&  cache->guess_row <= row) {
+        r     = cache->guess_row;
+        range = *(_yed_syntax_range**)array_item(syntax->ranges, cache->guess_range_idx);
+    } else {
+        r     = anchor;
+        range = syntax->global;
+    }
+
+    while (r < row) {
+        line = yed_buff_get_line(buffer, r);
+
+        if (line->visual_width > 0) {
+            new_range = _yed_syntax_get_buff_line_end_state(syntax, line, range);
+            if (!new_range->one_line) { range = new_range; }
+        }
+
+        r += 1;
+    }
+
+    cache->guess_anchor    = anchor;
+    cache->guess_row       = row;
+    cache->guess_range_idx = _yed_syntax_get_range_idx(syntax, range);
+
+    return range;
+}
+
 static _yed_syntax_range *_yed_syntax_get_start_state(yed_syntax *syntax, yed_buffer *buffer, int row) {
     _yed_syntax_cache       *cache;
     _yed_syntax_cache_entry *it;
@@ -694,7 +1603,12 @@ static _yed_syntax_range *_yed_syntax_get_start_state(yed_syntax *syntax, yed_bu
     if (row <= 1) { return syntax->global; }
 
     cache = _yed_syntax_get_cache(syntax, buffer);
-    it    = _yed_syntax_cache_lookup_nearest(syntax, cache, row);
+
+    if (!cache->ready) {
+        return _yed_syntax_guess_start_state(syntax, buffer, cache, row);
+    }
+
+    it = _yed_syntax_cache_lookup_nearest(syntax, cache, row);
 
     if (it == NULL) {
         range = syntax->global;
@@ -708,8 +1622,7 @@ static _yed_syntax_range *_yed_syntax_get_start_state(yed_syntax *syntax, yed_bu
         line = yed_buff_get_line(buffer, r);
 
         if (line->visual_width > 0) {
-            array_zero_term(line->chars);
-            new_range = _yed_syntax_get_line_end_state(syntax, buffer, line, range);
+            new_range = _yed_syntax_get_buff_line_end_state(syntax, line, range);
             if (!new_range->one_line) { range = new_range; }
         }
 
@@ -750,8 +1663,7 @@ static inline int _yed_syntax_fixup_cache(yed_syntax *syntax, yed_buffer *buffer
         start_range = *(_yed_syntax_range**)array_item(syntax->ranges, it->range_idx);
         line        = yed_buff_get_line(buffer, it->row);
 
-        array_zero_term(line->chars);
-        end_range = _yed_syntax_get_line_end_state(syntax, buffer, line, start_range);
+        end_range   = _yed_syntax_get_buff_line_end_state(syntax, line, start_range);
 
         end_range_idx = _yed_syntax_get_range_idx(syntax, end_range);
         if (end_range_idx == -1) { end_range_idx = 0; }
@@ -783,7 +1695,7 @@ out:;
     return changed | started_at_top;
 }
 
-static inline void _yed_syntax_cache_rebuild(yed_syntax *syntax, _yed_syntax_cache *cache, yed_buffer *buffer, int row, int mod_event) {
+static inline void _yed_syntax_cache_rebuild(yed_syntax *syntax, _yed_syntax_cache *cache, yed_buffer *buffer, int row, int mod_event, yed_buffer_change *change) {
     yed_line                *line;
     _yed_syntax_cache_entry *cache_entry;
     _yed_syntax_range       *cached_state;
@@ -794,6 +1706,12 @@ static inline void _yed_syntax_cache_rebuild(yed_syntax *syntax, _yed_syntax_cac
 
     if (!syntax->finalized) { return; }
 
+    /* A build in progress catches up on its own when it's finished. */
+    if (!cache->ready) {
+        cache->guess_row = 0;
+        return;
+    }
+
     switch (mod_event) {
         case BUFF_MOD_APPEND_TO_LINE:
         case BUFF_MOD_POP_FROM_LINE:
@@ -802,10 +1720,9 @@ static inline void _yed_syntax_cache_rebuild(yed_syntax *syntax, _yed_syntax_cac
         case BUFF_MOD_CLEAR_LINE:
         case BUFF_MOD_SET_LINE:
             line = yed_buff_get_line(buffer, row);
-            array_zero_term(line->chars);
 
             start_state  = _yed_syntax_get_start_state(syntax, buffer, row);
-            end_state    = _yed_syntax_get_line_end_state(syntax, buffer, line, start_state);
+            end_state    = _yed_syntax_get_buff_line_end_state(syntax, line, start_state);
             cache_entry  = _yed_syntax_cache_lookup_exact(syntax, cache, row + 1);
             cached_state = (cache_entry == NULL)
                             ? NULL
@@ -871,6 +1788,28 @@ static inline void _yed_syntax_cache_rebuild(yed_syntax *syntax, _yed_syntax_cac
         case BUFF_MOD_CLEAR:
             _yed_syntax_remove_cache(syntax, buffer);
             break;
+
+        case BUFF_MOD_BATCH:
+            /*
+             * Rows [row, row + n_old_rows) were replaced. The entry for row is still
+             * good, but the ones after it up to and including the first row that wasn't
+             * replaced aren't. Move the rest down and then fix up from row.
+             */
+            idx = array_len(cache->entries) - 1;
+            array_rtraverse(cache->entries, it) {
+                if (it->row > row + change->n_old_rows) {
+                    it->row += change->n_new_rows - change->n_old_rows;
+                } else if (it->row > row) {
+                    array_delete(cache->entries, idx);
+                } else {
+                    break;
+                }
+                idx -= 1;
+            }
+
+            _yed_syntax_fixup_cache(syntax, buffer, cache, row);
+
+            break;
     }
 }
 
@@ -889,6 +1828,8 @@ static inline const char * _yed_syntax_find_next_kwd(yed_syntax *syntax, _yed_sy
     const char      *word;
     _yed_syntax_kwd *lookup;
 
+    if (array_len(range->items.kwds.kwds) == 0) { return NULL; }
+
     g    = (yed_glyph*)(void*)start;
     gend = (yed_glyph*)(void*)end;
 
@@ -943,6 +1884,8 @@ static inline const char * _yed_syntax_find_next_regex_match(yed_syntax *syntax,
     memset(&first_match, 0, sizeof(first_match));
 
     array_traverse(range->items.regs, rit) {
+        if (!_yed_syntax_may_match(syntax, rit->bit, rit->bol, start)) { continue; }
+
         eflags = (start == array_data(line->chars)) ? 0 : REG_NOTBOL;
         err    = regexec(&rit->reg, start, nmatch, syntax->matches, eflags);
 
@@ -968,8 +1911,7 @@ static inline const char * _yed_syntax_find_next_regex_match(yed_syntax *syntax,
     return match_start;
 }
 
-static inline const char * _yed_syntax_find_next_range_start(yed_syntax *syntax, yed_line *line, const char *start, _yed_syntax_range **range_out, int *len_out) {
-    const char         *end;
+static inline const char * _yed_syntax_find_next_range_start(yed_syntax *syntax, const char *line_start, const char *start, _yed_syntax_range **range_out, int *len_out) {
     regmatch_t          match;
     const char         *match_start;
     _yed_syntax_range  *match_range;
@@ -979,15 +1921,17 @@ static inline const char * _yed_syntax_find_next_range_start(yed_syntax *syntax,
     int                 eflags;
     int                 err;
 
-    end         = array_data(line->chars) + array_len(line->chars);
     match_start = NULL;
     match_range = NULL;
 
     memset(&first_match, 0, sizeof(first_match));
 
     array_traverse_from(syntax->ranges, rit, 1) { /* Skip global. */
-        r      = *rit;
-        eflags = (start == array_data(line->chars)) ? 0 : REG_NOTBOL;
+        r = *rit;
+
+        if (!_yed_syntax_may_match(syntax, r->start_bit, r->start_bol, start)) { continue; }
+
+        eflags = (start == line_start) ? 0 : REG_NOTBOL;
         err    = regexec(&r->start, start, 1, &match, eflags);
 
         if (!err) {
@@ -1010,8 +1954,7 @@ static inline const char * _yed_syntax_find_next_range_start(yed_syntax *syntax,
     return match_start;
 }
 
-static inline const char * _yed_syntax_find_range_end(yed_syntax *syntax, _yed_syntax_range *range, yed_line *line, const char *start, int *len_out) {
-    const char *end;
+static inline const char * _yed_syntax_find_range_end(yed_syntax *syntax, _yed_syntax_range *range, const char *line_start, const char *end, const char *start, int *len_out) {
     int         nmatch;
     const char *match_start;
     regmatch_t  m;
@@ -1019,12 +1962,13 @@ static inline const char * _yed_syntax_find_range_end(yed_syntax *syntax, _yed_s
     int         err;
     regex_t    *rit;
 
-    end    = array_data(line->chars) + array_len(line->chars);
     nmatch = syntax->max_group + 1;
 
     while (start <= end) {
+        if (!_yed_syntax_may_match(syntax, range->end_bit, range->end_bol, start)) { goto out; }
+
         match_start = NULL;
-        eflags      = (start == array_data(line->chars)) ? 0 : REG_NOTBOL;
+        eflags      = (start == line_start) ? 0 : REG_NOTBOL;
         err         = regexec(&range->end, start, nmatch, syntax->matches, eflags);
 
         if (!err) {
@@ -1034,7 +1978,7 @@ static inline const char * _yed_syntax_find_range_end(yed_syntax *syntax, _yed_s
                 /* We found a match for the end. Is it in a skip? */
 
                 array_traverse(range->skips, rit) {
-                    eflags = (start == array_data(line->chars)) ? 0 : REG_NOTBOL;
+                    eflags = (start == line_start) ? 0 : REG_NOTBOL;
                     err    = regexec(rit, start, nmatch, syntax->matches, eflags);
 
                     if (!err) {
@@ -1066,7 +2010,8 @@ out:;
     return NULL;
 }
 
-static inline _yed_syntax_range *_yed_syntax_get_line_end_state(yed_syntax *syntax, yed_buffer *buffer, yed_line *line, _yed_syntax_range *start_range) {
+/* The line must be NUL terminated. */
+static inline _yed_syntax_range *_yed_syntax_get_line_end_state(yed_syntax *syntax, const char *line_start, int line_len, _yed_syntax_range *start_range) {
     _yed_syntax_range *range;
     const char        *start;
     const char        *end;
@@ -1078,13 +2023,15 @@ static inline _yed_syntax_range *_yed_syntax_get_line_end_state(yed_syntax *synt
     _yed_syntax_range *next_range;
 
     range            = start_range;
-    start            = array_data(line->chars);
-    end              = start + array_len(line->chars);
+    start            = line_start;
+    end              = start + line_len;
     str              = start;
     next_range_start = NULL;
 
+    _yed_syntax_prepare_line(syntax, start, line_len);
+
     if (range != syntax->global) {
-        range_end_start = _yed_syntax_find_range_end(syntax, range, line, str, &range_end_len);
+        range_end_start = _yed_syntax_find_range_end(syntax, range, start, end, str, &range_end_len);
 
         if (range_end_start == NULL) { goto out; }
 
@@ -1092,12 +2039,12 @@ static inline _yed_syntax_range *_yed_syntax_get_line_end_state(yed_syntax *synt
         range = syntax->global;
     }
 
-    while ((next_range_start = _yed_syntax_find_next_range_start(syntax, line, str, &next_range, &next_range_start_len)) != NULL) {
+    while ((next_range_start = _yed_syntax_find_next_range_start(syntax, start, str, &next_range, &next_range_start_len)) != NULL) {
             range = next_range;
 
             str = next_range_start + next_range_start_len;
 
-            range_end_start = _yed_syntax_find_range_end(syntax, range, line, str, &range_end_len);
+            range_end_start = _yed_syntax_find_range_end(syntax, range, start, end, str, &range_end_len);
             if (range_end_start == NULL) {
                 if (range->one_line) {
                     range = syntax->global;
@@ -1148,8 +2095,10 @@ static inline _yed_syntax_range *_yed_syntax_line(yed_syntax *syntax, yed_line *
     line_end = start + array_len(line->chars);
     end      = line_end;
 
+    _yed_syntax_prepare_line(syntax, start, array_len(line->chars));
+
     if (range != syntax->global) {
-        range_end_start = _yed_syntax_find_range_end(syntax, range, line, str, &range_end_len);
+        range_end_start = _yed_syntax_find_range_end(syntax, range, start, line_end, str, &range_end_len);
 
         cstart = yed_line_idx_to_col(line, str - start);
         cend   = range_end_start == NULL
@@ -1189,7 +2138,7 @@ static inline _yed_syntax_range *_yed_syntax_line(yed_syntax *syntax, yed_line *
         }
 
         if (range == syntax->global && NEEDS_SEARCH(next_range_start)) {
-            next_range_start = _yed_syntax_find_next_range_start(syntax, line, str, &next_range, &next_range_start_len);
+            next_range_start = _yed_syntax_find_next_range_start(syntax, start, str, &next_range, &next_range_start_len);
 
             /* If the next range is right here, skip regex search. */
             if (next_range_start == str) { goto set_range; }
@@ -1217,7 +2166,7 @@ set_match:;
 set_range:;
             range = next_range;
 
-            range_end_start = _yed_syntax_find_range_end(syntax, range, line, next_range_start + next_range_start_len, &range_end_len);
+            range_end_start = _yed_syntax_find_range_end(syntax, range, start, line_end, next_range_start + next_range_start_len, &range_end_len);
 
             cstart = yed_line_idx_to_col(line, next_range_start - start);
             cend   = range_end_start == NULL
@@ -1281,6 +2230,16 @@ set_kwd:;
 /************************************************************************************/
 
 
+static inline void _yed_syntax_build_kwd_sets(yed_syntax *syntax) {
+    _yed_syntax_range **rit;
+
+    array_traverse(syntax->ranges, rit) {
+        if (array_len((*rit)->items.kwds.kwds) > 0) {
+            _yed_syntax_kwd_set_build(&(*rit)->items.kwds);
+        }
+    }
+}
+
 static inline void yed_syntax_start(yed_syntax *syntax) {
     memset(syntax, 0, sizeof(*syntax));
 
@@ -1293,19 +2252,33 @@ static inline void yed_syntax_start(yed_syntax *syntax) {
     array_push(syntax->ranges, syntax->global);
 
     syntax->caches = CACHE_TREE_MAKE();
+    syntax->builds = array_make(_yed_syntax_build*);
 }
 
 static inline void yed_syntax_end(yed_syntax *syntax) {
     syntax->matches = malloc(sizeof(*syntax->matches) * (syntax->max_group + 1));
 
+    _yed_syntax_compile_prefilter(syntax);
+    _yed_syntax_build_kwd_sets(syntax);
+
     syntax->finalized = 1;
 }
 
 static inline void yed_syntax_free(yed_syntax *syntax) {
+    _yed_syntax_build  *build;
     _yed_syntax_range **rit;
     _yed_syntax_attr  **ait;
     CACHE_IT            it;
 
+    /* Builds in the background are running this code, so they have to be done first. */
+    while (array_len(syntax->builds) > 0) {
+        build         = *(_yed_syntax_build**)array_last(syntax->builds);
+        build->buffer = NULL;
+        yed_cancel_job(build->job);
+        yed_wait_job(build->job);
+    }
+    array_free(syntax->builds);
+
     array_traverse(syntax->ranges, rit) {
         _yed_syntax_free_range(*rit);
     }
@@ -1322,6 +2295,8 @@ static inline void yed_syntax_free(yed_syntax *syntax) {
 
     if (syntax->matches != NULL) { free(syntax->matches); }
 
+    if (syntax->line_items != NULL) { free(syntax->line_items); }
+
     tree_traverse(syntax->caches, it) {
         _yed_syntax_free_cache(&tree_it_val(it));
     }
@@ -1377,8 +2352,9 @@ static inline int _yed_syntax_add_regex(yed_syntax *syntax, const char *pattern,
     } else {
         range = _yed_syntax_top_range(syntax);
 
-        r.group = group;
-        r.attr  = _yed_syntax_top_attr(syntax);
+        r.group   = group;
+        r.attr    = _yed_syntax_top_attr(syntax);
+        r.pattern = strdup(pattern);
         array_push(range->items.regs, r);
 
         if (group > syntax->max_group) {
@@ -1417,7 +2393,8 @@ static inline int yed_syntax_range_start(yed_syntax *syntax, const char *pattern
         regerror(err, &range->start, syntax->regex_err_str, err_len);
         _yed_syntax_free_range(range);
     } else {
-        range->attr = _yed_syntax_top_attr(syntax);
+        range->attr          = _yed_syntax_top_attr(syntax);
+        range->start_pattern = strdup(pattern);
         array_push(syntax->ranges, range);
         syntax->range = range;
     }
@@ -1442,6 +2419,7 @@ static inline int yed_syntax_range_end(yed_syntax *syntax, const char *pattern)
         regerror(err, &range->end, syntax->regex_err_str, err_len);
         _yed_syntax_free_range(range);
     } else {
+        range->end_pattern = strdup(pattern);
         if (!range->one_line) { syntax->needs_state = 1; }
         syntax->range = NULL;
     }
@@ -1454,6 +2432,7 @@ static inline int yed_syntax_range_skip(yed_syntax *syntax, const char *pattern)
     int                err;
     regex_t            reg;
     size_t             err_len;
+    char              *pattern_dup;
 
     range = _yed_syntax_top_range(syntax);
     if (range == syntax->global) { return -1; }
@@ -1467,6 +2446,8 @@ static inline int yed_syntax_range_skip(yed_syntax *syntax, const char *pattern)
         regerror(err, &reg, syntax->regex_err_str, err_len);
     } else {
         array_push(range->skips, reg);
+        pattern_dup = strdup(pattern);
+        array_push(range->skip_patterns, pattern_dup);
     }
 
     return err;
@@ -1538,7 +2519,7 @@ static inline void yed_syntax_buffer_mod_event(yed_syntax *syntax, yed_event *ev
     it = tree_lookup(syntax->caches, event->buffer);
 
     if (tree_it_good(it)) {
-        _yed_syntax_cache_rebuild(syntax, &tree_it_val(it), event->buffer, event->row, event->buff_mod_event);
+        _yed_syntax_cache_rebuild(syntax, &tree_it_val(it), event->buffer, event->row, event->buff_mod_event, event->buff_change);
     }
 }
 
@@ -24,10 +24,12 @@ int yed_term_enter(void) {
 
     /* control chars - set return condition: min number of bytes and timer. */
 
-    /* Return each byte, or zero for timeout. */
-    raw_term.c_cc[VMIN] = 0;
-    /* 300 ms timeout (unit is tens of second). */
-    raw_term.c_cc[VTIME] = TERM_DEFAULT_READ_TIMEOUT;
+    /*
+     * Never block in read(). The main loop waits for input with poll() and
+     * key sequences time out in yed_read_input_byte().
+     */
+    raw_term.c_cc[VMIN]  = 0;
+    raw_term.c_cc[VTIME] = 0;
 
     tcsetattr(0, TCSAFLUSH, &raw_term);
 
@@ -36,6 +38,7 @@ int yed_term_enter(void) {
     yed_register_sigwinch_handler();
     yed_register_sigstop_handler();
     yed_register_sigcont_handler();
+    yed_register_sigchld_handler();
     yed_register_sigterm_handler();
     yed_register_sigquit_handler();
     yed_register_sigstop_handler();
@@ -147,6 +150,12 @@ void yed_term_set_cursor_style(int style) {
 
 void sigwinch_handler(int sig) {
     yed_check_for_resize();
+    yed_wake();
+}
+
+void sigchld_handler(int sig) {
+    /* Let whoever is waiting on a subprocess know that it may have exited. */
+    yed_wake();
 }
 
 void sigstop_handler(int sig) {
@@ -161,7 +170,7 @@ void sigstop_handler(int sig) {
     sigaction(SIGTSTP, &act, NULL);
 
     /* Stop the writer thread. */
-    pthread_mutex_lock(&ys->write_ready_mtx);
+    yed_stop_writer();
 
     /* Exit the terminal. */
     ys->stopped = 1;
@@ -178,7 +187,7 @@ void sigcont_handler(int sig) {
 
         ys->stopped = 0;
         yed_term_enter();
-        pthread_mutex_unlock(&ys->write_ready_mtx);
+        yed_resume_writer();
 
         yed_check_for_resize();
         yed_handle_resize();
@@ -191,6 +200,8 @@ void sigcont_handler(int sig) {
         if (yed_term_mouse_reporting_enabled()) {
             yed_term_enable_mouse_reporting();
         }
+
+        yed_wake();
     }
 }
 
@@ -203,7 +214,7 @@ void sigterm_handler(int sig) {
     sigaction(SIGTERM, &act, NULL);
 
     /* Stop the writer thread. */
-    pthread_mutex_lock(&ys->write_ready_mtx);
+    yed_stop_writer();
 
     /* Exit the terminal. */
     yed_term_exit();
@@ -221,7 +232,7 @@ void sigquit_handler(int sig) {
     sigaction(SIGQUIT, &act, NULL);
 
     /* Stop the writer thread. */
-    pthread_mutex_lock(&ys->write_ready_mtx);
+    yed_stop_writer();
 
     /* Exit the terminal. */
     yed_term_exit();
@@ -255,7 +266,7 @@ void sigsegv_handler(int sig) {
     sigaction(SIGSEGV, &act, NULL);
 
     /* Stop the writer thread. */
-    pthread_mutex_lock(&ys->write_ready_mtx);
+    yed_stop_writer();
 
     /* Exit the terminal. */
     yed_term_exit();
@@ -275,7 +286,7 @@ void sigill_handler(int sig) {
     sigaction(SIGILL, &act, NULL);
 
     /* Stop the writer thread. */
-    pthread_mutex_lock(&ys->write_ready_mtx);
+    yed_stop_writer();
 
     /* Exit the terminal. */
     yed_term_exit();
@@ -295,7 +306,7 @@ void sigfpe_handler(int sig) {
     sigaction(SIGFPE, &act, NULL);
 
     /* Stop the writer thread. */
-    pthread_mutex_lock(&ys->write_ready_mtx);
+    yed_stop_writer();
 
     /* Exit the terminal. */
     yed_term_exit();
@@ -315,7 +326,7 @@ void sigbus_handler(int sig) {
     sigaction(SIGBUS, &act, NULL);
 
     /* Stop the writer thread. */
-    pthread_mutex_lock(&ys->write_ready_mtx);
+    yed_stop_writer();
 
     /* Exit the terminal. */
     yed_term_exit();
@@ -359,6 +370,17 @@ void yed_register_sigcont_handler(void) {
     }
 }
 
+void yed_register_sigchld_handler(void) {
+    struct sigaction sa;
+
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags   = SA_RESTART | SA_NOCLDSTOP;
+    sa.sa_handler = sigchld_handler;
+    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
+        ASSERT(0, "sigaction failed for SIGCHLD");
+    }
+}
+
 void yed_register_sigterm_handler(void) {
     struct sigaction sa;
 
@@ -81,6 +81,7 @@ void yed_term_set_cursor_style(int style);
 void yed_register_sigwinch_handler(void);
 void yed_register_sigstop_handler(void);
 void yed_register_sigcont_handler(void);
+void yed_register_sigchld_handler(void);
 void yed_register_sigterm_handler(void);
 void yed_register_sigquit_handler(void);
 void yed_register_sigsegv_handler(void);
@@ -1,7 +1,13 @@
 yed_undo_record yed_new_undo_record(void) {
     yed_undo_record ur;
 
-    ur.actions = array_make(yed_undo_action);
+    ur.actions  = array_make(yed_undo_action);
+    ur.contents = array_make(yed_undo_content);
+    ur.text     = array_make(char);
+
+    ur.mem       = 0;
+    ur.spill_off = -1;
+    ur.spill_len = 0;
 
     return ur;
 }
@@ -14,17 +20,237 @@ yed_undo_history yed_new_undo_history(void) {
 
     uh.current_record    = NULL;
 
+    uh.mem        = 0;
+    uh.n_spilled  = 0;
+    uh.spill      = NULL;
+    uh.spill_size = 0;
+
     return uh;
 }
 
 void yed_free_undo_record(yed_undo_record *record) {
     array_free(record->actions);
+    array_free(record->contents);
+    array_free(record->text);
+}
+
+static unsigned long long yed_undo_record_mem(yed_undo_record *record) {
+    return   sizeof(*record)
+           + array_len(record->actions)  * sizeof(yed_undo_action)
+           + array_len(record->contents) * sizeof(yed_undo_content)
+           + array_len(record->text);
+}
+
+/*
+ * Only the closed, in-memory records of the undo list count towards the
+ * memory limits. A record remembers what it was counted as, so it can be
+ * taken off again even if it changed in the meantime.
+ */
+static void yed_undo_count_record(yed_undo_history *history, yed_undo_record *record) {
+    record->mem   = yed_undo_record_mem(record);
+    history->mem += record->mem;
+    ys->undo_mem += record->mem;
+}
+
+static void yed_undo_uncount_record(yed_undo_history *history, yed_undo_record *record) {
+    history->mem -= record->mem;
+    ys->undo_mem -= record->mem;
+    record->mem   = 0;
+}
+
+/*
+ * A record is written out (to the spill file or an undo file) as a header
+ * of ints followed by its actions, contents and text.
+ */
+#define UNDO_RECORD_HEADER_INTS (7)
+
+static void yed_undo_serialize_record(yed_undo_record *record, array_t *out) {
+    int header[UNDO_RECORD_HEADER_INTS];
+
+    header[0] = record->start_cursor_row;
+    header[1] = record->start_cursor_col;
+    header[2] = record->end_cursor_row;
+    header[3] = record->end_cursor_col;
+    header[4] = array_len(record->actions);
+    header[5] = array_len(record->contents);
+    header[6] = array_len(record->text);
+
+    array_push_n(*out, (char*)header, sizeof(header));
+    if (header[4] > 0) { array_push_n(*out, array_data(record->actions),  header[4] * sizeof(yed_undo_action));  }
+    if (header[5] > 0) { array_push_n(*out, array_data(record->contents), header[5] * sizeof(yed_undo_content)); }
+    if (header[6] > 0) { array_push_n(*out, array_data(record->text),     header[6]);                            }
+}
+
+static int yed_undo_range_ok(int off, int len, size_t text_len) {
+    return off >= 0 && len >= 0 && (size_t)off + (size_t)len <= text_len;
+}
+
+/*
+ * Records come back from files that could be corrupt, so everything that
+ * undo will index with is checked before the record is filled in.
+ */
+static int yed_undo_deserialize_record(const char *data, int len, yed_undo_record *record) {
+    int               header[UNDO_RECORD_HEADER_INTS];
+    const char       *actions;
+    const char       *contents;
+    const char       *text;
+    yed_undo_action   action;
+    yed_undo_content  content;
+    int               i;
+
+    if (len < (int)sizeof(header)) { return 0; }
+
+    memcpy(header, data, sizeof(header));
+    data += sizeof(header);
+    len  -= sizeof(header);
+
+    if (header[4] < 0 || header[5] < 0 || header[6] < 0
+    ||  (size_t)len !=   (size_t)header[4] * sizeof(yed_undo_action)
+                       + (size_t)header[5] * sizeof(yed_undo_content)
+                       + (size_t)header[6]) {
+        return 0;
+    }
+
+    actions  = data;
+    contents = actions  + (size_t)header[4] * sizeof(yed_undo_action);
+    text     = contents + (size_t)header[5] * sizeof(yed_undo_content);
+
+    for (i = 0; i < header[4]; i += 1) {
+        memcpy(&action, actions + (size_t)i * sizeof(action), sizeof(action));
+
+        if (action.row < 1) { return 0; }
+
+        switch (action.kind) {
+            case UNDO_GLYPH_ADD:
+            case UNDO_GLYPH_DEL:
+                if (action.col < 1) { return 0; }
+                break;
+            case UNDO_GLYPH_PUSH:
+            case UNDO_GLYPH_POP:
+            case UNDO_LINE_ADD:
+            case UNDO_LINE_DEL:
+                break;
+            case UNDO_CONTENT:
+                if (action.content < 0 || action.content >= header[5]) { return 0; }
+                break;
+            default:
+                return 0;
+        }
+    }
+
+    for (i = 0; i < header[5]; i += 1) {
+        memcpy(&content, contents + (size_t)i * sizeof(content), sizeof(content));
+
+        if (content.idx < 0
+        ||  !yed_undo_range_ok(content.old_off, content.old_len, header[6])
+        ||  !yed_undo_range_ok(content.new_off, content.new_len, header[6])) {
+            return 0;
+        }
+    }
+
+    record->start_cursor_row = header[0];
+    record->start_cursor_col = header[1];
+    record->end_cursor_row   = header[2];
+    record->end_cursor_col   = header[3];
+
+    if (header[4] > 0) { array_push_n(record->actions,  (char*)actions,  header[4]); }
+    if (header[5] > 0) { array_push_n(record->contents, (char*)contents, header[5]); }
+    if (header[6] > 0) { array_push_n(record->text,     (char*)text,     header[6]); }
+
+    return 1;
+}
+
+/* Writes the oldest in-memory record of the undo list out to the spill file. */
+static int yed_undo_spill(yed_undo_history *history) {
+    yed_undo_record *record;
+    array_t          data;
+    int              ok;
+
+    /* The newest record stays in memory so that it can always be merged into. */
+    if (history->n_spilled >= array_len(history->undo) - 1) { return 0; }
+
+    if (history->spill == NULL) {
+        history->spill = tmpfile();
+        if (history->spill == NULL) { return 0; }
+    }
+
+    record = array_item(history->undo, history->n_spilled);
+
+    if (record == history->current_record) { return 0; }
+
+    data = array_make(char);
+    yed_undo_serialize_record(record, &data);
+
+    ok = pwrite(fileno(history->spill), array_data(data), array_len(data), history->spill_size) == array_len(data);
+
+    if (ok) {
+        record->spill_off    = history->spill_size;
+        record->spill_len    = array_len(data);
+        history->spill_size += array_len(data);
+
+        yed_undo_uncount_record(history, record);
+
+        yed_free_undo_record(record);
+        record->actions  = array_make(yed_undo_action);
+        record->contents = array_make(yed_undo_content);
+        record->text     = array_make(char);
+
+        history->n_spilled += 1;
+    }
+
+    array_free(data);
+
+    return ok;
+}
+
+/* Reads the newest spilled record back in from the spill file. */
+static int yed_undo_page_in(yed_undo_history *history) {
+    yed_undo_record *record;
+    char            *data;
+    int              ok;
+
+    if (history->n_spilled == 0) { return 0; }
+
+    record = array_item(history->undo, history->n_spilled - 1);
+    data   = malloc(record->spill_len);
+
+    ok =    pread(fileno(history->spill), data, record->spill_len, record->spill_off) == record->spill_len
+         && yed_undo_deserialize_record(data, record->spill_len, record);
+
+    free(data);
+
+    if (!ok) { return 0; }
+
+    /* Records are read back in the reverse order they were spilled in, so the space can be reused. */
+    if (record->spill_off + record->spill_len == history->spill_size) {
+        history->spill_size = record->spill_off;
+    }
+
+    record->spill_off = -1;
+    record->spill_len = 0;
+
+    history->n_spilled -= 1;
+
+    yed_undo_count_record(history, record);
+
+    return 1;
+}
+
+static void yed_clear_redo(yed_undo_history *history) {
+    yed_undo_record *record;
+
+    array_traverse(history->redo, record) {
+        yed_free_undo_record(record);
+    }
+
+    array_clear(history->redo);
 }
 
 void yed_free_undo_history(yed_undo_history *history) {
     yed_undo_record *record;
 
     array_traverse(history->undo, record) {
+        yed_undo_uncount_record(history, record);
         yed_free_undo_record(record);
     }
 
@@ -35,6 +261,10 @@ void yed_free_undo_history(yed_undo_history *history) {
     }
 
     array_free(history->redo);
+
+    if (history->spill != NULL) {
+        fclose(history->spill);
+    }
 }
 
 void yed_reset_undo_history(yed_undo_history *history) {
@@ -56,13 +286,10 @@ void yed_force_end_undo_record(yed_undo_history *history) {
     record->end_cursor_row = record->start_cursor_row;
     record->end_cursor_col = record->start_cursor_col;
 
-    /*
-     * We must clear the redo history here.
-     * For now, we'll just clear the array, but
-     * eventually there will be stuff that needs
-     * to be freed and such.
-     */
-    array_clear(history->redo);
+    yed_undo_count_record(history, record);
+
+    /* We must clear the redo history here. */
+    yed_clear_redo(history);
 
     history->current_record = NULL;
 }
@@ -129,15 +356,14 @@ void yed_end_undo_record(yed_frame *frame, yed_buffer *buffer) {
         record->end_cursor_col = 1;
     }
 
-    /*
-     * We must clear the redo history here.
-     * For now, we'll just clear the array, but
-     * eventually there will be stuff that needs
-     * to be freed and such.
-     */
-    array_clear(history->redo);
+    yed_undo_count_record(history, record);
+
+    /* We must clear the redo history here. */
+    yed_clear_redo(history);
 
     history->current_record    = NULL;
+
+    yed_undo_enforce_memory_limits(buffer);
 }
 
 void yed_cancel_undo_record(yed_frame *frame, yed_buffer *buffer) {
@@ -171,6 +397,11 @@ void yed_merge_undo_records(struct yed_buffer_t *buffer) {
     yed_undo_history *history;
     yed_undo_record  *last_record,
                      *new_last_record;
+    yed_undo_action  *action;
+    yed_undo_content *content;
+    int               n_actions,
+                      n_contents,
+                      n_text;
 
     if (buffer->kind == BUFF_KIND_YANK)    { return; }
 
@@ -178,9 +409,22 @@ void yed_merge_undo_records(struct yed_buffer_t *buffer) {
 
     if (array_len(history->undo) < 2)    { return; }
 
+    if (array_len(history->undo) - 2 < history->n_spilled) {
+        yed_undo_page_in(history);
+    }
+
     last_record     = array_last(history->undo);
     new_last_record = array_item(history->undo, array_len(history->undo) - 2);
 
+    if (last_record != history->current_record) {
+        yed_undo_uncount_record(history, last_record);
+    }
+    yed_undo_uncount_record(history, new_last_record);
+
+    n_actions  = array_len(new_last_record->actions);
+    n_contents = array_len(new_last_record->contents);
+    n_text     = array_len(new_last_record->text);
+
     array_push_n(new_last_record->actions,
                  array_data(last_record->actions),
                  array_len(last_record->actions));
@@ -188,6 +432,26 @@ void yed_merge_undo_records(struct yed_buffer_t *buffer) {
 /*         array_push(new_last_record->actions, *action); */
 /*     } */
 
+    /* The contents and their text move too, so their indices change. */
+    array_push_n(new_last_record->contents,
+                 array_data(last_record->contents),
+                 array_len(last_record->contents));
+    if (array_len(last_record->text) > 0) {
+        array_push_n(new_last_record->text,
+                     array_data(last_record->text),
+                     array_len(last_record->text));
+    }
+
+    array_traverse_from(new_last_record->actions, action, n_actions) {
+        if (action->kind == UNDO_CONTENT) {
+            action->content += n_contents;
+        }
+    }
+    array_traverse_from(new_last_record->contents, content, n_contents) {
+        content->old_off += n_text;
+        content->new_off += n_text;
+    }
+
     new_last_record->end_cursor_row = last_record->end_cursor_row;
     new_last_record->end_cursor_col = last_record->end_cursor_col;
 
@@ -199,6 +463,8 @@ void yed_merge_undo_records(struct yed_buffer_t *buffer) {
     if (history->current_record) {
         ASSERT(history->current_record == last_record, "undo history messed up");
         history->current_record = new_last_record;
+    } else {
+        yed_undo_count_record(history, new_last_record);
     }
 }
 
@@ -221,7 +487,98 @@ int yed_push_undo_action(yed_buffer *buffer, yed_undo_action *action) {
     return 1;
 }
 
-void yed_undo_single_action(yed_frame *frame, yed_buffer *buffer, yed_undo_action *action) {
+int yed_push_undo_content(yed_buffer *buffer, int row, int idx, const char *old_text, int old_len, const char *new_text, int new_len) {
+    yed_undo_history *history;
+    yed_undo_record  *record;
+    yed_undo_content  content;
+    yed_undo_action   action;
+    int               prefix,
+                      suffix,
+                      i;
+
+    if (buffer->kind == BUFF_KIND_YANK)    { return 0; }
+
+    history = &buffer->undo_history;
+    record  = array_last(history->undo);
+
+    if (!record) {
+        yed_start_undo_record(NULL, buffer);
+        record = array_last(history->undo);
+    }
+
+    /*
+     * Only keep what changed. Neither end may split a glyph, since the
+     * range is put back in the buffer by byte index.
+     */
+    prefix = 0;
+    while (prefix < old_len && prefix < new_len && old_text[prefix] == new_text[prefix]) {
+        prefix += 1;
+    }
+    while (prefix > 0
+    &&     ((prefix < old_len && (old_text[prefix] & 0xC0) == 0x80)
+    ||      (prefix < new_len && (new_text[prefix] & 0xC0) == 0x80))) {
+        prefix -= 1;
+    }
+
+    suffix = 0;
+    while (suffix < old_len - prefix && suffix < new_len - prefix
+    &&     old_text[old_len - suffix - 1] == new_text[new_len - suffix - 1]) {
+        suffix += 1;
+    }
+    while (suffix > 0
+    &&     (old_text[old_len - suffix] & 0xC0) == 0x80) {
+        suffix -= 1;
+    }
+
+    if (prefix == old_len && prefix == new_len) { return 1; }
+
+    for (i = 0; i < prefix; i += 1) {
+        if (old_text[i] == '\n') {
+            row += 1;
+            idx  = 0;
+        } else {
+            idx += 1;
+        }
+    }
+
+    old_text += prefix;
+    new_text += prefix;
+    old_len  -= prefix + suffix;
+    new_len  -= prefix + suffix;
+
+    content.idx     = idx;
+    content.old_off = array_len(record->text);
+    content.old_len = old_len;
+    content.new_off = content.old_off + old_len;
+    content.new_len = new_len;
+
+    if (old_len > 0) { array_push_n(record->text, (char*)old_text, old_len); }
+    if (new_len > 0) { array_push_n(record->text, (char*)new_text, new_len); }
+
+    memset(&action, 0, sizeof(action));
+    action.kind    = UNDO_CONTENT;
+    action.row     = row;
+    action.content = array_len(record->contents);
+
+    array_push(record->contents, content);
+    array_push(record->actions, action);
+
+    return 1;
+}
+
+/* Replaces from_len bytes of from_text at (row, idx) with to_text. */
+static void yed_apply_undo_content(yed_buffer *buffer, int row, int idx, const char *from_text, int from_len, const char *to_text, int to_len) {
+    int end_row,
+        end_idx;
+
+    yed_get_text_end(row, idx, from_text, from_len, &end_row, &end_idx);
+
+    yed_buff_replace_range_no_undo(buffer, row, idx, end_row, end_idx, to_text, to_len);
+}
+
+void yed_undo_single_action(yed_frame *frame, yed_buffer *buffer, yed_undo_record *record, yed_undo_action *action) {
+    yed_undo_content *content;
+
     switch (action->kind) {
         case UNDO_GLYPH_ADD:
             yed_delete_from_line_no_undo(buffer, action->row, action->col);
@@ -247,12 +604,21 @@ void yed_undo_single_action(yed_frame *frame, yed_buffer *buffer, yed_undo_actio
             yed_buff_insert_line_no_undo(buffer, action->row);
             break;
 
+        case UNDO_CONTENT:
+            content = array_item(record->contents, action->content);
+            yed_apply_undo_content(buffer, action->row, content->idx,
+                                   array_item(record->text, content->new_off), content->new_len,
+                                   array_item(record->text, content->old_off), content->old_len);
+            break;
+
         default:
             ASSERT(0, "unhandled undo action kind");
     }
 }
 
-void yed_redo_single_action(yed_frame *frame, yed_buffer *buffer, yed_undo_action *action) {
+void yed_redo_single_action(yed_frame *frame, yed_buffer *buffer, yed_undo_record *record, yed_undo_action *action) {
+    yed_undo_content *content;
+
     switch (action->kind) {
         case UNDO_GLYPH_ADD:
             yed_insert_into_line_no_undo(buffer, action->row, action->col, action->g);
@@ -278,6 +644,13 @@ void yed_redo_single_action(yed_frame *frame, yed_buffer *buffer, yed_undo_actio
             yed_buff_delete_line_no_undo(buffer, action->row);
             break;
 
+        case UNDO_CONTENT:
+            content = array_item(record->contents, action->content);
+            yed_apply_undo_content(buffer, action->row, content->idx,
+                                   array_item(record->text, content->old_off), content->old_len,
+                                   array_item(record->text, content->new_off), content->new_len);
+            break;
+
         default:
             ASSERT(0, "unhandled undo action kind");
     }
@@ -295,9 +668,19 @@ int yed_undo(yed_frame *frame, yed_buffer *buffer) {
 
     if (!record)    { return 0; }
 
+    if (array_len(history->undo) - 1 < history->n_spilled
+    &&  !yed_undo_page_in(history)) {
+        yed_log("\n[!] couldn't read the undo history of '%s' back in", buffer->name);
+        return 0;
+    }
+
+    yed_undo_uncount_record(history, record);
+
+    yed_buff_begin_batch(buffer);
     array_rtraverse(record->actions, action) {
-        yed_undo_single_action(frame, buffer, action);
+        yed_undo_single_action(frame, buffer, record, action);
     }
+    yed_buff_end_batch(buffer);
 
     yed_set_cursor_within_frame(frame, record->start_cursor_row, record->start_cursor_col);
 
@@ -319,14 +702,240 @@ int yed_redo(yed_frame *frame, yed_buffer *buffer) {
 
     if (!record)    { return 0; }
 
+    yed_buff_begin_batch(buffer);
     array_traverse(record->actions, action) {
-        yed_redo_single_action(frame, buffer, action);
+        yed_redo_single_action(frame, buffer, record, action);
     }
+    yed_buff_end_batch(buffer);
 
     yed_set_cursor_within_frame(frame, record->end_cursor_row, record->end_cursor_col);
 
-    array_push(history->undo, *record);
+    record = array_push(history->undo, *record);
     array_pop(history->redo);
 
+    yed_undo_count_record(history, record);
+
     return 1;
 }
+
+static unsigned long long yed_undo_get_limit(char *var, unsigned long long dflt_kb) {
+    int kb;
+
+    if (!yed_get_var_as_int(var, &kb) || kb < 0) {
+        return dflt_kb * 1024ULL;
+    }
+
+    return kb * 1024ULL;
+}
+
+void yed_undo_enforce_memory_limits(yed_buffer *buffer) {
+    tree_it(yed_buffer_name_t, yed_buffer_ptr_t)  it;
+    unsigned long long                            limit,
+                                                  total_limit;
+    yed_undo_history                             *history;
+
+    if (buffer->kind == BUFF_KIND_YANK)    { return; }
+
+    limit       = yed_undo_get_limit("undo-memory-limit",       UNDO_DEFAULT_MEMORY_LIMIT_KB);
+    total_limit = yed_undo_get_limit("undo-total-memory-limit", UNDO_DEFAULT_TOTAL_MEMORY_LIMIT_KB);
+
+    history = &buffer->undo_history;
+
+    while (history->mem > limit && yed_undo_spill(history)) {}
+
+    if (ys->undo_mem <= total_limit) { return; }
+
+    /* Spill from this buffer first, then from any other. */
+    while (ys->undo_mem > total_limit && yed_undo_spill(history)) {}
+
+    tree_traverse(ys->buffers, it) {
+        if (ys->undo_mem <= total_limit) { break; }
+
+        if (tree_it_val(it)->kind == BUFF_KIND_YANK) { continue; }
+
+        history = &tree_it_val(it)->undo_history;
+
+        while (ys->undo_mem > total_limit && yed_undo_spill(history)) {}
+    }
+}
+
+#define UNDO_FILE_MAGIC "yed-undo-1"
+
+typedef struct {
+    char               magic[16];
+    unsigned long long file_size;
+    long long          mtime_sec,
+                       mtime_nsec;
+    int                n_records;
+} yed_undo_file_header;
+
+static int yed_undo_file_path(yed_buffer *buffer, char *out) {
+    const char *p;
+    char       *o;
+
+    if (buffer->path == NULL || buffer->path[0] != '/') { return 0; }
+
+    if (snprintf(out, 4096, "%s/undo/", get_config_path()) >= 4096) { return 0; }
+
+    /* The file's path, with its '/'s made into '%'s. */
+    o = out + strlen(out);
+    for (p = buffer->path; *p && o < out + 4095; p += 1) {
+        *o++ = *p == '/' ? '%' : *p;
+    }
+    *o = 0;
+
+    return *p == 0;
+}
+
+/*
+ * Writes the buffer's undo list to its undo file. The file is tied to the
+ * size and modification time of the buffer's file as it is now, so call
+ * this right after writing the buffer out.
+ */
+int yed_undo_save_history(yed_buffer *buffer) {
+    yed_undo_history     *history;
+    yed_undo_file_header  header;
+    yed_undo_record      *record;
+    struct stat           fs;
+    char                  path[4096];
+    char                  dir[4096];
+    char                 *p;
+    FILE                 *f;
+    array_t               data;
+    char                 *spilled;
+    int                   len,
+                          ok;
+
+    if (buffer->kind != BUFF_KIND_FILE)          { return 0; }
+    if (!yed_undo_file_path(buffer, path))       { return 0; }
+    if (stat(buffer->path, &fs) != 0)            { return 0; }
+
+    /* Make the undo directory, and any of its parents that are missing. */
+    snprintf(dir, sizeof(dir), "%s/undo", get_config_path());
+    for (p = dir + 1; *p; p += 1) {
+        if (*p == '/') {
+            *p = 0;
+            mkdir(dir, 0700);
+            *p = '/';
+        }
+    }
+    mkdir(dir, 0700);
+
+    f = fopen(path, "w");
+    if (f == NULL) { return 0; }
+
+    history = &buffer->undo_history;
+
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, UNDO_FILE_MAGIC);
+    header.file_size  = fs.st_size;
+    header.mtime_sec  = fs.st_mtim.tv_sec;
+    header.mtime_nsec = fs.st_mtim.tv_nsec;
+    header.n_records  = array_len(history->undo);
+
+    if (history->current_record != NULL) {
+        header.n_records -= 1;
+    }
+
+    ok   = fwrite(&header, sizeof(header), 1, f) == 1;
+    data = array_make(char);
+
+    array_traverse(history->undo, record) {
+        if (!ok || record == history->current_record) { break; }
+
+        array_clear(data);
+
+        if (record->spill_off >= 0) {
+            spilled = malloc(record->spill_len);
+            ok      = pread(fileno(history->spill), spilled, record->spill_len, record->spill_off) == record->spill_len;
+            array_push_n(data, spilled, record->spill_len);
+            free(spilled);
+        } else {
+            yed_undo_serialize_record(record, &data);
+        }
+
+        len = array_len(data);
+        ok  =    ok
+              && fwrite(&len, sizeof(len), 1, f) == 1
+              && (len == 0 || fwrite(array_data(data), len, 1, f) == 1);
+    }
+
+    array_free(data);
+
+    if (fclose(f) != 0) { ok = 0; }
+
+    if (!ok) { unlink(path); }
+
+    return ok;
+}
+
+/*
+ * Reads the undo history saved for the buffer's file back in, if the file
+ * (described by fs) hasn't changed since. The buffer's history should be
+ * empty.
+ */
+int yed_undo_load_history(yed_buffer *buffer, struct stat *fs) {
+    yed_undo_history     *history;
+    yed_undo_file_header  header;
+    yed_undo_record       record;
+    char                  path[4096];
+    FILE                 *f;
+    struct stat           st;
+    char                 *data;
+    size_t                left;
+    int                   i,
+                          len,
+                          ok;
+
+    if (!yed_undo_file_path(buffer, path)) { return 0; }
+
+    f = fopen(path, "r");
+    if (f == NULL) { return 0; }
+
+    ok =    fstat(fileno(f), &st) == 0
+         && (size_t)st.st_size >= sizeof(header)
+         && fread(&header, sizeof(header), 1, f) == 1
+         && strncmp(header.magic, UNDO_FILE_MAGIC, sizeof(header.magic)) == 0
+         && header.file_size  == (unsigned long long)fs->st_size
+         && header.mtime_sec  == fs->st_mtim.tv_sec
+         && header.mtime_nsec == fs->st_mtim.tv_nsec;
+
+    history = &buffer->undo_history;
+    left    = ok ? (size_t)st.st_size - sizeof(header) : 0;
+
+    for (i = 0; ok && i < header.n_records; i += 1) {
+        /* Don't trust a length that the rest of the file can't hold. */
+        if (left < sizeof(len)
+        ||  fread(&len, sizeof(len), 1, f) != 1
+        ||  len < 0
+        ||  (size_t)len > left - sizeof(len)) {
+            ok = 0;
+            break;
+        }
+
+        left -= sizeof(len) + (size_t)len;
+
+        data = malloc((size_t)len + 1);
+        ok   = fread(data, 1, len, f) == (size_t)len;
+
+        record = yed_new_undo_record();
+
+        if (ok && yed_undo_deserialize_record(data, len, &record)) {
+            yed_undo_count_record(history, array_push(history->undo, record));
+            yed_undo_enforce_memory_limits(buffer);
+        } else {
+            yed_free_undo_record(&record);
+            ok = 0;
+        }
+
+        free(data);
+    }
+
+    fclose(f);
+
+    if (!ok) {
+        yed_reset_undo_history(history);
+    }
+
+    return ok;
+}
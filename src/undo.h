@@ -13,23 +13,64 @@
 
 struct yed_line_t;
 
+/*
+ * An UNDO_CONTENT action replaces a whole range of text at once instead of
+ * a glyph at a time: starting at byte idx of the action's row, the old text
+ * was replaced by the new text. Rows are separated by '\n' in both.
+ * The bytes themselves live in the record's text array, so an action costs
+ * a few ints on top of the bytes that actually changed.
+ */
+typedef struct {
+    int idx;
+    int old_off, old_len;
+    int new_off, new_len;
+} yed_undo_content;
+
 typedef struct {
     int       kind;
     int       col;
     int       row;
-    yed_glyph g;
+    union {
+        yed_glyph g;
+        int       content;   /* UNDO_CONTENT: index into the record's contents */
+    };
 } yed_undo_action;
 
 typedef struct {
     int start_cursor_row, start_cursor_col;
     int end_cursor_row,   end_cursor_col;
     array_t actions;
+    array_t contents;        /* yed_undo_content */
+    array_t text;            /* char, the old and new text of the contents */
+    unsigned long long mem;  /* What the record counts for towards the memory limits. */
+    long long spill_off;     /* Where the record is in the spill file, if it was spilled. */
+    int       spill_len;
 } yed_undo_record;
 
+/*
+ * Undo memory budget.
+ *
+ * Once a buffer's undo records take up more than 'undo-memory-limit' KB
+ * (or all buffers' records take up more than 'undo-total-memory-limit' KB),
+ * the oldest ones are written out to the buffer's spill file and only a
+ * stub is kept in memory. Spilled records are always the first n_spilled
+ * records of the undo list and are read back in when undo reaches them.
+ *
+ * If 'undo-persist' is set, the undo history of a file is also saved in
+ * the 'undo' directory of the config path whenever the file is written,
+ * and read back in when the same, unchanged file is loaded again.
+ */
+#define UNDO_DEFAULT_MEMORY_LIMIT_KB       65536
+#define UNDO_DEFAULT_TOTAL_MEMORY_LIMIT_KB 262144
+
 typedef struct {
-    array_t          undo;
-    array_t          redo;
-    yed_undo_record *current_record;
+    array_t             undo;
+    array_t             redo;
+    yed_undo_record    *current_record;
+    unsigned long long  mem;        /* Bytes held by the in-memory records of the undo list. */
+    int                 n_spilled;
+    FILE               *spill;
+    long long           spill_size;
 } yed_undo_history;
 
 
@@ -46,7 +87,16 @@ void yed_cancel_undo_record(struct yed_frame_t *frame, struct yed_buffer_t *buff
 int yed_get_undo_num_records(struct yed_buffer_t *buffer);
 void yed_merge_undo_records(struct yed_buffer_t *buffer);
 int yed_push_undo_action(struct yed_buffer_t *buffer, yed_undo_action *action);
+/*
+ * Records that, starting at byte idx of row, old_text (of length old_len)
+ * was replaced by new_text (of length new_len). Takes copies of both, less
+ * whatever they have in common at the start and the end.
+ */
+int yed_push_undo_content(struct yed_buffer_t *buffer, int row, int idx, const char *old_text, int old_len, const char *new_text, int new_len);
 int yed_undo(struct yed_frame_t *frame, struct yed_buffer_t *buffer);
 int yed_redo(struct yed_frame_t *frame, struct yed_buffer_t *buffer);
+void yed_undo_enforce_memory_limits(struct yed_buffer_t *buffer);
+int yed_undo_save_history(struct yed_buffer_t *buffer);
+int yed_undo_load_history(struct yed_buffer_t *buffer, struct stat *fs);
 
 #endif
@@ -1,13 +1,18 @@
 int _yed_get_mbyte_width(yed_glyph g) {
-    int     len, w;
-    wchar_t wch;
+    int       len, w;
+    wchar_t   wch;
+    mbstate_t state;
 
     len = yed_get_glyph_len(g);
 
-    /* Reset the shift state. */
-    mbtowc(NULL, 0, 0);
+    /*
+     * Use a fresh shift state rather than mbtowc()'s hidden one so that
+     * this is safe to call from the file loading threads.
+     */
+    memset(&state, 0, sizeof(state));
 
-    mbtowc(&wch, (const char*)g.bytes, len);
+    wch = 0;
+    mbrtowc(&wch, (const char*)g.bytes, len, &state);
     w = wcwidth(wch);
 
     if (unlikely(w <= 0)) { return 1; }
@@ -1,5 +1,7 @@
 void yed_init_vars(void) {
-    ys->vars = tree_make(yed_var_name_t, yed_var_val_t);
+    ys->vars       = tree_make(yed_var_name_t, yed_var_val_t);
+    ys->vars_index = hash_map_make(yed_var_val_t);
+    ys->var_gen    = 1;
 
     yed_set_default_vars();
 }
@@ -7,7 +9,7 @@ void yed_init_vars(void) {
 void yed_set_default_vars(void) {
     yed_set_var("tab-width",                 XSTR(DEFAULT_TABW));
     yed_set_var("ctrl-h-is-backspace",       "yes");
-    yed_set_var("buffer-load-mode",          "map");
+    yed_set_var("buffer-load-mode",          "parallel");
     yed_set_var("bracketed-paste-mode",      "on");
     yed_set_var("enable-search-cursor-move", "yes");
     yed_set_var("default-scroll-offset",     XSTR(DEFAULT_SCROLL_OFF));
@@ -16,6 +18,10 @@ void yed_set_default_vars(void) {
     yed_set_var("fill-string",               DEFAULT_FILL_STRING);
     yed_set_var("cursor-move-clears-search", "yes");
     yed_set_var("use-boyer-moore",           "no");
+    yed_set_var("search-mode",               "literal");
+    yed_set_var("undo-memory-limit",         XSTR(UNDO_DEFAULT_MEMORY_LIMIT_KB));
+    yed_set_var("undo-total-memory-limit",   XSTR(UNDO_DEFAULT_TOTAL_MEMORY_LIMIT_KB));
+    yed_set_var("undo-persist",              "no");
     yed_set_var("status-line-left",           DEFAULT_STATUS_LINE_LEFT);
     yed_set_var("status-line-center",         DEFAULT_STATUS_LINE_CENTER);
     yed_set_var("status-line-right",          DEFAULT_STATUS_LINE_RIGHT);
@@ -26,6 +32,7 @@ void yed_set_var(char *var, char *val) {
             yed_var_val_t)     it;
     yed_event                  evt;
     char                      *old_val;
+    char                      *new_val;
 
     if (!var || !val) {
         return;
@@ -43,32 +50,42 @@ void yed_set_var(char *var, char *val) {
     it = tree_lookup(ys->vars, var);
 
     if (!tree_it_good(it)) {
-        tree_insert(ys->vars, strdup(var), strdup(val));
+        new_val = strdup(val);
+        tree_insert(ys->vars, strdup(var), new_val);
+        hash_map_insert(ys->vars_index, var, new_val);
+        yed_invalidate_line_draw_caches();
     } else {
         old_val = tree_it_val(it);
-        tree_insert(ys->vars, var, strdup(val));
+        if (strcmp(old_val, val) != 0) {
+            yed_invalidate_line_draw_caches();
+        }
+        new_val = strdup(val);
+        tree_insert(ys->vars, var, new_val);
+        hash_map_insert(ys->vars_index, var, new_val);
         free(old_val);
     }
 
+    /* Invalidate every yed_var_handle before anyone hears about the change. */
+    ys->var_gen += 1;
+
     evt.kind = EVENT_VAR_POST_SET;
     yed_trigger_event(&evt);
 }
 
 char *yed_get_var(char *var) {
-    tree_it(yed_var_name_t,
-            yed_var_val_t)     it;
+    yed_var_val_t *val;
 
     if (!var) {
         return NULL;
     }
 
-    it = tree_lookup(ys->vars, var);
+    val = hash_map_lookup(ys->vars_index, var);
 
-    if (!tree_it_good(it)) {
+    if (val == NULL) {
         return NULL;
     }
 
-    return tree_it_val(it);
+    return *val;
 }
 
 void yed_unset_var(char *var) {
@@ -100,18 +117,21 @@ void yed_unset_var(char *var) {
     if (evt.cancel) { return; }
 
     tree_delete(ys->vars, var);
+    hash_map_delete(ys->vars_index, var);
     free(old_var);
     free(old_val);
 
+    yed_invalidate_line_draw_caches();
+
+    ys->var_gen += 1;
+
     evt.kind    = EVENT_VAR_POST_UNSET;
     evt.var_val = NULL;
     yed_trigger_event(&evt);
 }
 
-int yed_var_is_truthy(char *var) {
-    char *val;
-
-    if (!(val = yed_get_var(var))) {
+static int yed_var_val_is_truthy(char *val) {
+    if (val == NULL) {
         return 0;
     }
 
@@ -132,6 +152,10 @@ int yed_var_is_truthy(char *var) {
     return 1;
 }
 
+int yed_var_is_truthy(char *var) {
+    return yed_var_val_is_truthy(yed_get_var(var));
+}
+
 int yed_get_var_as_int(char *var, int *out) {
     char *val;
 
@@ -145,9 +169,10 @@ int yed_get_var_as_int(char *var, int *out) {
 }
 
 int yed_get_tab_width(void) {
-    int tabw;
+    static yed_var_handle handle = YED_VAR_HANDLE("tab-width");
+    int                   tabw;
 
-    if (!yed_get_var_as_int("tab-width", &tabw)
+    if (!yed_var_handle_get_as_int(&handle, &tabw)
     ||  tabw <= 0) {
         tabw = DEFAULT_TABW;
     }
@@ -156,12 +181,44 @@ int yed_get_tab_width(void) {
 }
 
 int yed_get_default_scroll_offset(void) {
-    int scroll_off;
+    static yed_var_handle handle = YED_VAR_HANDLE("default-scroll-offset");
+    int                   scroll_off;
 
-    if (!yed_get_var_as_int("default-scroll-offset", &scroll_off)
+    if (!yed_var_handle_get_as_int(&handle, &scroll_off)
     ||  scroll_off < 0) {
         scroll_off = DEFAULT_SCROLL_OFF;
     }
 
     return scroll_off;
 }
+
+static void yed_var_handle_resolve(yed_var_handle *handle) {
+    if (handle->gen == ys->var_gen) { return; }
+
+    handle->val    = yed_get_var(handle->name);
+    handle->truthy = yed_var_val_is_truthy(handle->val);
+    handle->has_i  = handle->val != NULL && sscanf(handle->val, "%d", &handle->i) == 1;
+    handle->gen    = ys->var_gen;
+}
+
+char *yed_var_handle_get(yed_var_handle *handle) {
+    yed_var_handle_resolve(handle);
+    return handle->val;
+}
+
+int yed_var_handle_is_truthy(yed_var_handle *handle) {
+    yed_var_handle_resolve(handle);
+    return handle->truthy;
+}
+
+int yed_var_handle_get_as_int(yed_var_handle *handle, int *out) {
+    yed_var_handle_resolve(handle);
+
+    if (!handle->has_i) {
+        return 0;
+    }
+
+    *out = handle->i;
+
+    return 1;
+}
@@ -26,4 +26,32 @@ int yed_get_default_scroll_offset(void);
 int yed_var_is_truthy(char *var);
 int yed_get_var_as_int(char *var, int *out);
 
+/*
+ * A var handle caches the value of a variable for code that reads it
+ * often (e.g. for every drawn line or every key). The handle is resolved
+ * on first use and again only after some variable has been set or unset,
+ * so a read is usually just a compare.
+ *
+ *     static yed_var_handle cursor_line = YED_VAR_HANDLE("cursor-line");
+ *
+ *     if (yed_var_handle_is_truthy(&cursor_line)) { ... }
+ *
+ * The value returned by yed_var_handle_get() is only good until the next
+ * yed_set_var()/yed_unset_var().
+ */
+typedef struct {
+    char               *name;
+    unsigned long long  gen;
+    char               *val;
+    int                 truthy;
+    int                 has_i;
+    int                 i;
+} yed_var_handle;
+
+#define YED_VAR_HANDLE(var_name) { (var_name), 0, NULL, 0, 0, 0 }
+
+char *yed_var_handle_get(yed_var_handle *handle);
+int yed_var_handle_is_truthy(yed_var_handle *handle);
+int yed_var_handle_get_as_int(yed_var_handle *handle, int *out);
+
 #endif
@@ -0,0 +1,368 @@
+#include "words.h"
+
+static inline int yed_is_word_char(char c) {
+    return is_alnum(c) || c == '_';
+}
+
+/* Returns the words of the row as "a\0b\0\0", or NULL if it doesn't have any. */
+static char * yed_words_scan_row(const char *s, int len) {
+    int   i;
+    int   n_bytes;
+    int   in_word;
+    char *words;
+    char *w;
+
+    n_bytes = 0;
+    in_word = 0;
+    for (i = 0; i < len; i += 1) {
+        if (yed_is_word_char(s[i])) {
+            n_bytes += 1 + !in_word;
+            in_word  = 1;
+        } else {
+            in_word  = 0;
+        }
+    }
+
+    if (n_bytes == 0) { return NULL; }
+
+    words = malloc(n_bytes + 1);
+    w     = words;
+
+    for (i = 0; i < len; i += 1) {
+        if (yed_is_word_char(s[i])) {
+            *w++ = s[i];
+            if (i + 1 == len || !yed_is_word_char(s[i + 1])) {
+                *w++ = 0;
+            }
+        }
+    }
+
+    *w = 0;
+
+    return words;
+}
+
+static void yed_words_add_row(tree(str_t, int) words, const char *row_words) {
+    tree_it(str_t, int)  it;
+    const char          *w;
+
+    if (row_words == NULL) { return; }
+
+    for (w = row_words; *w; w += strlen(w) + 1) {
+        it = tree_lookup(words, (char*)w);
+        if (tree_it_good(it)) {
+            tree_it_val(it) += 1;
+        } else {
+            tree_insert(words, strdup(w), 1);
+        }
+    }
+}
+
+static void yed_words_remove_row(tree(str_t, int) words, const char *row_words) {
+    tree_it(str_t, int)  it;
+    const char          *w;
+    char                *key;
+
+    if (row_words == NULL) { return; }
+
+    for (w = row_words; *w; w += strlen(w) + 1) {
+        it = tree_lookup(words, (char*)w);
+        if (!tree_it_good(it)) { continue; }
+
+        tree_it_val(it) -= 1;
+
+        if (tree_it_val(it) <= 0) {
+            key = tree_it_key(it);
+            tree_delete(words, key);
+            free(key);
+        }
+    }
+}
+
+static void yed_words_free_tree(tree(str_t, int) words) {
+    tree_it(str_t, int)  it;
+    char                *key;
+
+    while (tree_len(words)) {
+        it  = tree_begin(words);
+        key = tree_it_key(it);
+        tree_delete(words, key);
+        free(key);
+    }
+    tree_free(words);
+}
+
+static void yed_words_free_rows(array_t *rows) {
+    char **it;
+
+    array_traverse(*rows, it) {
+        if (*it != NULL) { free(*it); }
+    }
+    array_free(*rows);
+}
+
+static char * yed_words_scan_buff_row(yed_buff_words *w, yed_buffer *buff, int row) {
+    yed_line *line;
+    char     *row_words;
+
+    line      = yed_buff_get_line(buff, row);
+    row_words = yed_words_scan_row(array_data(line->chars), array_len(line->chars));
+
+    yed_words_add_row(w->words, row_words);
+
+    return row_words;
+}
+
+
+/*
+ * Background scans.
+ */
+
+static void yed_words_scan_work(yed_job *job, void *arg) {
+    yed_words_scan *scan;
+    char           *s;
+    char           *end;
+    char           *nl;
+    char           *row_words;
+
+    scan = arg;
+    s    = scan->text;
+    end  = scan->text + scan->len;
+
+    while (s < end) {
+        if ((array_len(scan->rows) & 4095) == 0 && yed_job_is_cancelled(job)) { return; }
+
+        nl        = memchr(s, '\n', end - s);
+        row_words = yed_words_scan_row(s, nl - s);
+
+        yed_words_add_row(scan->words, row_words);
+        array_push(scan->rows, row_words);
+
+        s = nl + 1;
+    }
+}
+
+static void yed_words_scan_free(yed_words_scan *scan) {
+    free(scan->text);
+    yed_words_free_tree(scan->words);
+    yed_words_free_rows(&scan->rows);
+    free(scan);
+}
+
+static void yed_words_scan_done(yed_job *job, void *arg) {
+    yed_words_scan *scan;
+    yed_buff_words *w;
+
+    scan = arg;
+
+    if (scan->buffer == NULL || yed_job_is_cancelled(job)) {
+        yed_words_scan_free(scan);
+        return;
+    }
+
+    w = scan->buffer->words;
+
+    yed_words_free_tree(w->words);
+    yed_words_free_rows(&w->rows);
+
+    /* If the buffer changed in the meantime, the journal takes it from here. */
+    w->words   = scan->words;
+    w->rows    = scan->rows;
+    w->version = scan->version;
+    w->valid   = 1;
+    w->scan    = NULL;
+
+    free(scan->text);
+    free(scan);
+}
+
+static void yed_words_start_scan(yed_buffer *buff) {
+    yed_buff_words *w;
+    yed_words_scan *scan;
+    array_t         text;
+    yed_line       *line;
+    char            nl;
+
+    w = buff->words;
+
+    if (w->scan != NULL) {
+        w->scan->buffer = NULL;
+        yed_cancel_job(w->scan->job);
+    }
+
+    text = array_make_with_cap(char, KiB(64));
+    nl   = '\n';
+
+    bucket_array_traverse(buff->lines, line) {
+        array_push_n(text, array_data(line->chars), array_len(line->chars));
+        array_push(text, nl);
+    }
+
+    scan          = calloc(1, sizeof(*scan));
+    scan->buffer  = buff;
+    scan->text    = array_data(text);
+    scan->len     = array_len(text);
+    scan->version = yed_buff_get_version(buff);
+    scan->words   = tree_make(str_t, int);
+    scan->rows    = array_make_with_cap(char*, bucket_array_len(buff->lines));
+
+    w->scan  = scan;
+    w->valid = 0;
+
+    scan->job = yed_submit_job(yed_words_scan_work, yed_words_scan_done, scan);
+}
+
+
+/*
+ * Keeping up with the buffer.
+ */
+
+static yed_buff_words * yed_buff_words_make(yed_buffer *buff) {
+    yed_buff_words *w;
+
+    if (buff->words == NULL) {
+        w           = calloc(1, sizeof(*w));
+        w->words    = tree_make(str_t, int);
+        w->rows     = array_make(char*);
+        buff->words = w;
+    }
+
+    return buff->words;
+}
+
+static int yed_buff_words_loading(yed_buffer *buff) {
+    return buff->lazy_load != NULL && buff->lazy_load->loading;
+}
+
+static void yed_buff_words_rebuild(yed_buffer *buff) {
+    yed_buff_words *w;
+    int             row;
+    char           *row_words;
+
+    w = buff->words;
+
+    if (yed_buff_n_lines(buff) >= WORDS_BACKGROUND_ROWS) {
+        yed_words_start_scan(buff);
+        return;
+    }
+
+    yed_words_free_tree(w->words);
+    yed_words_free_rows(&w->rows);
+
+    w->words = tree_make(str_t, int);
+    w->rows  = array_make(char*);
+
+    for (row = 1; row <= yed_buff_n_lines(buff); row += 1) {
+        row_words = yed_words_scan_buff_row(w, buff, row);
+        array_push(w->rows, row_words);
+    }
+
+    w->version = yed_buff_get_version(buff);
+    w->valid   = 1;
+}
+
+/* Rows [row, row + n_old_rows) were replaced by n_new_rows rows. */
+static void yed_buff_words_apply(yed_buff_words *w, yed_buffer *buff, int row, int n_old_rows, int n_new_rows) {
+    array_t   tail;
+    char    **it;
+    char     *row_words;
+    int       i;
+
+    for (i = row - 1; i < row - 1 + n_old_rows; i += 1) {
+        it = array_item(w->rows, i);
+        yed_words_remove_row(w->words, *it);
+        if (*it != NULL) { free(*it); }
+    }
+
+    /* The common case: rows edited in place. Nothing has to move. */
+    if (n_old_rows == n_new_rows) {
+        for (i = row; i < row + n_new_rows; i += 1) {
+            it  = array_item(w->rows, i - 1);
+            *it = yed_words_scan_buff_row(w, buff, i);
+        }
+        return;
+    }
+
+    tail = array_make(char*);
+    if (row - 1 + n_old_rows < array_len(w->rows)) {
+        array_push_n(tail, array_item(w->rows, row - 1 + n_old_rows), array_len(w->rows) - (row - 1 + n_old_rows));
+    }
+
+    w->rows.used = row - 1;
+
+    for (i = row; i < row + n_new_rows; i += 1) {
+        row_words = yed_words_scan_buff_row(w, buff, i);
+        array_push(w->rows, row_words);
+    }
+
+    if (array_len(tail) > 0) {
+        array_push_n(w->rows, array_data(tail), array_len(tail));
+    }
+
+    array_free(tail);
+}
+
+yed_buff_words * yed_buff_get_words(yed_buffer *buff) {
+    yed_buff_words    *w;
+    yed_buffer_change  change;
+
+    w = yed_buff_words_make(buff);
+
+    if (w->scan != NULL || yed_buff_words_loading(buff)) { return NULL; }
+
+    if (!w->valid
+    ||  !yed_buff_changes_since(buff, w->version, &change)
+    ||  change.row - 1 + change.n_old_rows > array_len(w->rows)
+    ||  change.n_new_rows >= WORDS_BACKGROUND_ROWS) {
+
+        yed_buff_words_rebuild(buff);
+
+    } else if (change.version_after != change.version_before) {
+        yed_buff_words_apply(w, buff, change.row, change.n_old_rows, change.n_new_rows);
+        w->version = yed_buff_get_version(buff);
+
+        /* Shouldn't happen, but don't keep an index that's out of sync. */
+        if (array_len(w->rows) != yed_buff_n_lines(buff)) {
+            yed_buff_words_rebuild(buff);
+        }
+    }
+
+    return w->valid ? w : NULL;
+}
+
+void yed_buff_words_loaded(yed_buffer *buff) {
+    if (yed_buff_words_loading(buff)
+    ||  yed_buff_n_lines(buff) < WORDS_BACKGROUND_ROWS) {
+        return;
+    }
+
+    yed_buff_words_make(buff);
+    yed_words_start_scan(buff);
+}
+
+void yed_free_buff_words(yed_buffer *buff) {
+    yed_buff_words *w;
+
+    if ((w = buff->words) == NULL) { return; }
+
+    if (w->scan != NULL) {
+        w->scan->buffer = NULL;
+        yed_cancel_job(w->scan->job);
+    }
+
+    yed_words_free_tree(w->words);
+    yed_words_free_rows(&w->rows);
+    free(w);
+
+    buff->words = NULL;
+}
+
+void yed_reset_words_fns(void) {
+    tree_it(yed_buffer_name_t, yed_buffer_ptr_t) it;
+
+    tree_traverse(ys->buffers, it) {
+        if (tree_it_val(it)->words != NULL) {
+            tree_reset_fns(str_t, int, tree_it_val(it)->words->words);
+        }
+    }
+}
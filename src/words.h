@@ -0,0 +1,53 @@
+#ifndef __WORDS_H__
+#define __WORDS_H__
+
+/*
+ * Per-buffer word indexes, for word completion.
+ *
+ * A buffer's index counts how many times each word appears in it and keeps
+ * a copy of each row's words. When words are asked for, the index is
+ * brought up to date with yed_buff_changes_since(), so only the rows that
+ * changed are scanned again and their old words are taken back out.
+ *
+ * Scanning a large buffer from scratch (when it's loaded, or when the
+ * journal doesn't go back far enough) is done on the job pool. Until that
+ * is finished, the buffer's words aren't available.
+ *
+ * A word is a run of letters, digits and underscores.
+ */
+
+#define WORDS_BACKGROUND_ROWS (20000)
+
+struct yed_words_scan_t;
+
+typedef struct yed_buff_words_t {
+    tree(str_t, int)          words;    /* The index owns the keys. Values are counts. */
+    array_t                   rows;     /* char*, each row's words as "a\0b\0\0", or NULL if none */
+    unsigned long long        version;
+    int                       valid;
+    struct yed_words_scan_t  *scan;     /* If there's a scan in the background. */
+} yed_buff_words;
+
+typedef struct yed_words_scan_t {
+    yed_buffer          *buffer;        /* Main thread only. NULL once the buffer is freed. */
+    yed_job             *job;
+    char                *text;          /* A copy of the buffer, rows ending in '\n'. */
+    int                  len;
+    unsigned long long   version;
+    tree(str_t, int)     words;
+    array_t              rows;
+} yed_words_scan;
+
+/*
+ * Returns the buffer's word index after bringing it up to date, or NULL if
+ * it's still being built.
+ */
+yed_buff_words * yed_buff_get_words(yed_buffer *buff);
+
+/* Starts indexing a large buffer in the background after a load. */
+void yed_buff_words_loaded(yed_buffer *buff);
+
+void yed_free_buff_words(yed_buffer *buff);
+void yed_reset_words_fns(void);
+
+#endif
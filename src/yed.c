@@ -4,50 +4,39 @@
 yed_state *ys;
 
 static int writer_started;
-static int write_pending;
 
+/*
+ * The writer thread takes the latest frame from yed_publish_screen() and
+ * writes it to the terminal. It holds write_mtx only while it diffs the
+ * frame and renders it to bytes, so anything else that changes the screens
+ * or the palette takes write_mtx (it's recursive) and never waits on the
+ * terminal. The bytes are written after write_mtx is released.
+ */
 static void * writer(void *arg) {
     (void)arg;
 
-    while (1) {
-        pthread_mutex_lock(&ys->write_ready_mtx);
-
-        writer_started = 1;
+    writer_started = 1;
 
-        while (!write_pending) {
-            pthread_cond_wait(&ys->write_ready_cond, &ys->write_ready_mtx);
-        }
+    while (1) {
+        yed_take_screen();
 
+        pthread_mutex_lock(&ys->write_mtx);
+        yed_diff_screens();
         yed_render_screen();
+        pthread_mutex_unlock(&ys->write_mtx);
 
-        write_pending = 0;
+        yed_write_screen();
 
-        pthread_mutex_unlock(&ys->write_ready_mtx);
         if (ys->status == YED_RELOAD_CORE) { break; }
     }
 
     return NULL;
 }
 
-static void kick_off_write(void) {
-try_again:;
-    pthread_mutex_lock(&ys->write_ready_mtx);
-    if (write_pending) {
-        pthread_mutex_unlock(&ys->write_ready_mtx);
-        goto try_again;
-    }
-    array_copy(ys->writer_buffer, ys->output_buffer);
-    array_clear(ys->output_buffer);
-    yed_diff_and_swap_screens();
-    write_pending = 1;
-    pthread_cond_signal(&ys->write_ready_cond);
-    pthread_mutex_unlock(&ys->write_ready_mtx);
-}
-
 static void kill_writer(void) {
     void *junk;
 
-    kick_off_write();
+    yed_publish_screen();
     pthread_join(ys->writer_id, &junk);
 }
 
@@ -55,36 +44,6 @@ static void restart_writer(void) {
     pthread_create(&ys->writer_id, NULL, writer, NULL);
 }
 
-static void * update_forcer(void *arg) {
-    char zero;
-
-    (void)arg;
-    zero = 0;
-
-    while (ys->status != YED_RELOAD_CORE && ys->update_hz >= MIN_UPDATE_HZ) {
-        usleep(825000 * (1.0 / MIN(ys->update_hz, MAX_UPDATE_HZ)));
-
-        if (!ys->skip_force_update) {
-            ioctl(0, TIOCSTI, &zero);
-        } else {
-            ys->skip_force_update = 0;
-        }
-    }
-
-    return NULL;
-}
-
-static void kill_update_forcer(void) {
-    void *junk;
-
-    pthread_join(ys->update_forcer_id, &junk);
-}
-
-static void start_update_forcer(void) {
-    pthread_create(&ys->update_forcer_id, NULL, update_forcer, NULL);
-}
-
-
 static void print_usage(void) {
     char *usage =
 "usage: yed [options] [file...]\n"
@@ -230,6 +189,7 @@ yed_state * yed_init(yed_lib_t *yed_lib, int argc, char **argv) {
     char                *getcwd_ret;
     char               **it;
     array_t              split;
+    pthread_mutexattr_t  mtx_attr;
 
     ys = malloc(sizeof(*ys));
     memset(ys, 0, sizeof(*ys));
@@ -265,6 +225,9 @@ yed_state * yed_init(yed_lib_t *yed_lib, int argc, char **argv) {
     (void)getcwd_ret;
     ys->working_dir = strdup(cwd);
 
+    yed_init_loop();
+    yed_init_jobs();
+    yed_init_subprocs();
     yed_init_events();
     yed_init_ft();
     yed_init_buffers();
@@ -284,6 +247,12 @@ yed_state * yed_init(yed_lib_t *yed_lib, int argc, char **argv) {
     pthread_mutex_init(&ys->write_ready_mtx, NULL);
     pthread_cond_init(&ys->write_ready_cond, NULL);
 
+    pthread_mutexattr_init(&mtx_attr);
+    pthread_mutexattr_settype(&mtx_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&ys->write_mtx, &mtx_attr);
+    pthread_mutex_init(&ys->term_write_mtx, &mtx_attr);
+    pthread_mutexattr_destroy(&mtx_attr);
+
     pthread_create(&ys->writer_id, NULL, writer, NULL);
     while (!writer_started) { usleep(100); }
     yed_init_commands();
@@ -337,6 +306,9 @@ void yed_fini(yed_state *state) {
 
     startup_time = state->start_time_ms;
 
+    /* Stop the writer thread. */
+    yed_stop_writer();
+
     printf(TERM_RESET);
     yed_term_exit();
 
@@ -358,11 +330,9 @@ yed_state * yed_get_state(void)         { return ys;  }
 
 int yed_pump(void) {
     yed_event            event;
-    int                  save_hz;
     int                  keys[16], n_keys, i;
     unsigned long long   start_us;
     int                  skip_keys;
-    int                  got_non_null_key;
 
     if (ys->status == YED_QUIT) {
         memset(&event, 0, sizeof(event));
@@ -376,27 +346,35 @@ int yed_pump(void) {
     } else if (ys->status == YED_RELOAD_CORE) {
         yed_service_reload(1);
         restart_writer();
-        save_hz = ys->update_hz;
-        ys->update_hz = 0;
-        yed_set_update_hz(save_hz);
     }
 
     ys->status = YED_NORMAL;
 
+    /*
+     * Give the writer thread the new screen update.
+     */
+    yed_publish_screen();
+
+    /*
+     * Sleep until there's input, a timer or fd needs servicing, or
+     * someone calls yed_wake().
+     */
+    yed_loop_wait();
+
+    /* Hand finished background jobs back to whoever submitted them. */
+    yed_service_jobs();
+    yed_service_subprocs();
+
     skip_keys = ys->has_resized;
     if (ys->has_resized) {
+        /* The writer can't be looking at the screens while they're resized. */
+        pthread_mutex_lock(&ys->write_mtx);
         yed_handle_resize();
+        pthread_mutex_unlock(&ys->write_mtx);
     } else {
         memset(keys, 0, sizeof(keys));
     }
 
-
-    /*
-     * Give the writer thread the new screen update.
-     */
-    kick_off_write();
-
-
     memset(&event, 0, sizeof(event));
     event.kind = EVENT_PRE_PUMP;
     yed_trigger_event(&event);
@@ -405,15 +383,11 @@ int yed_pump(void) {
                 ? 0
                 : yed_read_keys(keys);
 
-    got_non_null_key = 0;
     for (i = 0; i < n_keys; i += 1) {
         yed_take_key(keys[i]);
-        got_non_null_key |= !!keys[i];
     }
 
-    if (got_non_null_key && ys->update_hz >= MIN_UPDATE_HZ) {
-        ys->skip_force_update = 1;
-    }
+    yed_service_lazy_loads();
 
     start_us = measure_time_now_us();
 
@@ -441,8 +415,9 @@ LOG_EXIT();
             ys->status = YED_NORMAL;
         } else {
             yed_unload_plugin_libs();
+            /* The workers are running code from the old library. */
+            yed_stop_jobs();
             kill_writer();
-            kill_update_forcer();
         }
     }
 #endif